@@ -1437,9 +1437,66 @@ static void __init steelhead_init(void)
 	steelhead_init_bluetooth();
 }
 
+/*
+ * Devices whose suspend and resume callbacks may run in parallel with
+ * others, and the ordering they still need beyond the device hierarchy.
+ */
+static const char * const steelhead_async_pm_devices[] __initconst = {
+	"omapdss_dss",
+	"omapdss_dispc",
+	"omapdss_hdmi",
+	"omap-mcasp-dai",
+	"usbhs_omap",
+	"ehci-omap.0",
+	"omap_hsmmc.4",		/* bcmdhd SDIO */
+};
+
+static const struct {
+	const char *consumer;
+	const char *supplier;
+} steelhead_pm_dependencies[] __initconst = {
+	{ "omapdss_dispc", "omapdss_dss" },
+	{ "omapdss_hdmi", "omapdss_dss" },
+	{ "omapdss_hdmi", "omapdss_dispc" },
+};
+
+static void __init steelhead_init_async_pm(void)
+{
+	struct device *dev, *supplier;
+	int i, ret;
+
+	for (i = 0; i < ARRAY_SIZE(steelhead_async_pm_devices); i++) {
+		dev = bus_find_device_by_name(&platform_bus_type, NULL,
+					      steelhead_async_pm_devices[i]);
+		if (!dev)
+			continue;
+		device_enable_async_suspend(dev);
+		put_device(dev);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(steelhead_pm_dependencies); i++) {
+		dev = bus_find_device_by_name(&platform_bus_type, NULL,
+				steelhead_pm_dependencies[i].consumer);
+		supplier = bus_find_device_by_name(&platform_bus_type, NULL,
+				steelhead_pm_dependencies[i].supplier);
+		if (dev && supplier) {
+			ret = device_pm_add_dependency(dev, supplier);
+			if (ret)
+				pr_err("%s: %s depending on %s failed: %d\n",
+				       __func__, dev_name(dev),
+				       dev_name(supplier), ret);
+		}
+		if (supplier)
+			put_device(supplier);
+		if (dev)
+			put_device(dev);
+	}
+}
+
 static int __init steelhead_init_late(void)
 {
 	steelhead_platform_init_counter();
+	steelhead_init_async_pm();
 	return 0;
 }
 
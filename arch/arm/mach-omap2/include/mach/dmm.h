@@ -39,6 +39,8 @@
 #ifndef DMM_H
 #define DMM_H
 
+#include <linux/list.h>
+
 #define DMM_BASE 0x4E000000
 #define DMM_SIZE 0x800
 
@@ -115,6 +117,18 @@ struct pat {
 	u32 data;
 };
 
+/**
+ * PAT descriptor as fetched by the DMM in AUTO mode.  Must be in coherent
+ * memory at a 16-byte aligned physical address.  The words have the layout
+ * of the DMM_PAT_DESCR, AREA, CTRL and DATA registers.
+ */
+struct pat_desc {
+	u32 next;		/* phys.addr of next descriptor, or 0 */
+	u32 area;
+	u32 ctrl;
+	u32 data;		/* phys.addr of page list */
+};
+
 /**
  * DMM device data
  */
@@ -122,6 +136,45 @@ struct dmm {
 	void __iomem *base;
 };
 
+/**
+ * Chain of PAT refills programmed in one go.  The caller provides the
+ * descriptor memory and keeps the batch and the page lists intact until
+ * done is called.
+ */
+struct dmm_batch {
+	struct pat_desc *desc;	/* descriptors */
+	u32 desc_pa;		/* phys.addr of descriptors */
+	u32 num;		/* descriptors used */
+	u32 max;		/* descriptors available */
+
+	/* called on completion, possibly from interrupt context */
+	void (*done)(struct dmm_batch *batch, s32 status);
+	void *data;
+
+	/* private */
+	struct list_head list;
+	struct dmm *dmm;
+};
+
+/**
+ * Initializes a PAT refill batch.
+ * @param batch    batch to initialize
+ * @param desc     descriptor memory
+ * @param desc_pa  phys.addr of descriptor memory, must be 16-byte aligned
+ * @param max      number of descriptors in desc
+ */
+static inline
+void dmm_batch_init(struct dmm_batch *batch, struct pat_desc *desc,
+		    u32 desc_pa, u32 max)
+{
+	batch->desc = desc;
+	batch->desc_pa = desc_pa;
+	batch->num = 0;
+	batch->max = max;
+	batch->done = NULL;
+	batch->data = NULL;
+}
+
 /**
  * Create and initialize the physical address translator.
  * @param id    PAT id
@@ -138,6 +191,36 @@ struct dmm *dmm_pat_init(u32 id);
  */
 s32 dmm_pat_refill(struct dmm *dmm, struct pat *desc, enum pat_mode mode);
 
+/**
+ * Adds the refill of an area to a batch.
+ * @param batch    PAT refill batch
+ * @param area     PAT area
+ * @param data_pa  phys.addr of the page list, must be 16-byte aligned
+ * @return an error status (-ENOSPC if the batch is full).
+ */
+s32 dmm_batch_add(struct dmm_batch *batch, struct pat_area area, u32 data_pa);
+
+/**
+ * Queues a batch of refills to the physical address translator.  The
+ * refills are programmed by the DMM through the descriptor chain, and
+ * batch->done is called once all of them completed or one failed.
+ * @param dmm    Device data
+ * @param batch  PAT refill batch
+ * @return an error status.  done is not called on error.
+ */
+s32 dmm_pat_refill_batch(struct dmm *dmm, struct dmm_batch *batch);
+
+/**
+ * Takes a queued batch off the refill queue, stopping the DMM if it is
+ * programming the batch.  done is not called for a cancelled batch.  The
+ * PAT entries of the batch may be partially refilled.
+ * @param dmm    Device data
+ * @param batch  PAT refill batch
+ * @return 0 if the batch was cancelled, -ENOENT if it was not queued
+ *	   (e.g. it completed already).
+ */
+s32 dmm_pat_cancel_batch(struct dmm *dmm, struct dmm_batch *batch);
+
 /**
  * Clean up the physical address translator.
  * @param dmm    Device data
@@ -429,6 +429,23 @@ void tiler_free_block_area(tiler_blk_handle block);
  */
 s32 tiler_pin_block(tiler_blk_handle handle, u32 *addr_array, u32 nents);
 
+/**
+ * Pins a set of physical pages into part of a 1D Tiler block, leaving the
+ * pages pinned into the rest of the block in place.  Only the PAT entries
+ * of the range are refilled.  The block must have been pinned with this
+ * method only.  Pages of the block that were never pinned, and 0 addresses
+ * in the array, map to the dummy page.
+ *
+ * @param handle	Handle to tiler block information
+ * @param offset	First page of the block to pin
+ * @param addr_array	Array of addresses
+ * @param nents		Number of addresses in array
+ *
+ * @return error status.
+ */
+s32 tiler_pin_block_range(tiler_blk_handle handle, u32 offset, u32 *addr_array,
+			  u32 nents);
+
 /**
  * Unpins a set of physical pages from the Tiler
  *
@@ -460,6 +477,27 @@ s32 tiler_memsize(enum tiler_fmt fmt, u32 width, u32 height, u32 *alloc_pages,
  */
 u32 tiler_block_vstride(tiler_blk_handle handle);
 
+/**
+ * Finds the block containing a system-space address and takes a
+ * reference on it.  Does not block, so it can be used on per-frame
+ * paths.
+ *
+ * @param ssptr		System-space (physical) address in the Tiler
+ *
+ * @return handle	Handle to tiler block information.  NULL if no
+ *			allocated block contains ssptr.
+ *
+ * NOTE: release the reference with tiler_release_block()
+ */
+tiler_blk_handle tiler_find_block_by_ssptr(u32 ssptr);
+
+/**
+ * Releases a reference taken by tiler_find_block_by_ssptr()
+ *
+ * @param handle	Handle to tiler block information
+ */
+void tiler_release_block(tiler_blk_handle handle);
+
 struct tiler_pa_info *user_block_to_pa(u32 usr_addr, u32 num_pg);
 void tiler_pa_free(struct tiler_pa_info *pa);
 
@@ -42,6 +42,7 @@
 #include <linux/errno.h>
 #include <linux/linkage.h>
 #include <linux/smp.h>
+#include <linux/suspend_timeline.h>
 
 #include <asm/cacheflush.h>
 #include <linux/dma-mapping.h>
@@ -496,6 +497,8 @@ int omap4_enter_lowpower(unsigned int cpu, unsigned int power_state)
 {
 	unsigned int save_state = 0;
 	unsigned int wakeup_cpu;
+	bool timeline = !cpu && suspend_timeline_entering();
+	u64 start = 0;
 
 	if ((cpu >= NR_CPUS) || (omap_rev() == OMAP4430_REV_ES1_0))
 		goto ret;
@@ -527,6 +530,8 @@ int omap4_enter_lowpower(unsigned int cpu, unsigned int power_state)
 	if (cpu)
 		goto cpu_prepare;
 
+	if (timeline)
+		start = suspend_timeline_start();
 	pwrdm_pre_transition();
 
 	/*
@@ -604,10 +609,21 @@ cpu_prepare:
 	 * Call low level function  with targeted CPU id
 	 * and its low power state.
 	 */
+	if (timeline) {
+		suspend_timeline_record(start, "mpuss", 0, "save_state_%u",
+					save_state);
+		start = suspend_timeline_start();
+	}
+
 	stop_critical_timings();
 	omap4_cpu_suspend(cpu, save_state);
 	start_critical_timings();
 
+	if (timeline) {
+		suspend_timeline_record(start, "mpuss", 0, "lowpower");
+		start = suspend_timeline_start();
+	}
+
 	/*
 	 * Restore the CPUx power state to ON otherwise CPUx
 	 * power domain can transitions to programmed low power
@@ -680,6 +696,9 @@ cpu_prepare:
 
 	pwrdm_post_transition();
 
+	if (timeline)
+		suspend_timeline_record(start, "mpuss", 0, "restore");
+
 ret:
 	return 0;
 }
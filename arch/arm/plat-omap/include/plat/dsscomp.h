@@ -22,4 +22,6 @@ int dsscomp_gralloc_queue(struct dsscomp_setup_dispc_data *d,
 			struct tiler_pa_info **pas,
 			bool early_callback,
 			void (*cb_fn)(void *, int), void *cb_arg);
+int dsscomp_wb_queue(struct dss2_ovl_info *src, struct dss2_ovl_info *dst,
+			void (*cb_fn)(void *, int), void *cb_arg);
 #endif
@@ -26,7 +26,9 @@
 #include <linux/interrupt.h>
 #include <linux/sched.h>
 #include <linux/async.h>
+#include <linux/slab.h>
 #include <linux/suspend.h>
+#include <linux/suspend_timeline.h>
 #include <linux/timer.h>
 
 #include "../base.h"
@@ -58,6 +60,21 @@ struct dpm_drv_wd_data {
 
 static int async_error;
 
+/*
+ * A dependency which the device hierarchy does not express: @consumer is
+ * suspended before and resumed after @supplier. Both lists are protected
+ * by dpm_list_mtx.
+ */
+struct pm_dependency {
+	struct device *consumer;
+	struct device *supplier;
+	struct list_head c_node;	/* on consumer->power.suppliers */
+	struct list_head s_node;	/* on supplier->power.consumers */
+};
+
+/* Start of the current suspend or resume phase, for per-device timing */
+static ktime_t dpm_phase_start;
+
 /**
  * device_pm_init - Initialize the PM-related part of a device object.
  * @dev: Device object being initialized.
@@ -72,6 +89,16 @@ void device_pm_init(struct device *dev)
 	spin_lock_init(&dev->power.lock);
 	pm_runtime_init(dev);
 	INIT_LIST_HEAD(&dev->power.entry);
+	INIT_LIST_HEAD(&dev->power.suppliers);
+	INIT_LIST_HEAD(&dev->power.consumers);
+	dev->power.pm_blocker = NULL;
+}
+
+static void dpm_free_dependency(struct pm_dependency *dep)
+{
+	list_del(&dep->c_node);
+	list_del(&dep->s_node);
+	kfree(dep);
 }
 
 /**
@@ -117,6 +144,12 @@ void device_pm_remove(struct device *dev)
 	complete_all(&dev->power.completion);
 	mutex_lock(&dpm_list_mtx);
 	list_del_init(&dev->power.entry);
+	while (!list_empty(&dev->power.suppliers))
+		dpm_free_dependency(list_first_entry(&dev->power.suppliers,
+					struct pm_dependency, c_node));
+	while (!list_empty(&dev->power.consumers))
+		dpm_free_dependency(list_first_entry(&dev->power.consumers,
+					struct pm_dependency, s_node));
 	mutex_unlock(&dpm_list_mtx);
 	device_wakeup_disable(dev);
 	pm_runtime_remove(dev);
@@ -165,7 +198,7 @@ static ktime_t initcall_debug_start(struct device *dev)
 {
 	ktime_t calltime = ktime_set(0, 0);
 
-	if (initcall_debug) {
+	if (initcall_debug || pm_print_times_enabled) {
 		pr_info("calling  %s+ @ %i\n",
 				dev_name(dev), task_pid_nr(current));
 		calltime = ktime_get();
@@ -179,7 +212,7 @@ static void initcall_debug_report(struct device *dev, ktime_t calltime,
 {
 	ktime_t delta, rettime;
 
-	if (initcall_debug) {
+	if (initcall_debug || pm_print_times_enabled) {
 		rettime = ktime_get();
 		delta = ktime_sub(rettime, calltime);
 		pr_info("call %s+ returned %d after %Ld usecs\n", dev_name(dev),
@@ -201,16 +234,222 @@ static void dpm_wait(struct device *dev, bool async)
 		wait_for_completion(&dev->power.completion);
 }
 
-static int dpm_wait_fn(struct device *dev, void *async_ptr)
+/*
+ * Remember @dep as the device @dev waited for, if it is the last one to
+ * have finished in this phase. This is what the critical path report
+ * follows.
+ */
+static void dpm_note_wait(struct device *dev, struct device *dep)
+{
+	struct device *blocker = dev->power.pm_blocker;
+
+	if (dep->power.pm_end.tv64 < dpm_phase_start.tv64)
+		return;
+	if (blocker && blocker->power.pm_end.tv64 >= dep->power.pm_end.tv64)
+		return;
+	dev->power.pm_blocker = dep;
+}
+
+/**
+ * dpm_wait_for - Wait for a PM operation @dev depends on to complete.
+ * @waiter: Device that needs to wait.
+ * @dev: Device to wait for.
+ * @async: If unset, wait only if the device's power.async_suspend flag is set.
+ */
+static void dpm_wait_for(struct device *waiter, struct device *dev, bool async)
+{
+	if (!dev)
+		return;
+
+	dpm_wait(dev, async);
+	dpm_note_wait(waiter, dev);
+}
+
+struct dpm_wait_data {
+	struct device *waiter;
+	bool async;
+};
+
+static int dpm_wait_fn(struct device *dev, void *data)
 {
-	dpm_wait(dev, *((bool *)async_ptr));
+	struct dpm_wait_data *wd = data;
+
+	dpm_wait_for(wd->waiter, dev, wd->async);
 	return 0;
 }
 
 static void dpm_wait_for_children(struct device *dev, bool async)
 {
-       device_for_each_child(dev, &async, dpm_wait_fn);
+	struct dpm_wait_data wd = { .waiter = dev, .async = async };
+
+	device_for_each_child(dev, &wd, dpm_wait_fn);
+}
+
+static struct device *dpm_dep_peer(struct list_head *node, bool suppliers)
+{
+	if (suppliers)
+		return list_entry(node, struct pm_dependency, c_node)->supplier;
+	return list_entry(node, struct pm_dependency, s_node)->consumer;
+}
+
+/**
+ * dpm_wait_for_deps - Wait for the suppliers or consumers of a device.
+ * @dev: Device that needs to wait.
+ * @suppliers: Wait for the suppliers of @dev if set, its consumers if not.
+ * @async: If unset, wait only for devices with power.async_suspend set.
+ *
+ * dpm_list_mtx is dropped while waiting, so the walk starts over after each
+ * wait. Devices that are done are skipped, so this terminates.
+ */
+static void dpm_wait_for_deps(struct device *dev, bool suppliers, bool async)
+{
+	struct list_head *head, *node;
+	struct device *peer;
+
+	head = suppliers ? &dev->power.suppliers : &dev->power.consumers;
+
+	mutex_lock(&dpm_list_mtx);
+ Again:
+	list_for_each(node, head) {
+		peer = dpm_dep_peer(node, suppliers);
+		if (!completion_done(&peer->power.completion)) {
+			if (!async &&
+			    !(pm_async_enabled && peer->power.async_suspend))
+				continue;
+
+			get_device(peer);
+			mutex_unlock(&dpm_list_mtx);
+			wait_for_completion(&peer->power.completion);
+			mutex_lock(&dpm_list_mtx);
+			dpm_note_wait(dev, peer);
+			put_device(peer);
+			goto Again;
+		}
+		dpm_note_wait(dev, peer);
+	}
+	mutex_unlock(&dpm_list_mtx);
+}
+
+/* Whether @dev has to wait for @target when resuming, directly or not */
+static bool dpm_depends_on(struct device *dev, struct device *target)
+{
+	struct pm_dependency *dep;
+
+	for (; dev; dev = dev->parent) {
+		if (dev == target)
+			return true;
+		list_for_each_entry(dep, &dev->power.suppliers, c_node)
+			if (dpm_depends_on(dep->supplier, target))
+				return true;
+	}
+	return false;
+}
+
+static void dpm_reorder_to_tail(struct device *dev);
+
+static int dpm_reorder_fn(struct device *dev, void *unused)
+{
+	dpm_reorder_to_tail(dev);
+	return 0;
+}
+
+/*
+ * Move @dev to the end of dpm_list, followed by everything that has to
+ * resume after it, so the list order stays valid for synchronous devices.
+ */
+static void dpm_reorder_to_tail(struct device *dev)
+{
+	struct pm_dependency *dep;
+
+	if (list_empty(&dev->power.entry))
+		return;
+
+	device_pm_move_last(dev);
+	device_for_each_child(dev, NULL, dpm_reorder_fn);
+	list_for_each_entry(dep, &dev->power.consumers, s_node)
+		dpm_reorder_to_tail(dep->consumer);
+}
+
+/**
+ * device_pm_add_dependency - Order the PM callbacks of two devices.
+ * @consumer: Device that uses @supplier.
+ * @supplier: Device that has to be available while @consumer is active.
+ *
+ * Make the PM core suspend @consumer before @supplier and resume it after
+ * @supplier, like a child and its parent, while letting either of them be
+ * handled asynchronously. Both devices must be registered, and no system
+ * power transition may be in progress.
+ */
+int device_pm_add_dependency(struct device *consumer, struct device *supplier)
+{
+	struct pm_dependency *dep;
+	struct device *dev;
+	bool found_supplier = false, found_consumer = false, reorder = false;
+	int error = 0;
+
+	dep = kzalloc(sizeof(*dep), GFP_KERNEL);
+	if (!dep)
+		return -ENOMEM;
+
+	dep->consumer = consumer;
+	dep->supplier = supplier;
+
+	mutex_lock(&dpm_list_mtx);
+	if (!list_empty(&dpm_prepared_list) || !list_empty(&dpm_suspended_list)
+	    || !list_empty(&dpm_noirq_list)) {
+		error = -EBUSY;
+		goto Unlock;
+	}
+	list_for_each_entry(dev, &dpm_list, power.entry) {
+		if (dev == supplier) {
+			found_supplier = true;
+		} else if (dev == consumer) {
+			found_consumer = true;
+			reorder = !found_supplier;
+		}
+	}
+	if (!found_supplier || !found_consumer) {
+		error = -ENODEV;
+		goto Unlock;
+	}
+	if (dpm_depends_on(supplier, consumer)) {
+		error = -EINVAL;
+		goto Unlock;
+	}
+
+	list_add_tail(&dep->c_node, &consumer->power.suppliers);
+	list_add_tail(&dep->s_node, &supplier->power.consumers);
+	if (reorder)
+		dpm_reorder_to_tail(consumer);
+	dep = NULL;
+
+ Unlock:
+	mutex_unlock(&dpm_list_mtx);
+	kfree(dep);
+	return error;
 }
+EXPORT_SYMBOL_GPL(device_pm_add_dependency);
+
+/**
+ * device_pm_remove_dependency - Undo device_pm_add_dependency().
+ * @consumer: Device that uses @supplier.
+ * @supplier: Device that has to be available while @consumer is active.
+ */
+void device_pm_remove_dependency(struct device *consumer,
+				 struct device *supplier)
+{
+	struct pm_dependency *dep;
+
+	mutex_lock(&dpm_list_mtx);
+	list_for_each_entry(dep, &consumer->power.suppliers, c_node) {
+		if (dep->supplier == supplier) {
+			dpm_free_dependency(dep);
+			break;
+		}
+	}
+	mutex_unlock(&dpm_list_mtx);
+}
+EXPORT_SYMBOL_GPL(device_pm_remove_dependency);
 
 /**
  * pm_op - Execute the PM operation appropriate for given PM event.
@@ -415,6 +654,50 @@ static void dpm_show_time(ktime_t starttime, pm_message_t state, char *info)
 		usecs / USEC_PER_MSEC, usecs % USEC_PER_MSEC);
 }
 
+static struct device *dpm_find_on_list(struct list_head *list,
+				       struct device *target)
+{
+	struct device *dev;
+
+	if (target)
+		list_for_each_entry(dev, list, power.entry)
+			if (dev == target)
+				return dev;
+	return NULL;
+}
+
+/**
+ * dpm_show_critical_path - Report what determined the length of a phase.
+ * @list: Devices handled in the phase.
+ * @state: PM transition of the system being carried out.
+ *
+ * Start from the device which finished last and follow, for each device,
+ * the dependency it waited for last.
+ */
+static void dpm_show_critical_path(struct list_head *list, pm_message_t state)
+{
+	struct device *dev, *last = NULL;
+
+	if (!pm_print_times_enabled)
+		return;
+
+	mutex_lock(&dpm_list_mtx);
+	list_for_each_entry(dev, list, power.entry) {
+		if (dev->power.pm_end.tv64 < dpm_phase_start.tv64)
+			continue;
+		if (!last || dev->power.pm_end.tv64 > last->power.pm_end.tv64)
+			last = dev;
+	}
+
+	pr_info("PM: critical path of %s:\n", pm_verb(state.event));
+	for (dev = last; dev; dev = dpm_find_on_list(list, dev->power.pm_blocker))
+		pr_info("PM:   %s done at %lld usecs, callback %lld usecs\n",
+			dev_name(dev),
+			ktime_us_delta(dev->power.pm_end, dpm_phase_start),
+			ktime_us_delta(dev->power.pm_end, dev->power.pm_start));
+	mutex_unlock(&dpm_list_mtx);
+}
+
 /*------------------------- Resume routines -------------------------*/
 
 /**
@@ -460,17 +743,22 @@ static int device_resume_noirq(struct device *dev, pm_message_t state)
 void dpm_resume_noirq(pm_message_t state)
 {
 	ktime_t starttime = ktime_get();
+	u64 start = suspend_timeline_start();
 
 	mutex_lock(&dpm_list_mtx);
 	while (!list_empty(&dpm_noirq_list)) {
 		struct device *dev = to_device(dpm_noirq_list.next);
 		int error;
+		u64 dev_start;
 
 		get_device(dev);
 		list_move_tail(&dev->power.entry, &dpm_suspended_list);
 		mutex_unlock(&dpm_list_mtx);
 
+		dev_start = suspend_timeline_start();
 		error = device_resume_noirq(dev, state);
+		suspend_timeline_record(dev_start, "dpm_resume_noirq", error,
+					"%s", dev_name(dev));
 		if (error)
 			pm_dev_err(dev, state, " early", error);
 
@@ -480,6 +768,7 @@ void dpm_resume_noirq(pm_message_t state)
 	mutex_unlock(&dpm_list_mtx);
 	dpm_show_time(starttime, state, "early");
 	resume_device_irqs();
+	suspend_timeline_record(start, "dpm_resume_noirq", 0, "-");
 }
 EXPORT_SYMBOL_GPL(dpm_resume_noirq);
 
@@ -512,11 +801,15 @@ static int legacy_resume(struct device *dev, int (*cb)(struct device *dev))
 static int device_resume(struct device *dev, pm_message_t state, bool async)
 {
 	int error = 0;
+	u64 start;
 
 	TRACE_DEVICE(dev);
 	TRACE_RESUME(0);
 
-	dpm_wait(dev->parent, async);
+	dpm_wait_for(dev, dev->parent, async);
+	dpm_wait_for_deps(dev, true, async);
+	dev->power.pm_start = ktime_get();
+	start = suspend_timeline_start();
 	device_lock(dev);
 
 	/*
@@ -567,6 +860,9 @@ static int device_resume(struct device *dev, pm_message_t state, bool async)
 
  Unlock:
 	device_unlock(dev);
+	suspend_timeline_record(start, "dpm_resume", error, "%s",
+				dev_name(dev));
+	dev->power.pm_end = ktime_get();
 	complete_all(&dev->power.completion);
 
 	TRACE_RESUME(error);
@@ -625,15 +921,18 @@ void dpm_resume(pm_message_t state)
 {
 	struct device *dev;
 	ktime_t starttime = ktime_get();
+	u64 start = suspend_timeline_start();
 
 	might_sleep();
 
 	mutex_lock(&dpm_list_mtx);
 	pm_transition = state;
 	async_error = 0;
+	dpm_phase_start = starttime;
 
 	list_for_each_entry(dev, &dpm_suspended_list, power.entry) {
 		INIT_COMPLETION(dev->power.completion);
+		dev->power.pm_blocker = NULL;
 		if (is_async(dev)) {
 			get_device(dev);
 			async_schedule(async_resume, dev);
@@ -661,6 +960,8 @@ void dpm_resume(pm_message_t state)
 	mutex_unlock(&dpm_list_mtx);
 	async_synchronize_full();
 	dpm_show_time(starttime, state, NULL);
+	dpm_show_critical_path(&dpm_prepared_list, state);
+	suspend_timeline_record(start, "dpm_resume", 0, "-");
 }
 
 /**
@@ -703,6 +1004,7 @@ static void device_complete(struct device *dev, pm_message_t state)
 void dpm_complete(pm_message_t state)
 {
 	struct list_head list;
+	u64 start = suspend_timeline_start();
 
 	might_sleep();
 
@@ -710,19 +1012,24 @@ void dpm_complete(pm_message_t state)
 	mutex_lock(&dpm_list_mtx);
 	while (!list_empty(&dpm_prepared_list)) {
 		struct device *dev = to_device(dpm_prepared_list.prev);
+		u64 dev_start;
 
 		get_device(dev);
 		dev->power.is_prepared = false;
 		list_move(&dev->power.entry, &list);
 		mutex_unlock(&dpm_list_mtx);
 
+		dev_start = suspend_timeline_start();
 		device_complete(dev, state);
+		suspend_timeline_record(dev_start, "dpm_complete", 0, "%s",
+					dev_name(dev));
 
 		mutex_lock(&dpm_list_mtx);
 		put_device(dev);
 	}
 	list_splice(&list, &dpm_list);
 	mutex_unlock(&dpm_list_mtx);
+	suspend_timeline_record(start, "dpm_complete", 0, "-");
 }
 
 /**
@@ -810,17 +1117,22 @@ static int device_suspend_noirq(struct device *dev, pm_message_t state)
 int dpm_suspend_noirq(pm_message_t state)
 {
 	ktime_t starttime = ktime_get();
+	u64 start = suspend_timeline_start();
 	int error = 0;
 
 	suspend_device_irqs();
 	mutex_lock(&dpm_list_mtx);
 	while (!list_empty(&dpm_suspended_list)) {
 		struct device *dev = to_device(dpm_suspended_list.prev);
+		u64 dev_start;
 
 		get_device(dev);
 		mutex_unlock(&dpm_list_mtx);
 
+		dev_start = suspend_timeline_start();
 		error = device_suspend_noirq(dev, state);
+		suspend_timeline_record(dev_start, "dpm_suspend_noirq", error,
+					"%s", dev_name(dev));
 
 		mutex_lock(&dpm_list_mtx);
 		if (error) {
@@ -833,6 +1145,7 @@ int dpm_suspend_noirq(pm_message_t state)
 		put_device(dev);
 	}
 	mutex_unlock(&dpm_list_mtx);
+	suspend_timeline_record(start, "dpm_suspend_noirq", error, "-");
 	if (error)
 		dpm_resume_noirq(resume_event(state));
 	else
@@ -874,8 +1187,12 @@ static int __device_suspend(struct device *dev, pm_message_t state, bool async)
 	int error = 0;
 	struct timer_list timer;
 	struct dpm_drv_wd_data data;
+	u64 start;
 
 	dpm_wait_for_children(dev, async);
+	dpm_wait_for_deps(dev, false, async);
+	dev->power.pm_start = ktime_get();
+	start = suspend_timeline_start();
 
 	data.dev = dev;
 	data.tsk = get_current();
@@ -938,6 +1255,9 @@ static int __device_suspend(struct device *dev, pm_message_t state, bool async)
 	del_timer_sync(&timer);
 	destroy_timer_on_stack(&timer);
 
+	suspend_timeline_record(start, "dpm_suspend", error, "%s",
+				dev_name(dev));
+	dev->power.pm_end = ktime_get();
 	complete_all(&dev->power.completion);
 
 	if (error)
@@ -961,6 +1281,7 @@ static void async_suspend(void *data, async_cookie_t cookie)
 static int device_suspend(struct device *dev)
 {
 	INIT_COMPLETION(dev->power.completion);
+	dev->power.pm_blocker = NULL;
 
 	if (pm_async_enabled && dev->power.async_suspend) {
 		get_device(dev);
@@ -978,6 +1299,7 @@ static int device_suspend(struct device *dev)
 int dpm_suspend(pm_message_t state)
 {
 	ktime_t starttime = ktime_get();
+	u64 start = suspend_timeline_start();
 	int error = 0;
 
 	might_sleep();
@@ -985,6 +1307,7 @@ int dpm_suspend(pm_message_t state)
 	mutex_lock(&dpm_list_mtx);
 	pm_transition = state;
 	async_error = 0;
+	dpm_phase_start = starttime;
 	while (!list_empty(&dpm_prepared_list)) {
 		struct device *dev = to_device(dpm_prepared_list.prev);
 
@@ -1009,8 +1332,11 @@ int dpm_suspend(pm_message_t state)
 	async_synchronize_full();
 	if (!error)
 		error = async_error;
-	if (!error)
+	suspend_timeline_record(start, "dpm_suspend", error, "-");
+	if (!error) {
 		dpm_show_time(starttime, state, NULL);
+		dpm_show_critical_path(&dpm_suspended_list, state);
+	}
 	return error;
 }
 
@@ -1071,12 +1397,14 @@ static int device_prepare(struct device *dev, pm_message_t state)
 int dpm_prepare(pm_message_t state)
 {
 	int error = 0;
+	u64 start = suspend_timeline_start();
 
 	might_sleep();
 
 	mutex_lock(&dpm_list_mtx);
 	while (!list_empty(&dpm_list)) {
 		struct device *dev = to_device(dpm_list.next);
+		u64 dev_start;
 
 		get_device(dev);
 		mutex_unlock(&dpm_list_mtx);
@@ -1086,8 +1414,11 @@ int dpm_prepare(pm_message_t state)
 			pm_wakeup_event(dev, 0);
 
 		pm_runtime_put_sync(dev);
+		dev_start = suspend_timeline_start();
 		error = pm_wakeup_pending() ?
 				-EBUSY : device_prepare(dev, state);
+		suspend_timeline_record(dev_start, "dpm_prepare", error, "%s",
+					dev_name(dev));
 
 		mutex_lock(&dpm_list_mtx);
 		if (error) {
@@ -1108,6 +1439,7 @@ int dpm_prepare(pm_message_t state)
 		put_device(dev);
 	}
 	mutex_unlock(&dpm_list_mtx);
+	suspend_timeline_record(start, "dpm_prepare", error, "-");
 	return error;
 }
 
@@ -213,6 +213,8 @@ typedef struct _PVRSRV_BRIDGE_GLOBAL_STATS
 	IMG_UINT32 ui32IOCTLCount;
 	IMG_UINT32 ui32TotalCopyFromUserBytes;
 	IMG_UINT32 ui32TotalCopyToUserBytes;
+	IMG_UINT32 ui32BatchCount;
+	IMG_UINT32 ui32BatchedCallCount;
 }PVRSRV_BRIDGE_GLOBAL_STATS;
 
 extern PVRSRV_BRIDGE_GLOBAL_STATS g_BridgeGlobalStats;
@@ -47,12 +47,26 @@
 
 #define	INDEX_IS_VALID(psBase, i) ((i) < (psBase)->ui32TotalHandCount)
 
+/*
+ * A handle is its index in the handle array plus one, with the generation
+ * of the handle structure in the bits above the index.  The generation is
+ * bumped whenever a handle is freed, so a stale handle whose index has been
+ * reused no longer resolves.
+ */
+#define	HANDLE_INDEX_BITS		20
+#define	HANDLE_INDEX_MASK		((1U << HANDLE_INDEX_BITS) - 1)
+#define	HANDLE_GENERATION_MASK		0x3ffU
+
+#define	INDEX_AND_GENERATION(i, g) ((((IMG_UINT32)(g) & HANDLE_GENERATION_MASK) << HANDLE_INDEX_BITS) | (IMG_UINT32)(i))
+
 #if defined (SUPPORT_SID_INTERFACE)
-#define	INDEX_TO_HANDLE(i) ((IMG_SID)((i) + 1))
-#define	HANDLE_TO_INDEX(h) ((IMG_UINT32)(h) - 1)
+#define	INDEX_TO_HANDLE(i, g) ((IMG_SID)(INDEX_AND_GENERATION(i, g) + 1))
+#define	HANDLE_TO_INDEX(h) (((IMG_UINT32)(h) - 1) & HANDLE_INDEX_MASK)
+#define	HANDLE_TO_GENERATION(h) ((((IMG_UINT32)(h) - 1) >> HANDLE_INDEX_BITS) & HANDLE_GENERATION_MASK)
 #else
-#define	INDEX_TO_HANDLE(i) ((IMG_HANDLE)((IMG_UINTPTR_T)(i) + 1))
-#define	HANDLE_TO_INDEX(h) ((IMG_UINT32)(IMG_UINTPTR_T)(h) - 1)
+#define	INDEX_TO_HANDLE(i, g) ((IMG_HANDLE)(IMG_UINTPTR_T)(INDEX_AND_GENERATION(i, g) + 1))
+#define	HANDLE_TO_INDEX(h) (((IMG_UINT32)(IMG_UINTPTR_T)(h) - 1) & HANDLE_INDEX_MASK)
+#define	HANDLE_TO_GENERATION(h) ((((IMG_UINT32)(IMG_UINTPTR_T)(h) - 1) >> HANDLE_INDEX_BITS) & HANDLE_GENERATION_MASK)
 
 #endif
 
@@ -70,13 +84,13 @@
 #define	HANDLE_TO_HANDLE_STRUCT_PTR(psBase, h) (INDEX_TO_HANDLE_STRUCT_PTR(psBase, HANDLE_TO_INDEX(h)))
 
 #define	HANDLE_PTR_TO_INDEX(psHandle) ((psHandle)->ui32Index)
-#define	HANDLE_PTR_TO_HANDLE(psHandle) INDEX_TO_HANDLE(HANDLE_PTR_TO_INDEX(psHandle))
+#define	HANDLE_PTR_TO_HANDLE(psHandle) INDEX_TO_HANDLE(HANDLE_PTR_TO_INDEX(psHandle), (psHandle)->ui32Generation)
 
 #define	ROUND_DOWN_TO_MULTIPLE_OF_BLOCK_SIZE(a) (HANDLE_BLOCK_MASK & (a))
 #define	ROUND_UP_TO_MULTIPLE_OF_BLOCK_SIZE(a) ROUND_DOWN_TO_MULTIPLE_OF_BLOCK_SIZE((a) + HANDLE_BLOCK_SIZE - 1)
 
 #define	DEFAULT_MAX_HANDLE		0x7fffffffu
-#define	DEFAULT_MAX_INDEX_PLUS_ONE	ROUND_DOWN_TO_MULTIPLE_OF_BLOCK_SIZE(DEFAULT_MAX_HANDLE)
+#define	DEFAULT_MAX_INDEX_PLUS_ONE	ROUND_DOWN_TO_MULTIPLE_OF_BLOCK_SIZE(HANDLE_INDEX_MASK + 1)
 
 #define	HANDLES_BATCHED(psBase) ((psBase)->ui32HandBatchSize != 0)
 
@@ -149,6 +163,9 @@ struct sHandle
 	IMG_UINT32 ui32Index;
 
 	
+	IMG_UINT32 ui32Generation;
+
+	
 	struct sHandleList sChildren;
 
 	
@@ -246,7 +263,7 @@ IMG_VOID InitParentList(struct sHandle *psHandle)
 {
 	IMG_UINT32 ui32Parent = HANDLE_PTR_TO_INDEX(psHandle);
 
-	HandleListInit(ui32Parent, &psHandle->sChildren, INDEX_TO_HANDLE(ui32Parent));
+	HandleListInit(ui32Parent, &psHandle->sChildren, HANDLE_PTR_TO_HANDLE(psHandle));
 }
 
 #ifdef INLINE_IS_PRAGMA
@@ -335,17 +352,18 @@ IMG_VOID HandleListInsertBefore(PVRSRV_HANDLE_BASE *psBase, IMG_UINT32 ui32InsIn
 {
 	 
 	struct sHandleList *psPrevIns = LIST_PTR_FROM_INDEX_AND_OFFSET(psBase, psIns->ui32Prev, ui32ParentIndex, uiParentOffset, uiEntryOffset);
+	struct sHandle *psParent = INDEX_TO_HANDLE_STRUCT_PTR(psBase, ui32ParentIndex);
 
 	PVR_ASSERT(psEntry->hParent == IMG_NULL)
 	PVR_ASSERT(ui32InsIndex == psPrevIns->ui32Next)
-	PVR_ASSERT(LIST_PTR_FROM_INDEX_AND_OFFSET(psBase, ui32ParentIndex, ui32ParentIndex, uiParentOffset, uiParentOffset)->hParent == INDEX_TO_HANDLE(ui32ParentIndex))
+	PVR_ASSERT(LIST_PTR_FROM_INDEX_AND_OFFSET(psBase, ui32ParentIndex, ui32ParentIndex, uiParentOffset, uiParentOffset)->hParent == HANDLE_PTR_TO_HANDLE(psParent))
 
 	psEntry->ui32Prev = psIns->ui32Prev;
 	psIns->ui32Prev = ui32EntryIndex;
 	psEntry->ui32Next = ui32InsIndex;
 	psPrevIns->ui32Next = ui32EntryIndex;
 
-	psEntry->hParent = INDEX_TO_HANDLE(ui32ParentIndex);
+	psEntry->hParent = HANDLE_PTR_TO_HANDLE(psParent);
 }
 
 #ifdef INLINE_IS_PRAGMA
@@ -469,6 +487,16 @@ PVRSRV_ERROR GetHandleStructure(PVRSRV_HANDLE_BASE *psBase, struct sHandle **pps
 	}
 
 	
+	if (HANDLE_TO_GENERATION(hHandle) != (psHandle->ui32Generation & HANDLE_GENERATION_MASK))
+	{
+		PVR_DPF((PVR_DBG_ERROR, "GetHandleStructure: Stale handle (index: %u, generation %u != %u)", ui32Index, HANDLE_TO_GENERATION(hHandle), psHandle->ui32Generation & HANDLE_GENERATION_MASK));
+#if defined (SUPPORT_SID_INTERFACE)
+		PVR_DBG_BREAK
+#endif
+		return PVRSRV_ERROR_HANDLE_NOT_ALLOCATED;
+	}
+
+	
 	if (eType != PVRSRV_HANDLE_TYPE_NONE && eType != psHandle->eType)
 	{
 		PVR_DPF((PVR_DBG_ERROR, "GetHandleStructure: Handle type mismatch (%d != %d)", eType, psHandle->eType));
@@ -612,6 +640,7 @@ PVRSRV_ERROR ReallocHandleArray(PVRSRV_HANDLE_BASE *psBase, IMG_UINT32 ui32NewCo
 
 
 				psHandle->ui32Index = ui32SubIndex + ui32Index;
+				psHandle->ui32Generation = 0;
 				psHandle->eType = PVRSRV_HANDLE_TYPE_NONE;
 				psHandle->eInternalFlag = INTERNAL_HANDLE_FLAG_NONE;
 				psHandle->ui32NextIndexPlusOne  = 0;
@@ -763,7 +792,7 @@ static PVRSRV_ERROR FreeHandle(PVRSRV_HANDLE_BASE *psBase, struct sHandle *psHan
 #endif
 
 		PVR_ASSERT(hHandle != IMG_NULL)
-		PVR_ASSERT(hHandle == INDEX_TO_HANDLE(ui32Index))
+		PVR_ASSERT(hHandle == HANDLE_PTR_TO_HANDLE(psHandle))
 		PVR_UNREFERENCED_PARAMETER(hHandle);
 	}
 
@@ -781,6 +810,9 @@ static PVRSRV_ERROR FreeHandle(PVRSRV_HANDLE_BASE *psBase, struct sHandle *psHan
 	
 	psHandle->eType = PVRSRV_HANDLE_TYPE_NONE;
 
+	
+	psHandle->ui32Generation++;
+
 	if (BATCHED_HANDLE(psHandle) && !BATCHED_HANDLE_PARTIALLY_FREE(psHandle))
 	{
 		 
@@ -1075,7 +1107,7 @@ static PVRSRV_ERROR AllocHandle(PVRSRV_HANDLE_BASE *psBase, IMG_HANDLE *phHandle
 	PVR_ASSERT(psNewHandle != IMG_NULL)
 
 	
-	hHandle = INDEX_TO_HANDLE(ui32NewIndex);
+	hHandle = HANDLE_PTR_TO_HANDLE(psNewHandle);
 
 	
 	if (!TEST_FLAG(eFlag, PVRSRV_HANDLE_ALLOC_FLAG_MULTI))
@@ -33,8 +33,12 @@
 
 #define PRIVATE_MAX(a,b) ((a)>(b)?(a):(b))
 
+/* Number of removed buckets kept by a table for reuse by later inserts */
+#define	HASH_BUCKET_CACHE	16
+
+/* Table sizes are powers of two, so the hash is masked rather than divided */
 #define	KEY_TO_INDEX(pHash, key, uSize) \
-	((pHash)->pfnHashFunc((pHash)->uKeySize, (key), (uSize)) % (uSize))
+	((pHash)->pfnHashFunc((pHash)->uKeySize, (key), (uSize)) & ((uSize) - 1))
 
 #define	KEY_COMPARE(pHash, pKey1, pKey2) \
 	((pHash)->pfnKeyComp((pHash)->uKeySize, (pKey1), (pKey2)))
@@ -74,6 +78,12 @@ struct _HASH_TABLE_
 
 	
 	HASH_KEY_COMP *pfnKeyComp;
+
+	
+	BUCKET *pFreeBuckets;
+
+	
+	IMG_UINT32 uFreeCount;
 };
 
 IMG_UINT32
@@ -217,6 +227,12 @@ HASH_TABLE * HASH_Create_Extended (IMG_UINT32 uInitialLen, IMG_SIZE_T uKeySize,
 
 	PVR_DPF ((PVR_DBG_MESSAGE, "HASH_Create_Extended: InitialSize=0x%x", uInitialLen));
 
+	
+	uIndex = 1;
+	while (uIndex < uInitialLen)
+		uIndex <<= 1;
+	uInitialLen = uIndex;
+
 	if(OSAllocMem(PVRSRV_PAGEABLE_SELECT,
 					sizeof(HASH_TABLE),
 					(IMG_VOID **)&pHash, IMG_NULL,
@@ -231,6 +247,8 @@ HASH_TABLE * HASH_Create_Extended (IMG_UINT32 uInitialLen, IMG_SIZE_T uKeySize,
 	pHash->uKeySize = (IMG_UINT32)uKeySize;
 	pHash->pfnHashFunc = pfnHashFunc;
 	pHash->pfnKeyComp = pfnKeyComp;
+	pHash->pFreeBuckets = IMG_NULL;
+	pHash->uFreeCount = 0;
 
 	OSAllocMem(PVRSRV_PAGEABLE_SELECT,
                   sizeof (BUCKET *) * pHash->uSize,
@@ -268,6 +286,13 @@ HASH_Delete (HASH_TABLE *pHash)
 			PVR_DPF ((PVR_DBG_ERROR, "HASH_Delete: leak detected in hash table!"));
 			PVR_DPF ((PVR_DBG_ERROR, "Likely Cause: client drivers not freeing alocations before destroying devmemcontext"));
 		}
+		while (pHash->pFreeBuckets != IMG_NULL)
+		{
+			BUCKET *pBucket = pHash->pFreeBuckets;
+
+			pHash->pFreeBuckets = pBucket->pNext;
+			OSFreeMem(PVRSRV_PAGEABLE_SELECT, sizeof(BUCKET) + pHash->uKeySize, pBucket, IMG_NULL);
+		}
 		OSFreeMem(PVRSRV_PAGEABLE_SELECT, sizeof(BUCKET *)*pHash->uSize, pHash->ppBucketTable, IMG_NULL);
 		pHash->ppBucketTable = IMG_NULL;
 		OSFreeMem(PVRSRV_PAGEABLE_SELECT, sizeof(HASH_TABLE), pHash, IMG_NULL);
@@ -292,7 +317,13 @@ HASH_Insert_Extended (HASH_TABLE *pHash, IMG_VOID *pKey, IMG_UINTPTR_T v)
 		return IMG_FALSE;
 	}
 
-	if(OSAllocMem(PVRSRV_PAGEABLE_SELECT,
+	if (pHash->pFreeBuckets != IMG_NULL)
+	{
+		pBucket = pHash->pFreeBuckets;
+		pHash->pFreeBuckets = pBucket->pNext;
+		pHash->uFreeCount--;
+	}
+	else if(OSAllocMem(PVRSRV_PAGEABLE_SELECT,
 					sizeof(BUCKET) + pHash->uKeySize,
 					(IMG_VOID **)&pBucket, IMG_NULL,
 					"Hash Table entry") != PVRSRV_OK)
@@ -363,13 +394,25 @@ HASH_Remove_Extended(HASH_TABLE *pHash, IMG_VOID *pKey)
 			IMG_UINTPTR_T v = pBucket->v;
 			(*ppBucket) = pBucket->pNext;
 
-			OSFreeMem(PVRSRV_PAGEABLE_SELECT, sizeof(BUCKET) + pHash->uKeySize, pBucket, IMG_NULL);
-			
+			if (pHash->uFreeCount < HASH_BUCKET_CACHE)
+			{
+				pBucket->pNext = pHash->pFreeBuckets;
+				pHash->pFreeBuckets = pBucket;
+				pHash->uFreeCount++;
+			}
+			else
+			{
+				OSFreeMem(PVRSRV_PAGEABLE_SELECT, sizeof(BUCKET) + pHash->uKeySize, pBucket, IMG_NULL);
+			}
 
 			pHash->uCount--;
 
-			
-			if (pHash->uSize > (pHash->uCount << 2) &&
+			/*
+			 * Shrink below a quarter of the load that makes the table
+			 * grow, so that a count hovering around a resize point does
+			 * not rehash the table on every insert and remove.
+			 */
+			if (pHash->uSize > (pHash->uCount << 3) &&
                 pHash->uSize > pHash->uMinimumSize)
             {
                 
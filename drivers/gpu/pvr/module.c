@@ -134,6 +134,8 @@ MODULE_PARM_DESC(gPVRDebugLevel, "Sets the level of debug output (default 0x7)")
 #define DEFAULT_IDLE_MODE	1
 #elif defined(CONFIG_SGX_DVFS_MODE_OPTIMIZED)
 #define DEFAULT_IDLE_MODE	2
+#elif defined(CONFIG_SGX_DVFS_MODE_GOVERNOR)
+#define DEFAULT_IDLE_MODE	3
 #else
 #error "sgx ide mode not defined"
 #endif
@@ -145,6 +147,15 @@ module_param(sgx_idle_mode, uint, 0644);
 uint sgx_idle_timeout = CONFIG_SGX_DVFS_IDLE_TIMEOUT * NSEC_PER_USEC;
 module_param(sgx_idle_timeout, uint, 0644);
 
+uint sgx_gov_period_ms = 20;
+module_param(sgx_gov_period_ms, uint, 0644);
+uint sgx_gov_up_threshold = 80;
+module_param(sgx_gov_up_threshold, uint, 0644);
+uint sgx_gov_down_differential = 10;
+module_param(sgx_gov_down_differential, uint, 0644);
+uint sgx_gov_history = 50;
+module_param(sgx_gov_history, uint, 0644);
+
 uint sgx_apm_latency = SYS_SGX_ACTIVE_POWER_LATENCY_MS;
 module_param(sgx_apm_latency, uint, 0644);
 
@@ -27,8 +27,10 @@
 #include <linux/debugfs.h>
 #include <linux/hrtimer.h>
 #include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/seq_file.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 
 #include "sysconfig.h"
 #include "services_headers.h"
@@ -54,6 +56,10 @@ extern bool sgx_idle_logging;
 extern uint sgx_idle_mode;
 extern uint sgx_idle_timeout;
 extern uint sgx_apm_latency;
+extern uint sgx_gov_period_ms;
+extern uint sgx_gov_up_threshold;
+extern uint sgx_gov_down_differential;
+extern uint sgx_gov_history;
 
 #if defined(NO_HARDWARE) || defined(SGX_OCP_REGS_ENABLED)
 static IMG_CPU_VIRTADDR gsSGXRegsCPUVAddr;
@@ -71,6 +77,7 @@ IMG_UINT32 PVRSRV_BridgeDispatchKM(IMG_UINT32	Ioctl,
 								   IMG_UINT32	*pdwBytesTransferred);
 
 static void sgx_idle_init(void);
+static void sgx_gov_stop(void);
 
 #if defined(SGX_OCP_REGS_ENABLED)
 
@@ -618,6 +625,8 @@ PVRSRV_ERROR SysDeinitialise (SYS_DATA *psSysData)
 
 	if (SYS_SPECIFIC_DATA_TEST(gpsSysSpecificData, SYS_SPECIFIC_DATA_DVFS_INIT))
 	{
+		sgx_gov_stop();
+
 		eError = SysDvfsDeinitialize(gpsSysSpecificData);
 		if (eError != PVRSRV_OK)
 		{
@@ -1188,6 +1197,7 @@ static struct workqueue_struct *sgx_idle_wq;
 static struct work_struct sgx_idle_work;
 
 void RequestSGXFreq(SYS_DATA *psSysData, IMG_BOOL bMaxFreq);
+void RequestSGXFreqIndex(SYS_DATA *psSysData, IMG_UINT32 ui32FreqIndex);
 
 enum hrtimer_restart sgx_idle_timer_callback(struct hrtimer *timer)
 {
@@ -1201,13 +1211,145 @@ void sgx_idle_work_func(struct work_struct *work)
 	RequestSGXFreq(gpsSysData, IMG_FALSE);
 }
 
+/*
+ * Utilization governor (sgx_idle_mode 3).  The busy time reported by the
+ * idle callbacks is sampled every sgx_gov_period_ms.  The load of a period,
+ * as a percentage of the capacity at the highest frequency, is blended with
+ * the previous prediction (sgx_gov_history percent of it) but the demand is
+ * never predicted below the last period, so that bursts are served at once
+ * and the frequency only decays slowly.  The lowest frequency that keeps
+ * the predicted load under sgx_gov_up_threshold is requested, and lower
+ * frequencies only once the load drops sgx_gov_down_differential below it.
+ * Sampling stops while the SGX sits idle at the lowest frequency.
+ */
+static DEFINE_SPINLOCK(sgx_gov_lock);
+static bool sgx_gov_running;
+static bool sgx_gov_busy;
+static ktime_t sgx_gov_busy_since;
+static ktime_t sgx_gov_sample_start;
+static u64 sgx_gov_busy_ns;
+static uint sgx_gov_demand;
+
+static void sgx_gov_work_func(struct work_struct *work);
+static DECLARE_DEFERRED_WORK(sgx_gov_work, sgx_gov_work_func);
+
+static void sgx_gov_queue(void)
+{
+	queue_delayed_work(sgx_idle_wq, &sgx_gov_work,
+			   msecs_to_jiffies(max(sgx_gov_period_ms, 1u)));
+}
+
+/* lowest frequency index that serves demand below threshold percent load */
+static uint sgx_gov_target(uint demand, uint threshold)
+{
+	u32 *freq = gpsSysSpecificData->pui32SGXFreqList;
+	uint last = gpsSysSpecificData->ui32SGXFreqListSize - 2;
+	uint i;
+
+	for (i = 0; i < last; i++)
+		if (demand * (freq[last] / 1000) <=
+		    threshold * (freq[i] / 1000))
+			break;
+	return i;
+}
+
+static void sgx_gov_work_func(struct work_struct *work)
+{
+	u32 *freq = gpsSysSpecificData->pui32SGXFreqList;
+	uint last = gpsSysSpecificData->ui32SGXFreqListSize - 2;
+	uint cur, load, demand, target, hist, margin;
+	unsigned long flags;
+	ktime_t now;
+	u64 busy, window;
+	bool stop;
+
+	/* the "unknown" slot past the end runs at the highest frequency */
+	cur = min(gpsSysSpecificData->ui32SGXFreqListIndex, last);
+
+	spin_lock_irqsave(&sgx_gov_lock, flags);
+	now = ktime_get();
+	if (sgx_gov_busy) {
+		sgx_gov_busy_ns += ktime_to_ns(ktime_sub(now,
+							 sgx_gov_busy_since));
+		sgx_gov_busy_since = now;
+	}
+	busy = sgx_gov_busy_ns;
+	window = ktime_to_ns(ktime_sub(now, sgx_gov_sample_start));
+	sgx_gov_busy_ns = 0;
+	sgx_gov_sample_start = now;
+	spin_unlock_irqrestore(&sgx_gov_lock, flags);
+
+	load = div64_u64(min(busy, window) * 100, window ? : 1);
+	load = load * (freq[cur] / 1000) / (freq[last] / 1000);
+	hist = min(sgx_gov_history, 100u);
+	demand = (load * (100 - hist) + sgx_gov_demand * hist) / 100;
+	sgx_gov_demand = max(load, demand);
+
+	target = sgx_gov_target(sgx_gov_demand, sgx_gov_up_threshold);
+	if (target <= cur) {
+		margin = min(sgx_gov_down_differential, sgx_gov_up_threshold);
+		target = min(cur, sgx_gov_target(sgx_gov_demand,
+					sgx_gov_up_threshold - margin));
+	}
+
+	if (target != gpsSysSpecificData->ui32SGXFreqListIndex) {
+		sgx_idle_log_event(target > cur ? SGX_FAST : SGX_SLOW);
+		RequestSGXFreqIndex(gpsSysData, target);
+	}
+
+	spin_lock_irqsave(&sgx_gov_lock, flags);
+	stop = sgx_idle_mode != 3 || (!sgx_gov_busy && !busy && !target);
+	if (stop)
+		sgx_gov_running = false;
+	else
+		sgx_gov_queue();
+	spin_unlock_irqrestore(&sgx_gov_lock, flags);
+}
+
+static void sgx_gov_transition(bool idle)
+{
+	unsigned long flags;
+	ktime_t now;
+
+	spin_lock_irqsave(&sgx_gov_lock, flags);
+	now = ktime_get();
+	if (idle && sgx_gov_busy)
+		sgx_gov_busy_ns += ktime_to_ns(ktime_sub(now,
+							 sgx_gov_busy_since));
+	else if (!idle)
+		sgx_gov_busy_since = now;
+	sgx_gov_busy = !idle;
+
+	if (!idle && sgx_idle_mode == 3 && !sgx_gov_running) {
+		sgx_gov_running = true;
+		sgx_gov_busy_ns = 0;
+		sgx_gov_sample_start = now;
+		sgx_gov_queue();
+	}
+	spin_unlock_irqrestore(&sgx_gov_lock, flags);
+}
+
+static void sgx_gov_stop(void)
+{
+	unsigned long flags;
+
+	/* a running governor is never restarted by the idle callbacks */
+	spin_lock_irqsave(&sgx_gov_lock, flags);
+	sgx_gov_running = true;
+	spin_unlock_irqrestore(&sgx_gov_lock, flags);
+
+	cancel_delayed_work_sync(&sgx_gov_work);
+}
+
 IMG_VOID SysSGXIdleTransition(IMG_BOOL bSGXIdle)
 {
 	int ret;
 
+	sgx_gov_transition(bSGXIdle);
+
 	if (bSGXIdle) {
 		sgx_idle_log_event(SGX_IDLE);
-		if (sgx_idle_mode != 0) {
+		if (sgx_idle_mode == 1 || sgx_idle_mode == 2) {
 			uint timeout = sgx_idle_timeout;
 
 			if (sgx_idle_mode == 2) {
@@ -1226,7 +1368,7 @@ IMG_VOID SysSGXIdleTransition(IMG_BOOL bSGXIdle)
 				      HRTIMER_MODE_REL);
 		}
 	} else {
-		if (sgx_idle_mode != 0) {
+		if (sgx_idle_mode == 1 || sgx_idle_mode == 2) {
 			bool fast = true;
 
 			ret = hrtimer_cancel(&sgx_idle_timer);
@@ -159,6 +159,10 @@ typedef struct _SYS_SPECIFIC_DATA_TAG_
 	IMG_UINT32 ui32SGXFreqListSize;
 	IMG_UINT32 *pui32SGXFreqList;
 	IMG_UINT32 ui32SGXFreqListIndex;
+	struct mutex sSGXFreqLock;
+	IMG_UINT64 *pui64SGXFreqTime;
+	IMG_UINT64 ui64SGXFreqTimestamp;
+	IMG_UINT32 ui32SGXFreqTransitions;
 #endif	
 } SYS_SPECIFIC_DATA;
 
@@ -28,6 +28,8 @@
 #include <linux/clk.h>
 #include <linux/err.h>
 #include <linux/hardirq.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
 #include <linux/mutex.h>
 #include <linux/slab.h>
 
@@ -143,16 +145,25 @@ IMG_VOID SysGetSGXTimingInformation(SGX_TIMING_INFORMATION *psTimingInfo)
 	psTimingInfo->ui32ActivePowManLatencyms = sgx_apm_latency;
 }
 
-void RequestSGXFreq(SYS_DATA *psSysData, IMG_BOOL bMaxFreq)
+/* Charge the time since the last frequency change to the current frequency */
+static void SGXFreqAccount(SYS_SPECIFIC_DATA *psSysSpecData)
+{
+	IMG_UINT64 now = ktime_to_ns(ktime_get());
+
+	psSysSpecData->pui64SGXFreqTime[psSysSpecData->ui32SGXFreqListIndex] +=
+		now - psSysSpecData->ui64SGXFreqTimestamp;
+	psSysSpecData->ui64SGXFreqTimestamp = now;
+}
+
+void RequestSGXFreqIndex(SYS_DATA *psSysData, IMG_UINT32 freq_index)
 {
 	SYS_SPECIFIC_DATA *psSysSpecData = (SYS_SPECIFIC_DATA *) psSysData->pvSysSpecificData;
 	struct gpu_platform_data *pdata;
-	IMG_UINT32 freq_index;
 	int res;
 
 	pdata = (struct gpu_platform_data *)gpsPVRLDMDev->dev.platform_data;
-	freq_index = bMaxFreq ? psSysSpecData->ui32SGXFreqListSize - 2 : 0;
 
+	mutex_lock(&psSysSpecData->sSGXFreqLock);
 	if (psSysSpecData->ui32SGXFreqListIndex != freq_index)
 	{
 		PVR_ASSERT(pdata->device_scale != IMG_NULL);
@@ -160,8 +171,12 @@ void RequestSGXFreq(SYS_DATA *psSysData, IMG_BOOL bMaxFreq)
 					  &gpsPVRLDMDev->dev,
 					  psSysSpecData->pui32SGXFreqList[freq_index]);
 
+		SGXFreqAccount(psSysSpecData);
 		if (res == 0)
+		{
 			psSysSpecData->ui32SGXFreqListIndex = freq_index;
+			psSysSpecData->ui32SGXFreqTransitions++;
+		}
 		else if (res == -EBUSY)
 		{
 			PVR_DPF((PVR_DBG_WARNING, "EnableSGXClocks: Unable to scale SGX frequency (EBUSY)"));
@@ -173,7 +188,15 @@ void RequestSGXFreq(SYS_DATA *psSysData, IMG_BOOL bMaxFreq)
 			psSysSpecData->ui32SGXFreqListIndex = psSysSpecData->ui32SGXFreqListSize - 1;
 		}
 	}
+	mutex_unlock(&psSysSpecData->sSGXFreqLock);
+}
 
+void RequestSGXFreq(SYS_DATA *psSysData, IMG_BOOL bMaxFreq)
+{
+	SYS_SPECIFIC_DATA *psSysSpecData = (SYS_SPECIFIC_DATA *) psSysData->pvSysSpecificData;
+
+	RequestSGXFreqIndex(psSysData, bMaxFreq ?
+			    psSysSpecData->ui32SGXFreqListSize - 2 : 0);
 }
 
 void sgx_idle_log_on(void);
@@ -507,6 +530,7 @@ PVRSRV_ERROR EnableSystemClocks(SYS_DATA *psSysData)
 	if (!psSysSpecData->bSysClocksOneTimeInit)
 	{
 		mutex_init(&psSysSpecData->sPowerLock);
+		mutex_init(&psSysSpecData->sSGXFreqLock);
 
 		atomic_set(&psSysSpecData->sSGXClocksEnabled, 0);
 
@@ -544,10 +568,66 @@ PVRSRV_ERROR SysPMRuntimeUnregister(void)
 	return PVRSRV_OK;
 }
 
+/*
+ * Frequency statistics, in the dvfs group of the SGX device.  time_in_state
+ * lists each frequency (Hz) with the time (ms) spent at it, total_trans the
+ * number of frequency changes.
+ */
+static ssize_t time_in_state_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	SYS_SPECIFIC_DATA *psSysSpecData = gpsSysSpecificData;
+	ssize_t len = 0;
+	IMG_UINT32 i;
+
+	mutex_lock(&psSysSpecData->sSGXFreqLock);
+	SGXFreqAccount(psSysSpecData);
+	for (i = 0; i < psSysSpecData->ui32SGXFreqListSize - 1; i++)
+		len += snprintf(buf + len, PAGE_SIZE - len, "%u %llu\n",
+				psSysSpecData->pui32SGXFreqList[i],
+				div_u64(psSysSpecData->pui64SGXFreqTime[i],
+					NSEC_PER_MSEC));
+	mutex_unlock(&psSysSpecData->sSGXFreqLock);
+
+	return len;
+}
+
+static ssize_t total_trans_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", gpsSysSpecificData->ui32SGXFreqTransitions);
+}
+
+static ssize_t cur_freq_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	SYS_SPECIFIC_DATA *psSysSpecData = gpsSysSpecificData;
+
+	return sprintf(buf, "%u\n", psSysSpecData->pui32SGXFreqList[
+				psSysSpecData->ui32SGXFreqListIndex]);
+}
+
+static DEVICE_ATTR(time_in_state, S_IRUGO, time_in_state_show, NULL);
+static DEVICE_ATTR(total_trans, S_IRUGO, total_trans_show, NULL);
+static DEVICE_ATTR(cur_freq, S_IRUGO, cur_freq_show, NULL);
+
+static struct attribute *sgx_dvfs_attrs[] = {
+	&dev_attr_time_in_state.attr,
+	&dev_attr_total_trans.attr,
+	&dev_attr_cur_freq.attr,
+	NULL,
+};
+
+static struct attribute_group sgx_dvfs_attr_group = {
+	.name = "dvfs",
+	.attrs = sgx_dvfs_attrs,
+};
+
 PVRSRV_ERROR SysDvfsInitialize(SYS_SPECIFIC_DATA *psSysSpecificData)
 {
 	IMG_INT32 opp_count;
 	IMG_UINT32 i, *freq_list;
+	IMG_UINT64 *freq_time;
 	struct opp *opp;
 	unsigned long freq;
 
@@ -601,11 +681,28 @@ PVRSRV_ERROR SysDvfsInitialize(SYS_SPECIFIC_DATA *psSysSpecificData)
 	rcu_read_unlock();
 	freq_list[opp_count] = freq_list[opp_count - 1];
 
+	freq_time = kzalloc((opp_count + 1) * sizeof(IMG_UINT64), GFP_KERNEL);
+	if (!freq_time)
+	{
+		PVR_DPF((PVR_DBG_ERROR, "SysDvfsInitialize: Could not allocate frequency statistics"));
+		kfree(freq_list);
+		return PVRSRV_ERROR_OUT_OF_MEMORY;
+	}
+
 	psSysSpecificData->ui32SGXFreqListSize = opp_count + 1;
 	psSysSpecificData->pui32SGXFreqList = freq_list;
 	/* Start in unknown state - no frequency request to DVFS yet made */
 	psSysSpecificData->ui32SGXFreqListIndex = opp_count;
 
+	psSysSpecificData->pui64SGXFreqTime = freq_time;
+	psSysSpecificData->ui64SGXFreqTimestamp = ktime_to_ns(ktime_get());
+	psSysSpecificData->ui32SGXFreqTransitions = 0;
+
+	if (sysfs_create_group(&gpsPVRLDMDev->dev.kobj, &sgx_dvfs_attr_group))
+	{
+		PVR_DPF((PVR_DBG_WARNING, "SysDvfsInitialize: Could not create DVFS statistics"));
+	}
+
 	return PVRSRV_OK;
 }
 
@@ -621,6 +718,8 @@ PVRSRV_ERROR SysDvfsDeinitialize(SYS_SPECIFIC_DATA *psSysSpecificData)
 	 * report busy if early in initialization, but all other errors are
 	 * considered serious.
 	 */
+	sysfs_remove_group(&gpsPVRLDMDev->dev.kobj, &sgx_dvfs_attr_group);
+
 	if (psSysSpecificData->ui32SGXFreqListIndex != 0)
 	{
 		IMG_INT32 res;
@@ -643,6 +742,8 @@ PVRSRV_ERROR SysDvfsDeinitialize(SYS_SPECIFIC_DATA *psSysSpecificData)
 
 	kfree(psSysSpecificData->pui32SGXFreqList);
 	psSysSpecificData->pui32SGXFreqList = 0;
+	kfree(psSysSpecificData->pui64SGXFreqTime);
+	psSysSpecificData->pui64SGXFreqTime = 0;
 	psSysSpecificData->ui32SGXFreqListSize = 0;
 
 	return PVRSRV_OK;
@@ -37,6 +37,9 @@
 
 static HASH_TABLE *psHashTab = IMG_NULL;
 
+/* Last looked up per-process data, as most bridge calls come from one process */
+static PVRSRV_PER_PROCESS_DATA *psLastPerProc = IMG_NULL;
+
 static PVRSRV_ERROR FreePerProcessData(PVRSRV_PER_PROCESS_DATA *psPerProc)
 {
 	PVRSRV_ERROR eError;
@@ -50,6 +53,11 @@ static PVRSRV_ERROR FreePerProcessData(PVRSRV_PER_PROCESS_DATA *psPerProc)
 		return PVRSRV_ERROR_INVALID_PARAMS;
 	}
 
+	if (psLastPerProc == psPerProc)
+	{
+		psLastPerProc = IMG_NULL;
+	}
+
 	uiPerProc = HASH_Remove(psHashTab, (IMG_UINTPTR_T)psPerProc->ui32PID);
 	if (uiPerProc == 0)
 	{
@@ -115,8 +123,18 @@ PVRSRV_PER_PROCESS_DATA *PVRSRVPerProcessData(IMG_UINT32 ui32PID)
 
 	PVR_ASSERT(psHashTab != IMG_NULL);
 
+	psPerProc = psLastPerProc;
+	if (psPerProc != IMG_NULL && psPerProc->ui32PID == ui32PID)
+	{
+		return psPerProc;
+	}
+
 	
 	psPerProc = (PVRSRV_PER_PROCESS_DATA *)HASH_Retrieve(psHashTab, (IMG_UINTPTR_T)ui32PID);
+	if (psPerProc != IMG_NULL)
+	{
+		psLastPerProc = psPerProc;
+	}
 	return psPerProc;
 }
 
@@ -244,6 +244,26 @@ typedef struct PVRSRV_BRIDGE_PACKAGE_TAG
 #endif
 }PVRSRV_BRIDGE_PACKAGE;
 
+/*
+ * A vector of bridge packages, run under one acquisition of the bridge lock
+ * to save a system call and a lock round trip per package in sequences such
+ * as sync object updates or memory mapping.  pi32Status receives, for each
+ * package, the value its own ioctl would have returned.  The batch has an
+ * ioctl number of its own, so the bridge IDs are left as they are.
+ */
+#define PVRSRV_BRIDGE_BATCH_MAX					32
+
+typedef struct PVRSRV_BRIDGE_BATCH_PACKAGE_TAG
+{
+	IMG_UINT32				ui32Count;
+	PVRSRV_BRIDGE_PACKAGE	*psPackages;
+	IMG_INT32				*pi32Status;
+}PVRSRV_BRIDGE_BATCH_PACKAGE;
+
+#ifdef __linux__
+#define PVRSRV_BRIDGE_BATCH						_IOWR(PVRSRV_IOC_GID, 0xff, PVRSRV_BRIDGE_BATCH_PACKAGE)
+#endif
+
 
 typedef struct PVRSRV_BRIDGE_IN_CONNECT_SERVICES_TAG
 {
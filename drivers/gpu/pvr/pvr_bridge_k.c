@@ -73,6 +73,26 @@ static void ProcSeqStartstopBridgeStats(struct seq_file *sfile,IMG_BOOL start);
 
 #endif
 
+#if defined(PVR_BRIDGE_BENCH)
+
+#include <linux/moduleparam.h>
+#include <linux/hrtimer.h>
+#include <linux/math64.h>
+#include <linux/vmalloc.h>
+#include "handle.h"
+
+static uint bridge_bench_handles = 1024;
+module_param(bridge_bench_handles, uint, 0644);
+static uint bridge_bench_calls = 100000;
+module_param(bridge_bench_calls, uint, 0644);
+
+static struct proc_dir_entry *g_ProcBridgeBench =0;
+static void* ProcSeqNextBridgeBench(struct seq_file *sfile,void* el,loff_t off);
+static void ProcSeqShowBridgeBench(struct seq_file *sfile,void* el);
+static void* ProcSeqOff2ElementBridgeBench(struct seq_file * sfile, loff_t off);
+
+#endif
+
 extern PVRSRV_LINUX_MUTEX gPVRSRVLock;
 
 #if defined(SUPPORT_MEMINFO_IDS)
@@ -97,6 +117,18 @@ LinuxBridgeInit(IMG_VOID)
 			return PVRSRV_ERROR_OUT_OF_MEMORY;
 		}
 	}
+#endif
+#if defined(PVR_BRIDGE_BENCH)
+	g_ProcBridgeBench = CreateProcReadEntrySeq("bridge_bench",
+											   NULL,
+											   ProcSeqNextBridgeBench,
+											   ProcSeqShowBridgeBench,
+											   ProcSeqOff2ElementBridgeBench,
+											   NULL);
+	if(!g_ProcBridgeBench)
+	{
+		return PVRSRV_ERROR_OUT_OF_MEMORY;
+	}
 #endif
 	return CommonBridgeInit();
 }
@@ -107,8 +139,134 @@ LinuxBridgeDeInit(IMG_VOID)
 #if defined(DEBUG_BRIDGE_KM)
     RemoveProcEntrySeq(g_ProcBridgeStats);
 #endif
+#if defined(PVR_BRIDGE_BENCH)
+	RemoveProcEntrySeq(g_ProcBridgeBench);
+#endif
+}
+
+#if defined(PVR_BRIDGE_BENCH)
+
+/*
+ * Reading /proc/pvr/bridge_bench times the handle work done by bridge calls,
+ * on a private handle base holding bridge_bench_handles handles: allocation,
+ * reverse lookup by data pointer, and bridge_bench_calls simulated calls that
+ * each take the bridge lock, find the per-process data of the caller and
+ * look up one handle, as PVRSRV_BridgeDispatchKM and the bridge wrappers do.
+ */
+#define BRIDGE_BENCH_DATA(i)	((IMG_VOID *)(((IMG_UINTPTR_T)(i) + 1) << 4))
+
+static void* ProcSeqOff2ElementBridgeBench(struct seq_file *sfile, loff_t off)
+{
+	return off ? (void*)0 : PVR_PROC_SEQ_START_TOKEN;
+}
+
+static void* ProcSeqNextBridgeBench(struct seq_file *sfile,void* el,loff_t off)
+{
+	return ProcSeqOff2ElementBridgeBench(sfile,off);
+}
+
+static void ProcSeqShowBridgeBench(struct seq_file *sfile,void* el)
+{
+	IMG_UINT32 ui32Handles = max(bridge_bench_handles, 1U);
+	IMG_UINT32 ui32Calls = bridge_bench_calls;
+	IMG_UINT32 ui32PID = OSGetCurrentProcessIDKM();
+	PVRSRV_HANDLE_BASE *psBase;
+	IMG_HANDLE *phHandles, hHandle;
+	IMG_PVOID pvData;
+	IMG_BOOL bConnected;
+	IMG_UINT32 i, j;
+	u64 ui64Alloc, ui64Find, ui64Call, ui64Release;
+	ktime_t sStart;
+	PVRSRV_ERROR eError = PVRSRV_OK;
+
+	if(el != PVR_PROC_SEQ_START_TOKEN)
+	{
+		return;
+	}
+
+	phHandles = vmalloc(ui32Handles * sizeof(*phHandles));
+	if(phHandles == IMG_NULL)
+	{
+		seq_printf(sfile, "out of memory\n");
+		return;
+	}
+
+	LinuxLockMutex(&gPVRSRVLock);
+	bConnected = PVRSRVPerProcessData(ui32PID) != IMG_NULL;
+	if(PVRSRVAllocHandleBase(&psBase) != PVRSRV_OK)
+	{
+		LinuxUnLockMutex(&gPVRSRVLock);
+		vfree(phHandles);
+		seq_printf(sfile, "cannot allocate handle base\n");
+		return;
+	}
+
+	sStart = ktime_get();
+	for(i = 0; i < ui32Handles && eError == PVRSRV_OK; i++)
+	{
+		eError = PVRSRVAllocHandle(psBase, &phHandles[i], BRIDGE_BENCH_DATA(i),
+								   PVRSRV_HANDLE_TYPE_MEM_INFO,
+								   PVRSRV_HANDLE_ALLOC_FLAG_NONE);
+	}
+	ui64Alloc = ktime_to_ns(ktime_sub(ktime_get(), sStart));
+	ui32Handles = i - (eError != PVRSRV_OK);
+
+	sStart = ktime_get();
+	for(i = 0; i < ui32Handles && eError == PVRSRV_OK; i++)
+	{
+		eError = PVRSRVFindHandle(psBase, &hHandle, BRIDGE_BENCH_DATA(i),
+								  PVRSRV_HANDLE_TYPE_MEM_INFO);
+	}
+	ui64Find = ktime_to_ns(ktime_sub(ktime_get(), sStart));
+	LinuxUnLockMutex(&gPVRSRVLock);
+
+	sStart = ktime_get();
+	for(i = 0, j = 0; i < ui32Calls && eError == PVRSRV_OK; i++)
+	{
+		LinuxLockMutex(&gPVRSRVLock);
+		(IMG_VOID)PVRSRVPerProcessData(ui32PID);
+		eError = PVRSRVLookupHandle(psBase, &pvData, phHandles[j],
+									PVRSRV_HANDLE_TYPE_MEM_INFO);
+		LinuxUnLockMutex(&gPVRSRVLock);
+
+		if(++j == ui32Handles)
+		{
+			j = 0;
+		}
+	}
+	ui64Call = ktime_to_ns(ktime_sub(ktime_get(), sStart));
+
+	LinuxLockMutex(&gPVRSRVLock);
+	sStart = ktime_get();
+	for(i = 0; i < ui32Handles; i++)
+	{
+		(IMG_VOID)PVRSRVReleaseHandle(psBase, phHandles[i],
+									  PVRSRV_HANDLE_TYPE_MEM_INFO);
+	}
+	ui64Release = ktime_to_ns(ktime_sub(ktime_get(), sStart));
+	(IMG_VOID)PVRSRVFreeHandleBase(psBase);
+	LinuxUnLockMutex(&gPVRSRVLock);
+
+	vfree(phHandles);
+
+	seq_printf(sfile, "%u handles, %u calls, caller %sconnected\n",
+			   ui32Handles, ui32Calls, bConnected ? "" : "not ");
+	seq_printf(sfile, "alloc   %llu ns/handle\n",
+			   div_u64(ui64Alloc, ui32Handles ? ui32Handles : 1));
+	seq_printf(sfile, "find    %llu ns/handle\n",
+			   div_u64(ui64Find, ui32Handles ? ui32Handles : 1));
+	seq_printf(sfile, "call    %llu ns/call\n",
+			   div_u64(ui64Call, ui32Calls ? ui32Calls : 1));
+	seq_printf(sfile, "release %llu ns/handle\n",
+			   div_u64(ui64Release, ui32Handles ? ui32Handles : 1));
+	if(eError != PVRSRV_OK)
+	{
+		seq_printf(sfile, "error: %d\n", eError);
+	}
 }
 
+#endif
+
 #if defined(DEBUG_BRIDGE_KM)
 
 static void ProcSeqStartstopBridgeStats(struct seq_file *sfile,IMG_BOOL start) 
@@ -156,12 +314,18 @@ static void ProcSeqShowBridgeStats(struct seq_file *sfile,void* el)
 						  "Total ioctl call count = %u\n"
 						  "Total number of bytes copied via copy_from_user = %u\n"
 						  "Total number of bytes copied via copy_to_user = %u\n"
-						  "Total number of bytes copied via copy_*_user = %u\n\n"
+						  "Total number of bytes copied via copy_*_user = %u\n"
+						  "Total batch ioctl count = %u\n"
+						  "Total calls made in batches = %u\n"
+						  "Total bridge system call count = %u\n\n"
 						  "%-45s | %-40s | %10s | %20s | %10s\n",
 						  g_BridgeGlobalStats.ui32IOCTLCount,
 						  g_BridgeGlobalStats.ui32TotalCopyFromUserBytes,
 						  g_BridgeGlobalStats.ui32TotalCopyToUserBytes,
 						  g_BridgeGlobalStats.ui32TotalCopyFromUserBytes+g_BridgeGlobalStats.ui32TotalCopyToUserBytes,
+						  g_BridgeGlobalStats.ui32BatchCount,
+						  g_BridgeGlobalStats.ui32BatchedCallCount,
+						  g_BridgeGlobalStats.ui32IOCTLCount-g_BridgeGlobalStats.ui32BatchedCallCount+g_BridgeGlobalStats.ui32BatchCount,
 						  "Bridge Name",
 						  "Wrapper Function",
 						  "Call Count",
@@ -183,53 +347,20 @@ static void ProcSeqShowBridgeStats(struct seq_file *sfile,void* el)
 #endif 
 
 
+static IMG_INT
+BridgeDispatchPackage(
 #if defined(SUPPORT_DRI_DRM)
-int
-PVRSRV_BridgeDispatchKM(struct drm_device unref__ *dev, void *arg, struct drm_file *pFile)
+					  struct drm_file *pFile,
 #else
-long
-PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsigned long arg)
+					  struct file *pFile,
 #endif
+					  PVRSRV_BRIDGE_PACKAGE *psBridgePackageKM,
+					  IMG_UINT32 ui32PID)
 {
 	IMG_UINT32 cmd;
-#if !defined(SUPPORT_DRI_DRM)
-	PVRSRV_BRIDGE_PACKAGE *psBridgePackageUM = (PVRSRV_BRIDGE_PACKAGE *)arg;
-	PVRSRV_BRIDGE_PACKAGE sBridgePackageKM;
-#endif
-	PVRSRV_BRIDGE_PACKAGE *psBridgePackageKM;
-	IMG_UINT32 ui32PID = OSGetCurrentProcessIDKM();
 	PVRSRV_PER_PROCESS_DATA *psPerProc;
 	IMG_INT err = -EFAULT;
 
-	LinuxLockMutex(&gPVRSRVLock);
-
-#if defined(SUPPORT_DRI_DRM)
-	psBridgePackageKM = (PVRSRV_BRIDGE_PACKAGE *)arg;
-	PVR_ASSERT(psBridgePackageKM != IMG_NULL);
-#else
-	psBridgePackageKM = &sBridgePackageKM;
-
-	if(!OSAccessOK(PVR_VERIFY_WRITE,
-				   psBridgePackageUM,
-				   sizeof(PVRSRV_BRIDGE_PACKAGE)))
-	{
-		PVR_DPF((PVR_DBG_ERROR, "%s: Received invalid pointer to function arguments",
-				 __FUNCTION__));
-
-		goto unlock_and_return;
-	}
-	
-	
-	if(OSCopyFromUser(IMG_NULL,
-					  psBridgePackageKM,
-					  psBridgePackageUM,
-					  sizeof(PVRSRV_BRIDGE_PACKAGE))
-	  != PVRSRV_OK)
-	{
-		goto unlock_and_return;
-	}
-#endif
-
 	cmd = psBridgePackageKM->ui32BridgeID;
 	
 	if(cmd != PVRSRV_BRIDGE_CONNECT_SERVICES)
@@ -244,7 +375,7 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 		{
 			PVR_DPF((PVR_DBG_ERROR, "%s: Invalid kernel services handle (%d)",
 					 __FUNCTION__, eError));
-			goto unlock_and_return;
+			return err;
 		}
 
 		if(psPerProc->ui32PID != ui32PID)
@@ -252,7 +383,7 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 			PVR_DPF((PVR_DBG_ERROR, "%s: Process %d tried to access data "
 					 "belonging to process %d", __FUNCTION__, ui32PID,
 					 psPerProc->ui32PID));
-			goto unlock_and_return;
+			return err;
 		}
 	}
 	else
@@ -263,7 +394,7 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 		{
 			PVR_DPF((PVR_DBG_ERROR, "PVRSRV_BridgeDispatchKM: "
 					 "Couldn't create per-process data area"));
-			goto unlock_and_return;
+			return err;
 		}
 	}
 
@@ -280,7 +411,7 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 				PVR_DPF((PVR_DBG_ERROR, "%s: Can only export one MemInfo "
 						 "per file descriptor", __FUNCTION__));
 				err = -EINVAL;
-				goto unlock_and_return;
+				return err;
 			}
 			break;
 		}
@@ -296,13 +427,13 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 				PVR_DPF((PVR_DBG_ERROR, "%s: File descriptor has no "
 						 "associated MemInfo handle", __FUNCTION__));
 				err = -EINVAL;
-				goto unlock_and_return;
+				return err;
 			}
 
 			if (pvr_put_user(psPrivateData->hKernelMemInfo, &psMapDevMemIN->hKernelMemInfo) != 0)
 			{
 				err = -EFAULT;
-				goto unlock_and_return;
+				return err;
 			}
 			break;
 		}
@@ -315,7 +446,7 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 			{
 				PVR_DPF((PVR_DBG_ERROR, "%s: Import/Export handle tried "
 						 "to use privileged service", __FUNCTION__));
-				goto unlock_and_return;
+				return err;
 			}
 			break;
 		}
@@ -342,7 +473,7 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 			{
 				PVR_DPF((PVR_DBG_ERROR, "%s: Process private data not allocated", __FUNCTION__));
 				err = -EFAULT;
-				goto unlock_and_return;
+				return err;
 			}
 
 			list_for_each_entry(psPrivateData, &psEnvPerProc->sDRMAuthListHead, sDRMAuthListItem)
@@ -363,7 +494,7 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 			{
 				PVR_DPF((PVR_DBG_ERROR, "%s: Not authenticated for mapping device or device class memory", __FUNCTION__));
 				err = -EPERM;
-				goto unlock_and_return;
+				return err;
 			}
 			break;
 		}
@@ -374,7 +505,7 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 
 	err = BridgedDispatchKM(psPerProc, psBridgePackageKM);
 	if(err != PVRSRV_OK)
-		goto unlock_and_return;
+		return err;
 
 	switch(cmd)
 	{
@@ -389,7 +520,7 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 			if (pvr_get_user(hMemInfo, &psExportDeviceMemOUT->hMemInfo) != 0)
 			{
 				err = -EFAULT;
-				goto unlock_and_return;
+				return err;
 			}
 
 			
@@ -400,7 +531,7 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 			{
 				PVR_DPF((PVR_DBG_ERROR, "%s: Failed to look up export handle", __FUNCTION__));
 				err = -EFAULT;
-				goto unlock_and_return;
+				return err;
 			}
 
 			
@@ -420,7 +551,7 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 			if (pvr_put_user(psPrivateData->ui64Stamp, &psExportDeviceMemOUT->ui64Stamp) != 0)
 			{
 				err = -EFAULT;
-				goto unlock_and_return;
+				return err;
 			}
 #endif
 			break;
@@ -436,7 +567,7 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 			if (pvr_put_user(psPrivateData->ui64Stamp, &psMapDeviceMemoryOUT->sDstClientMemInfo.ui64Stamp) != 0)
 			{
 				err = -EFAULT;
-				goto unlock_and_return;
+				return err;
 			}
 			break;
 		}
@@ -448,7 +579,7 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 			if (pvr_put_user(++ui64Stamp, &psDeviceClassMemoryOUT->sClientMemInfo.ui64Stamp) != 0)
 			{
 				err = -EFAULT;
-				goto unlock_and_return;
+				return err;
 			}
 			break;
 		}
@@ -458,6 +589,137 @@ PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int unref__ ioctlCmd, unsig
 			break;
 	}
 
+	return err;
+}
+
+#if !defined(SUPPORT_DRI_DRM)
+/*
+ * Runs the packages of a batch one after the other, each through the same
+ * checks as a single bridge call, but taking the bridge lock only once.  The
+ * result each package would have returned from its own ioctl is written to
+ * its status entry; a failing package does not stop the ones after it.
+ */
+static IMG_INT
+BridgeDispatchBatch(struct file *pFile, PVRSRV_BRIDGE_BATCH_PACKAGE *psBatchUM,
+					IMG_UINT32 ui32PID)
+{
+	PVRSRV_BRIDGE_BATCH_PACKAGE sBatch;
+	PVRSRV_BRIDGE_PACKAGE sBridgePackageKM;
+	IMG_INT32 i32Status;
+	IMG_UINT32 i;
+	IMG_INT err = 0;
+
+	if(OSCopyFromUser(IMG_NULL, &sBatch, psBatchUM, sizeof(sBatch)) != PVRSRV_OK)
+	{
+		return -EFAULT;
+	}
+
+	if(sBatch.ui32Count > PVRSRV_BRIDGE_BATCH_MAX)
+	{
+		PVR_DPF((PVR_DBG_ERROR, "%s: Too many packages in batch (%u)",
+				 __FUNCTION__, sBatch.ui32Count));
+		return -EINVAL;
+	}
+
+	if(!OSAccessOK(PVR_VERIFY_READ,
+				   sBatch.psPackages,
+				   sBatch.ui32Count * sizeof(PVRSRV_BRIDGE_PACKAGE)) ||
+	   !OSAccessOK(PVR_VERIFY_WRITE,
+				   sBatch.pi32Status,
+				   sBatch.ui32Count * sizeof(IMG_INT32)))
+	{
+		PVR_DPF((PVR_DBG_ERROR, "%s: Received invalid pointer to batch",
+				 __FUNCTION__));
+		return -EFAULT;
+	}
+
+	LinuxLockMutex(&gPVRSRVLock);
+
+#if defined(DEBUG_BRIDGE_KM)
+	g_BridgeGlobalStats.ui32BatchCount++;
+	g_BridgeGlobalStats.ui32BatchedCallCount += sBatch.ui32Count;
+#endif
+
+	for(i = 0; i < sBatch.ui32Count; i++)
+	{
+		if(OSCopyFromUser(IMG_NULL,
+						  &sBridgePackageKM,
+						  &sBatch.psPackages[i],
+						  sizeof(PVRSRV_BRIDGE_PACKAGE)) != PVRSRV_OK)
+		{
+			i32Status = -EFAULT;
+		}
+		else
+		{
+			i32Status = BridgeDispatchPackage(pFile, &sBridgePackageKM, ui32PID);
+		}
+
+		if(pvr_put_user(i32Status, &sBatch.pi32Status[i]) != 0)
+		{
+			err = -EFAULT;
+			break;
+		}
+	}
+
+	LinuxUnLockMutex(&gPVRSRVLock);
+	return err;
+}
+#endif
+
+#if defined(SUPPORT_DRI_DRM)
+int
+PVRSRV_BridgeDispatchKM(struct drm_device unref__ *dev, void *arg, struct drm_file *pFile)
+#else
+long
+PVRSRV_BridgeDispatchKM(struct file *pFile, unsigned int ioctlCmd, unsigned long arg)
+#endif
+{
+#if !defined(SUPPORT_DRI_DRM)
+	PVRSRV_BRIDGE_PACKAGE *psBridgePackageUM = (PVRSRV_BRIDGE_PACKAGE *)arg;
+	PVRSRV_BRIDGE_PACKAGE sBridgePackageKM;
+#endif
+	PVRSRV_BRIDGE_PACKAGE *psBridgePackageKM;
+	IMG_UINT32 ui32PID = OSGetCurrentProcessIDKM();
+	IMG_INT err = -EFAULT;
+
+#if !defined(SUPPORT_DRI_DRM)
+	if(ioctlCmd == PVRSRV_BRIDGE_BATCH)
+	{
+		return BridgeDispatchBatch(pFile, (PVRSRV_BRIDGE_BATCH_PACKAGE *)arg, ui32PID);
+	}
+#endif
+
+	LinuxLockMutex(&gPVRSRVLock);
+
+#if defined(SUPPORT_DRI_DRM)
+	psBridgePackageKM = (PVRSRV_BRIDGE_PACKAGE *)arg;
+	PVR_ASSERT(psBridgePackageKM != IMG_NULL);
+#else
+	psBridgePackageKM = &sBridgePackageKM;
+
+	if(!OSAccessOK(PVR_VERIFY_WRITE,
+				   psBridgePackageUM,
+				   sizeof(PVRSRV_BRIDGE_PACKAGE)))
+	{
+		PVR_DPF((PVR_DBG_ERROR, "%s: Received invalid pointer to function arguments",
+				 __FUNCTION__));
+
+		goto unlock_and_return;
+	}
+	
+	
+	if(OSCopyFromUser(IMG_NULL,
+					  psBridgePackageKM,
+					  psBridgePackageUM,
+					  sizeof(PVRSRV_BRIDGE_PACKAGE))
+	  != PVRSRV_OK)
+	{
+		goto unlock_and_return;
+	}
+#endif
+
+	err = BridgeDispatchPackage(pFile, psBridgePackageKM, ui32PID);
+
 unlock_and_return:
 	LinuxUnLockMutex(&gPVRSRVLock);
 	return err;
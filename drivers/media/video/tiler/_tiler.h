@@ -40,6 +40,7 @@
 #define _TILER_H
 
 #include <linux/kernel.h>
+#include <linux/rcupdate.h>
 #include <mach/tiler.h>
 #include "tcm.h"
 
@@ -75,11 +76,13 @@ struct gid_info {
 
 /* info for an area reserved from a container */
 struct area_info {
+	struct list_head global;	/* all areas */
 	struct list_head by_gid;	/* areas in this pid/gid */
 	struct list_head blocks;	/* blocks in this area */
 	u32 nblocks;			/* # of blocks in this area */
 
 	struct tcm_area area;		/* area details */
+	u16 align;			/* alignment area was reserved with */
 	struct gid_info *gi;		/* link to parent, if still alive */
 };
 
@@ -89,11 +92,12 @@ struct mem_info {
 	struct tiler_block_t blk;	/* block info */
 	struct tiler_pa_info pa;	/* pinned physical pages */
 	struct tcm_area area;
-	int refs;			/* number of times referenced */
+	atomic_t refs;			/* number of times referenced */
 	bool alloced;			/* still alloced */
 
 	struct list_head by_area;	/* blocks in the same area / 1D */
 	void *parent;			/* area info for 2D, else group info */
+	struct rcu_head rcu;		/* for lockless ssptr lookups */
 };
 
 /* tiler geometry information */
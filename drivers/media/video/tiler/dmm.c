@@ -24,6 +24,10 @@
 #include <linux/errno.h>
 #include <linux/slab.h>
 #include <linux/delay.h>
+#include <linux/interrupt.h>
+#include <linux/spinlock.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
 
 #include <mach/dmm.h>
 
@@ -40,12 +44,101 @@
 #define DEBUG(x, y)
 #endif
 
+/* PAT engine 0 interrupt bits */
+#define DMM_IRQ_DST		(1 << 0)	/* descriptor done */
+#define DMM_IRQ_LST		(1 << 1)	/* last descriptor done */
+#define DMM_IRQ_ERR		0x7C		/* refill errors */
+
 static struct mutex dmm_mtx;
 
 static struct omap_dmm_platform_data *device_data;
+static bool dmm_irq;			/* batches complete by interrupt */
+
+/*
+ * Queued refill batches.  The first one is being programmed by the DMM.
+ * Batches are queued under dmm_mtx, and completed under batch_lock.  The
+ * PAT interrupt is only enabled while the queue is not empty, as manual
+ * refills poll the same status bits.
+ */
+static LIST_HEAD(batch_queue);
+static DEFINE_SPINLOCK(batch_lock);
+static DECLARE_WAIT_QUEUE_HEAD(batch_idle);
+
+/* start the descriptor chain of a batch, batch_lock is held */
+static void batch_start(struct dmm_batch *batch)
+{
+	void __iomem *base = batch->dmm->base;
+
+	__raw_writel(0xFFFFFFFF, base + DMM_PAT_IRQSTATUS);
+	wmb();
+	__raw_writel(SET_FLD(0, 31, 4, batch->desc_pa >> 4),
+		     base + DMM_PAT_DESCR__0);
+	wmb();
+}
+
+static irqreturn_t dmm_isr(int irq, void *data)
+{
+	struct dmm_batch *batch, *next = NULL;
+	u32 status;
+	s32 res;
+
+	spin_lock(&batch_lock);
+	if (list_empty(&batch_queue)) {
+		/* ack a late interrupt, or the level keeps it firing */
+		status = __raw_readl(device_data->base + DMM_PAT_IRQSTATUS);
+		__raw_writel(status, device_data->base + DMM_PAT_IRQSTATUS);
+		spin_unlock(&batch_lock);
+		return status ? IRQ_HANDLED : IRQ_NONE;
+	}
+	batch = list_first_entry(&batch_queue, struct dmm_batch, list);
+
+	status = __raw_readl(batch->dmm->base + DMM_PAT_IRQSTATUS);
+	__raw_writel(status, batch->dmm->base + DMM_PAT_IRQSTATUS);
+	if (!(status & (DMM_IRQ_LST | DMM_IRQ_ERR))) {
+		spin_unlock(&batch_lock);
+		return status ? IRQ_HANDLED : IRQ_NONE;
+	}
+
+	if (status & DMM_IRQ_ERR) {
+		printk(KERN_ERR "dmm: batch refill failed (0x%x)\n", status);
+		/* stop the engine on the failed descriptor */
+		__raw_writel(0, batch->dmm->base + DMM_PAT_DESCR__0);
+		res = -EIO;
+	} else {
+		res = 0;
+	}
+
+	list_del(&batch->list);
+	if (!list_empty(&batch_queue)) {
+		next = list_first_entry(&batch_queue, struct dmm_batch, list);
+		batch_start(next);
+	} else {
+		__raw_writel(DMM_IRQ_LST | DMM_IRQ_ERR,
+			     batch->dmm->base + DMM_PAT_IRQENABLE_CLR);
+		wake_up_all(&batch_idle);
+	}
+	spin_unlock(&batch_lock);
+
+	if (batch->done)
+		batch->done(batch, res);
+	return IRQ_HANDLED;
+}
+
+static bool batch_queue_empty(void)
+{
+	unsigned long flags;
+	bool empty;
+
+	spin_lock_irqsave(&batch_lock, flags);
+	empty = list_empty(&batch_queue);
+	spin_unlock_irqrestore(&batch_lock, flags);
+	return empty;
+}
 
 static int dmm_probe(struct platform_device *pdev)
 {
+	int r;
+
 	if (!pdev || !pdev->dev.platform_data) {
 		printk(KERN_ERR "dmm: invalid platform data\n");
 		return -EINVAL;
@@ -58,6 +151,15 @@ static int dmm_probe(struct platform_device *pdev)
 	writel(0x88888888, device_data->base + DMM_TILER_OR__0);
 	writel(0x88888888, device_data->base + DMM_TILER_OR__1);
 
+	/* without the interrupt, batches are refilled one area at a time */
+	if (device_data->irq > 0) {
+		r = request_irq(device_data->irq, dmm_isr, 0, "dmm", NULL);
+		if (r)
+			printk(KERN_WARNING "dmm: no irq, not batching (%d)\n",
+									r);
+		dmm_irq = !r;
+	}
+
 	return 0;
 }
 
@@ -81,6 +183,9 @@ s32 dmm_pat_refill(struct dmm *dmm, struct pat *pd, enum pat_mode mode)
 
 	mutex_lock(&dmm_mtx);
 
+	/* the engine is shared with the refill batches */
+	wait_event(batch_idle, batch_queue_empty());
+
 	/* Check that the DMM_PAT_STATUS register has not reported an error */
 	r = dmm->base + DMM_PAT_STATUS__0;
 	v = __raw_readl(r);
@@ -210,6 +315,125 @@ refill_error:
 }
 EXPORT_SYMBOL(dmm_pat_refill);
 
+s32 dmm_batch_add(struct dmm_batch *batch, struct pat_area area, u32 data_pa)
+{
+	struct pat_desc *d;
+	u32 v;
+
+	if (batch->num >= batch->max)
+		return -ENOSPC;
+	if ((data_pa | batch->desc_pa) & 15)
+		return -EINVAL;
+
+	d = batch->desc + batch->num;
+	v = SET_FLD(0, 30, 24, area.y1);
+	v = SET_FLD(v, 23, 16, area.x1);
+	v = SET_FLD(v, 14, 8, area.y0);
+	d->area = SET_FLD(v, 7, 0, area.x0);
+	d->ctrl = SET_FLD(0, 0, 0, 1);		/* start, LUT 0, no sync */
+	d->data = data_pa;
+	d->next = 0;
+
+	/* chain to the previous descriptor */
+	if (batch->num)
+		d[-1].next = batch->desc_pa + batch->num * sizeof(*d);
+	batch->num++;
+	return 0;
+}
+EXPORT_SYMBOL(dmm_batch_add);
+
+/* refill a batch one area at a time */
+static s32 batch_refill_manual(struct dmm *dmm, struct dmm_batch *batch)
+{
+	struct pat pd = {0};
+	struct pat_desc *d;
+	s32 res = 0;
+	u32 i;
+
+	for (i = 0; i < batch->num && !res; i++) {
+		d = batch->desc + i;
+		pd.area.x0 = d->area & 0xff;
+		pd.area.y0 = (d->area >> 8) & 0x7f;
+		pd.area.x1 = (d->area >> 16) & 0xff;
+		pd.area.y1 = (d->area >> 24) & 0x7f;
+		pd.ctrl.start = 1;
+		pd.data = d->data;
+		res = dmm_pat_refill(dmm, &pd, MANUAL);
+	}
+	return res;
+}
+
+s32 dmm_pat_refill_batch(struct dmm *dmm, struct dmm_batch *batch)
+{
+	unsigned long flags;
+	s32 res;
+
+	if (!batch->num)
+		return -EINVAL;
+
+	if (!dmm_irq) {
+		res = batch_refill_manual(dmm, batch);
+		if (!res && batch->done)
+			batch->done(batch, 0);
+		return res;
+	}
+
+	mutex_lock(&dmm_mtx);
+
+	/* descriptors and page lists must reach memory first */
+	wmb();
+
+	batch->dmm = dmm;
+	spin_lock_irqsave(&batch_lock, flags);
+	list_add_tail(&batch->list, &batch_queue);
+	if (list_is_singular(&batch_queue)) {
+		batch_start(batch);
+		__raw_writel(DMM_IRQ_LST | DMM_IRQ_ERR,
+			     dmm->base + DMM_PAT_IRQENABLE_SET);
+	}
+	spin_unlock_irqrestore(&batch_lock, flags);
+
+	mutex_unlock(&dmm_mtx);
+	return 0;
+}
+EXPORT_SYMBOL(dmm_pat_refill_batch);
+
+s32 dmm_pat_cancel_batch(struct dmm *dmm, struct dmm_batch *batch)
+{
+	struct dmm_batch *b, *first;
+	unsigned long flags;
+	s32 res = -ENOENT;
+
+	spin_lock_irqsave(&batch_lock, flags);
+	list_for_each_entry(b, &batch_queue, list) {
+		if (b != batch)
+			continue;
+
+		first = list_first_entry(&batch_queue, struct dmm_batch, list);
+		list_del(&batch->list);
+		if (batch == first) {
+			/* stop the engine wherever it is in the chain */
+			__raw_writel(0, dmm->base + DMM_PAT_DESCR__0);
+			wmb();
+			if (!list_empty(&batch_queue)) {
+				batch_start(list_first_entry(&batch_queue,
+						struct dmm_batch, list));
+			} else {
+				__raw_writel(DMM_IRQ_LST | DMM_IRQ_ERR,
+					dmm->base + DMM_PAT_IRQENABLE_CLR);
+				__raw_writel(0xFFFFFFFF,
+					dmm->base + DMM_PAT_IRQSTATUS);
+				wake_up_all(&batch_idle);
+			}
+		}
+		res = 0;
+		break;
+	}
+	spin_unlock_irqrestore(&batch_lock, flags);
+	return res;
+}
+EXPORT_SYMBOL(dmm_pat_cancel_batch);
+
 struct dmm *dmm_pat_init(u32 id)
 {
 	u32 base;
@@ -266,6 +490,8 @@ static s32 __init dmm_init(void)
 
 static void __exit dmm_exit(void)
 {
+	if (dmm_irq)
+		free_irq(device_data->irq, NULL);
 	mutex_destroy(&dmm_mtx);
 	platform_driver_unregister(&dmm_driver_ldm);
 }
@@ -70,6 +70,9 @@ struct tcm {
 	s32 (*reserve_1d)(struct tcm *tcm, u32 slots, struct tcm_area *area);
 	s32 (*free)      (struct tcm *tcm, struct tcm_area *area);
 	void (*deinit)   (struct tcm *tcm);
+
+	/* optional */
+	s32 (*relocate_2d)(struct tcm *tcm, u16 align, struct tcm_area *area);
 };
 
 /*=============================================================================
@@ -216,6 +219,28 @@ static inline s32 tcm_free(struct tcm_area *area)
 	return res;
 }
 
+/**
+ * Move a reserved 2D area to a better place in its container, if the
+ * container manager supports it and finds one.  The caller must make sure
+ * nothing uses the area's slots while it moves.
+ *
+ * @param area	Pointer to area to move.  Updated to its new position.
+ * @param align	Alignment the area was reserved with.
+ *
+ * @return 1 if the area moved, 0 if it did not.  Negative error value if
+ *	   the area is invalid (-EINVAL) or the container manager cannot
+ *	   move areas (-ENOSYS).
+ */
+static inline s32 tcm_relocate_2d(struct tcm_area *area, u16 align)
+{
+	if (!area || !area->tcm || !area->is2d)
+		return -EINVAL;
+	if (!area->tcm->relocate_2d)
+		return -ENOSYS;
+
+	return area->tcm->relocate_2d(area->tcm, align, area);
+}
+
 /*=============================================================================
     HELPER FUNCTION FOR ANY TILER CONTAINER MANAGER
 =============================================================================*/
@@ -0,0 +1,375 @@
+/*
+ * tcm-pack.c
+ *
+ * Packing tiler container manager: 2D and 1D allocation(reservation)
+ * algorithm.
+ *
+ * 2D areas are placed where they touch the most busy slots and container
+ * edges, which keeps the free space in few large pieces.  Only positions
+ * at either end of a free run of columns are considered.  1D areas are
+ * taken from the end of the container, like SiTA does.
+ *
+ * Busy slots are kept in a bitmap, slot (x, y) being bit y * width + x,
+ * so 1D ranges are contiguous bit ranges.
+ *
+ * This package is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+#include <linux/slab.h>
+#include <linux/bitmap.h>
+
+#include "tcm-pack.h"
+
+#define TCM_ALG_NAME "tcm_pack"
+#include "tcm-utils.h"
+
+#define ALIGN_DOWN(value, align) ((value) & ~((align) - 1))
+
+struct pack_pvt {
+	struct mutex mtx;
+	u16 div_y;		/* 2D areas prefer rows above this */
+	unsigned long *busy;	/* busy slots */
+	unsigned long *rows;	/* busy columns of a candidate row band */
+};
+
+struct pack_fit {
+	struct tcm_area a;
+	u32 contact;		/* busy or edge slots around the area */
+	bool found;
+};
+
+static inline unsigned long *busy_row(struct tcm *tcm, u16 y)
+{
+	struct pack_pvt *pvt = (struct pack_pvt *)tcm->pvt;
+
+	return pvt->busy + y * BITS_TO_LONGS(tcm->width);
+}
+
+static inline bool slot_busy(struct tcm *tcm, u16 x, u16 y)
+{
+	struct pack_pvt *pvt = (struct pack_pvt *)tcm->pvt;
+
+	return test_bit(y * tcm->width + x, pvt->busy);
+}
+
+/* mark the slots of an area busy or free */
+static void fill_area(struct tcm *tcm, struct tcm_area *area, bool busy)
+{
+	struct pack_pvt *pvt = (struct pack_pvt *)tcm->pvt;
+	u32 start = area->p0.y * tcm->width + area->p0.x;
+	u16 y, len;
+
+	/* set area's tcm; otherwise, tcm_sizeof cannot size 1D areas */
+	area->tcm = tcm;
+	len = tcm_sizeof(*area);
+
+	if (area->is2d) {
+		len = tcm_awidth(*area);
+		for (y = area->p0.y; y <= area->p1.y; y++, start += tcm->width)
+			if (busy)
+				bitmap_set(pvt->busy, start, len);
+			else
+				bitmap_clear(pvt->busy, start, len);
+	} else if (busy) {
+		bitmap_set(pvt->busy, start, len);
+	} else {
+		bitmap_clear(pvt->busy, start, len);
+	}
+}
+
+/* number of busy or edge slots along the border of an area */
+static u32 get_contact(struct tcm *tcm, u16 x0, u16 y0, u16 w, u16 h)
+{
+	u32 contact = 0;
+	u16 i;
+
+	for (i = x0; i < x0 + w; i++) {
+		contact += y0 == 0 || slot_busy(tcm, i, y0 - 1);
+		contact += y0 + h == tcm->height || slot_busy(tcm, i, y0 + h);
+	}
+	for (i = y0; i < y0 + h; i++) {
+		contact += x0 == 0 || slot_busy(tcm, x0 - 1, i);
+		contact += x0 + w == tcm->width || slot_busy(tcm, x0 + w, i);
+	}
+
+	return contact;
+}
+
+/*
+ * Compares a candidate position to the best one so far.  Candidates come
+ * top-to-bottom, left-to-right, so on a tie the earlier one is kept.
+ *
+ * @return true if the candidate is fully surrounded, so no more searching
+ * should be performed
+ */
+static bool update_candidate(struct tcm *tcm, u16 x, u16 y, u16 w, u16 h,
+			     struct pack_fit *best)
+{
+	u32 contact = get_contact(tcm, x, y, w, h);
+
+	if (!best->found || contact > best->contact) {
+		assign(&best->a, x, y, x + w - 1, y + h - 1);
+		best->contact = contact;
+		best->found = true;
+	}
+
+	return contact == 2 * (w + h);
+}
+
+/*
+ * Find the best place for a w * h area whose rows are all above y_end.
+ * Stops early on a fully surrounded fit.
+ */
+static void scan_2d(struct tcm *tcm, u16 w, u16 h, u16 align, u16 y_end,
+		    struct pack_fit *best)
+{
+	struct pack_pvt *pvt = (struct pack_pvt *)tcm->pvt;
+	u16 longs = BITS_TO_LONGS(tcm->width);
+	unsigned long *row;
+	s32 y, i, j, s, e, first, last;
+
+	for (y = 0; y + h <= y_end; y++) {
+		/* busy columns in rows y .. y + h - 1 */
+		memcpy(pvt->rows, busy_row(tcm, y), longs * sizeof(long));
+		for (i = 1; i < h; i++) {
+			row = busy_row(tcm, y + i);
+			for (j = 0; j < longs; j++)
+				pvt->rows[j] |= row[j];
+		}
+
+		/* try both ends of each free run that is wide enough */
+		for (s = 0; s < tcm->width; s = e) {
+			s = find_next_zero_bit(pvt->rows, tcm->width, s);
+			if (s >= tcm->width)
+				break;
+			e = find_next_bit(pvt->rows, tcm->width, s);
+
+			first = ALIGN(s, align);
+			if (first + w > e)
+				continue;
+			last = ALIGN_DOWN(e - w, align);
+
+			if (update_candidate(tcm, first, y, w, h, best))
+				return;
+			if (last != first &&
+			    update_candidate(tcm, last, y, w, h, best))
+				return;
+		}
+	}
+}
+
+/* find the best place for a 2D area, preferably above the 1D region */
+static void find_2d(struct tcm *tcm, u16 w, u16 h, u16 align,
+		    struct pack_fit *best)
+{
+	struct pack_pvt *pvt = (struct pack_pvt *)tcm->pvt;
+
+	if (h <= pvt->div_y)
+		scan_2d(tcm, w, h, align, pvt->div_y, best);
+	if (!best->found && pvt->div_y < tcm->height)
+		scan_2d(tcm, w, h, align, tcm->height, best);
+}
+
+/*********************************************
+ *	TCM API - Pack Implementation
+ *********************************************/
+
+/**
+ * Reserve a 1D area in the container
+ *
+ * @param num_slots	size of 1D area
+ * @param area		pointer to the area that will be populated with the
+ *			reserved area
+ *
+ * @return 0 on success, non-0 error value on failure.
+ */
+static s32 pack_reserve_1d(struct tcm *tcm, u32 num_slots,
+			   struct tcm_area *area)
+{
+	struct pack_pvt *pvt = (struct pack_pvt *)tcm->pvt;
+	u32 end = tcm->width * tcm->height, start, busy;
+	s32 ret = -ENOSPC;
+
+	mutex_lock(&(pvt->mtx));
+
+	/*
+	 * Take the last free range that fits.  Every range ending after a
+	 * busy slot in the current window includes it, so continue below
+	 * that slot.
+	 */
+	while (end >= num_slots) {
+		start = end - num_slots;
+		busy = find_next_bit(pvt->busy, end, start);
+		if (busy >= end) {
+			assign(area, start % tcm->width, start / tcm->width,
+			       (end - 1) % tcm->width, (end - 1) / tcm->width);
+			fill_area(tcm, area, true);
+			ret = 0;
+			break;
+		}
+		end = busy;
+	}
+
+	mutex_unlock(&(pvt->mtx));
+	return ret;
+}
+
+/**
+ * Reserve a 2D area in the container
+ *
+ * @param w	width
+ * @param h	height
+ * @param area	pointer to the area that will be populated with the reserved
+ *		area
+ *
+ * @return 0 on success, non-0 error value on failure.
+ */
+static s32 pack_reserve_2d(struct tcm *tcm, u16 h, u16 w, u8 align,
+			   struct tcm_area *area)
+{
+	struct pack_pvt *pvt = (struct pack_pvt *)tcm->pvt;
+	struct pack_fit best = { .found = false };
+
+	/* not supporting more than 64 as alignment, like SiTA */
+	if (align > 64)
+		return -EINVAL;
+	align = align ? : 1;
+
+	mutex_lock(&(pvt->mtx));
+	find_2d(tcm, w, h, align, &best);
+	if (best.found) {
+		assign(area, best.a.p0.x, best.a.p0.y,
+		       best.a.p1.x, best.a.p1.y);
+		fill_area(tcm, area, true);
+	}
+	mutex_unlock(&(pvt->mtx));
+
+	return best.found ? 0 : -ENOSPC;
+}
+
+/**
+ * Move a 2D area to a better place, if there is one.
+ *
+ * @param align	alignment the area was reserved with
+ * @param area	area to move, updated to the new position
+ *
+ * @return 1 if the area moved, 0 if it stayed in place.
+ */
+static s32 pack_relocate_2d(struct tcm *tcm, u16 align, struct tcm_area *area)
+{
+	struct pack_pvt *pvt = (struct pack_pvt *)tcm->pvt;
+	struct pack_fit best = { .found = false };
+	u16 w = tcm_awidth(*area), h = tcm_aheight(*area);
+	u32 contact;
+	s32 moved = 0;
+
+	align = align ? : 1;
+
+	mutex_lock(&(pvt->mtx));
+	fill_area(tcm, area, false);
+
+	contact = get_contact(tcm, area->p0.x, area->p0.y, w, h);
+	find_2d(tcm, w, h, align, &best);
+
+	/* move if it touches more, or as much but is nearer the top left */
+	if (best.found &&
+	    (best.contact > contact ||
+	     (best.contact == contact &&
+	      (best.a.p0.y < area->p0.y ||
+	       (best.a.p0.y == area->p0.y && best.a.p0.x < area->p0.x))))) {
+		assign(area, best.a.p0.x, best.a.p0.y,
+		       best.a.p1.x, best.a.p1.y);
+		moved = 1;
+	}
+
+	fill_area(tcm, area, true);
+	mutex_unlock(&(pvt->mtx));
+
+	return moved;
+}
+
+/**
+ * Unreserve a previously allocated 2D or 1D area
+ * @param area	area to be freed
+ * @return 0 - success
+ */
+static s32 pack_free(struct tcm *tcm, struct tcm_area *area)
+{
+	struct pack_pvt *pvt = (struct pack_pvt *)tcm->pvt;
+
+	mutex_lock(&(pvt->mtx));
+
+	/* check that this is in fact an existing area */
+	WARN_ON(!slot_busy(tcm, area->p0.x, area->p0.y) ||
+		!slot_busy(tcm, area->p1.x, area->p1.y));
+
+	fill_area(tcm, area, false);
+
+	mutex_unlock(&(pvt->mtx));
+
+	return 0;
+}
+
+static void pack_deinit(struct tcm *tcm)
+{
+	struct pack_pvt *pvt = (struct pack_pvt *)tcm->pvt;
+
+	mutex_destroy(&(pvt->mtx));
+	kfree(pvt->busy);
+	kfree(pvt->rows);
+	kfree(pvt);
+	kfree(tcm);
+}
+
+struct tcm *pack_init(u16 width, u16 height, struct tcm_pt *attr)
+{
+	struct tcm *tcm;
+	struct pack_pvt *pvt;
+
+	/* rows must be whole longs for 1D ranges to be contiguous */
+	if (width == 0 || height == 0 || width % BITS_PER_LONG)
+		return NULL;
+
+	tcm = kzalloc(sizeof(*tcm), GFP_KERNEL);
+	pvt = kzalloc(sizeof(*pvt), GFP_KERNEL);
+	if (!tcm || !pvt)
+		goto error;
+
+	pvt->busy = kzalloc(BITS_TO_LONGS(width) * height * sizeof(long),
+			    GFP_KERNEL);
+	pvt->rows = kzalloc(BITS_TO_LONGS(width) * sizeof(long), GFP_KERNEL);
+	if (!pvt->busy || !pvt->rows)
+		goto error;
+
+	tcm->height = height;
+	tcm->width = width;
+	tcm->reserve_2d = pack_reserve_2d;
+	tcm->reserve_1d = pack_reserve_1d;
+	tcm->relocate_2d = pack_relocate_2d;
+	tcm->free = pack_free;
+	tcm->deinit = pack_deinit;
+	tcm->pvt = (void *)pvt;
+
+	/* Defaulting to 3:1 ratio on height for 2D and 1D split */
+	if (attr && attr->y <= height)
+		pvt->div_y = attr->y;
+	else
+		pvt->div_y = (height * 3) / 4;
+
+	mutex_init(&(pvt->mtx));
+	return tcm;
+
+error:
+	if (pvt) {
+		kfree(pvt->busy);
+		kfree(pvt->rows);
+	}
+	kfree(pvt);
+	kfree(tcm);
+	return NULL;
+}
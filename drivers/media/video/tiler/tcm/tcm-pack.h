@@ -0,0 +1,35 @@
+/*
+ * tcm-pack.h
+ *
+ * Packing tiler container manager interface.
+ *
+ * This package is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#ifndef TCM_PACK_H
+#define TCM_PACK_H
+
+#include "../tcm.h"
+
+/**
+ * Create a packing tiler container manager.
+ *
+ * @param width  Container width, must be a multiple of BITS_PER_LONG
+ * @param height Container height
+ * @param attr   preferred division point between 2D allocations (top)
+ *		 and page mode allocations (bottom).  Only the y
+ *		 coordinate is used.
+ *
+ * @return TCM instance
+ */
+struct tcm *pack_init(u16 width, u16 height, struct tcm_pt *attr);
+
+TCM_INIT(pack_init, struct tcm_pt);
+
+#endif /* TCM_PACK_H */
@@ -0,0 +1,115 @@
+/*
+ * tiler-bench.c
+ *
+ * Times TILER block lookups by system-space address against the number of
+ * allocated blocks.  Blocks are 1D container areas without backing memory,
+ * so the benchmark does not touch the PAT.
+ *
+ * This package is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * THIS PACKAGE IS PROVIDED ``AS IS'' AND WITHOUT ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, WITHOUT LIMITATION, THE IMPLIED
+ * WARRANTIES OF MERCHANTIBILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+ */
+
+#define pr_fmt(fmt) "tiler_bench: " fmt
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/err.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/vmalloc.h>
+
+#include <mach/tiler.h>
+
+static unsigned int nr_blocks = 1024;
+module_param(nr_blocks, uint, 0);
+MODULE_PARM_DESC(nr_blocks, "Largest number of blocks allocated");
+
+static unsigned int lookups = 100000;
+module_param(lookups, uint, 0);
+MODULE_PARM_DESC(lookups, "Lookups timed per block count");
+
+struct bench_block {
+	tiler_blk_handle handle;
+	u32 ssptr;
+};
+
+static int bench_lookups(struct bench_block *b, unsigned int n)
+{
+	unsigned int i;
+	ktime_t start;
+	s64 ns;
+
+	start = ktime_get();
+	for (i = 0; i < lookups; i++) {
+		struct bench_block *bb = b + random32() % n;
+		tiler_blk_handle h;
+
+		h = tiler_find_block_by_ssptr(bb->ssptr +
+					      (random32() & ~PAGE_MASK));
+		if (h != bb->handle) {
+			pr_err("lookup of %08x returned the wrong block\n",
+			       bb->ssptr);
+			if (h)
+				tiler_release_block(h);
+			return -EINVAL;
+		}
+		tiler_release_block(h);
+
+		if (!(i & 1023))
+			cond_resched();
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	pr_info("%5u blocks: %lld ns/lookup\n", n, div_s64(ns, lookups ?: 1));
+
+	return 0;
+}
+
+static int __init tiler_bench_init(void)
+{
+	struct bench_block *b;
+	unsigned int n = 0, count;
+	int r = 0;
+
+	b = vzalloc(nr_blocks * sizeof(*b));
+	if (!b)
+		return -ENOMEM;
+
+	pr_info("%u lookups per block count\n", lookups);
+	for (count = 16; !r && n < nr_blocks; count *= 2) {
+		count = min(count, nr_blocks);
+		for (; n < count; n++) {
+			b[n].handle = tiler_alloc_block_area(TILFMT_PAGE,
+						PAGE_SIZE, 1, &b[n].ssptr, NULL);
+			if (IS_ERR_OR_NULL(b[n].handle)) {
+				pr_err("could only allocate %u blocks\n", n);
+				r = -ENOMEM;
+				break;
+			}
+		}
+		if (n)
+			r = bench_lookups(b, n) ?: r;
+	}
+
+	while (n--)
+		tiler_free_block_area(b[n].handle);
+	vfree(b);
+
+	return r;
+}
+
+static void __exit tiler_bench_exit(void)
+{
+}
+
+module_init(tiler_bench_init);
+module_exit(tiler_bench_exit);
+
+MODULE_LICENSE("GPL v2");
+MODULE_DESCRIPTION("TILER block lookup benchmark");
@@ -27,17 +27,21 @@
 #include <linux/err.h>			/* IS_ERR() */
 #include <linux/errno.h>
 #include <linux/mutex.h>
+#include <linux/rcupdate.h>
 #include <linux/dma-mapping.h>		/* dma_alloc_coherent */
 #include <linux/pagemap.h>		/* page_cache_release() */
 #include <linux/slab.h>
 #include <linux/sched.h>
 #include <linux/seq_file.h>
 #include <linux/debugfs.h>
+#include <linux/vmalloc.h>
+#include <linux/completion.h>
 
 #include <mach/dmm.h>
 #include "tmm.h"
 #include "_tiler.h"
 #include "tcm/tcm-sita.h"		/* TCM algorithm */
+#include "tcm/tcm-pack.h"
 
 static bool ssptr_id = CONFIG_TILER_SSPTR_ID;
 static uint granularity = CONFIG_TILER_GRANULARITY;
@@ -64,6 +68,7 @@ static struct dentry *dbg_map;
 static struct tiler_ops tiler;		/* shared methods and variables */
 
 static struct list_head blocks;		/* all tiler blocks */
+static struct list_head areas;		/* all 2D areas */
 static struct list_head orphan_areas;	/* orphaned 2D areas */
 static struct list_head orphan_onedim;	/* orphaned 1D areas */
 
@@ -74,40 +79,123 @@ static struct class *tilerdev_class;
 static struct mutex mtx;
 static struct tcm *tcm[TILER_FORMATS];
 static struct tmm *tmm[TILER_FORMATS];
+/*
+ * Slot to block index for each container: slot_map[fmt][y * width + x] is
+ * the allocated block covering slot (x, y) in the container of fmt, for
+ * lookups by ssptr.  Updated under mtx, read under RCU.
+ */
+static struct mem_info __rcu **slot_map[TILER_FORMATS];
 static u32 *dmac_va;
 static dma_addr_t dmac_pa;
 static DEFINE_MUTEX(dmac_mtx);
+/*
+ * PAT refill batch: page lists are packed into dmac_va and refilled through
+ * one DMM descriptor chain.  Protected by dmac_mtx.
+ */
+#define PAT_BATCH_DESCS	(PAGE_SIZE / sizeof(struct pat_desc))
+#define PAT_BATCH_TIMEOUT_MS	100
+static struct pat_desc *desc_va;
+static dma_addr_t desc_pa;
+static struct dmm_batch batch;
+static u32 batch_used;			/* dmac_va entries used by batch */
+static s32 batch_status;
+static DECLARE_COMPLETION(batch_done);
+static u32 batch_refills;		/* batches refilled */
+static u32 batch_areas;			/* areas refilled in batches */
+static u32 batch_timeouts;		/* batches cancelled on timeout */
+static u32 compact_runs;		/* times areas were compacted */
+static u32 compact_moved;		/* areas moved by compaction */
 
 /*
  *  TMM connectors
  *  ==========================================================================
  */
-/* wrapper around tmm_pin */
-static s32 pin_mem_to_area(struct tmm *tmm, struct tcm_area *area, u32 *ptr)
+static void batch_complete(struct dmm_batch *b, s32 status)
+{
+	batch_status = status;
+	complete(&batch_done);
+}
+
+/* refill the areas in the batch and wait for it, dmac_mtx is held */
+static s32 batch_flush(struct tmm *tmm)
 {
 	s32 res = 0;
+
+	if (batch.num) {
+		INIT_COMPLETION(batch_done);
+		res = tmm_pin_batch(tmm, &batch);
+		if (res) {
+			res = -EFAULT;
+		} else if (wait_for_completion_timeout(&batch_done,
+				msecs_to_jiffies(PAT_BATCH_TIMEOUT_MS))) {
+			res = batch_status ? -EFAULT : 0;
+		} else if (!tmm_cancel_batch(tmm, &batch)) {
+			/* lost interrupt or stalled chain, done is not called */
+			printk(KERN_ERR "tiler: PAT refill of %u areas timed out\n",
+			       batch.num);
+			batch_timeouts++;
+			res = -ETIMEDOUT;
+		} else {
+			/* completed while timing out, done is being called */
+			wait_for_completion(&batch_done);
+			res = batch_status ? -EFAULT : 0;
+		}
+		batch_refills++;
+		batch_areas += batch.num;
+	}
+
+	dmm_batch_init(&batch, desc_va, desc_pa, PAT_BATCH_DESCS);
+	batch.done = batch_complete;
+	batch_used = 0;
+	return res;
+}
+
+/* add the slices of an area to the batch, dmac_mtx is held */
+static s32 batch_add(struct tmm *tmm, struct tcm_area *area, u32 *ptr)
+{
 	struct pat_area p_area = {0};
 	struct tcm_area slice, area_s;
+	u32 n;
+	s32 res;
 
-	/* Ensure the data reaches to main memory before PAT refill */
-	wmb();
-
-	mutex_lock(&dmac_mtx);
 	tcm_for_each_slice(slice, *area, area_s) {
 		p_area.x0 = slice.p0.x;
 		p_area.y0 = slice.p0.y;
 		p_area.x1 = slice.p1.x;
 		p_area.y1 = slice.p1.y;
+		n = tcm_sizeof(slice);
+
+		/* page lists must be 16-byte aligned */
+		if (batch.num == batch.max ||
+		    batch_used + n > tiler.width * tiler.height) {
+			res = batch_flush(tmm);
+			if (res)
+				return res;
+		}
 
-		memcpy(dmac_va, ptr, sizeof(*ptr) * tcm_sizeof(slice));
-		ptr += tcm_sizeof(slice);
+		memcpy(dmac_va + batch_used, ptr, sizeof(*ptr) * n);
+		ptr += n;
 
-		/* pin memory into DMM */
-		if (tmm_pin(tmm, p_area, dmac_pa)) {
-			res = -EFAULT;
-			break;
-		}
+		res = dmm_batch_add(&batch, p_area,
+				    dmac_pa + batch_used * sizeof(*dmac_va));
+		if (res)
+			return res;
+		batch_used += ALIGN(n, 16 / sizeof(*dmac_va));
 	}
+	return 0;
+}
+
+/* wrapper around tmm_pin_batch */
+static s32 pin_mem_to_area(struct tmm *tmm, struct tcm_area *area, u32 *ptr)
+{
+	s32 res;
+
+	/* Ensure the data reaches to main memory before PAT refill */
+	wmb();
+
+	mutex_lock(&dmac_mtx);
+	res = batch_add(tmm, area, ptr);
+	res = batch_flush(tmm) ? : res;
 	mutex_unlock(&dmac_mtx);
 
 	return res;
@@ -334,6 +422,45 @@ static const struct file_operations tiler_debug_fops = {
 	.release        = single_release,
 };
 
+/*
+ *  Slot index methods
+ *  ==========================================================================
+ */
+
+/* (must have mutex) point the slots of a block at @to, or clear them */
+static void _m_set_slots(struct mem_info *mi, struct mem_info *to)
+{
+	enum tiler_fmt fmt = tiler_fmt(mi->blk.phys);
+	struct mem_info __rcu **map;
+	struct tcm_area slice, area_s;
+	u16 x, y;
+
+	if (fmt == TILFMT_INVALID || !slot_map[fmt])
+		return;
+
+	tcm_for_each_slice(slice, mi->area, area_s) {
+		for (y = slice.p0.y; y <= slice.p1.y; y++) {
+			map = slot_map[fmt] + y * tiler.width;
+			for (x = slice.p0.x; x <= slice.p1.x; x++)
+				if (to || rcu_dereference_protected(map[x],
+						lockdep_is_held(&mtx)) == mi)
+					rcu_assign_pointer(map[x], to);
+		}
+	}
+}
+
+/* (must have mutex) make an allocated block findable by ssptr */
+static inline void _m_index_block(struct mem_info *mi)
+{
+	_m_set_slots(mi, mi);
+}
+
+/* (must have mutex) */
+static inline void _m_unindex_block(struct mem_info *mi)
+{
+	_m_set_slots(mi, NULL);
+}
+
 /*
  *  gid_info handling methods
  *  ==========================================================================
@@ -418,11 +545,64 @@ static void release_gi(struct gid_info *gi)
  *  ==========================================================================
  */
 
+/*
+ * (must have mutex) an area can move if none of its blocks were handed out:
+ * nobody knows their address, and nothing is pinned behind them
+ */
+static bool _m_area_movable(struct area_info *ai)
+{
+	struct mem_info *mi;
+
+	list_for_each_entry(mi, &ai->blocks, by_area)
+		if (mi->alloced || atomic_read(&mi->refs) || mi->pa.mem ||
+		    mi->blk.phys)
+			return false;
+	return true;
+}
+
+/*
+ * (must have mutex) move reserved 2D areas of a container to better places
+ * to make room.  Returns the number of areas moved.
+ */
+static u32 _m_compact(struct tcm *tcm)
+{
+	struct area_info *ai;
+	struct mem_info *mi;
+	struct tcm_pt p0;
+	s32 dx, dy;
+	u32 moved = 0;
+
+	list_for_each_entry(ai, &areas, global) {
+		if (ai->area.tcm != tcm || !_m_area_movable(ai))
+			continue;
+
+		p0 = ai->area.p0;
+		if (tcm_relocate_2d(&ai->area, ai->align) <= 0)
+			continue;
+
+		/* blocks keep their place within the area */
+		dx = ai->area.p0.x - p0.x;
+		dy = ai->area.p0.y - p0.y;
+		list_for_each_entry(mi, &ai->blocks, by_area) {
+			mi->area.p0.x += dx;
+			mi->area.p1.x += dx;
+			mi->area.p0.y += dy;
+			mi->area.p1.y += dy;
+		}
+		moved++;
+	}
+
+	compact_runs++;
+	compact_moved += moved;
+	return moved;
+}
+
 /* allocate an reserved area of size, alignment and link it to gi */
 /* leaves mutex locked to be able to add block to area */
 static struct area_info *area_new_m(u16 width, u16 height, u16 align,
 				  struct tcm *tcm, struct gid_info *gi)
 {
+	u32 moved;
 	struct area_info *ai = kmalloc(sizeof(*ai), GFP_KERNEL);
 	if (!ai)
 		return NULL;
@@ -431,14 +611,23 @@ static struct area_info *area_new_m(u16 width, u16 height, u16 align,
 	memset(ai, 0x0, sizeof(*ai));
 	INIT_LIST_HEAD(&ai->blocks);
 
-	/* reserve an allocation area */
+	/* reserve an allocation area, compacting the container if full */
 	if (tcm_reserve_2d(tcm, width, height, align, &ai->area)) {
-		kfree(ai);
-		return NULL;
+		mutex_lock(&mtx);
+		moved = _m_compact(tcm);
+		mutex_unlock(&mtx);
+
+		if (!moved ||
+		    tcm_reserve_2d(tcm, width, height, align, &ai->area)) {
+			kfree(ai);
+			return NULL;
+		}
 	}
 
 	ai->gi = gi;
+	ai->align = align;
 	mutex_lock(&mtx);
+	list_add_tail(&ai->global, &areas);
 	list_add_tail(&ai->by_gid, &gi->areas);
 	return ai;
 }
@@ -447,6 +636,7 @@ static struct area_info *area_new_m(u16 width, u16 height, u16 align,
 static inline void _m_area_free(struct area_info *ai)
 {
 	if (ai) {
+		list_del(&ai->global);
 		list_del(&ai->by_gid);
 		kfree(ai);
 	}
@@ -730,7 +920,7 @@ static s32 lay_nv12(int n, u16 w, u16 w1, u16 h, struct gid_info *gi, u8 *p)
 	struct list_head *pos;
 
 	/* reserve area */
-	ai = area_new_m(w, h, a, TILFMT_8BIT, gi);
+	ai = area_new_m(w, h, a, tcm[TILFMT_8BIT], gi);
 	if (!ai)
 		return -ENOMEM;
 
@@ -797,6 +987,8 @@ static s32 _m_free(struct mem_info *mi)
 
 	_m_unpin(mi);
 
+	_m_unindex_block(mi);
+
 	/* safe deletion as list may not have been assigned */
 	if (mi->global.next)
 		list_del(&mi->global);
@@ -817,6 +1009,7 @@ static s32 _m_free(struct mem_info *mi)
 							   ai->area.p0.y, ai->area.p1.y);
 
 			res = tcm_free(&ai->area);
+			list_del(&ai->global);
 			list_del(&ai->by_gid);
 			/* try to remove parent if it became empty */
 			_m_try_free_group(ai->gi);
@@ -840,7 +1033,8 @@ static s32 _m_free(struct mem_info *mi)
 		_m_try_free_group(mi->parent);
 	}
 
-	kfree(mi);
+	/* lockless ssptr lookups may still be looking at the block */
+	kfree_rcu(mi, rcu);
 	return res;
 }
 
@@ -848,7 +1042,7 @@ static s32 _m_free(struct mem_info *mi)
 static bool _m_chk_ref(struct mem_info *mi)
 {
 	/* check references */
-	if (mi->refs)
+	if (atomic_read(&mi->refs))
 		return 0;
 
 	if (_m_free(mi))
@@ -860,7 +1054,7 @@ static bool _m_chk_ref(struct mem_info *mi)
 /* (must have mutex) */
 static inline bool _m_dec_ref(struct mem_info *mi)
 {
-	if (mi->refs-- <= 1)
+	if (atomic_dec_return(&mi->refs) <= 0)
 		return _m_chk_ref(mi);
 
 	return 0;
@@ -869,14 +1063,14 @@ static inline bool _m_dec_ref(struct mem_info *mi)
 /* (must have mutex) */
 static inline void _m_inc_ref(struct mem_info *mi)
 {
-	mi->refs++;
+	atomic_inc(&mi->refs);
 }
 
 /* (must have mutex) returns true if block was freed */
 static inline bool _m_try_free(struct mem_info *mi)
 {
 	if (mi->alloced) {
-		mi->refs--;
+		atomic_dec(&mi->refs);
 		mi->alloced = false;
 	}
 	return _m_chk_ref(mi);
@@ -925,7 +1119,7 @@ find_n_lock(u32 key, u32 id, struct gid_info *gi) {
 done:
 	/* lock block by increasing its ref count */
 	if (mi)
-		mi->refs++;
+		atomic_inc(&mi->refs);
 
 	mutex_unlock(&mtx);
 
@@ -935,6 +1129,10 @@ done:
 /* unlock a block, and optionally free it */
 static void unlock_n_free(struct mem_info *mi, bool free)
 {
+	/* dropping a reference that is not the last one needs no mutex */
+	if (!free && atomic_add_unless(&mi->refs, -1, 1))
+		return;
+
 	mutex_lock(&mtx);
 
 	_m_dec_ref(mi);
@@ -1011,7 +1209,7 @@ static void release_blocks(struct list_head *reserved)
 
 	/* find block in global list and free it */
 	list_for_each_entry_safe(mi, mi_, reserved, global) {
-		BUG_ON(mi->refs || mi->alloced);
+		BUG_ON(atomic_read(&mi->refs) || mi->alloced);
 		_m_free(mi);
 	}
 	mutex_unlock(&mtx);
@@ -1025,38 +1223,38 @@ static void add_reserved_blocks(struct list_head *reserved, struct gid_info *gi)
 	mutex_unlock(&mtx);
 }
 
-/* find a block by ssptr */
+/* find a block by ssptr and lock it (does not take the mutex) */
 static struct mem_info *find_block_by_ssptr(u32 sys_addr)
 {
 	struct mem_info *i;
-	struct tcm_pt pt;
 	u32 x, y;
 	enum tiler_fmt fmt;
 	const struct tiler_geom *g;
 
 	fmt = tiler_fmt(sys_addr);
-	if (fmt == TILFMT_INVALID)
+	if (fmt == TILFMT_INVALID || !slot_map[fmt])
 		return NULL;
 
 	g = tiler.geom(fmt);
 
 	/* convert x & y pixel coordinates to slot coordinates */
 	tiler.xy(sys_addr, &x, &y);
-	pt.x = x / g->slot_w;
-	pt.y = y / g->slot_h;
+	x /= g->slot_w;
+	y /= g->slot_h;
+	if (x >= tiler.width || y >= tiler.height)
+		return NULL;
 
-	mutex_lock(&mtx);
-	list_for_each_entry(i, &blocks, global) {
-		if (tiler_fmt(i->blk.phys) == tiler_fmt(sys_addr) &&
-		    tcm_is_in(pt, i->area)) {
-			i->refs++;
-			goto found;
-		}
-	}
-	i = NULL;
+	/*
+	 * Blocks being freed have no references left, and are not freed
+	 * before an RCU grace period.
+	 */
+	rcu_read_lock();
+	i = rcu_dereference(slot_map[fmt][y * tiler.width + x]);
+	if (i && (tiler_fmt(i->blk.phys) != fmt ||
+		  !atomic_inc_not_zero(&i->refs)))
+		i = NULL;
+	rcu_read_unlock();
 
-found:
-	mutex_unlock(&mtx);
 	return i;
 }
 
@@ -1123,14 +1321,15 @@ static struct mem_info *alloc_area(enum tiler_fmt fmt, u32 width, u32 height,
 		mutex_lock(&mtx);
 	}
 
+	mi->blk.phys = tiler.addr(fmt,
+		mi->area.p0.x * g->slot_w, mi->area.p0.y * g->slot_h);
 	list_add(&mi->global, &blocks);
 	mi->alloced = true;
-	mi->refs++;
+	atomic_inc(&mi->refs);
 	gi->refs--;
+	_m_index_block(mi);
 	mutex_unlock(&mtx);
 
-	mi->blk.phys = tiler.addr(fmt,
-		mi->area.p0.x * g->slot_w, mi->area.p0.y * g->slot_h);
 	return mi;
 }
 
@@ -1455,6 +1654,62 @@ s32 tiler_pin_block(tiler_blk_handle block, u32 *addr_array, u32 nents)
 }
 EXPORT_SYMBOL(tiler_pin_block);
 
+s32 tiler_pin_block_range(tiler_blk_handle block, u32 offset, u32 *addr_array,
+			  u32 nents)
+{
+	struct tcm_area area;
+	u32 size, x, i, dummy, *mem;
+	int res;
+
+	if (tiler_fmt(block->blk.phys) != TILFMT_PAGE ||
+	    !tmm_can_pin(tmm[TILFMT_PAGE]))
+		return -EINVAL;
+
+	size = tcm_sizeof(block->area);
+	if (!nents || offset > size || nents > size - offset)
+		return -EINVAL;
+
+	dummy = tmm_dummy_pa(tmm[TILFMT_PAGE]);
+
+	mutex_lock(&mtx);
+
+	/*
+	 * keep the full page list of the block for restoring the PAT.  Slots
+	 * not pinned yet point to the dummy page, as after tmm_unpin.
+	 */
+	if (!block->pa.mem) {
+		mem = kmalloc(sizeof(*mem) * size, GFP_KERNEL);
+		if (!mem) {
+			res = -ENOMEM;
+			goto done;
+		}
+		for (i = 0; i < size; i++)
+			mem[i] = dummy;
+		block->pa.mem = mem;
+		block->pa.memtype = TILER_MEM_USING;
+		block->pa.num_pg = 0;
+	} else if (block->pa.memtype != TILER_MEM_USING) {
+		res = -EINVAL;
+		goto done;
+	}
+	/* a 0 address leaves the slot unmapped */
+	for (i = 0; i < nents; i++)
+		block->pa.mem[offset + i] = addr_array[i] ? : dummy;
+	block->pa.num_pg = max(block->pa.num_pg, offset + nents);
+
+	/* refill only the slots of the range */
+	area = block->area;
+	x = area.p0.x + offset;
+	area.p0.y += x / area.tcm->width;
+	area.p0.x = x % area.tcm->width;
+	tcm_1d_limit(&area, nents);
+	res = pin_mem_to_area(tmm[TILFMT_PAGE], &area, block->pa.mem + offset);
+done:
+	mutex_unlock(&mtx);
+	return res;
+}
+EXPORT_SYMBOL(tiler_pin_block_range);
+
 /*
  *  Driver code
  *  ==========================================================================
@@ -1474,13 +1729,17 @@ static int tiler_resume(struct device *pdev)
 	mutex_unlock(&dmac_mtx);
 
 	/* iterate over all the blocks and refresh the PAT entries */
+	mutex_lock(&dmac_mtx);
 	list_for_each_entry(mi, &blocks, global) {
 		if (mi->pa.mem)
-			if (pin_mem_to_area(tmm[tiler_fmt(mi->blk.phys)],
+			if (batch_add(tmm[tiler_fmt(mi->blk.phys)],
 						&mi->area, mi->pa.mem))
 				printk(KERN_ERR "Failed PAT restore - %08x\n",
 					mi->blk.phys);
 	}
+	if (batch_flush(tmm[TILFMT_PAGE]))
+		printk(KERN_ERR "Failed PAT restore\n");
+	mutex_unlock(&dmac_mtx);
 
 	return 0;
 }
@@ -1506,7 +1765,7 @@ static s32 __init tiler_init(void)
 	s32 r = -1;
 	struct device *device = NULL;
 	struct tcm_pt div_pt;
-	struct tcm *sita = NULL;
+	struct tcm *container = NULL;
 	struct tmm *tmm_pat = NULL;
 	struct pat_area area = {0};
 
@@ -1552,15 +1811,29 @@ static s32 __init tiler_init(void)
 	if (!dmac_va)
 		return -ENOMEM;
 
+	/* PAT descriptors for batched refills */
+	desc_va = dma_alloc_coherent(NULL, PAGE_SIZE, &desc_pa, GFP_KERNEL);
+	if (!desc_va) {
+		dma_free_coherent(NULL, tiler.width * tiler.height *
+					sizeof(*dmac_va), dmac_va, dmac_pa);
+		return -ENOMEM;
+	}
+	dmm_batch_init(&batch, desc_va, desc_pa, PAT_BATCH_DESCS);
+	batch.done = batch_complete;
+
 	/* Allocate tiler container manager (we share 1 on OMAP4) */
 	div_pt.x = tiler.width;   /* hardcoded default */
 	div_pt.y = (3 * tiler.height) / 4;
-	sita = sita_init(tiler.width, tiler.height, (void *)&div_pt);
+#ifdef CONFIG_TILER_TCM_PACK
+	container = pack_init(tiler.width, tiler.height, &div_pt);
+#else
+	container = sita_init(tiler.width, tiler.height, (void *)&div_pt);
+#endif
 
-	tcm[TILFMT_8BIT]  = sita;
-	tcm[TILFMT_16BIT] = sita;
-	tcm[TILFMT_32BIT] = sita;
-	tcm[TILFMT_PAGE]  = sita;
+	tcm[TILFMT_8BIT]  = container;
+	tcm[TILFMT_16BIT] = container;
+	tcm[TILFMT_32BIT] = container;
+	tcm[TILFMT_PAGE]  = container;
 
 	/* Allocate tiler memory manager (must have 1 unique TMM per TCM ) */
 	tmm_pat = tmm_pat_init(0, dmac_va, dmac_pa);
@@ -1569,6 +1842,13 @@ static s32 __init tiler_init(void)
 	tmm[TILFMT_32BIT] = tmm_pat;
 	tmm[TILFMT_PAGE]  = tmm_pat;
 
+	/* Allocate slot index (one per TCM, so we share 1 also) */
+	slot_map[TILFMT_8BIT] = vzalloc(tiler.width * tiler.height *
+						sizeof(**slot_map));
+	slot_map[TILFMT_16BIT] = slot_map[TILFMT_8BIT];
+	slot_map[TILFMT_32BIT] = slot_map[TILFMT_8BIT];
+	slot_map[TILFMT_PAGE]  = slot_map[TILFMT_8BIT];
+
 	/* Clear out all PAT entries */
 	area.x1 = tiler.width - 1;
 	area.y1 = tiler.height - 1;
@@ -1579,7 +1859,8 @@ static s32 __init tiler_init(void)
 #endif
 
 	tiler_device = kmalloc(sizeof(*tiler_device), GFP_KERNEL);
-	if (!tiler_device || !sita || !tmm_pat) {
+	if (!tiler_device || !container || !tmm_pat ||
+	    !slot_map[TILFMT_8BIT]) {
 		r = -ENOMEM;
 		goto error;
 	}
@@ -1616,6 +1897,7 @@ static s32 __init tiler_init(void)
 
 	mutex_init(&mtx);
 	INIT_LIST_HEAD(&blocks);
+	INIT_LIST_HEAD(&areas);
 	INIT_LIST_HEAD(&orphan_areas);
 	INIT_LIST_HEAD(&orphan_onedim);
 
@@ -1624,6 +1906,18 @@ static s32 __init tiler_init(void)
 		dev_warn(device, "failed to create debug files.\n");
 	else
 		dbg_map = debugfs_create_dir("map", dbgfs);
+	if (!IS_ERR_OR_NULL(dbgfs)) {
+		debugfs_create_u32("compact_runs", S_IRUGO, dbgfs,
+							&compact_runs);
+		debugfs_create_u32("compact_moved", S_IRUGO, dbgfs,
+							&compact_moved);
+		debugfs_create_u32("batch_refills", S_IRUGO, dbgfs,
+							&batch_refills);
+		debugfs_create_u32("batch_areas", S_IRUGO, dbgfs,
+							&batch_areas);
+		debugfs_create_u32("batch_timeouts", S_IRUGO, dbgfs,
+							&batch_timeouts);
+	}
 	if (!IS_ERR_OR_NULL(dbg_map)) {
 		int i;
 		for (i = 0; i < ARRAY_SIZE(debugfs_maps); i++)
@@ -1636,10 +1930,12 @@ error:
 	/* TODO: error handling for device registration */
 	if (r) {
 		kfree(tiler_device);
-		tcm_deinit(sita);
+		tcm_deinit(container);
 		tmm_deinit(tmm_pat);
+		vfree(slot_map[TILFMT_8BIT]);
 		dma_free_coherent(NULL, tiler.width * tiler.height *
 					sizeof(*dmac_va), dmac_va, dmac_pa);
+		dma_free_coherent(NULL, PAGE_SIZE, desc_va, desc_pa);
 	}
 
 	return r;
@@ -1665,6 +1961,7 @@ static void __exit tiler_exit(void)
 
 	dma_free_coherent(NULL, tiler.width * tiler.height * sizeof(*dmac_va),
 							dmac_va, dmac_pa);
+	dma_free_coherent(NULL, PAGE_SIZE, desc_va, desc_pa);
 
 	/* close containers only once */
 	for (i = TILFMT_MIN; i <= TILFMT_MAX; i++) {
@@ -1679,6 +1976,9 @@ static void __exit tiler_exit(void)
 		tmm_deinit(tmm[i]);
 	}
 
+	/* slot index is shared by all formats on OMAP4 */
+	vfree(slot_map[TILFMT_8BIT]);
+
 	mutex_destroy(&mtx);
 	platform_driver_unregister(&tiler_driver_ldm);
 	cdev_del(&tiler_device->cdev);
@@ -1765,6 +2065,18 @@ u32 tiler_block_vstride(tiler_blk_handle block)
 }
 EXPORT_SYMBOL(tiler_block_vstride);
 
+tiler_blk_handle tiler_find_block_by_ssptr(u32 ssptr)
+{
+	return find_block_by_ssptr(ssptr);
+}
+EXPORT_SYMBOL(tiler_find_block_by_ssptr);
+
+void tiler_release_block(tiler_blk_handle block)
+{
+	unlock_n_free(block, false);
+}
+EXPORT_SYMBOL(tiler_release_block);
+
 MODULE_LICENSE("GPL v2");
 MODULE_AUTHOR("Lajos Molnar <molnar@ti.com>");
 MODULE_AUTHOR("David Sin <davidsin@ti.com>");
@@ -268,6 +268,20 @@ static s32 tmm_pat_pin(struct tmm *tmm, struct pat_area area, u32 page_pa)
 	return dmm_pat_refill(pvt->dmm, &pat_desc, MANUAL);
 }
 
+static s32 tmm_pat_pin_batch(struct tmm *tmm, struct dmm_batch *batch)
+{
+	struct dmm_mem *pvt = (struct dmm_mem *) tmm->pvt;
+
+	return dmm_pat_refill_batch(pvt->dmm, batch);
+}
+
+static s32 tmm_pat_cancel_batch(struct tmm *tmm, struct dmm_batch *batch)
+{
+	struct dmm_mem *pvt = (struct dmm_mem *) tmm->pvt;
+
+	return dmm_pat_cancel_batch(pvt->dmm, batch);
+}
+
 static void tmm_pat_unpin(struct tmm *tmm, struct pat_area area)
 {
 	u16 w = (u8) area.x1 - (u8) area.x0;
@@ -281,6 +295,13 @@ static void tmm_pat_unpin(struct tmm *tmm, struct pat_area area)
 	tmm_pat_pin(tmm, area, pvt->dmac_pa);
 }
 
+static u32 tmm_pat_dummy(struct tmm *tmm)
+{
+	struct dmm_mem *pvt = (struct dmm_mem *) tmm->pvt;
+
+	return pvt->dummy_pa;
+}
+
 struct tmm *tmm_pat_init(u32 pat_id, u32 *dmac_va, u32 dmac_pa)
 {
 	struct tmm *tmm = NULL;
@@ -313,7 +334,10 @@ struct tmm *tmm_pat_init(u32 pat_id, u32 *dmac_va, u32 dmac_pa)
 		tmm->get = tmm_pat_get_pages;
 		tmm->free = tmm_pat_free_pages;
 		tmm->pin = tmm_pat_pin;
+		tmm->pin_batch = tmm_pat_pin_batch;
+		tmm->cancel_batch = tmm_pat_cancel_batch;
 		tmm->unpin = tmm_pat_unpin;
+		tmm->dummy = tmm_pat_dummy;
 
 		return tmm;
 	}
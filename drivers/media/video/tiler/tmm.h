@@ -50,7 +50,10 @@ struct tmm {
 	u32 *(*get)	(struct tmm *tmm, u32 num_pages);
 	void (*free)	(struct tmm *tmm, u32 *pages);
 	s32  (*pin)	(struct tmm *tmm, struct pat_area area, u32 page_pa);
+	s32  (*pin_batch)(struct tmm *tmm, struct dmm_batch *batch);
+	s32  (*cancel_batch)(struct tmm *tmm, struct dmm_batch *batch);
 	void (*unpin)	(struct tmm *tmm, struct pat_area area);
+	u32  (*dummy)	(struct tmm *tmm);
 	void (*deinit)	(struct tmm *tmm);
 };
 
@@ -90,6 +93,32 @@ s32 tmm_pin(struct tmm *tmm, struct pat_area area, u32 page_pa)
 	return -ENODEV;
 }
 
+/**
+ * Program the physical address translator for a batch of areas.  Returns
+ * before the areas are programmed, batch->done is called on completion.
+ * @param batch PAT refill batch
+ */
+static inline
+s32 tmm_pin_batch(struct tmm *tmm, struct dmm_batch *batch)
+{
+	if (tmm && tmm->pin_batch && tmm->pvt)
+		return tmm->pin_batch(tmm, batch);
+	return -ENODEV;
+}
+
+/**
+ * Cancels a batch queued by tmm_pin_batch, e.g. if it did not complete in
+ * time.  batch->done is not called once this succeeds.
+ * @param batch PAT refill batch
+ */
+static inline
+s32 tmm_cancel_batch(struct tmm *tmm, struct dmm_batch *batch)
+{
+	if (tmm && tmm->cancel_batch && tmm->pvt)
+		return tmm->cancel_batch(tmm, batch);
+	return -ENODEV;
+}
+
 /**
  * Clears the physical address translator.
  * @param area PAT area
@@ -101,6 +130,17 @@ void tmm_unpin(struct tmm *tmm, struct pat_area area)
 		tmm->unpin(tmm, area);
 }
 
+/**
+ * Returns the physical address of the page unpinned PAT entries point to.
+ */
+static inline
+u32 tmm_dummy_pa(struct tmm *tmm)
+{
+	if (tmm && tmm->dummy && tmm->pvt)
+		return tmm->dummy(tmm);
+	return 0;
+}
+
 /**
  * Checks whether tiler memory manager supports mapping
  */
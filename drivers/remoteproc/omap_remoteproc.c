@@ -308,7 +308,7 @@ static int omap_rproc_iommu_init(struct rproc *rproc,
 	rpp->iommu_cb = callback;
 	rproc->priv = rpp;
 
-	if (!rproc->secure_mode) {
+	if (!rproc->secure_mode && !rproc->iommu_mapped) {
 		for (i = 0; rproc->memory_maps[i].size; i++) {
 			const struct rproc_mem_entry *me =
 							&rproc->memory_maps[i];
@@ -543,6 +543,24 @@ err:
 	return ret;
 }
 
+/* the remote processor timestamps its events with its first timer */
+static int omap_rproc_read_clock(struct rproc *rproc, u32 *counter)
+{
+	struct omap_rproc_pdata *pdata = rproc->dev->platform_data;
+	struct omap_dm_timer *odt;
+
+	if (!pdata->timers_cnt)
+		return -ENODEV;
+
+	odt = pdata->timers[0].odt;
+	/* the timers are stopped while the remote processor is idled */
+	if (!odt || !odt->enabled)
+		return -EAGAIN;
+
+	*counter = omap_dm_timer_read_counter(odt);
+	return 0;
+}
+
 static int omap_rproc_set_lat(struct rproc *rproc, long val)
 {
 	pm_qos_update_request(rproc->qos_request, val);
@@ -575,6 +593,7 @@ static struct rproc_ops omap_rproc_ops = {
 	.watchdog_exit = omap_rproc_watchdog_exit,
 #endif
 	.dump_registers = omap_rproc_dump_registers,
+	.read_clock = omap_rproc_read_clock,
 };
 
 static int omap_rproc_probe(struct platform_device *pdev)
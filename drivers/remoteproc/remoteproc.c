@@ -39,6 +39,8 @@
 #include <linux/uaccess.h>
 #include <linux/elf.h>
 #include <linux/elfcore.h>
+#include <linux/poll.h>
+#include <linux/log2.h>
 #include <plat/remoteproc.h>
 
 /* list of available remote processors on this board */
@@ -48,6 +50,12 @@ static DEFINE_SPINLOCK(rprocs_lock);
 /* debugfs parent dir */
 static struct dentry *rproc_dbg;
 
+/* delay before fetching the firmware images ahead of first use, 0 = never */
+static unsigned int preload_ms;
+module_param(preload_ms, uint, 0444);
+MODULE_PARM_DESC(preload_ms,
+	"Fetch firmware images this many ms after registration (0 = never)");
+
 static ssize_t rproc_format_trace_buf(char __user *userbuf, size_t count,
 				    loff_t *ppos, const void *src, int size)
 {
@@ -125,12 +133,335 @@ static ssize_t rproc_version_read(struct file *filp, char __user *userbuf,
 	return simple_read_from_buffer(userbuf, count, ppos, pch, len);
 }
 
+static ssize_t rproc_boot_stats_read(struct file *filp, char __user *userbuf,
+						size_t count, loff_t *ppos)
+{
+	struct rproc *rproc = filp->private_data;
+	struct rproc_boot_stats *bs = &rproc->boot_stats;
+	char buf[256];
+	int i;
+
+	i = scnprintf(buf, sizeof(buf),
+		"last boot: %s\n"
+		"fetch: %lld us\nload: %lld us\niommu: %lld us\n"
+		"start: %lld us\ntotal: %lld us\n"
+		"cold boots: %u\nwarm boots: %u\n",
+		bs->warm ? "warm" : "cold",
+		ktime_to_us(bs->fetch), ktime_to_us(bs->load),
+		ktime_to_us(bs->iommu), ktime_to_us(bs->start),
+		ktime_to_us(bs->total), bs->cold_boots, bs->warm_boots);
+
+	return simple_read_from_buffer(userbuf, count, ppos, buf, i);
+}
+
+static ssize_t rproc_retain_read(struct file *filp, char __user *userbuf,
+						size_t count, loff_t *ppos)
+{
+	struct rproc *rproc = filp->private_data;
+	char buf[4];
+	int i;
+
+	i = scnprintf(buf, sizeof(buf), "%d\n", rproc->retain);
+
+	return simple_read_from_buffer(userbuf, count, ppos, buf, i);
+}
+
+static void rproc_drop_image(struct rproc *rproc);
+
+/*
+ * Writing 0 drops the retained image, e.g. to pick up a new firmware file,
+ * and stops retaining it; writing 1 retains the image of the next boot.
+ */
+static ssize_t rproc_retain_write(struct file *filp,
+		const char __user *userbuf, size_t count, loff_t *ppos)
+{
+	struct rproc *rproc = filp->private_data;
+	char buf[4];
+	int len, ret = count;
+
+	len = min(sizeof(buf) - 1, count);
+	if (copy_from_user(buf, userbuf, len))
+		return -EFAULT;
+	buf[len] = '\0';
+
+	if (buf[0] != '0' && buf[0] != '1')
+		return -EINVAL;
+
+	mutex_lock(&rproc->lock);
+	/* the image may be in use while the processor is */
+	if (rproc->count) {
+		ret = -EBUSY;
+		goto unlock;
+	}
+	rproc->retain = buf[0] == '1';
+	if (!rproc->retain)
+		rproc_drop_image(rproc);
+unlock:
+	mutex_unlock(&rproc->lock);
+	return ret;
+}
+
 static int rproc_open_generic(struct inode *inode, struct file *file)
 {
 	file->private_data = inode->i_private;
 	return 0;
 }
 
+/* how often the event log is polled for new events while it has readers */
+#define RPROC_EVLOG_POLL_MS	10
+/* events formatted per read() call, and room for each of them */
+#define RPROC_EVLOG_BATCH	32
+#define RPROC_EVLOG_LINE	64
+
+static const char * const rproc_evlog_names[] = {
+	[RPROC_EVLOG_LOAD]		= "load",
+	[RPROC_EVLOG_IDLE_ENTER]	= "idle_enter",
+	[RPROC_EVLOG_IDLE_EXIT]		= "idle_exit",
+	[RPROC_EVLOG_FRAME_BEGIN]	= "frame_begin",
+	[RPROC_EVLOG_FRAME_END]		= "frame_end",
+	[RPROC_EVLOG_MARK]		= "mark",
+};
+
+struct rproc_evlog_reader {
+	struct rproc *rproc;
+	unsigned gen;
+	u32 pos;
+};
+
+/* must be called with rproc->lock held */
+static void rproc_evlog_init(struct rproc *rproc)
+{
+	struct rproc_evlog_hdr *hdr = rproc->evlog;
+
+	if (!hdr)
+		return;
+
+	/* the remote may write the header, so only this copy of num is used */
+	rproc->evlog_num = rounddown_pow_of_two((rproc->evlog_len -
+			sizeof(*hdr)) / sizeof(struct rproc_evlog_entry));
+
+	hdr->magic = 0;
+	wmb();
+	hdr->num = rproc->evlog_num;
+	hdr->clock_rate = 0;
+	hdr->head = 0;
+	wmb();
+	hdr->magic = RPROC_EVLOG_MAGIC;
+
+	rproc->evlog_head = 0;
+	rproc->evlog_gen++;
+	wake_up_interruptible(&rproc->evlog_wq);
+}
+
+static void rproc_evlog_work(struct work_struct *work)
+{
+	struct rproc *rproc = container_of(to_delayed_work(work), struct rproc,
+								evlog_work);
+	u32 head;
+
+	mutex_lock(&rproc->lock);
+	if (!rproc->evlog_readers) {
+		mutex_unlock(&rproc->lock);
+		return;
+	}
+
+	if (rproc->evlog) {
+		head = ACCESS_ONCE(rproc->evlog->head);
+		if (head != rproc->evlog_head) {
+			rproc->evlog_head = head;
+			wake_up_interruptible(&rproc->evlog_wq);
+		}
+	}
+	schedule_delayed_work(&rproc->evlog_work,
+				msecs_to_jiffies(RPROC_EVLOG_POLL_MS));
+	mutex_unlock(&rproc->lock);
+}
+
+static bool rproc_evlog_pending(struct rproc_evlog_reader *r)
+{
+	struct rproc *rproc = r->rproc;
+
+	return r->gen != rproc->evlog_gen || r->pos != rproc->evlog_head;
+}
+
+/*
+ * Formats the events of the log the reader did not see yet, as lines of
+ * "<time> <event> <id> <arg>".  The time is the CLOCK_MONOTONIC time of the
+ * event in seconds if the host can read the clock of the remote processor,
+ * or the raw timestamp otherwise.  Must be called with rproc->lock held.
+ */
+static int rproc_evlog_format(struct rproc_evlog_reader *r, char *buf,
+								int size)
+{
+	struct rproc *rproc = r->rproc;
+	struct rproc_evlog_hdr *hdr = rproc->evlog;
+	struct rproc_evlog_entry ev[RPROC_EVLOG_BATCH];
+	u32 num = rproc->evlog_num;
+	u32 head, first, rate, clk = 0, n, i, lost = 0, rem;
+	bool sync = false;
+	ktime_t now = ktime_set(0, 0);
+	u64 ns;
+	int len = 0;
+
+	if (r->gen != rproc->evlog_gen) {
+		r->gen = rproc->evlog_gen;
+		r->pos = 0;
+	}
+	if (!hdr || !num || hdr->magic != RPROC_EVLOG_MAGIC)
+		return 0;
+
+	head = ACCESS_ONCE(hdr->head);
+	rmb();
+	if (head != rproc->evlog_head) {
+		rproc->evlog_head = head;
+		wake_up_interruptible(&rproc->evlog_wq);
+	}
+	/* a head behind the reader means the log was reset or corrupted */
+	if ((s32) (head - r->pos) < 0)
+		r->pos = head;
+	if (head - r->pos > num) {
+		lost += head - r->pos - num;
+		r->pos = head - num;
+	}
+
+	n = min_t(u32, head - r->pos, RPROC_EVLOG_BATCH);
+	n = min_t(u32, n, (size - RPROC_EVLOG_LINE) / RPROC_EVLOG_LINE);
+	for (i = 0; i < n; i++)
+		ev[i] = hdr->entries[(r->pos + i) & (num - 1)];
+
+	/* drop what the remote processor overwrote while we were copying */
+	rmb();
+	head = ACCESS_ONCE(hdr->head);
+	first = 0;
+	if ((s32) (head - r->pos) > 0 && head - r->pos > num) {
+		first = min(head - r->pos - num, n);
+		lost += first;
+	}
+
+	/* sample both clocks after the copied events were written */
+	rate = ACCESS_ONCE(hdr->clock_rate);
+	if (rate && rproc->ops->read_clock) {
+		now = ktime_get();
+		sync = !rproc->ops->read_clock(rproc, &clk);
+	}
+
+	if (lost)
+		len += scnprintf(buf + len, size - len, "lost %u\n", lost);
+
+	for (i = first; i < n; i++) {
+		const char *name = ev[i].type < ARRAY_SIZE(rproc_evlog_names) ?
+				rproc_evlog_names[ev[i].type] : "unknown";
+
+		if (sync) {
+			ns = ktime_to_ns(now) - div_u64((u64) (clk - ev[i].ts) *
+							NSEC_PER_SEC, rate);
+			ns = div_u64_rem(ns, NSEC_PER_SEC, &rem);
+			len += scnprintf(buf + len, size - len,
+				"%llu.%06u %s %u %u\n", ns,
+				rem / (u32) NSEC_PER_USEC, name, ev[i].id,
+				ev[i].arg);
+		} else {
+			len += scnprintf(buf + len, size - len, "%u %s %u %u\n",
+				ev[i].ts, name, ev[i].id, ev[i].arg);
+		}
+	}
+	r->pos += n;
+
+	return len;
+}
+
+static int rproc_evlog_open(struct inode *inode, struct file *filp)
+{
+	struct rproc *rproc = inode->i_private;
+	struct rproc_evlog_reader *r;
+
+	r = kzalloc(sizeof(*r), GFP_KERNEL);
+	if (!r)
+		return -ENOMEM;
+	r->rproc = rproc;
+
+	mutex_lock(&rproc->lock);
+	/* start with the oldest event still in the log */
+	r->gen = rproc->evlog_gen;
+	if (rproc->evlog && rproc->evlog->magic == RPROC_EVLOG_MAGIC &&
+			rproc->evlog->head > rproc->evlog_num)
+		r->pos = rproc->evlog->head - rproc->evlog_num;
+	if (!rproc->evlog_readers++)
+		schedule_delayed_work(&rproc->evlog_work, 0);
+	mutex_unlock(&rproc->lock);
+
+	filp->private_data = r;
+	return nonseekable_open(inode, filp);
+}
+
+static int rproc_evlog_release(struct inode *inode, struct file *filp)
+{
+	struct rproc_evlog_reader *r = filp->private_data;
+	struct rproc *rproc = r->rproc;
+
+	/* the poll work stops by itself without readers */
+	mutex_lock(&rproc->lock);
+	rproc->evlog_readers--;
+	mutex_unlock(&rproc->lock);
+
+	kfree(r);
+	return 0;
+}
+
+static ssize_t rproc_evlog_read(struct file *filp, char __user *userbuf,
+						size_t count, loff_t *ppos)
+{
+	struct rproc_evlog_reader *r = filp->private_data;
+	struct rproc *rproc = r->rproc;
+	char *buf;
+	int len;
+
+	/* room for at least one event */
+	if (count < 2 * RPROC_EVLOG_LINE)
+		return -EINVAL;
+
+	/* a full batch of the longest lines */
+	buf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	do {
+		if (mutex_lock_interruptible(&rproc->lock)) {
+			len = -ERESTARTSYS;
+			break;
+		}
+		len = rproc_evlog_format(r, buf, min_t(size_t, count,
+								PAGE_SIZE));
+		mutex_unlock(&rproc->lock);
+		if (len)
+			break;
+
+		if (filp->f_flags & O_NONBLOCK) {
+			len = -EAGAIN;
+			break;
+		}
+		if (wait_event_interruptible(rproc->evlog_wq,
+						rproc_evlog_pending(r))) {
+			len = -ERESTARTSYS;
+			break;
+		}
+	} while (1);
+
+	if (len > 0 && copy_to_user(userbuf, buf, len))
+		len = -EFAULT;
+	kfree(buf);
+	return len;
+}
+
+static unsigned int rproc_evlog_poll(struct file *filp, poll_table *wait)
+{
+	struct rproc_evlog_reader *r = filp->private_data;
+
+	poll_wait(filp, &r->rproc->evlog_wq, wait);
+
+	return rproc_evlog_pending(r) ? POLLIN | POLLRDNORM : 0;
+}
+
 #define DEBUGFS_READONLY_FILE(name, value, len)				\
 static ssize_t name## _rproc_read(struct file *filp,			\
 		char __user *userbuf, size_t count, loff_t *ppos)	\
@@ -500,6 +831,27 @@ static const struct file_operations rproc_version_ops = {
 	.llseek	= generic_file_llseek,
 };
 
+static const struct file_operations rproc_boot_stats_ops = {
+	.read = rproc_boot_stats_read,
+	.open = rproc_open_generic,
+	.llseek	= generic_file_llseek,
+};
+
+static const struct file_operations rproc_evlog_ops = {
+	.read = rproc_evlog_read,
+	.poll = rproc_evlog_poll,
+	.open = rproc_evlog_open,
+	.release = rproc_evlog_release,
+	.llseek	= no_llseek,
+};
+
+static const struct file_operations rproc_retain_ops = {
+	.read = rproc_retain_read,
+	.write = rproc_retain_write,
+	.open = rproc_open_generic,
+	.llseek	= generic_file_llseek,
+};
+
 DEBUGFS_READONLY_FILE(trace0, rproc->trace_buf0, rproc->trace_len0);
 DEBUGFS_READONLY_FILE(trace1, rproc->trace_buf1, rproc->trace_len1);
 DEBUGFS_READONLY_FILE(trace0_last, rproc->last_trace_buf0,
@@ -641,6 +993,8 @@ static int _event_notify(struct rproc *rproc, int type, void *data)
 static void rproc_start(struct rproc *rproc, u64 bootaddr)
 {
 	struct device *dev = rproc->dev;
+	struct rproc_boot_stats *bs = &rproc->boot_stats;
+	ktime_t t;
 	int err;
 
 	err = mutex_lock_interruptible(&rproc->lock);
@@ -649,13 +1003,27 @@ static void rproc_start(struct rproc *rproc, u64 bootaddr)
 		return;
 	}
 
+	/*
+	 * the iommu page table outlives the iommu users, so if the memory
+	 * maps did not change since it was filled, there is nothing to map
+	 */
+	rproc->iommu_mapped = rproc->retain && !rproc->secure_mode &&
+			rproc->mapped_maps[0].size &&
+			!memcmp(rproc->mapped_maps, rproc->memory_maps,
+					sizeof(rproc->memory_maps));
+
+	t = ktime_get();
 	if (rproc->ops->iommu_init) {
 		err = rproc->ops->iommu_init(rproc, rproc_mmu_fault_isr);
 		if (err) {
 			dev_err(dev, "can't configure iommu %d\n", err);
 			goto unlock_mutex;
 		}
+		if (rproc->retain && !rproc->secure_mode)
+			memcpy(rproc->mapped_maps, rproc->memory_maps,
+					sizeof(rproc->memory_maps));
 	}
+	bs->iommu = ktime_sub(ktime_get(), t);
 
 	if (rproc->ops->watchdog_init) {
 		err = rproc->ops->watchdog_init(rproc, rproc_watchdog_isr);
@@ -671,11 +1039,15 @@ static void rproc_start(struct rproc *rproc, u64 bootaddr)
 			rproc, &core_rproc_ops);
 #endif
 
+	rproc_evlog_init(rproc);
+
+	t = ktime_get();
 	err = rproc->ops->start(rproc, bootaddr);
 	if (err) {
 		dev_err(dev, "can't start rproc %s: %d\n", rproc->name, err);
 		goto start_error;
 	}
+	bs->start = ktime_sub(ktime_get(), t);
 
 #ifdef CONFIG_REMOTE_PROC_AUTOSUSPEND
 	pm_runtime_use_autosuspend(dev);
@@ -690,7 +1062,15 @@ static void rproc_start(struct rproc *rproc, u64 bootaddr)
 
 	rproc->state = RPROC_RUNNING;
 
-	dev_info(dev, "remote processor %s is now up\n", rproc->name);
+	bs->total = ktime_sub(ktime_get(), rproc->boot_begin);
+	if (bs->warm)
+		bs->warm_boots++;
+	else
+		bs->cold_boots++;
+
+	dev_info(dev, "remote processor %s is now up (%s boot, %lld us)\n",
+		rproc->name, bs->warm ? "warm" : "cold",
+		ktime_to_us(bs->total));
 	rproc->secure_ok = true;
 	complete_all(&rproc->secure_restart);
 	mutex_unlock(&rproc->lock);
@@ -807,6 +1187,7 @@ static int rproc_handle_resources(struct rproc *rproc, struct fw_resource *rsc,
 	u64 trace_da1 = 0;
 	u64 cdump_da0 = 0;
 	u64 cdump_da1 = 0;
+	u64 evlog_da = 0;
 	int ret = 0;
 
 	while (len >= sizeof(*rsc) && !ret) {
@@ -854,6 +1235,17 @@ static int rproc_handle_resources(struct rproc *rproc, struct fw_resource *rsc,
 				cdump_da1 = da;
 			}
 			break;
+		case RSC_EVENTLOG:
+			if (rsc->len < sizeof(struct rproc_evlog_hdr) +
+					sizeof(struct rproc_evlog_entry)) {
+				dev_warn(dev, "event log %s is too small\n",
+						rsc->name);
+				break;
+			}
+			/* store the da for processing at the end */
+			rproc->evlog_len = rsc->len;
+			evlog_da = da;
+			break;
 		case RSC_BOOTADDR:
 			*bootaddr = da;
 			break;
@@ -995,6 +1387,20 @@ static int rproc_handle_resources(struct rproc *rproc, struct fw_resource *rsc,
 		}
 	}
 
+	/* event log memory _is_ normal memory too */
+	if (evlog_da) {
+		ret = rproc_da_to_pa(rproc->memory_maps, evlog_da, &pa);
+		if (ret)
+			goto error;
+		rproc->evlog = (__force void *)
+					ioremap_nocache(pa, rproc->evlog_len);
+		if (!rproc->evlog) {
+			dev_err(dev, "can't ioremap event log\n");
+			ret = -EIO;
+			goto error;
+		}
+	}
+
 error:
 	if (ret && rproc->dbg_dir) {
 		debugfs_remove_recursive(rproc->dbg_dir);
@@ -1086,21 +1492,122 @@ exit:
 	return ret;
 }
 
+/**
+ * rproc_image_rsc - find the resource table of a firmware image
+ * @fw: the firmware image
+ * @len: pointer to the length of the resource table result
+ *
+ * Returns the content of the first section of @fw if it is a resource
+ * table that fits in the image, or NULL otherwise.
+ */
+static void *rproc_image_rsc(const struct firmware *fw, int *len)
+{
+	struct fw_header *image = (struct fw_header *) fw->data;
+	struct fw_section *section;
+	size_t left;
+
+	if (fw->size < sizeof(*image) || memcmp(image->magic, "RPRC", 4) ||
+			fw->size - sizeof(*image) < image->header_len)
+		return NULL;
+
+	left = fw->size - sizeof(*image) - image->header_len;
+	section = (struct fw_section *)(image->header + image->header_len);
+	if (left < sizeof(*section) || section->type != FW_RESOURCE ||
+			left - sizeof(*section) < section->len)
+		return NULL;
+
+	*len = section->len;
+	return section->content;
+}
+
+/*
+ * Resource handling writes the carveouts it allocates into the resource
+ * table of the image, so the image is only retained along with a copy of
+ * the table taken before it was handled.
+ */
+static int rproc_save_rsc(struct rproc *rproc, const struct firmware *fw)
+{
+	void *rsc;
+	int len;
+
+	kfree(rproc->rsc_copy);
+	rproc->rsc_copy = NULL;
+
+	rsc = rproc_image_rsc(fw, &len);
+	if (!rsc)
+		return -EINVAL;
+
+	rproc->rsc_copy = kmemdup(rsc, len, GFP_KERNEL);
+	if (!rproc->rsc_copy)
+		return -ENOMEM;
+	rproc->rsc_len = len;
+
+	return 0;
+}
+
+/* must be called with rproc->lock held, and the processor not in use */
+static void rproc_drop_image(struct rproc *rproc)
+{
+	if (rproc->fw)
+		release_firmware(rproc->fw);
+	rproc->fw = NULL;
+	kfree(rproc->rsc_copy);
+	rproc->rsc_copy = NULL;
+	memset(rproc->mapped_maps, 0, sizeof(rproc->mapped_maps));
+}
+
+/* keep @fw for the next boot if it booted fine, or release it */
+static void rproc_keep_image(struct rproc *rproc, const struct firmware *fw,
+								bool booted)
+{
+	mutex_lock(&rproc->lock);
+	if (fw == rproc->fw)
+		goto unlock;
+
+	if (booted && rproc->retain && !rproc->fw && rproc->rsc_copy) {
+		rproc->fw = fw;
+		goto unlock;
+	}
+
+	release_firmware(fw);
+	kfree(rproc->rsc_copy);
+	rproc->rsc_copy = NULL;
+unlock:
+	mutex_unlock(&rproc->lock);
+}
+
 static void rproc_loader_cont(const struct firmware *fw, void *context)
 {
 	struct rproc *rproc = context;
 	struct device *dev = rproc->dev;
 	const char *fwfile = rproc->firmware;
+	struct rproc_boot_stats *bs = &rproc->boot_stats;
 	u64 bootaddr = 0;
 	struct fw_header *image;
 	struct fw_section *section;
-	int left, ret;
+	bool booted = false;
+	void *rsc;
+	int left, ret, len;
+	ktime_t t;
 
 	if (!fw) {
 		dev_err(dev, "%s: failed to load %s\n", __func__, fwfile);
 		goto complete_fw;
 	}
 
+	t = ktime_get();
+	bs->warm = fw == rproc->fw;
+	if (bs->warm) {
+		/* undo what the previous boot wrote into the resource table */
+		rsc = rproc_image_rsc(fw, &len);
+		memcpy(rsc, rproc->rsc_copy, len);
+		bs->fetch = ktime_set(0, 0);
+	} else {
+		if (rproc->retain)
+			rproc_save_rsc(rproc, fw);
+		bs->fetch = ktime_sub(t, rproc->boot_begin);
+	}
+
 	dev_info(dev, "Loaded BIOS image %s, size %d\n", fwfile, fw->size);
 
 	/* make sure this image is sane */
@@ -1143,16 +1650,56 @@ static void rproc_loader_cont(const struct firmware *fw, void *context)
 		dev_err(dev, "Failed to process the image: %d\n", ret);
 		goto out;
 	}
+	bs->load = ktime_sub(ktime_get(), t);
 
 	rproc_start(rproc, bootaddr);
+	booted = rproc->state == RPROC_RUNNING;
 
 out:
-	release_firmware(fw);
+	rproc_keep_image(rproc, fw, booted);
 complete_fw:
 	/* allow all contexts calling rproc_put() to proceed */
 	complete_all(&rproc->firmware_loading_complete);
 }
 
+static void rproc_boot_work(struct work_struct *work)
+{
+	struct rproc *rproc = container_of(work, struct rproc, boot_work);
+
+	rproc_loader_cont(rproc->fw, rproc);
+}
+
+/*
+ * Fetches the firmware image ahead of the first boot, so that the first
+ * user of the remote processor does not have to wait for it.
+ */
+static void rproc_preload_work(struct work_struct *work)
+{
+	struct rproc *rproc = container_of(to_delayed_work(work), struct rproc,
+								preload_work);
+	const struct firmware *fw;
+	int ret;
+
+	if (!rproc->firmware ||
+			request_firmware(&fw, rproc->firmware, rproc->dev))
+		return;
+
+	mutex_lock(&rproc->lock);
+	if (rproc->retain && !rproc->fw && !rproc->count) {
+		ret = rproc_save_rsc(rproc, fw);
+		if (!ret) {
+			rproc->fw = fw;
+			fw = NULL;
+			dev_info(rproc->dev, "preloaded %s\n", rproc->firmware);
+		}
+	}
+	mutex_unlock(&rproc->lock);
+
+	if (fw)
+		release_firmware(fw);
+}
+
+/* must be called with rproc->lock held */
 static int rproc_loader(struct rproc *rproc)
 {
 	const char *fwfile = rproc->firmware;
@@ -1164,6 +1711,14 @@ static int rproc_loader(struct rproc *rproc)
 		return -EINVAL;
 	}
 
+	rproc->boot_begin = ktime_get();
+
+	/* a retained image only needs to be copied in place again */
+	if (rproc->fw) {
+		schedule_work(&rproc->boot_work);
+		return 0;
+	}
+
 	/*
 	 * allow building remoteproc as built-in kernel code, without
 	 * hanging the boot process
@@ -1331,6 +1886,15 @@ void rproc_put(struct rproc *rproc)
 		iounmap((__force void __iomem *) rproc->cdump_buf1);
 	rproc->cdump_buf0 = rproc->cdump_buf1 = NULL;
 
+	if (rproc->evlog)
+		/* iounmap normal memory, so make sparse happy */
+		iounmap((__force void __iomem *) rproc->evlog);
+	rproc->evlog = NULL;
+	rproc->evlog_num = 0;
+	/* readers of the event log wait for the next boot */
+	rproc->evlog_gen++;
+	rproc->evlog_head = 0;
+
 	rproc_reset_poolmem(rproc);
 	memset(rproc->memory_maps, 0, sizeof(rproc->memory_maps));
 	kfree(rproc->header);
@@ -1517,6 +2081,34 @@ out:
 	return ret;
 }
 
+/*
+ * The memory of the remote processor is not part of the hibernation image,
+ * so the state it was suspended with is lost on restore.  Restart it
+ * through the crash recovery path instead, which boots from the retained
+ * image if there is one.
+ */
+static int rproc_restore(struct device *dev)
+{
+	struct platform_device *pdev = to_platform_device(dev);
+	struct rproc *rproc = platform_get_drvdata(pdev);
+
+	dev_dbg(dev, "Enter %s\n", __func__);
+
+	mutex_lock(&rproc->lock);
+	if (rproc->state != RPROC_SUSPENDED) {
+		mutex_unlock(&rproc->lock);
+		return 0;
+	}
+	rproc->need_resume = false;
+	rproc->state = RPROC_RUNNING;
+	mutex_unlock(&rproc->lock);
+
+	dev_info(dev, "%s lost its state across hibernation, restarting\n",
+								rproc->name);
+	schedule_work(&rproc->error_work);
+	return 0;
+}
+
 static int rproc_runtime_resume(struct device *dev)
 {
 	struct platform_device *pdev = to_platform_device(dev);
@@ -1600,7 +2192,14 @@ abort:
 }
 
 const struct dev_pm_ops rproc_gen_pm_ops = {
-	SET_SYSTEM_SLEEP_PM_OPS(rproc_suspend, rproc_resume)
+#ifdef CONFIG_PM_SLEEP
+	.suspend = rproc_suspend,
+	.resume = rproc_resume,
+	.freeze = rproc_suspend,
+	.thaw = rproc_resume,
+	.poweroff = rproc_suspend,
+	.restore = rproc_restore,
+#endif
 	SET_RUNTIME_PM_OPS(rproc_runtime_suspend, rproc_runtime_resume, NULL)
 };
 #endif
@@ -1681,7 +2280,12 @@ int rproc_register(struct device *dev, const char *name,
 	mutex_init(&rproc->lock);
 	mutex_init(&rproc->secure_lock);
 	INIT_WORK(&rproc->error_work, rproc_error_work);
+	INIT_WORK(&rproc->boot_work, rproc_boot_work);
+	INIT_DELAYED_WORK(&rproc->preload_work, rproc_preload_work);
+	INIT_DELAYED_WORK(&rproc->evlog_work, rproc_evlog_work);
+	init_waitqueue_head(&rproc->evlog_wq);
 	BLOCKING_INIT_NOTIFIER_HEAD(&rproc->nbh);
+	rproc->retain = true;
 
 	rproc->state = RPROC_OFFLINE;
 
@@ -1707,6 +2311,10 @@ int rproc_register(struct device *dev, const char *name,
 
 	dev_info(dev, "%s is available\n", name);
 
+	if (preload_ms)
+		schedule_delayed_work(&rproc->preload_work,
+						msecs_to_jiffies(preload_ms));
+
 	if (!rproc_dbg)
 		goto out;
 
@@ -1721,6 +2329,15 @@ int rproc_register(struct device *dev, const char *name,
 
 	debugfs_create_file("version", 0444, rproc->dbg_dir, rproc,
 							&rproc_version_ops);
+
+	debugfs_create_file("boot_stats", 0444, rproc->dbg_dir, rproc,
+							&rproc_boot_stats_ops);
+
+	debugfs_create_file("retain", 0644, rproc->dbg_dir, rproc,
+							&rproc_retain_ops);
+
+	debugfs_create_file("eventlog", 0400, rproc->dbg_dir, rproc,
+							&rproc_evlog_ops);
 out:
 	return 0;
 }
@@ -1745,6 +2362,12 @@ int rproc_unregister(const char *name)
 	list_del(&rproc->next);
 	spin_unlock(&rprocs_lock);
 
+	cancel_delayed_work_sync(&rproc->preload_work);
+	cancel_delayed_work_sync(&rproc->evlog_work);
+	mutex_lock(&rproc->lock);
+	rproc_drop_image(rproc);
+	mutex_unlock(&rproc->lock);
+
 	rproc->secure_mode = false;
 	rproc->secure_ttb = NULL;
 	pm_qos_remove_request(rproc->qos_request);
@@ -0,0 +1,284 @@
+/*
+ * Remote processor messaging benchmark
+ *
+ * Measures the throughput and round trip latency of an rpmsg channel whose
+ * remote end echoes every message, like the "rpmsg-bench" service of the
+ * loopback transport.  Several threads send concurrently, each from its own
+ * endpoint, keeping up to "window" messages in flight.  Messages larger
+ * than an rpmsg buffer exercise fragmentation and reassembly.
+ *
+ * Reading /sys/kernel/debug/rpmsg_bench runs the benchmark with the current
+ * module parameters, and reports the result.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#define pr_fmt(fmt) "%s: " fmt, __func__
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/wait.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/rpmsg.h>
+
+#define MAX_THREADS	16
+
+static unsigned int threads = 1;
+module_param(threads, uint, 0644);
+static unsigned int count = 10000;	/* messages per thread */
+module_param(count, uint, 0644);
+static unsigned int size = 64;		/* bytes per message */
+module_param(size, uint, 0644);
+static unsigned int window = 8;		/* messages in flight per thread */
+module_param(window, uint, 0644);
+
+struct bench_thread {
+	struct rpmsg_channel *rpdev;
+	struct rpmsg_endpoint *ept;
+	struct completion done;
+	wait_queue_head_t wq;
+	unsigned int sent;
+	atomic_t received;
+	u64 lat_sum;		/* ns, updated by the callback only */
+	u64 lat_max;
+	int err;
+};
+
+static struct rpmsg_channel *bench_rpdev;
+static DEFINE_MUTEX(bench_lock);
+static struct dentry *bench_dentry;
+
+static void rpmsg_bench_cb(struct rpmsg_channel *rpdev, void *data, int len,
+						void *priv, u32 src)
+{
+	struct bench_thread *t = priv;
+	s64 sent, lat;
+
+	if (len < sizeof(sent) || len != size) {
+		dev_warn(&rpdev->dev, "bad echo length %d\n", len);
+		t->err = -EIO;
+	} else {
+		memcpy(&sent, data, sizeof(sent));
+		lat = ktime_to_ns(ktime_get()) - sent;
+		t->lat_sum += lat;
+		t->lat_max = max_t(u64, t->lat_max, lat);
+	}
+
+	atomic_inc(&t->received);
+	wake_up(&t->wq);
+}
+
+static int rpmsg_bench_thread(void *data)
+{
+	struct bench_thread *t = data;
+	char *buf;
+	s64 now;
+	int ret = 0;
+
+	buf = kzalloc(size, GFP_KERNEL);
+	if (!buf) {
+		t->err = -ENOMEM;
+		goto out;
+	}
+
+	for (t->sent = 0; t->sent < count && !t->err; t->sent++) {
+		/* keep at most window messages in flight */
+		if (!wait_event_timeout(t->wq, t->sent -
+				atomic_read(&t->received) < window, 5 * HZ)) {
+			ret = -ETIMEDOUT;
+			break;
+		}
+
+		now = ktime_to_ns(ktime_get());
+		memcpy(buf, &now, sizeof(now));
+		ret = rpmsg_send_offchannel(t->rpdev, t->ept->addr,
+					t->rpdev->dst, buf, size);
+		if (ret)
+			break;
+	}
+
+	if (!ret && !wait_event_timeout(t->wq,
+			atomic_read(&t->received) == t->sent, 5 * HZ))
+		ret = -ETIMEDOUT;
+	if (ret)
+		t->err = ret;
+
+	kfree(buf);
+out:
+	complete(&t->done);
+	return 0;
+}
+
+static int rpmsg_bench_show(struct seq_file *s, void *unused)
+{
+	struct bench_thread *t;
+	struct task_struct *task;
+	unsigned int n, i;
+	u64 msgs = 0, lat_sum = 0, lat_max = 0, ns;
+	ktime_t start;
+	int err = 0;
+
+	n = clamp_t(unsigned int, threads, 1, MAX_THREADS);
+	if (size < sizeof(s64) || !window) {
+		seq_printf(s, "invalid size or window\n");
+		return 0;
+	}
+
+	mutex_lock(&bench_lock);
+	if (!bench_rpdev) {
+		mutex_unlock(&bench_lock);
+		seq_printf(s, "no rpmsg-bench channel\n");
+		return 0;
+	}
+
+	t = kcalloc(n, sizeof(*t), GFP_KERNEL);
+	if (!t) {
+		err = -ENOMEM;
+		goto unlock;
+	}
+
+	for (i = 0; i < n; i++) {
+		t[i].rpdev = bench_rpdev;
+		init_completion(&t[i].done);
+		init_waitqueue_head(&t[i].wq);
+		t[i].ept = rpmsg_create_ept(bench_rpdev, rpmsg_bench_cb, &t[i],
+							RPMSG_ADDR_ANY);
+		if (!t[i].ept) {
+			err = -ENOMEM;
+			n = i;
+			goto destroy;
+		}
+	}
+
+	start = ktime_get();
+	for (i = 0; i < n; i++) {
+		task = kthread_run(rpmsg_bench_thread, &t[i], "rpmsg-bench/%u",
+									i);
+		if (IS_ERR(task)) {
+			t[i].err = PTR_ERR(task);
+			complete(&t[i].done);
+		}
+	}
+	for (i = 0; i < n; i++)
+		wait_for_completion(&t[i].done);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	for (i = 0; i < n; i++) {
+		msgs += atomic_read(&t[i].received);
+		lat_sum += t[i].lat_sum;
+		lat_max = max(lat_max, t[i].lat_max);
+		if (t[i].err && !err)
+			err = t[i].err;
+	}
+
+	seq_printf(s, "threads %u, %u messages of %u bytes each, window %u\n",
+		   n, count, size, window);
+	seq_printf(s, "%llu messages/s, %llu KB/s\n",
+		   div64_u64(msgs * NSEC_PER_SEC, ns ? : 1),
+		   div64_u64(msgs * size * NSEC_PER_SEC, (ns ? : 1) * 1024));
+	seq_printf(s, "latency: avg %llu us, max %llu us\n",
+		   div64_u64(lat_sum, (msgs ? : 1) * NSEC_PER_USEC),
+		   div64_u64(lat_max, NSEC_PER_USEC));
+
+destroy:
+	for (i = 0; i < n; i++)
+		rpmsg_destroy_ept(t[i].ept);
+	kfree(t);
+unlock:
+	mutex_unlock(&bench_lock);
+	if (err)
+		seq_printf(s, "error: %d\n", err);
+	return 0;
+}
+
+static int rpmsg_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, rpmsg_bench_show, inode->i_private);
+}
+
+static const struct file_operations rpmsg_bench_fops = {
+	.open		= rpmsg_bench_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int rpmsg_bench_probe(struct rpmsg_channel *rpdev)
+{
+	mutex_lock(&bench_lock);
+	if (bench_rpdev) {
+		mutex_unlock(&bench_lock);
+		return -EBUSY;
+	}
+	bench_rpdev = rpdev;
+	mutex_unlock(&bench_lock);
+
+	dev_info(&rpdev->dev, "new channel: 0x%x <-> 0x%x!\n",
+			rpdev->src, rpdev->dst);
+	return 0;
+}
+
+static void __devexit rpmsg_bench_remove(struct rpmsg_channel *rpdev)
+{
+	mutex_lock(&bench_lock);
+	bench_rpdev = NULL;
+	mutex_unlock(&bench_lock);
+}
+
+static void rpmsg_bench_driver_cb(struct rpmsg_channel *rpdev, void *data,
+						int len, void *priv, u32 src)
+{
+	dev_warn(&rpdev->dev, "uhm, unexpected message\n");
+}
+
+static struct rpmsg_device_id rpmsg_bench_id_table[] = {
+	{ .name	= "rpmsg-bench" },
+	{ },
+};
+MODULE_DEVICE_TABLE(platform, rpmsg_bench_id_table);
+
+static struct rpmsg_driver rpmsg_bench_driver = {
+	.drv.name	= KBUILD_MODNAME,
+	.drv.owner	= THIS_MODULE,
+	.id_table	= rpmsg_bench_id_table,
+	.probe		= rpmsg_bench_probe,
+	.callback	= rpmsg_bench_driver_cb,
+	.remove		= __devexit_p(rpmsg_bench_remove),
+};
+
+static int __init init(void)
+{
+	int ret;
+
+	ret = register_rpmsg_driver(&rpmsg_bench_driver);
+	if (ret)
+		return ret;
+
+	bench_dentry = debugfs_create_file("rpmsg_bench", S_IRUSR, NULL, NULL,
+							&rpmsg_bench_fops);
+	return 0;
+}
+module_init(init);
+
+static void __exit fini(void)
+{
+	debugfs_remove(bench_dentry);
+	unregister_rpmsg_driver(&rpmsg_bench_driver);
+}
+module_exit(fini);
+
+MODULE_DESCRIPTION("Remote processor messaging benchmark");
+MODULE_LICENSE("GPL v2");
@@ -0,0 +1,433 @@
+/*
+ * Loopback remote processor messaging transport
+ *
+ * A virtio rpmsg device whose remote processor is emulated on the host, so
+ * that rpmsg drivers and their user space can be tested and benchmarked
+ * without a remote processor or its firmware.
+ *
+ * The vrings and buffers live in kernel memory, and a work item plays the
+ * remote side: it announces an "rpmsg-omx" and an "rpmsg-bench" channel,
+ * accepts every OMX connection request, and echoes all other messages back
+ * to their sender, fragment by fragment.
+ * Driver callbacks run in this work item, so they must not wait for
+ * transmit buffers.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#define pr_fmt(fmt) "%s: " fmt, __func__
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/gfp.h>
+#include <linux/workqueue.h>
+#include <linux/virtio.h>
+#include <linux/virtio_config.h>
+#include <linux/virtio_ids.h>
+#include <linux/virtio_ring.h>
+#include <linux/rpmsg.h>
+#include <linux/rpmsg_omx.h>
+#include <asm/io.h>
+
+/* 32 buffers of 512 bytes for each direction */
+#define LB_NUM_BUFS		(64)
+#define LB_BUF_SIZE		(512)
+#define LB_BUFS_SPACE		(LB_NUM_BUFS * LB_BUF_SIZE)
+#define LB_VRING_ALIGN		(4096)
+#define LB_RING_SIZE		PAGE_ALIGN(vring_size(LB_NUM_BUFS / 2, \
+							LB_VRING_ALIGN))
+
+/* addresses on the emulated remote processor */
+#define LB_NS_ADDR		(53)	/* rpmsg name service */
+#define LB_OMX_ADDR		(60)	/* OMX connection service */
+#define LB_BENCH_ADDR		(61)	/* echo service for benchmarks */
+#define LB_INST_ADDR		(1024)	/* first OMX instance */
+
+static struct rpmsg_channel_info rpmsg_lb_chnls[] = {
+	{ "rpmsg-omx", LB_OMX_ADDR, RPMSG_ADDR_ANY },
+	{ "rpmsg-bench", LB_BENCH_ADDR, RPMSG_ADDR_ANY },
+};
+
+struct rpmsg_lb_vq {
+	struct virtqueue *vq;
+	struct vring vring;	/* the remote side's view of the vring */
+	void *addr;
+	u16 last_avail;
+};
+
+struct rpmsg_lb_vproc {
+	struct virtio_device vdev;
+	void *bufs;
+	struct rpmsg_lb_vq vq[2];	/* host rx, then host tx */
+	struct workqueue_struct *wq;
+	struct work_struct work;
+	int announced;			/* channels announced so far */
+	bool pending;			/* msg is consumed but not handled */
+	u32 next_addr;			/* address of the next OMX instance */
+	char msg[LB_BUF_SIZE];
+};
+
+#define to_lb_vproc(vd) container_of(vd, struct rpmsg_lb_vproc, vdev)
+
+/* next buffer the host made available on a vring, or NULL */
+static void *lb_get_avail(struct rpmsg_lb_vq *lvq, u16 *head, u32 *len)
+{
+	struct vring *vr = &lvq->vring;
+
+	if (lvq->last_avail == vr->avail->idx)
+		return NULL;
+	/* read the ring entry after the index */
+	rmb();
+
+	*head = vr->avail->ring[lvq->last_avail % vr->num];
+	if (WARN_ON(*head >= vr->num))
+		return NULL;
+	*len = vr->desc[*head].len;
+	return phys_to_virt(vr->desc[*head].addr);
+}
+
+/* hands a buffer back to the host, and interrupts it unless it opted out */
+static void lb_put_used(struct rpmsg_lb_vq *lvq, u16 head, u32 len)
+{
+	struct vring *vr = &lvq->vring;
+	struct vring_used_elem *used = &vr->used->ring[vr->used->idx % vr->num];
+
+	used->id = head;
+	used->len = len;
+	lvq->last_avail++;
+	/* the element must be visible before the index */
+	wmb();
+	vr->used->idx++;
+	mb();
+
+	if (!(vr->avail->flags & VRING_AVAIL_F_NO_INTERRUPT))
+		vring_interrupt(0, lvq->vq);
+}
+
+/* sends a message to the host, -EAGAIN if it has no free rx buffer */
+static int lb_send(struct rpmsg_lb_vproc *lb, u32 src, u32 dst, void *data,
+					int len, u16 flags, u32 offset)
+{
+	struct rpmsg_lb_vq *lvq = &lb->vq[0];
+	struct rpmsg_hdr *msg;
+	u32 size;
+	u16 head;
+
+	msg = lb_get_avail(lvq, &head, &size);
+	if (!msg)
+		return -EAGAIN;
+	if (sizeof(*msg) + len > size)
+		return -EMSGSIZE;
+
+	msg->len = len;
+	msg->flags = flags;
+	msg->src = src;
+	msg->dst = dst;
+	msg->offset = offset;
+	memcpy(msg->data, data, len);
+
+	lb_put_used(lvq, head, sizeof(*msg) + len);
+	return 0;
+}
+
+static int lb_announce(struct rpmsg_lb_vproc *lb)
+{
+	struct rpmsg_channel_info *ch;
+	struct rpmsg_ns_msg ns;
+	int ret;
+
+	for (; lb->announced < ARRAY_SIZE(rpmsg_lb_chnls); lb->announced++) {
+		ch = &rpmsg_lb_chnls[lb->announced];
+		strncpy(ns.name, ch->name, sizeof(ns.name));
+		ns.addr = ch->src;
+		ns.flags = RPMSG_NS_CREATE;
+
+		ret = lb_send(lb, ch->src, LB_NS_ADDR, &ns, sizeof(ns), 0, 0);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* plays the remote processor's part for a message from the host */
+static int lb_handle(struct rpmsg_lb_vproc *lb, struct rpmsg_hdr *msg)
+{
+	struct omx_msg_hdr *hdr = (struct omx_msg_hdr *) msg->data;
+	char buf[sizeof(*hdr) + sizeof(struct omx_conn_rsp)];
+	struct omx_msg_hdr *rsp_hdr = (struct omx_msg_hdr *) buf;
+	struct omx_conn_rsp *rsp = (struct omx_conn_rsp *) rsp_hdr->data;
+	int ret;
+
+	switch (msg->dst) {
+	case LB_NS_ADDR:
+		/* the host announcing its own channels */
+		return 0;
+	case LB_OMX_ADDR:
+		if (msg->len < sizeof(*hdr) || hdr->type != OMX_CONN_REQ)
+			return 0;
+
+		rsp_hdr->type = OMX_CONN_RSP;
+		rsp_hdr->flags = 0;
+		rsp_hdr->len = sizeof(*rsp);
+		rsp->status = OMX_SUCCESS;
+		rsp->addr = lb->next_addr;
+
+		ret = lb_send(lb, LB_OMX_ADDR, msg->src, buf, sizeof(buf),
+									0, 0);
+		if (!ret)
+			lb->next_addr++;
+		return ret;
+	default:
+		/* the bench service and OMX instances echo everything */
+		return lb_send(lb, msg->dst, msg->src, msg->data, msg->len,
+						msg->flags, msg->offset);
+	}
+}
+
+static void rpmsg_lb_work(struct work_struct *work)
+{
+	struct rpmsg_lb_vproc *lb =
+			container_of(work, struct rpmsg_lb_vproc, work);
+	struct rpmsg_hdr *msg = (struct rpmsg_hdr *) lb->msg;
+	void *buf;
+	u32 len;
+	u16 head;
+
+	if (lb_announce(lb))
+		return;
+
+	for (;;) {
+		/*
+		 * take the message and free its tx buffer first, so that
+		 * the host can send again while the reply waits for an rx
+		 * buffer
+		 */
+		if (!lb->pending) {
+			buf = lb_get_avail(&lb->vq[1], &head, &len);
+			if (!buf)
+				break;
+			memcpy(lb->msg, buf, min_t(u32, len, sizeof(lb->msg)));
+			lb_put_used(&lb->vq[1], head, 0);
+
+			if (len < sizeof(*msg) ||
+					len - sizeof(*msg) < msg->len) {
+				pr_err("truncated message (%u)\n", len);
+				continue;
+			}
+			lb->pending = true;
+		}
+
+		if (lb_handle(lb, msg) == -EAGAIN)
+			break;
+		lb->pending = false;
+	}
+}
+
+/* provide drivers with platform-specific details */
+static void rpmsg_lb_get(struct virtio_device *vdev, unsigned int request,
+		   void *buf, unsigned len)
+{
+	struct rpmsg_lb_vproc *lb = to_lb_vproc(vdev);
+	void *presult = NULL;
+	int iresult;
+
+	switch (request) {
+	case VPROC_BUF_ADDR:
+	case VPROC_SIM_BASE:
+		/* the buffers are in lowmem, so no simulated base is needed */
+		BUG_ON(len != sizeof(lb->bufs));
+		memcpy(buf, &lb->bufs, len);
+		break;
+	case VPROC_BUF_NUM:
+		BUG_ON(len != sizeof(iresult));
+		iresult = LB_NUM_BUFS;
+		memcpy(buf, &iresult, len);
+		break;
+	case VPROC_BUF_SZ:
+		BUG_ON(len != sizeof(iresult));
+		iresult = LB_BUF_SIZE;
+		memcpy(buf, &iresult, len);
+		break;
+	case VPROC_STATIC_CHANNELS:
+		/* channels are announced through the name service */
+		BUG_ON(len != sizeof(presult));
+		memcpy(buf, &presult, len);
+		break;
+	default:
+		dev_err(&vdev->dev, "invalid request: %d\n", request);
+	}
+}
+
+/* the emulated remote processor runs when the host kicks any vring */
+static void rpmsg_lb_notify(struct virtqueue *vq)
+{
+	struct rpmsg_lb_vproc *lb = vq->priv;
+
+	queue_work(lb->wq, &lb->work);
+}
+
+static void rpmsg_lb_del_vqs(struct virtio_device *vdev)
+{
+	struct rpmsg_lb_vproc *lb = to_lb_vproc(vdev);
+	int i;
+
+	cancel_work_sync(&lb->work);
+
+	for (i = 0; i < ARRAY_SIZE(lb->vq); i++) {
+		struct rpmsg_lb_vq *lvq = &lb->vq[i];
+
+		if (lvq->vq)
+			vring_del_virtqueue(lvq->vq);
+		if (lvq->addr)
+			free_pages_exact(lvq->addr, LB_RING_SIZE);
+		memset(lvq, 0, sizeof(*lvq));
+	}
+
+	lb->announced = 0;
+	lb->pending = false;
+}
+
+static int rpmsg_lb_find_vqs(struct virtio_device *vdev, unsigned nvqs,
+		       struct virtqueue *vqs[],
+		       vq_callback_t *callbacks[],
+		       const char *names[])
+{
+	struct rpmsg_lb_vproc *lb = to_lb_vproc(vdev);
+	int i;
+
+	/* we maintain two virtqueues (for RX and TX) */
+	if (nvqs != ARRAY_SIZE(lb->vq))
+		return -EINVAL;
+
+	lb->next_addr = LB_INST_ADDR;
+
+	for (i = 0; i < nvqs; i++) {
+		struct rpmsg_lb_vq *lvq = &lb->vq[i];
+
+		lvq->addr = alloc_pages_exact(LB_RING_SIZE,
+					      GFP_KERNEL | __GFP_ZERO);
+		if (!lvq->addr)
+			goto error;
+
+		vring_init(&lvq->vring, LB_NUM_BUFS / 2, lvq->addr,
+							LB_VRING_ALIGN);
+		lvq->vq = vring_new_virtqueue(LB_NUM_BUFS / 2, LB_VRING_ALIGN,
+				vdev, lvq->addr, rpmsg_lb_notify,
+				callbacks[i], names[i]);
+		if (!lvq->vq)
+			goto error;
+
+		lvq->vq->priv = lb;
+		vqs[i] = lvq->vq;
+	}
+
+	return 0;
+
+error:
+	rpmsg_lb_del_vqs(vdev);
+	return -ENOMEM;
+}
+
+static u8 rpmsg_lb_get_status(struct virtio_device *vdev)
+{
+	return 0;
+}
+
+static void rpmsg_lb_set_status(struct virtio_device *vdev, u8 status)
+{
+	dev_dbg(&vdev->dev, "new status: %d\n", status);
+}
+
+static void rpmsg_lb_reset(struct virtio_device *vdev)
+{
+	dev_dbg(&vdev->dev, "reset !\n");
+}
+
+static u32 rpmsg_lb_get_features(struct virtio_device *vdev)
+{
+	return (1 << VIRTIO_RPMSG_F_NS) | (1 << VIRTIO_RPMSG_F_FRAG);
+}
+
+static void rpmsg_lb_finalize_features(struct virtio_device *vdev)
+{
+	/* Give virtio_ring a chance to accept features */
+	vring_transport_features(vdev);
+}
+
+static void rpmsg_lb_vproc_release(struct device *dev)
+{
+	/* this handler is provided so driver core doesn't yell at us */
+}
+
+static struct virtio_config_ops rpmsg_lb_config_ops = {
+	.get_features	= rpmsg_lb_get_features,
+	.finalize_features = rpmsg_lb_finalize_features,
+	.get		= rpmsg_lb_get,
+	.find_vqs	= rpmsg_lb_find_vqs,
+	.del_vqs	= rpmsg_lb_del_vqs,
+	.reset		= rpmsg_lb_reset,
+	.set_status	= rpmsg_lb_set_status,
+	.get_status	= rpmsg_lb_get_status,
+};
+
+static struct rpmsg_lb_vproc rpmsg_lb_vproc = {
+	.vdev.id.device	= VIRTIO_ID_RPMSG,
+	.vdev.config	= &rpmsg_lb_config_ops,
+};
+
+static int __init rpmsg_lb_init(void)
+{
+	struct rpmsg_lb_vproc *lb = &rpmsg_lb_vproc;
+	int ret;
+
+	lb->bufs = alloc_pages_exact(LB_BUFS_SPACE, GFP_KERNEL | __GFP_ZERO);
+	if (!lb->bufs)
+		return -ENOMEM;
+
+	/* the remote side must handle one message at a time */
+	lb->wq = create_singlethread_workqueue("rpmsg-loopback");
+	if (!lb->wq) {
+		ret = -ENOMEM;
+		goto free_bufs;
+	}
+	INIT_WORK(&lb->work, rpmsg_lb_work);
+
+	lb->vdev.dev.release = rpmsg_lb_vproc_release;
+	ret = register_virtio_device(&lb->vdev);
+	if (ret) {
+		pr_err("failed to register vproc: %d\n", ret);
+		goto destroy_wq;
+	}
+
+	return 0;
+
+destroy_wq:
+	destroy_workqueue(lb->wq);
+free_bufs:
+	free_pages_exact(lb->bufs, LB_BUFS_SPACE);
+	return ret;
+}
+module_init(rpmsg_lb_init);
+
+static void __exit rpmsg_lb_fini(void)
+{
+	struct rpmsg_lb_vproc *lb = &rpmsg_lb_vproc;
+
+	unregister_virtio_device(&lb->vdev);
+	destroy_workqueue(lb->wq);
+	free_pages_exact(lb->bufs, LB_BUFS_SPACE);
+}
+module_exit(rpmsg_lb_fini);
+
+MODULE_LICENSE("GPL v2");
+MODULE_DESCRIPTION("Loopback remote processor messaging virtio device");
@@ -23,6 +23,10 @@
 #include <linux/module.h>
 #include <linux/scatterlist.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/file.h>
+#include <linux/hash.h>
 #include <linux/idr.h>
 #include <linux/fs.h>
 #include <linux/poll.h>
@@ -48,6 +52,24 @@ extern struct ion_device *omap_ion_device;
 /* maximum OMX devices this driver can handle */
 #define MAX_OMX_DEVICES		8
 
+/* buffer translations cached per instance */
+#define OMX_XLAT_BITS		4
+#define OMX_XLAT_MAX		64
+
+enum rpmsg_omx_xlat_kind {
+	OMX_XLAT_NONE,		/* not cacheable */
+	OMX_XLAT_ION,		/* valid until the handle is unregistered */
+	OMX_XLAT_FD,		/* valid while the fd refers to the same file */
+};
+
+struct rpmsg_omx_xlat {
+	struct hlist_node node;
+	struct list_head lru;
+	long buffer;		/* handle or fd, as passed by user space */
+	u32 da;
+	struct file *file;	/* pins the buffer behind an fd */
+};
+
 enum rpc_omx_map_info_type {
 	RPC_OMX_MAP_INFO_NONE          = 0,
 	RPC_OMX_MAP_INFO_ONE_BUF       = 1,
@@ -74,6 +96,8 @@ struct rpmsg_omx_service {
 #ifdef CONFIG_ION_OMAP
 	struct ion_client *ion_client;
 #endif
+	atomic_t xlat_hits;
+	atomic_t xlat_misses;
 };
 
 struct rpmsg_omx_instance {
@@ -89,6 +113,14 @@ struct rpmsg_omx_instance {
 #ifdef CONFIG_ION_OMAP
 	struct ion_client *ion_client;
 #endif
+	struct omx_ring_ctrl *ring;	/* shared with user space, or NULL */
+	struct mutex tx_lock;		/* serializes ring transmits */
+	u32 rx_head;			/* private copies of the ring indices */
+	u32 tx_tail;
+	struct mutex xlat_lock;
+	struct hlist_head xlat[1 << OMX_XLAT_BITS];
+	struct list_head xlat_lru;	/* most recently used first */
+	int xlat_num;
 };
 
 static struct class *rpmsg_omx_class;
@@ -124,7 +156,13 @@ static u32 _rpmsg_pa_to_da(u32 pa)
 		return 0;
 }
 
-static u32 _rpmsg_omx_buffer_lookup(struct rpmsg_omx_instance *omx, long buffer)
+/*
+ * Translates a buffer to a device address, and tells how long the
+ * translation stays valid, see enum rpmsg_omx_xlat_kind.  For OMX_XLAT_FD,
+ * a reference to the file is returned in *file.
+ */
+static u32 _rpmsg_omx_buffer_lookup(struct rpmsg_omx_instance *omx,
+		long buffer, enum rpmsg_omx_xlat_kind *kind, struct file **file)
 {
 	phys_addr_t pa;
 	u32 va;
@@ -133,11 +171,17 @@ static u32 _rpmsg_omx_buffer_lookup(struct rpmsg_omx_instance *omx, long buffer)
 	ion_phys_addr_t paddr;
 	size_t unused;
 	int fd;
+#endif
+
+	*kind = OMX_XLAT_NONE;
+	*file = NULL;
 
+#ifdef CONFIG_ION_OMAP
 	/* is it an ion handle? */
 	handle = (struct ion_handle *)buffer;
 	if (!ion_phys(omx->ion_client, handle, &paddr, &unused)) {
 		pa = (phys_addr_t) paddr;
+		*kind = OMX_XLAT_ION;
 		goto to_va;
 	}
 
@@ -146,12 +190,18 @@ static u32 _rpmsg_omx_buffer_lookup(struct rpmsg_omx_instance *omx, long buffer)
 	{
 		struct ion_client *pvr_ion_client;
 		fd = buffer;
+		*file = fget(fd);
 		handle = PVRSRVExportFDToIONHandle(fd, &pvr_ion_client);
 		if (handle &&
 			!ion_phys(pvr_ion_client, handle, &paddr, &unused)) {
 			pa = (phys_addr_t)paddr;
+			if (*file)
+				*kind = OMX_XLAT_FD;
 			goto to_va;
 		}
+		if (*file)
+			fput(*file);
+		*file = NULL;
 	}
 #endif
 #endif
@@ -164,6 +214,113 @@ to_va:
 	return va;
 }
 
+static struct rpmsg_omx_xlat *
+rpmsg_omx_xlat_find(struct rpmsg_omx_instance *omx, long buffer)
+{
+	struct rpmsg_omx_xlat *x;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry(x, pos, &omx->xlat[hash_long(buffer,
+						OMX_XLAT_BITS)], node)
+		if (x->buffer == buffer)
+			return x;
+	return NULL;
+}
+
+static void rpmsg_omx_xlat_drop(struct rpmsg_omx_instance *omx,
+						struct rpmsg_omx_xlat *x)
+{
+	hlist_del(&x->node);
+	list_del(&x->lru);
+	if (x->file)
+		fput(x->file);
+	kfree(x);
+	omx->xlat_num--;
+}
+
+#ifdef CONFIG_ION_OMAP
+/* forgets the translation of a buffer that is being freed */
+static void rpmsg_omx_xlat_invalidate(struct rpmsg_omx_instance *omx,
+								long buffer)
+{
+	struct rpmsg_omx_xlat *x;
+
+	mutex_lock(&omx->xlat_lock);
+	x = rpmsg_omx_xlat_find(omx, buffer);
+	if (x)
+		rpmsg_omx_xlat_drop(omx, x);
+	mutex_unlock(&omx->xlat_lock);
+}
+#endif
+
+static void rpmsg_omx_xlat_flush(struct rpmsg_omx_instance *omx)
+{
+	struct rpmsg_omx_xlat *x, *tmp;
+
+	mutex_lock(&omx->xlat_lock);
+	list_for_each_entry_safe(x, tmp, &omx->xlat_lru, lru)
+		rpmsg_omx_xlat_drop(omx, x);
+	mutex_unlock(&omx->xlat_lock);
+}
+
+/*
+ * Translates a buffer through the instance's cache, so that the buffers
+ * a decode loop keeps passing are only looked up once.  Called with
+ * xlat_lock held.
+ */
+static u32 rpmsg_omx_xlat(struct rpmsg_omx_instance *omx, long buffer)
+{
+	struct rpmsg_omx_service *omxserv = omx->omxserv;
+	enum rpmsg_omx_xlat_kind kind;
+	struct rpmsg_omx_xlat *x;
+	struct file *file;
+	u32 da;
+
+	x = rpmsg_omx_xlat_find(omx, buffer);
+	if (x && x->file) {
+		/* the fd may have been closed, and reused for another file */
+		file = fget(buffer);
+		if (file != x->file) {
+			rpmsg_omx_xlat_drop(omx, x);
+			x = NULL;
+		}
+		if (file)
+			fput(file);
+	}
+	if (x) {
+		list_move(&x->lru, &omx->xlat_lru);
+		atomic_inc(&omxserv->xlat_hits);
+		return x->da;
+	}
+
+	atomic_inc(&omxserv->xlat_misses);
+	da = _rpmsg_omx_buffer_lookup(omx, buffer, &kind, &file);
+	if (!da || kind == OMX_XLAT_NONE)
+		goto out;
+
+	x = kmalloc(sizeof(*x), GFP_KERNEL);
+	if (!x)
+		goto out;
+
+	/* evict the least recently used translation */
+	if (omx->xlat_num >= OMX_XLAT_MAX)
+		rpmsg_omx_xlat_drop(omx, list_entry(omx->xlat_lru.prev,
+						struct rpmsg_omx_xlat, lru));
+
+	x->buffer = buffer;
+	x->da = da;
+	x->file = file;
+	hlist_add_head(&x->node, &omx->xlat[hash_long(buffer, OMX_XLAT_BITS)]);
+	list_add(&x->lru, &omx->xlat_lru);
+	omx->xlat_num++;
+	return da;
+
+out:
+	if (file)
+		fput(file);
+	return da;
+}
+
 static int _rpmsg_omx_map_buf(struct rpmsg_omx_instance *omx, char *packet)
 {
 	int ret = -EINVAL, offset = 0;
@@ -186,7 +343,9 @@ static int _rpmsg_omx_map_buf(struct rpmsg_omx_instance *omx, char *packet)
 	offset = *(int *)((int)data + sizeof(maptype));
 	buffer = (long *)((int)data + offset);
 
-	da = _rpmsg_omx_buffer_lookup(omx, *buffer);
+	/* translate all buffers of the packet under one lock */
+	mutex_lock(&omx->xlat_lock);
+	da = rpmsg_omx_xlat(omx, *buffer);
 	if (da) {
 		*buffer = da;
 		ret = 0;
@@ -196,7 +355,7 @@ static int _rpmsg_omx_map_buf(struct rpmsg_omx_instance *omx, char *packet)
 		buffer = (long *)((int)data + offset + sizeof(*buffer));
 		if (*buffer != 0) {
 			ret = -EIO;
-			da = _rpmsg_omx_buffer_lookup(omx, *buffer);
+			da = rpmsg_omx_xlat(omx, *buffer);
 			if (da) {
 				*buffer = da;
 				ret = 0;
@@ -208,16 +367,63 @@ static int _rpmsg_omx_map_buf(struct rpmsg_omx_instance *omx, char *packet)
 		buffer = (long *)((int)data + offset + 2*sizeof(*buffer));
 		if (*buffer != 0) {
 			ret = -EIO;
-			da = _rpmsg_omx_buffer_lookup(omx, *buffer);
+			da = rpmsg_omx_xlat(omx, *buffer);
 			if (da) {
 				*buffer = da;
 				ret = 0;
 			}
 		}
 	}
+	mutex_unlock(&omx->xlat_lock);
 	return ret;
 }
 
+static struct omx_ring_slot *
+rpmsg_omx_ring_slot(struct rpmsg_omx_instance *omx, u32 offset, u32 index)
+{
+	return (void *) omx->ring + offset +
+				(index % OMX_RING_SLOTS) * OMX_RING_SLOT_SIZE;
+}
+
+/*
+ * Puts a message in the receive ring, if there is a free slot.  Called with
+ * omx->lock held.
+ */
+static bool rpmsg_omx_ring_rx(struct rpmsg_omx_instance *omx, void *data,
+								u32 len)
+{
+	struct omx_ring_ctrl *ctrl = omx->ring;
+	struct omx_ring_slot *slot;
+
+	if (!ctrl || len > sizeof(slot->data))
+		return false;
+	if (omx->rx_head - ACCESS_ONCE(ctrl->rx_tail) >= OMX_RING_SLOTS)
+		return false;
+	/* user space must be done with the slot before it is reused */
+	smp_mb();
+
+	slot = rpmsg_omx_ring_slot(omx, OMX_RING_RX_OFFSET, omx->rx_head);
+	slot->len = len;
+	memcpy(slot->data, data, len);
+	/* publish the message before the index */
+	smp_wmb();
+	ctrl->rx_head = ++omx->rx_head;
+	return true;
+}
+
+/* moves queued messages into the receive ring, called with omx->lock held */
+static void rpmsg_omx_ring_refill(struct rpmsg_omx_instance *omx)
+{
+	struct sk_buff *skb;
+
+	while ((skb = skb_peek(&omx->queue)) &&
+			rpmsg_omx_ring_rx(omx, skb->data, skb->len)) {
+		skb_unlink(skb, &omx->queue);
+		kfree_skb(skb);
+	}
+	omx->ring->rx_queued = skb_queue_len(&omx->queue);
+}
+
 static void rpmsg_omx_cb(struct rpmsg_channel *rpdev, void *data, int len,
 							void *priv, u32 src)
 {
@@ -256,6 +462,19 @@ static void rpmsg_omx_cb(struct rpmsg_channel *rpdev, void *data, int len,
 		complete(&omx->reply_arrived);
 		break;
 	case OMX_RAW_MSG:
+		/*
+		 * with a ring mapped, messages go straight into it, unless
+		 * older ones are still queued
+		 */
+		mutex_lock(&omx->lock);
+		if (skb_queue_empty(&omx->queue) &&
+				rpmsg_omx_ring_rx(omx, hdr->data, hdr->len)) {
+			mutex_unlock(&omx->lock);
+			wake_up_interruptible(&omx->readq);
+			break;
+		}
+		mutex_unlock(&omx->lock);
+
 		skb = alloc_skb(hdr->len, GFP_KERNEL);
 		if (!skb) {
 			dev_err(&rpdev->dev, "alloc_skb err: %u\n", hdr->len);
@@ -266,6 +485,8 @@ static void rpmsg_omx_cb(struct rpmsg_channel *rpdev, void *data, int len,
 
 		mutex_lock(&omx->lock);
 		skb_queue_tail(&omx->queue, skb);
+		if (omx->ring)
+			omx->ring->rx_queued = skb_queue_len(&omx->queue);
 		mutex_unlock(&omx->lock);
 		/* wake up any blocking processes, waiting for new data */
 		wake_up_interruptible(&omx->readq);
@@ -324,6 +545,78 @@ static int rpmsg_omx_connect(struct rpmsg_omx_instance *omx, char *omxname)
 	return -ETIMEDOUT;
 }
 
+/* sends the messages that user space put in the transmit ring */
+static int rpmsg_omx_ring_kick(struct rpmsg_omx_instance *omx)
+{
+	struct rpmsg_omx_service *omxserv = omx->omxserv;
+	struct omx_ring_ctrl *ctrl = omx->ring;
+	struct omx_ring_slot *slot;
+	char kbuf[512];
+	struct omx_msg_hdr *hdr = (struct omx_msg_hdr *) kbuf;
+	u32 head, len;
+	int ret = 0;
+
+	if (!ctrl)
+		return -EINVAL;
+	if (omx->state != OMX_CONNECTED)
+		return -ENOTCONN;
+
+	mutex_lock(&omx->tx_lock);
+	head = ACCESS_ONCE(ctrl->tx_head);
+	if (head - omx->tx_tail > OMX_RING_SLOTS) {
+		ret = -EINVAL;
+		goto out;
+	}
+	/* read the slots after the index */
+	smp_rmb();
+
+	while (omx->tx_tail != head) {
+		slot = rpmsg_omx_ring_slot(omx, OMX_RING_TX_OFFSET,
+								omx->tx_tail);
+		/*
+		 * translate a copy of the message, so that user space cannot
+		 * change it after it is checked
+		 */
+		len = ACCESS_ONCE(slot->len);
+		if (len > sizeof(kbuf) - sizeof(*hdr)) {
+			ret = -EMSGSIZE;
+		} else {
+			memcpy(hdr->data, slot->data, len);
+			ret = _rpmsg_omx_map_buf(omx, hdr->data);
+		}
+		if (ret < 0) {
+			/* drop the invalid message, so that the ring goes on */
+			ctrl->tx_errors++;
+			omx->tx_tail++;
+			break;
+		}
+
+		hdr->type = OMX_RAW_MSG;
+		hdr->flags = 0;
+		hdr->len = len;
+
+		ret = rpmsg_send_offchannel(omxserv->rpdev, omx->ept->addr,
+					omx->dst, kbuf, sizeof(*hdr) + len);
+		if (ret) {
+			dev_err(omxserv->dev, "rpmsg_send failed: %d\n", ret);
+			break;
+		}
+		omx->tx_tail++;
+	}
+
+	/* finish reading the slots before handing them back */
+	smp_mb();
+	ctrl->tx_tail = omx->tx_tail;
+out:
+	mutex_unlock(&omx->tx_lock);
+
+	mutex_lock(&omx->lock);
+	rpmsg_omx_ring_refill(omx);
+	mutex_unlock(&omx->lock);
+
+	return ret;
+}
+
 static
 long rpmsg_omx_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 {
@@ -353,6 +646,9 @@ long rpmsg_omx_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		buf[sizeof(buf) - 1] = '\0';
 		ret = rpmsg_omx_connect(omx, buf);
 		break;
+	case OMX_IOCRINGKICK:
+		ret = rpmsg_omx_ring_kick(omx);
+		break;
 #ifdef CONFIG_ION_OMAP
 	case OMX_IOCIONREGISTER:
 	{
@@ -383,6 +679,7 @@ long rpmsg_omx_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 				_IOC_NR(cmd), ret);
 			return -EFAULT;
 		}
+		rpmsg_omx_xlat_invalidate(omx, (long) data.handle);
 		ion_free(omx->ion_client, data.handle);
 		if (copy_to_user(&data, (char __user *) arg, sizeof(data))) {
 			dev_err(omxserv->dev,
@@ -418,6 +715,9 @@ static int rpmsg_omx_open(struct inode *inode, struct file *filp)
 		return -ENOMEM;
 
 	mutex_init(&omx->lock);
+	mutex_init(&omx->tx_lock);
+	mutex_init(&omx->xlat_lock);
+	INIT_LIST_HEAD(&omx->xlat_lru);
 	skb_queue_head_init(&omx->queue);
 	init_waitqueue_head(&omx->readq);
 	omx->omxserv = omxserv;
@@ -485,12 +785,14 @@ static int rpmsg_omx_release(struct inode *inode, struct file *filp)
 	}
 	rpmsg_destroy_ept(omx->ept);
 out:
+	rpmsg_omx_xlat_flush(omx);
 #ifdef CONFIG_ION_OMAP
 	ion_client_destroy(omx->ion_client);
 #endif
 	mutex_lock(&omxserv->lock);
 	list_del(&omx->next);
 	mutex_unlock(&omxserv->lock);
+	vfree(omx->ring);
 	kfree(omx);
 
 	return 0;
@@ -616,7 +918,8 @@ unsigned int rpmsg_poll(struct file *filp, struct poll_table_struct *wait)
 		return -ENXIO;
 	}
 
-	if (!skb_queue_empty(&omx->queue))
+	if (!skb_queue_empty(&omx->queue) || (omx->ring &&
+			omx->rx_head != ACCESS_ONCE(omx->ring->rx_tail)))
 		mask |= POLLIN | POLLRDNORM;
 
 	/* implement missing rpmsg virtio functionality here */
@@ -628,6 +931,28 @@ unsigned int rpmsg_poll(struct file *filp, struct poll_table_struct *wait)
 	return mask;
 }
 
+/* maps the message ring, see OMX_RING_SIZE */
+static int rpmsg_omx_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct rpmsg_omx_instance *omx = filp->private_data;
+	int ret = 0;
+
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start != OMX_RING_SIZE)
+		return -EINVAL;
+
+	mutex_lock(&omx->lock);
+	if (!omx->ring) {
+		omx->ring = vmalloc_user(OMX_RING_SIZE);
+		if (!omx->ring)
+			ret = -ENOMEM;
+	}
+	if (!ret)
+		ret = remap_vmalloc_range(vma, omx->ring, 0);
+	mutex_unlock(&omx->lock);
+
+	return ret;
+}
+
 static const struct file_operations rpmsg_omx_fops = {
 	.open		= rpmsg_omx_open,
 	.release	= rpmsg_omx_release,
@@ -635,6 +960,7 @@ static const struct file_operations rpmsg_omx_fops = {
 	.read		= rpmsg_omx_read,
 	.write		= rpmsg_omx_write,
 	.poll		= rpmsg_poll,
+	.mmap		= rpmsg_omx_mmap,
 	.owner		= THIS_MODULE,
 };
 
@@ -696,7 +1022,7 @@ static int rpmsg_omx_probe(struct rpmsg_channel *rpdev)
 	}
 
 	omxserv->dev = device_create(rpmsg_omx_class, &rpdev->dev,
-			MKDEV(major, minor), NULL,
+			MKDEV(major, minor), omxserv,
 			"rpmsg-omx%d", minor);
 	if (IS_ERR(omxserv->dev)) {
 		ret = PTR_ERR(omxserv->dev);
@@ -772,6 +1098,29 @@ static void rpmsg_omx_driver_cb(struct rpmsg_channel *rpdev, void *data,
 		       data, len,  true);
 }
 
+static ssize_t xlat_hits_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct rpmsg_omx_service *omxserv = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", atomic_read(&omxserv->xlat_hits));
+}
+
+static ssize_t xlat_misses_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct rpmsg_omx_service *omxserv = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%d\n", atomic_read(&omxserv->xlat_misses));
+}
+
+/* buffer translation cache statistics, of all instances of the service */
+static struct device_attribute rpmsg_omx_dev_attrs[] = {
+	__ATTR_RO(xlat_hits),
+	__ATTR_RO(xlat_misses),
+	__ATTR_NULL,
+};
+
 static struct rpmsg_device_id rpmsg_omx_id_table[] = {
 	{ .name	= "rpmsg-omx" },
 	{ },
@@ -804,6 +1153,7 @@ static int __init init(void)
 		pr_err("class_create failed: %d\n", ret);
 		goto unreg_region;
 	}
+	rpmsg_omx_class->dev_attrs = rpmsg_omx_dev_attrs;
 
 	return register_rpmsg_driver(&rpmsg_omx_driver);
 
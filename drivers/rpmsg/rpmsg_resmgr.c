@@ -49,6 +49,11 @@
 
 static struct dentry *rprm_dbg;
 
+/* how long a relaxed constraint must stay unchanged before it is applied */
+static unsigned int coalesce_ms = 50;
+module_param(coalesce_ms, uint, 0644);
+MODULE_PARM_DESC(coalesce_ms, "Window to coalesce constraint changes in");
+
 static char *regulator_name[] = {
 	"cam2pwr"
 };
@@ -83,6 +88,13 @@ static const char *rname(u32 type) {
 	return rnames[type];
 }
 
+struct rprm_stats {
+	u32 requests;		/* constraint requests */
+	u32 cached;		/* requests for the value already in effect */
+	u32 coalesced;		/* requests superseding one not applied yet */
+	u32 applied;		/* constraint changes actually applied */
+};
+
 struct rprm_elem {
 	struct list_head next;
 	u32 src;
@@ -90,15 +102,26 @@ struct rprm_elem {
 	u32 id;
 	void *handle;
 	u32 base;
-	struct rprm_constraints_data *constraints;
+	struct rprm_constraints_data *constraints;	/* as requested */
+	struct rprm_constraints_data applied;		/* as in effect */
+	u32 dirty;		/* constraints requested but not applied */
+	unsigned long relax_at;	/* when to apply relaxed constraints */
+	unsigned long since;	/* when the resource was allocated */
+	struct rprm_stats stats;
 	char res[];
 };
 
+/*
+ * @lock protects the lists and the requested constraints, @apply_lock is
+ * held while applying constraints, and while the resource list changes.
+ */
 struct rprm {
 	struct list_head res_list;
 	struct idr conn_list;
 	struct idr id_list;
 	struct mutex lock;
+	struct mutex apply_lock;
+	struct delayed_work cstr_work;
 	struct dentry *dbg_dir;
 };
 
@@ -532,59 +555,172 @@ static int _rproc_set_constraints(struct rprm_elem *e, u32 type, long val)
 	return -EINVAL;
 }
 
-static
-int _set_constraints(struct rprm_elem *e, struct rprm_constraints_data *c)
-{
-	int ret = -EINVAL;
-	u32 mask = 0;
-	int (*_set_constraints_func)(struct rprm_elem *, u32 type, long val);
+typedef int (*rprm_constraints_fn)(struct rprm_elem *, u32 type, long val);
 
+static rprm_constraints_fn _constraints_func(struct rprm_elem *e)
+{
 	switch (e->type) {
 	case RPRM_IVAHD:
 	case RPRM_ISS:
 	case RPRM_FDIF:
-		_set_constraints_func = _rpres_set_constraints;
-		break;
+		return _rpres_set_constraints;
 	case RPRM_IPU:
-		_set_constraints_func = _rproc_set_constraints;
-		break;
+		return _rproc_set_constraints;
+	}
+	return NULL;
+}
+
+static long *_constraint_val(struct rprm_constraints_data *c, u32 type)
+{
+	switch (type) {
+	case RPRM_SCALE:
+		return &c->frequency;
+	case RPRM_LATENCY:
+		return &c->latency;
 	default:
-		return -EINVAL;
+		return &c->bandwidth;
 	}
+}
 
-	if (c->mask & RPRM_SCALE) {
-		ret = _set_constraints_func(e, RPRM_SCALE, c->frequency);
-		if (ret)
-			goto err;
-		mask |= RPRM_SCALE;
-		e->constraints->frequency = c->frequency;
+/* whether @val asks more of the system than @cur, and so can't wait */
+static bool _constraint_tighter(u32 type, long val, long cur)
+{
+	switch (type) {
+	case RPRM_SCALE:
+		return val > cur;
+	case RPRM_LATENCY:
+		return val != -1 && (cur == -1 || val < cur);
+	default:
+		return val != -1 && (cur == -1 || val > cur);
 	}
+}
 
-	if (c->mask & RPRM_LATENCY) {
-		ret = _set_constraints_func(e, RPRM_LATENCY, c->latency);
-		if (ret)
-			goto err;
-		mask |= RPRM_LATENCY;
-		e->constraints->latency = c->latency;
+#define for_each_constraint(type) \
+	for (type = RPRM_SCALE; type <= RPRM_BANDWIDTH; type <<= 1)
+
+/*
+ * Records a constraint request, to be applied by rprm_constraints_work().
+ * Requests for the value already in effect are dropped, and a request
+ * superseding one not applied yet replaces it.  Tighter constraints are
+ * applied right away, while relaxed ones only once they were not changed
+ * for the coalescing window, so that a remote processor toggling a
+ * constraint around each frame does not pay for it every time.
+ * Must be called with rprm->lock held.
+ */
+static void _request_constraint(struct rprm *rprm, struct rprm_elem *e,
+							u32 type, long val)
+{
+	long cur = *_constraint_val(&e->applied, type);
+	unsigned long window = msecs_to_jiffies(coalesce_ms);
+
+	e->stats.requests++;
+	*_constraint_val(e->constraints, type) = val;
+
+	if (e->dirty & type)
+		e->stats.coalesced++;
+	else if (val == cur)
+		e->stats.cached++;
+
+	if (val == cur) {
+		e->dirty &= ~type;
+		return;
 	}
 
-	if (c->mask & RPRM_BANDWIDTH) {
-		ret = _set_constraints_func(e, RPRM_BANDWIDTH, c->bandwidth);
-		if (ret)
-			goto err;
-		mask |= RPRM_BANDWIDTH;
-		e->constraints->bandwidth = c->bandwidth;
+	e->dirty |= type;
+	if (_constraint_tighter(type, val, cur)) {
+		/* run now, even if it is waiting for a relaxed constraint */
+		cancel_delayed_work(&rprm->cstr_work);
+		schedule_delayed_work(&rprm->cstr_work, 0);
+	} else {
+		e->relax_at = jiffies + window;
+		schedule_delayed_work(&rprm->cstr_work, window);
+	}
+}
+
+static void rprm_constraints_work(struct work_struct *work)
+{
+	struct rprm *rprm = container_of(to_delayed_work(work), struct rprm,
+								cstr_work);
+	rprm_constraints_fn func;
+	struct rprm_constraints_data c;
+	struct rprm_elem *e;
+	unsigned long next = 0;
+	u32 type, due;
+	int ret;
+
+	/* the resource list only changes with apply_lock held */
+	mutex_lock(&rprm->apply_lock);
+	list_for_each_entry(e, &rprm->res_list, next) {
+		mutex_lock(&rprm->lock);
+		c = e->applied;
+		due = 0;
+		for_each_constraint(type) {
+			if (!(e->dirty & type))
+				continue;
+			*_constraint_val(&c, type) =
+				*_constraint_val(e->constraints, type);
+			if (_constraint_tighter(type,
+					*_constraint_val(&c, type),
+					*_constraint_val(&e->applied, type)) ||
+					time_after_eq(jiffies, e->relax_at))
+				due |= type;
+			else if (!next || time_before(e->relax_at, next))
+				next = e->relax_at;
+		}
+		e->dirty &= ~due;
+		mutex_unlock(&rprm->lock);
+
+		func = _constraints_func(e);
+		for_each_constraint(type) {
+			if (!(due & type))
+				continue;
+			ret = func(e, type, *_constraint_val(&c, type));
+			if (ret) {
+				pr_err("%s: setting constraint 0x%x of %s to "
+					"%ld failed: %d\n", __func__, type,
+					rname(e->type),
+					*_constraint_val(&c, type), ret);
+				continue;
+			}
+			mutex_lock(&rprm->lock);
+			*_constraint_val(&e->applied, type) =
+						*_constraint_val(&c, type);
+			e->stats.applied++;
+			mutex_unlock(&rprm->lock);
+		}
+	}
+	mutex_unlock(&rprm->apply_lock);
+
+	if (next)
+		schedule_delayed_work(&rprm->cstr_work,
+			time_after(next, jiffies) ? next - jiffies : 0);
+}
+
+/* must be called with rprm->apply_lock held */
+static void _release_constraints(struct rprm_elem *e)
+{
+	rprm_constraints_fn func;
+	long def;
+	u32 type;
+
+	func = _constraints_func(e);
+	if (!func)
+		return;
+
+	for_each_constraint(type) {
+		def = *_constraint_val(&def_data, type);
+		if (*_constraint_val(&e->applied, type) != def)
+			func(e, type, def);
 	}
-err:
-	c->mask = mask;
-	return ret;
 }
 
 static int rprm_set_constraints(struct rprm *rprm, u32 addr, int res_id,
 			   void *data, bool set)
 {
+	struct rprm_constraints_data *c = data;
 	int ret = 0;
 	struct rprm_elem *e;
+	u32 type;
 
 	mutex_lock(&rprm->lock);
 	if (!idr_find(&rprm->conn_list, addr)) {
@@ -598,26 +734,24 @@ static int rprm_set_constraints(struct rprm *rprm, u32 addr, int res_id,
 		goto out;
 	}
 
-	if (!e->constraints) {
+	if (!e->constraints || !_constraints_func(e)) {
 		pr_warn("No constraints\n");
 		ret = -EINVAL;
 		goto out;
 	}
 
-	if (set) {
-		ret = _set_constraints(e, data);
-		if (!ret) {
-			e->constraints->mask |=
-				((struct rprm_constraints_data *)data)->mask;
-			goto out;
-		}
-	}
-	def_data.mask = ((struct rprm_constraints_data *)data)->mask;
-	if (def_data.mask) {
-		_set_constraints(e, &def_data);
-		e->constraints->mask &=
-				~((struct rprm_constraints_data *)data)->mask;
+	for_each_constraint(type) {
+		if (!(c->mask & type))
+			continue;
+		_request_constraint(rprm, e, type, set ?
+				*_constraint_val(c, type) :
+				*_constraint_val(&def_data, type));
 	}
+
+	if (set)
+		e->constraints->mask |= c->mask;
+	else
+		e->constraints->mask &= ~c->mask;
 out:
 	mutex_unlock(&rprm->lock);
 	return ret;
@@ -632,6 +766,7 @@ static int rprm_rpres_request(struct rprm_elem *e, int type)
 	e->constraints = kzalloc(sizeof(*(e->constraints)), GFP_KERNEL);
 	if (!(e->constraints))
 		return -ENOMEM;
+	e->applied = def_data;
 
 	res = rpres_get(res_name);
 
@@ -657,6 +792,7 @@ static int rprm_rproc_request(struct rprm_elem *e, char *name)
 	e->constraints = kzalloc(sizeof(*(e->constraints)), GFP_KERNEL);
 	if (!(e->constraints))
 		return -ENOMEM;
+	e->applied = def_data;
 
 	rp = rproc_get(name);
 	if (IS_ERR(rp)) {
@@ -677,10 +813,8 @@ static void rprm_rproc_release(struct rproc *rp)
 static int _resource_free(struct rprm_elem *e)
 {
 	int ret = 0;
-	if (e->constraints && e->constraints->mask) {
-		def_data.mask = e->constraints->mask;
-		_set_constraints(e, &def_data);
-	}
+	if (e->constraints)
+		_release_constraints(e);
 	kfree(e->constraints);
 
 	switch (e->type) {
@@ -729,6 +863,7 @@ static int rprm_resource_free(struct rprm *rprm, u32 addr, int res_id)
 	int ret = 0;
 	struct rprm_elem *e;
 
+	mutex_lock(&rprm->apply_lock);
 	mutex_lock(&rprm->lock);
 	if (!idr_find(&rprm->conn_list, addr)) {
 		ret = -ENOTCONN;
@@ -749,6 +884,7 @@ out:
 		ret = _resource_free(e);
 		kfree(e);
 	}
+	mutex_unlock(&rprm->apply_lock);
 
 	return ret;
 }
@@ -819,6 +955,7 @@ static int rprm_resource_alloc(struct rprm *rprm, u32 addr, int *res_id,
 		goto err_res_alloc;
 	}
 
+	mutex_lock(&rprm->apply_lock);
 	mutex_lock(&rprm->lock);
 	if (!idr_find(&rprm->conn_list, addr)) {
 		pr_err("%s: addr %d not connected!\n", __func__, addr);
@@ -840,13 +977,16 @@ static int rprm_resource_alloc(struct rprm *rprm, u32 addr, int *res_id,
 	e->type = type;
 	e->src = addr;
 	e->id = *res_id;
+	e->since = jiffies;
 	memcpy(e->res, data, rlen);
 	list_add(&e->next, &rprm->res_list);
 	mutex_unlock(&rprm->lock);
+	mutex_unlock(&rprm->apply_lock);
 
 	return 0;
 err:
 	mutex_unlock(&rprm->lock);
+	mutex_unlock(&rprm->apply_lock);
 	_resource_free(e);
 err_res_alloc:
 	kfree(e);
@@ -859,6 +999,7 @@ static int rprm_disconnect_client(struct rprm *rprm, u32 addr)
 	struct rprm_elem *e, *tmp;
 	int ret;
 
+	mutex_lock(&rprm->apply_lock);
 	mutex_lock(&rprm->lock);
 	if (!idr_find(&rprm->conn_list, addr)) {
 		ret = -ENOTCONN;
@@ -876,6 +1017,7 @@ static int rprm_disconnect_client(struct rprm *rprm, u32 addr)
 	idr_remove(&rprm->conn_list, addr);
 out:
 	mutex_unlock(&rprm->lock);
+	mutex_unlock(&rprm->apply_lock);
 
 	return 0;
 }
@@ -1066,6 +1208,19 @@ static int _printf_constraints_args(char *buf, struct rprm_elem *e)
 		e->constraints->latency, e->constraints->bandwidth);
 }
 
+static int _printf_constraints_stats(char *buf, struct rprm_elem *e)
+{
+	unsigned long secs = (jiffies - e->since) / HZ ? : 1;
+
+	return sprintf(buf,
+		"Requests:%u (%lu/s)\n"
+		"Cached:%u\n"
+		"Coalesced:%u\n"
+		"Applied:%u\n",
+		e->stats.requests, e->stats.requests / secs,
+		e->stats.cached, e->stats.coalesced, e->stats.applied);
+}
+
 static ssize_t rprm_dbg_read(struct file *filp, char __user *userbuf,
 			 size_t count, loff_t *ppos)
 {
@@ -1087,6 +1242,9 @@ static ssize_t rprm_dbg_read(struct file *filp, char __user *userbuf,
 		if (e->constraints && e->constraints->mask)
 			c += _printf_constraints_args(res + c, e);
 
+		if (e->stats.requests)
+			c += _printf_constraints_stats(res + c, e);
+
 		p += c;
 		if (*ppos >= p)
 			continue;
@@ -1123,6 +1281,8 @@ static int rprm_probe(struct rpmsg_channel *rpdev)
 		return -ENOMEM;
 
 	mutex_init(&rprm->lock);
+	mutex_init(&rprm->apply_lock);
+	INIT_DELAYED_WORK(&rprm->cstr_work, rprm_constraints_work);
 	INIT_LIST_HEAD(&rprm->res_list);
 	idr_init(&rprm->conn_list);
 	idr_init(&rprm->id_list);
@@ -1148,6 +1308,8 @@ static void __devexit rprm_remove(struct rpmsg_channel *rpdev)
 	if (rprm->dbg_dir)
 		debugfs_remove_recursive(rprm->dbg_dir);
 
+	cancel_delayed_work_sync(&rprm->cstr_work);
+	mutex_lock(&rprm->apply_lock);
 	mutex_lock(&rprm->lock);
 
 	/* clean up remaining resources */
@@ -1162,6 +1324,7 @@ static void __devexit rprm_remove(struct rpmsg_channel *rpdev)
 	idr_destroy(&rprm->conn_list);
 
 	mutex_unlock(&rprm->lock);
+	mutex_unlock(&rprm->apply_lock);
 
 	kfree(rprm);
 }
@@ -30,8 +30,17 @@
 #include <linux/jiffies.h>
 #include <linux/sched.h>
 #include <linux/wait.h>
+#include <linux/percpu.h>
 #include <linux/rpmsg.h>
 
+/* tx buffers reserved by each cpu, see get_a_buf() */
+#define RPMSG_TX_POOL		(8)
+
+struct rpmsg_tx_pool {
+	void *bufs[RPMSG_TX_POOL];
+	int num;
+};
+
 /**
  * struct virtproc_info - virtual remote processor info
  *
@@ -44,12 +53,17 @@
  * @last_sbuf:	index of last tx buffer used
  * @sim_base:	simulated base addr base to make virtio's virt_to_page happy
  * @svq_lock:	protects the tx virtqueue, to allow several concurrent senders
+ * @tx_pool:	tx buffers reserved by each cpu
+ * @pool_fill:	number of buffers a cpu reserves at once
+ * @sleepers:	number of senders waiting for a tx buffer
+ * @frag_lock:	serializes the senders of fragmented messages
  * @num_bufs:	total number of buffers allocated for communicating with this
  *		virtual remote processor. half is used for rx and half for tx.
  * @buf_size:	size of buffers allocated for communications
  * @endpoints:	the set of local endpoints
  * @endpoints_lock: lock of the endpoints set
  * @sendq:	wait queue of sending contexts waiting for free rpmsg buffer
+ * @tx_done:	count of "tx-complete" interrupts, for the senders on @sendq
  * @ns_ept:	the bus's name service endpoint
  *
  * This structure stores the rpmsg state of a given virtio remote processor
@@ -63,11 +77,16 @@ struct virtproc_info {
 	int last_rbuf, last_sbuf;
 	void *sim_base;
 	struct mutex svq_lock;
+	struct rpmsg_tx_pool __percpu *tx_pool;
+	int pool_fill;
+	atomic_t sleepers;
+	struct mutex frag_lock;
 	int num_bufs;
 	int buf_size;
 	struct idr endpoints;
 	spinlock_t endpoints_lock;
 	wait_queue_head_t sendq;
+	atomic_t tx_done;
 	struct rpmsg_endpoint *ns_ept;
 };
 
@@ -84,6 +103,9 @@ struct virtproc_info {
 /* Address 53 is reserved for advertising remote services */
 #define RPMSG_NS_ADDR			(53)
 
+/* Maximum number of buffers a fragmented message may span */
+#define RPMSG_MAX_FRAGS			(32)
+
 /* show configuration fields */
 #define rpmsg_show_attr(field, path, format_string)			\
 static ssize_t								\
@@ -222,6 +244,7 @@ void rpmsg_destroy_ept(struct rpmsg_endpoint *ept)
 	idr_remove(&vrp->endpoints, ept->addr);
 	spin_unlock(&vrp->endpoints_lock);
 
+	kfree(ept->frag);
 	kfree(ept);
 }
 EXPORT_SYMBOL(rpmsg_destroy_ept);
@@ -414,114 +437,148 @@ static int rpmsg_destroy_channel_by_info(struct virtproc_info *vrp,
 	return 0;
 }
 
-/* minimal buf "allocator" that is just enough for now */
-static void *get_a_buf(struct virtproc_info *vrp)
+/* takes a tx buffer from the shared supply, called with svq_lock held */
+static void *__get_a_buf(struct virtproc_info *vrp)
 {
 	unsigned int len;
-	void *buf = NULL;
 
 	/* make sure the descriptors are updated before reading */
 	rmb();
 	/* either pick the next unused buffer */
 	if (vrp->last_sbuf < vrp->num_bufs / 2)
-		buf = vrp->sbufs + vrp->buf_size * vrp->last_sbuf++;
+		return vrp->sbufs + vrp->buf_size * vrp->last_sbuf++;
 	/* or recycle a used one */
-	else
-		buf = virtqueue_get_buf(vrp->svq, &len);
+	return virtqueue_get_buf(vrp->svq, &len);
+}
+
+/*
+ * Every cpu keeps a few tx buffers reserved, so that most senders take a
+ * buffer without contending on svq_lock.  An empty pool is refilled in one
+ * go from the unused buffers and from those the remote processor consumed.
+ */
+static void *get_a_buf(struct virtproc_info *vrp)
+{
+	struct rpmsg_tx_pool *pool;
+	void *buf = NULL, *extra;
+
+	pool = get_cpu_ptr(vrp->tx_pool);
+	if (pool->num)
+		buf = pool->bufs[--pool->num];
+	put_cpu_ptr(vrp->tx_pool);
+	if (buf)
+		return buf;
+
+	mutex_lock(&vrp->svq_lock);
+	pool = get_cpu_ptr(vrp->tx_pool);
+	buf = __get_a_buf(vrp);
+	while (buf && pool->num < vrp->pool_fill &&
+					(extra = __get_a_buf(vrp)))
+		pool->bufs[pool->num++] = extra;
+	put_cpu_ptr(vrp->tx_pool);
+	mutex_unlock(&vrp->svq_lock);
 
 	return buf;
 }
 
-/* XXX: the blocking 'wait' mechanism hasn't been tested yet */
-int rpmsg_send_offchannel_raw(struct rpmsg_channel *rpdev, u32 src, u32 dst,
-					void *data, int len, bool wait)
+/* the first sender to doze off enables "tx-complete" interrupts */
+static void rpmsg_upref_sleepers(struct virtproc_info *vrp)
 {
-	struct virtproc_info *vrp = rpdev->vrp;
-	struct device *dev = &rpdev->dev;
+	mutex_lock(&vrp->svq_lock);
+	if (atomic_inc_return(&vrp->sleepers) == 1)
+		virtqueue_enable_cb(vrp->svq);
+	mutex_unlock(&vrp->svq_lock);
+}
+
+/* and the last one to wake up suppresses them again */
+static void rpmsg_downref_sleepers(struct virtproc_info *vrp)
+{
+	mutex_lock(&vrp->svq_lock);
+	if (atomic_dec_and_test(&vrp->sleepers))
+		virtqueue_disable_cb(vrp->svq);
+	mutex_unlock(&vrp->svq_lock);
+}
+
+/* sends a single buffer; svq_lock is only held to hand it to the remote */
+static int rpmsg_send_buf(struct virtproc_info *vrp, u32 src, u32 dst,
+			void *data, int len, u16 flags, u32 offset, bool wait)
+{
+	struct device *dev = &vrp->vdev->dev;
 	struct scatterlist sg;
 	struct rpmsg_hdr *msg;
-	int err;
-	unsigned long offset;
+	unsigned long offs;
 	void *sim_addr;
+	long timeout;
+	int err, done;
 
-	if (src == RPMSG_ADDR_ANY || dst == RPMSG_ADDR_ANY) {
-		dev_err(dev, "invalid addr (src 0x%x, dst 0x%x)\n", src, dst);
-		return -EINVAL;
-	}
-
-	/* the payload's size is currently limited */
-	if (len > vrp->buf_size - sizeof(struct rpmsg_hdr)) {
-		dev_err(dev, "message is too big (%d)\n", len);
-		return -EMSGSIZE;
-	}
-
-	/*
-	 * protect svq from simultaneous concurrent manipulations,
-	 * and serialize the sending of messages
-	 */
-	if (mutex_lock_interruptible(&vrp->svq_lock))
-		return -ERESTARTSYS;
 	/* grab a buffer */
 	msg = get_a_buf(vrp);
-	if (!msg && !wait) {
-		err = -ENOMEM;
-		goto out;
-	}
+	if (!msg && !wait)
+		return -ENOMEM;
 
 	/* no free buffer ? wait for one (but bail after 15 seconds) */
 	if (!msg) {
-		/* enable "tx-complete" interrupts before dozing off */
-		virtqueue_enable_cb(vrp->svq);
+		rpmsg_upref_sleepers(vrp);
 
 		/*
 		 * sleep until a free buffer is available or 15 secs elapse.
 		 * the timeout period is not configurable because frankly
 		 * i don't see why drivers need to deal with that.
 		 * if later this happens to be required, it'd be easy to add.
+		 *
+		 * get_a_buf() may sleep on svq_lock, so it is not the wait
+		 * condition: sleep until the remote consumes a buffer, and
+		 * retry while running.  Sampling tx_done first makes sure a
+		 * buffer freed before we sleep is not missed.
 		 */
-		err = wait_event_interruptible_timeout(vrp->sendq,
-					(msg = get_a_buf(vrp)),
-					msecs_to_jiffies(15000));
-
-		/* on success, suppress "tx-complete" interrupts again */
-		virtqueue_disable_cb(vrp->svq);
-
-		if (err < 0) {
-			err = -ERESTARTSYS;
-			goto out;
-		}
+		timeout = msecs_to_jiffies(15000);
+		do {
+			done = atomic_read(&vrp->tx_done);
+			msg = get_a_buf(vrp);
+			if (msg)
+				break;
+			timeout = wait_event_interruptible_timeout(vrp->sendq,
+					atomic_read(&vrp->tx_done) != done,
+					timeout);
+		} while (timeout > 0);
+
+		rpmsg_downref_sleepers(vrp);
+
+		if (!msg && timeout < 0)
+			return -ERESTARTSYS;
 
 		if (!msg) {
 			dev_err(dev, "timeout waiting for buffer\n");
-			err = -ETIMEDOUT;
-			goto out;
+			return -ETIMEDOUT;
 		}
 	}
 
 	msg->len = len;
-	msg->flags = 0;
+	msg->flags = flags;
 	msg->src = src;
 	msg->dst = dst;
-	msg->unused = 0;
+	msg->offset = offset;
 	memcpy(msg->data, data, len);
 
-	dev_dbg(dev, "TX From 0x%x, To 0x%x, Len %d, Flags %d, Unused %d\n",
+	dev_dbg(dev, "TX From 0x%x, To 0x%x, Len %d, Flags %d, Offset %d\n",
 					msg->src, msg->dst, msg->len,
-					msg->flags, msg->unused);
+					msg->flags, msg->offset);
 #if 0
 	print_hex_dump(KERN_DEBUG, "rpmsg_virtio TX: ", DUMP_PREFIX_NONE, 16, 1,
 					msg, sizeof(*msg) + msg->len, true);
 #endif
 
-	offset = ((unsigned long) msg) - ((unsigned long) vrp->rbufs);
-	sim_addr = vrp->sim_base + offset;
+	offs = ((unsigned long) msg) - ((unsigned long) vrp->rbufs);
+	sim_addr = vrp->sim_base + offs;
 	sg_init_one(&sg, sim_addr, sizeof(*msg) + len);
 
+	mutex_lock(&vrp->svq_lock);
+
 	/* add message to the remote processor's virtqueue */
 	err = virtqueue_add_buf_gfp(vrp->svq, &sg, 1, 0, msg, GFP_KERNEL);
 	if (err < 0) {
+		mutex_unlock(&vrp->svq_lock);
 		dev_err(dev, "virtqueue_add_buf_gfp failed: %d\n", err);
-		goto out;
+		return err;
 	}
 	/* descriptors must be written before kicking remote processor */
 	wmb();
@@ -529,13 +586,104 @@ int rpmsg_send_offchannel_raw(struct rpmsg_channel *rpdev, u32 src, u32 dst,
 	/* tell the remote processor it has a pending message to read */
 	virtqueue_kick(vrp->svq);
 
-	err = 0;
-out:
 	mutex_unlock(&vrp->svq_lock);
+
+	return 0;
+}
+
+/*
+ * Sends a message larger than a buffer as consecutive fragments.  Only the
+ * first fragment honours !wait: once it is sent, the others wait for
+ * buffers, so that the receiver gets whole messages whenever possible.
+ */
+static int rpmsg_send_frags(struct virtproc_info *vrp, u32 src, u32 dst,
+					void *data, int len, bool wait)
+{
+	int payload = vrp->buf_size - sizeof(struct rpmsg_hdr);
+	int off, n, err = 0;
+
+	/* fragments of different messages must not interleave */
+	if (mutex_lock_interruptible(&vrp->frag_lock))
+		return -ERESTARTSYS;
+
+	for (off = 0; off < len; off += n) {
+		n = min(len - off, payload);
+		err = rpmsg_send_buf(vrp, src, dst, data + off, n,
+				off + n < len ? RPMSG_F_FRAG : 0, off,
+				wait || off);
+		if (err)
+			break;
+	}
+
+	mutex_unlock(&vrp->frag_lock);
 	return err;
 }
+
+int rpmsg_send_offchannel_raw(struct rpmsg_channel *rpdev, u32 src, u32 dst,
+					void *data, int len, bool wait)
+{
+	struct virtproc_info *vrp = rpdev->vrp;
+	struct device *dev = &rpdev->dev;
+	int payload = vrp->buf_size - sizeof(struct rpmsg_hdr);
+
+	if (src == RPMSG_ADDR_ANY || dst == RPMSG_ADDR_ANY) {
+		dev_err(dev, "invalid addr (src 0x%x, dst 0x%x)\n", src, dst);
+		return -EINVAL;
+	}
+
+	if (len <= payload)
+		return rpmsg_send_buf(vrp, src, dst, data, len, 0, 0, wait);
+
+	/* larger messages need the remote processor to reassemble them */
+	if (!virtio_has_feature(vrp->vdev, VIRTIO_RPMSG_F_FRAG) ||
+					len > RPMSG_MAX_FRAGS * payload) {
+		dev_err(dev, "message is too big (%d)\n", len);
+		return -EMSGSIZE;
+	}
+
+	return rpmsg_send_frags(vrp, src, dst, data, len, wait);
+}
 EXPORT_SYMBOL(rpmsg_send_offchannel_raw);
 
+/* hands a message to its endpoint, reassembling fragmented messages first */
+static void rpmsg_deliver(struct virtproc_info *vrp,
+			struct rpmsg_endpoint *ept, struct rpmsg_hdr *msg)
+{
+	struct device *dev = &vrp->vdev->dev;
+	int max = RPMSG_MAX_FRAGS * (vrp->buf_size - sizeof(*msg));
+
+	if ((!(msg->flags & RPMSG_F_FRAG) && !msg->offset) ||
+			!virtio_has_feature(vrp->vdev, VIRTIO_RPMSG_F_FRAG)) {
+		ept->cb(ept->rpdev, msg->data, msg->len, ept->priv, msg->src);
+		return;
+	}
+
+	/* a first fragment drops whatever was left of an older message */
+	if (!msg->offset) {
+		if (!ept->frag)
+			ept->frag = kmalloc(max, GFP_KERNEL);
+		ept->frag_len = 0;
+		ept->frag_src = msg->src;
+	}
+
+	if (!ept->frag || msg->src != ept->frag_src ||
+			(int) msg->offset != ept->frag_len ||
+			msg->offset + msg->len > max) {
+		dev_warn(dev, "dropping fragment from 0x%x at %u\n",
+						msg->src, msg->offset);
+		ept->frag_len = -1;
+		return;
+	}
+
+	memcpy(ept->frag + msg->offset, msg->data, msg->len);
+	ept->frag_len += msg->len;
+	if (msg->flags & RPMSG_F_FRAG)
+		return;
+
+	ept->cb(ept->rpdev, ept->frag, ept->frag_len, ept->priv, msg->src);
+	ept->frag_len = -1;
+}
+
 static void rpmsg_recv_done(struct virtqueue *rvq)
 {
 	struct rpmsg_hdr *msg;
@@ -556,9 +704,9 @@ static void rpmsg_recv_done(struct virtqueue *rvq)
 		return;
 	}
 
-	dev_dbg(dev, "From: 0x%x, To: 0x%x, Len: %d, Flags: %d, Unused: %d\n",
+	dev_dbg(dev, "From: 0x%x, To: 0x%x, Len: %d, Flags: %d, Offset: %d\n",
 					msg->src, msg->dst, msg->len,
-					msg->flags, msg->unused);
+					msg->flags, msg->offset);
 #if 0
 	print_hex_dump(KERN_DEBUG, "rpmsg_virtio RX: ", DUMP_PREFIX_NONE, 16, 1,
 					msg, sizeof(*msg) + msg->len, true);
@@ -570,14 +718,17 @@ static void rpmsg_recv_done(struct virtqueue *rvq)
 	spin_unlock(&vrp->endpoints_lock);
 
 	if (ept && ept->cb)
-		ept->cb(ept->rpdev, msg->data, msg->len, ept->priv, msg->src);
+		rpmsg_deliver(vrp, ept, msg);
 	else
 		dev_warn(dev, "msg received with no recepient\n");
 
-	/* add the buffer back to the remote processor's virtqueue */
+	/*
+	 * add the buffer back to the remote processor's virtqueue, whole:
+	 * the next message may be larger than this one
+	 */
 	offset = ((unsigned long) msg) - ((unsigned long) vrp->rbufs);
 	sim_addr = vrp->sim_base + offset;
-	sg_init_one(&sg, sim_addr, sizeof(*msg) + len);
+	sg_init_one(&sg, sim_addr, vrp->buf_size);
 
 	err = virtqueue_add_buf_gfp(vrp->rvq, &sg, 0, 1, msg, GFP_KERNEL);
 	if (err < 0) {
@@ -598,6 +749,7 @@ static void rpmsg_xmit_done(struct virtqueue *svq)
 	dev_dbg(&svq->vdev->dev, "%s\n", __func__);
 
 	/* wake up potential processes that are waiting for a buffer */
+	atomic_inc(&vrp->tx_done);
 	wake_up_interruptible(&vrp->sendq);
 }
 
@@ -673,12 +825,19 @@ static int rpmsg_probe(struct virtio_device *vdev)
 	idr_init(&vrp->endpoints);
 	spin_lock_init(&vrp->endpoints_lock);
 	mutex_init(&vrp->svq_lock);
+	mutex_init(&vrp->frag_lock);
 	init_waitqueue_head(&vrp->sendq);
 
+	vrp->tx_pool = alloc_percpu(struct rpmsg_tx_pool);
+	if (!vrp->tx_pool) {
+		err = -ENOMEM;
+		goto free_vi;
+	}
+
 	/* We expect two virtqueues, rx and tx (in this order) */
 	err = vdev->config->find_vqs(vdev, 2, vqs, vq_cbs, names);
 	if (err)
-		goto free_vi;
+		goto free_pool;
 
 	vrp->rvq = vqs[0];
 	vrp->svq = vqs[1];
@@ -696,6 +855,10 @@ static int rpmsg_probe(struct virtio_device *vdev)
 
 	vrp->num_bufs = num_bufs;
 	vrp->buf_size = buf_size;
+
+	/* cpus may not reserve more than a quarter of the tx buffers */
+	vrp->pool_fill = min(RPMSG_TX_POOL,
+				num_bufs / 2 / 4 / (int) num_possible_cpus());
 	vrp->rbufs = addr;
 	vrp->sbufs = addr + total_buf_size / 2;
 
@@ -746,6 +909,8 @@ static int rpmsg_probe(struct virtio_device *vdev)
 
 vqs_del:
 	vdev->config->del_vqs(vrp->vdev);
+free_pool:
+	free_percpu(vrp->tx_pool);
 free_vi:
 	kfree(vrp);
 	return err;
@@ -774,6 +939,7 @@ static void __devexit rpmsg_remove(struct virtio_device *vdev)
 
 	vdev->config->del_vqs(vrp->vdev);
 
+	free_percpu(vrp->tx_pool);
 	kfree(vrp);
 }
 
@@ -784,6 +950,7 @@ static struct virtio_device_id id_table[] = {
 
 static unsigned int features[] = {
 	VIRTIO_RPMSG_F_NS,
+	VIRTIO_RPMSG_F_FRAG,
 };
 
 static struct virtio_driver virtio_ipc_driver = {
@@ -26,12 +26,15 @@
 #include <linux/blkdev.h>
 #include <linux/buffer_head.h>
 #include <linux/device.h>
+#include <linux/file.h>
+#include <linux/fs.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
 #include <linux/slab.h>
 #include <linux/lzo.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 
 #include "zram_drv.h"
 
@@ -133,15 +136,230 @@ static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 	zram->disksize &= PAGE_MASK;
 }
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+static void zram_reset_bdev(struct zram *zram)
+{
+	if (!zram->backing_dev)
+		return;
+
+	blkdev_put(zram->bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	filp_close(zram->backing_dev, NULL);
+	vfree(zram->bitmap);
+
+	zram->backing_dev = NULL;
+	zram->bdev = NULL;
+	zram->bitmap = NULL;
+	zram->nr_pages = 0;
+}
+
+int zram_set_backing_dev(struct zram *zram, const char *path)
+{
+	int ret;
+	unsigned long nr_pages, *bitmap;
+	struct file *backing_dev;
+	struct block_device *bdev;
+	struct inode *inode;
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done) {
+		pr_info("Cannot change backing device for initialized device\n");
+		ret = -EBUSY;
+		goto out;
+	}
+
+	backing_dev = filp_open(path, O_RDWR | O_LARGEFILE, 0);
+	if (IS_ERR(backing_dev)) {
+		ret = PTR_ERR(backing_dev);
+		goto out;
+	}
+
+	/* Files must be attached through a loop device first */
+	inode = backing_dev->f_mapping->host;
+	if (!S_ISBLK(inode->i_mode)) {
+		ret = -ENOTBLK;
+		goto close;
+	}
+
+	/* blkdev_get() drops the reference on failure */
+	bdev = bdgrab(I_BDEV(inode));
+	ret = blkdev_get(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL, zram);
+	if (ret < 0)
+		goto close;
+
+	nr_pages = i_size_read(inode) >> PAGE_SHIFT;
+	if (!nr_pages) {
+		ret = -EINVAL;
+		goto put;
+	}
+
+	bitmap = vzalloc(BITS_TO_LONGS(nr_pages) * sizeof(long));
+	if (!bitmap) {
+		ret = -ENOMEM;
+		goto put;
+	}
+
+	zram_reset_bdev(zram);
+
+	zram->backing_dev = backing_dev;
+	zram->bdev = bdev;
+	zram->bitmap = bitmap;
+	zram->nr_pages = nr_pages;
+	mutex_unlock(&zram->init_lock);
+
+	pr_info("setup backing device %s (%lu pages)\n", path, nr_pages);
+	return 0;
+
+put:
+	blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+close:
+	filp_close(backing_dev, NULL);
+out:
+	mutex_unlock(&zram->init_lock);
+	return ret;
+}
+
+/*
+ * Returns a free block on the backing device. Block 0 is never handed
+ * out so that a zero table[].element can not name a valid block.
+ */
+static unsigned long alloc_block_bdev(struct zram *zram)
+{
+	unsigned long blk_idx;
+
+	spin_lock(&zram->bitmap_lock);
+	blk_idx = find_next_zero_bit(zram->bitmap, zram->nr_pages, 1);
+	if (blk_idx >= zram->nr_pages) {
+		spin_unlock(&zram->bitmap_lock);
+		return 0;
+	}
+	__set_bit(blk_idx, zram->bitmap);
+	spin_unlock(&zram->bitmap_lock);
+
+	zram_stat64_inc(zram, &zram->stats.bd_count);
+	return blk_idx;
+}
+
+static void free_block_bdev(struct zram *zram, unsigned long blk_idx)
+{
+	spin_lock(&zram->bitmap_lock);
+	WARN_ON_ONCE(!test_bit(blk_idx, zram->bitmap));
+	__clear_bit(blk_idx, zram->bitmap);
+	spin_unlock(&zram->bitmap_lock);
+
+	zram_stat64_sub(zram, &zram->stats.bd_count, 1);
+}
+
+static void zram_bdev_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+static int zram_bdev_rw_page(struct zram *zram, struct page *page,
+			unsigned long blk_idx, int rw)
+{
+	int ret = 0;
+	struct bio *bio;
+	DECLARE_COMPLETION_ONSTACK(done);
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_sector = blk_idx << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_bdev = zram->bdev;
+	bio->bi_end_io = zram_bdev_end_io;
+	bio->bi_private = &done;
+	if (!bio_add_page(bio, page, PAGE_SIZE, 0)) {
+		bio_put(bio);
+		return -EIO;
+	}
+
+	submit_bio(rw, bio);
+	wait_for_completion(&done);
+
+	if (!test_bit(BIO_UPTODATE, &bio->bi_flags))
+		ret = -EIO;
+	bio_put(bio);
+
+	return ret;
+}
+
+struct zram_work {
+	struct work_struct work;
+	struct zram *zram;
+	struct page *page;
+	unsigned long blk_idx;
+	int ret;
+};
+
+static void zram_sync_read(struct work_struct *work)
+{
+	struct zram_work *zw = container_of(work, struct zram_work, work);
+
+	zw->ret = zram_bdev_rw_page(zw->zram, zw->page, zw->blk_idx, READ);
+}
+
+/*
+ * We are called from zram_make_request(), and a bio submitted from a
+ * make_request_fn is only dispatched after it returns. Issue the read
+ * from a worker so that waiting for it can not deadlock.
+ */
+static int read_from_bdev(struct zram *zram, struct page *page,
+			unsigned long blk_idx)
+{
+	struct zram_work work;
+
+	work.zram = zram;
+	work.page = page;
+	work.blk_idx = blk_idx;
+
+	INIT_WORK_ONSTACK(&work.work, zram_sync_read);
+	queue_work(system_unbound_wq, &work.work);
+	flush_work(&work.work);
+	destroy_work_on_stack(&work.work);
+
+	if (!work.ret)
+		zram_stat64_inc(zram, &zram->stats.bd_reads);
+
+	return work.ret;
+}
+#else
+static inline void zram_reset_bdev(struct zram *zram) {}
+static inline void free_block_bdev(struct zram *zram, unsigned long blk_idx)
+{
+}
+
+static inline int read_from_bdev(struct zram *zram, struct page *page,
+			unsigned long blk_idx)
+{
+	return -EIO;
+}
+#endif
+
+/* Called with slot_lock held */
 static void zram_free_page(struct zram *zram, size_t index)
 {
-	u32 clen;
-	void *obj;
+	unsigned long handle = zram->table[index].handle;
+	u16 size = zram->table[index].size;
+
+	/* The last backing device read of the page frees it */
+	if (zram->table[index].count) {
+		zram_set_flag(zram, index, ZRAM_FREE_PENDING);
+		return;
+	}
 
-	struct page *page = zram->table[index].page;
-	u32 offset = zram->table[index].offset;
+	zram_clear_flag(zram, index, ZRAM_FREE_PENDING);
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
 
-	if (unlikely(!page)) {
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		free_block_bdev(zram, zram->table[index].element);
+		zram_clear_flag(zram, index, ZRAM_WB);
+		zram->table[index].element = 0;
+		return;
+	}
+
+	if (unlikely(!handle)) {
 		/*
 		 * No memory is allocated for zero filled pages.
 		 * Simply clear zero page flag.
@@ -154,27 +372,19 @@ static void zram_free_page(struct zram *zram, size_t index)
 	}
 
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-		clen = PAGE_SIZE;
-		__free_page(page);
 		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
 		zram_stat_dec(&zram->stats.pages_expand);
-		goto out;
+	} else if (size <= PAGE_SIZE / 2) {
+		zram_stat_dec(&zram->stats.good_compress);
 	}
 
-	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
-	kunmap_atomic(obj, KM_USER0);
+	zs_free(zram->mem_pool, handle);
 
-	xv_free(zram->mem_pool, page, offset);
-	if (clen <= PAGE_SIZE / 2)
-		zram_stat_dec(&zram->stats.good_compress);
-
-out:
-	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
+	zram_stat64_sub(zram, &zram->stats.compr_size, size);
 	zram_stat_dec(&zram->stats.pages_stored);
 
-	zram->table[index].page = NULL;
-	zram->table[index].offset = 0;
+	zram->table[index].handle = 0;
+	zram->table[index].size = 0;
 }
 
 static void handle_zero_page(struct page *page)
@@ -193,17 +403,38 @@ static void handle_uncompressed_page(struct zram *zram,
 {
 	unsigned char *user_mem, *cmem;
 
+	cmem = zs_map_object(zram->mem_pool, zram->table[index].handle,
+				ZS_MM_RO);
 	user_mem = kmap_atomic(page, KM_USER0);
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-			zram->table[index].offset;
 
 	memcpy(user_mem, cmem, PAGE_SIZE);
 	kunmap_atomic(user_mem, KM_USER0);
-	kunmap_atomic(cmem, KM_USER1);
+	zs_unmap_object(zram->mem_pool, zram->table[index].handle);
 
 	flush_dcache_page(page);
 }
 
+/* Called with slot_lock held */
+static int zram_decompress_page(struct zram *zram, struct page *page,
+				u32 index)
+{
+	int ret;
+	size_t clen = PAGE_SIZE;
+	unsigned char *user_mem, *cmem;
+
+	cmem = zs_map_object(zram->mem_pool, zram->table[index].handle,
+				ZS_MM_RO);
+	user_mem = kmap_atomic(page, KM_USER0);
+
+	ret = lzo1x_decompress_safe(cmem, zram->table[index].size,
+				user_mem, &clen);
+
+	kunmap_atomic(user_mem, KM_USER0);
+	zs_unmap_object(zram->mem_pool, zram->table[index].handle);
+
+	return ret;
+}
+
 static void zram_read(struct zram *zram, struct bio *bio)
 {
 
@@ -216,21 +447,52 @@ static void zram_read(struct zram *zram, struct bio *bio)
 
 	bio_for_each_segment(bvec, bio, i) {
 		int ret;
-		size_t clen;
 		struct page *page;
-		struct zobj_header *zheader;
-		unsigned char *user_mem, *cmem;
 
 		page = bvec->bv_page;
 
+		spin_lock(&zram->slot_lock);
+		zram_clear_flag(zram, index, ZRAM_IDLE);
+
+		/*
+		 * Page was written back; the worker may sleep. Pin the slot
+		 * so that its block is not freed and reused under the read.
+		 */
+		if (zram_test_flag(zram, index, ZRAM_WB)) {
+			unsigned long blk_idx = zram->table[index].element;
+
+			zram->table[index].count++;
+			spin_unlock(&zram->slot_lock);
+			ret = read_from_bdev(zram, page, blk_idx);
+			spin_lock(&zram->slot_lock);
+			if (!--zram->table[index].count) {
+				if (zram_test_flag(zram, index,
+						ZRAM_FREE_PENDING))
+					zram_free_page(zram, index);
+				wake_up_all(&zram->slot_wait);
+			}
+			spin_unlock(&zram->slot_lock);
+			if (ret) {
+				pr_err("Backing device read failed! page=%u\n",
+					index);
+				zram_stat64_inc(zram, &zram->stats.failed_reads);
+				goto out;
+			}
+			flush_dcache_page(page);
+			index++;
+			continue;
+		}
+
 		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
+			spin_unlock(&zram->slot_lock);
 			handle_zero_page(page);
 			index++;
 			continue;
 		}
 
 		/* Requested page is not present in compressed area */
-		if (unlikely(!zram->table[index].page)) {
+		if (unlikely(!zram->table[index].handle)) {
+			spin_unlock(&zram->slot_lock);
 			pr_debug("Read before write: sector=%lu, size=%u",
 				(ulong)(bio->bi_sector), bio->bi_size);
 			handle_zero_page(page);
@@ -241,23 +503,13 @@ static void zram_read(struct zram *zram, struct bio *bio)
 		/* Page is stored uncompressed since it's incompressible */
 		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 			handle_uncompressed_page(zram, page, index);
+			spin_unlock(&zram->slot_lock);
 			index++;
 			continue;
 		}
 
-		user_mem = kmap_atomic(page, KM_USER0);
-		clen = PAGE_SIZE;
-
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
-
-		ret = lzo1x_decompress_safe(
-			cmem + sizeof(*zheader),
-			xv_get_object_size(cmem) - sizeof(*zheader),
-			user_mem, &clen);
-
-		kunmap_atomic(user_mem, KM_USER0);
-		kunmap_atomic(cmem, KM_USER1);
+		ret = zram_decompress_page(zram, page, index);
+		spin_unlock(&zram->slot_lock);
 
 		/* Should NEVER happen. Return bio error if it does. */
 		if (unlikely(ret != LZO_E_OK)) {
@@ -290,10 +542,9 @@ static void zram_write(struct zram *zram, struct bio *bio)
 
 	bio_for_each_segment(bvec, bio, i) {
 		int ret;
-		u32 offset;
 		size_t clen;
-		struct zobj_header *zheader;
-		struct page *page, *page_store;
+		unsigned long handle;
+		struct page *page;
 		unsigned char *user_mem, *cmem, *src;
 
 		page = bvec->bv_page;
@@ -301,11 +552,17 @@ static void zram_write(struct zram *zram, struct bio *bio)
 
 		/*
 		 * System overwrites unused sectors. Free memory associated
-		 * with this sector now.
+		 * with this sector now. A page still being read from the
+		 * backing device can only be freed once the read is done.
 		 */
-		if (zram->table[index].page ||
-				zram_test_flag(zram, index, ZRAM_ZERO))
-			zram_free_page(zram, index);
+		spin_lock(&zram->slot_lock);
+		while (zram->table[index].count) {
+			spin_unlock(&zram->slot_lock);
+			wait_event(zram->slot_wait, !zram->table[index].count);
+			spin_lock(&zram->slot_lock);
+		}
+		zram_free_page(zram, index);
+		spin_unlock(&zram->slot_lock);
 
 		mutex_lock(&zram->lock);
 
@@ -313,8 +570,10 @@ static void zram_write(struct zram *zram, struct bio *bio)
 		if (page_zero_filled(user_mem)) {
 			kunmap_atomic(user_mem, KM_USER0);
 			mutex_unlock(&zram->lock);
+			spin_lock(&zram->slot_lock);
 			zram_stat_inc(&zram->stats.pages_zero);
 			zram_set_flag(zram, index, ZRAM_ZERO);
+			spin_unlock(&zram->slot_lock);
 			index++;
 			continue;
 		}
@@ -338,27 +597,16 @@ static void zram_write(struct zram *zram, struct bio *bio)
 		 */
 		if (unlikely(clen > max_zpage_size)) {
 			clen = PAGE_SIZE;
-			page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
-			if (unlikely(!page_store)) {
-				mutex_unlock(&zram->lock);
-				pr_info("Error allocating memory for "
-					"incompressible page: %u\n", index);
-				zram_stat64_inc(zram,
-					&zram->stats.failed_writes);
-				goto out;
-			}
-
-			offset = 0;
 			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
 			zram_stat_inc(&zram->stats.pages_expand);
-			zram->table[index].page = page_store;
-			src = kmap_atomic(page, KM_USER0);
-			goto memstore;
 		}
 
-		if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-				&zram->table[index].page, &offset,
-				GFP_NOIO | __GFP_HIGHMEM)) {
+		handle = zs_malloc(zram->mem_pool, clen);
+		if (!handle) {
+			if (zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
+				zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
+				zram_stat_dec(&zram->stats.pages_expand);
+			}
 			mutex_unlock(&zram->lock);
 			pr_info("Error allocating memory for compressed "
 				"page: %u, size=%zu\n", index, clen);
@@ -366,27 +614,22 @@ static void zram_write(struct zram *zram, struct bio *bio)
 			goto out;
 		}
 
-memstore:
-		zram->table[index].offset = offset;
-
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
-
-#if 0
-		/* Back-reference needed for memory defragmentation */
-		if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
-			zheader = (struct zobj_header *)cmem;
-			zheader->table_idx = index;
-			cmem += sizeof(*zheader);
-		}
-#endif
+		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
+			src = kmap_atomic(page, KM_USER0);
 
+		cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_WO);
 		memcpy(cmem, src, clen);
+		zs_unmap_object(zram->mem_pool, handle);
 
-		kunmap_atomic(cmem, KM_USER1);
 		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
 			kunmap_atomic(src, KM_USER0);
 
+		/* Publish the object only once it holds valid data */
+		spin_lock(&zram->slot_lock);
+		zram->table[index].handle = handle;
+		zram->table[index].size = clen;
+		spin_unlock(&zram->slot_lock);
+
 		/* Update stats */
 		zram_stat64_add(zram, &zram->stats.compr_size, clen);
 		zram_stat_inc(&zram->stats.pages_stored);
@@ -453,6 +696,129 @@ static int zram_make_request(struct request_queue *queue, struct bio *bio)
 	return 0;
 }
 
+unsigned long zram_compact(struct zram *zram)
+{
+	unsigned long nr_pages = 0;
+
+	mutex_lock(&zram->init_lock);
+	if (zram->init_done) {
+		nr_pages = zs_compact(zram->mem_pool);
+		zram_stat64_add(zram, &zram->stats.pages_compacted, nr_pages);
+	}
+	mutex_unlock(&zram->init_lock);
+
+	return nr_pages;
+}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+void zram_mark_idle(struct zram *zram)
+{
+	size_t index;
+
+	mutex_lock(&zram->init_lock);
+	if (!zram->init_done)
+		goto out;
+
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		spin_lock(&zram->slot_lock);
+		if (!zram_test_flag(zram, index, ZRAM_WB) &&
+				zram->table[index].handle)
+			zram_set_flag(zram, index, ZRAM_IDLE);
+		spin_unlock(&zram->slot_lock);
+	}
+
+out:
+	mutex_unlock(&zram->init_lock);
+}
+
+/*
+ * Write back pages matching @mode to the backing device and free the
+ * memory they occupy. The slot is copied out under slot_lock and marked
+ * ZRAM_UNDER_WB; if it is freed or overwritten while the write is in
+ * flight, zram_free_page() clears that flag and the block is dropped.
+ */
+int zram_writeback(struct zram *zram, enum zram_wb_mode mode)
+{
+	int ret = 0;
+	size_t index;
+	unsigned long blk_idx = 0;
+	struct page *page;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
+
+	mutex_lock(&zram->init_lock);
+	if (!zram->init_done || !zram->backing_dev) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		if (!blk_idx) {
+			blk_idx = alloc_block_bdev(zram);
+			if (!blk_idx) {
+				ret = -ENOSPC;
+				break;
+			}
+		}
+
+		spin_lock(&zram->slot_lock);
+		if (zram_test_flag(zram, index, ZRAM_WB) ||
+				zram_test_flag(zram, index, ZRAM_UNDER_WB) ||
+				!zram->table[index].handle)
+			goto next;
+
+		if (mode == ZRAM_WB_IDLE &&
+				!zram_test_flag(zram, index, ZRAM_IDLE))
+			goto next;
+
+		if (mode == ZRAM_WB_HUGE &&
+				!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))
+			goto next;
+
+		if (zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))
+			handle_uncompressed_page(zram, page, index);
+		else if (zram_decompress_page(zram, page, index) != LZO_E_OK)
+			goto next;
+
+		zram_set_flag(zram, index, ZRAM_UNDER_WB);
+		spin_unlock(&zram->slot_lock);
+
+		if (zram_bdev_rw_page(zram, page, blk_idx, WRITE_SYNC)) {
+			spin_lock(&zram->slot_lock);
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			spin_unlock(&zram->slot_lock);
+			ret = -EIO;
+			continue;
+		}
+
+		zram_stat64_inc(zram, &zram->stats.bd_writes);
+
+		spin_lock(&zram->slot_lock);
+		/* Slot was freed or rewritten while the write was in flight */
+		if (!zram_test_flag(zram, index, ZRAM_UNDER_WB))
+			goto next;
+
+		zram_free_page(zram, index);
+		zram->table[index].element = blk_idx;
+		zram_set_flag(zram, index, ZRAM_WB);
+		blk_idx = 0;
+next:
+		spin_unlock(&zram->slot_lock);
+	}
+
+	if (blk_idx)
+		free_block_bdev(zram, blk_idx);
+
+out:
+	mutex_unlock(&zram->init_lock);
+	__free_page(page);
+
+	return ret;
+}
+#endif
+
 void zram_reset_device(struct zram *zram)
 {
 	size_t index;
@@ -469,27 +835,22 @@ void zram_reset_device(struct zram *zram)
 
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
-		struct page *page;
-		u16 offset;
-
-		page = zram->table[index].page;
-		offset = zram->table[index].offset;
-
-		if (!page)
+		/* Backing device blocks go away with the bitmap below */
+		if (zram_test_flag(zram, index, ZRAM_WB))
 			continue;
 
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			__free_page(page);
-		else
-			xv_free(zram->mem_pool, page, offset);
+		if (zram->table[index].handle)
+			zs_free(zram->mem_pool, zram->table[index].handle);
 	}
 
 	vfree(zram->table);
 	zram->table = NULL;
 
-	xv_destroy_pool(zram->mem_pool);
+	zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
+	zram_reset_bdev(zram);
+
 	/* Reset stats */
 	memset(&zram->stats, 0, sizeof(zram->stats));
 
@@ -540,7 +901,8 @@ int zram_init_device(struct zram *zram)
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = xv_create_pool();
+	zram->mem_pool = zs_create_pool(zram->disk->disk_name,
+					GFP_NOIO | __GFP_HIGHMEM);
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
@@ -566,7 +928,9 @@ void zram_slot_free_notify(struct block_device *bdev, unsigned long index)
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	spin_lock(&zram->slot_lock);
 	zram_free_page(zram, index);
+	spin_unlock(&zram->slot_lock);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -582,6 +946,11 @@ static int create_device(struct zram *zram, int device_id)
 	mutex_init(&zram->lock);
 	mutex_init(&zram->init_lock);
 	spin_lock_init(&zram->stat64_lock);
+	spin_lock_init(&zram->slot_lock);
+	init_waitqueue_head(&zram->slot_wait);
+#ifdef CONFIG_ZRAM_WRITEBACK
+	spin_lock_init(&zram->bitmap_lock);
+#endif
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
@@ -651,6 +1020,9 @@ static void destroy_device(struct zram *zram)
 
 	if (zram->queue)
 		blk_cleanup_queue(zram->queue);
+
+	/* A backing device may be attached to a never initialized disk */
+	zram_reset_bdev(zram);
 }
 
 static int __init zram_init(void)
@@ -17,8 +17,9 @@
 
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/wait.h>
 
-#include "xvmalloc.h"
+#include "../zsmalloc/zsmalloc.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -26,18 +27,6 @@
  */
 static const unsigned max_num_devices = 32;
 
-/*
- * Stored at beginning of each compressed object.
- *
- * It stores back-reference to table entry which points to this
- * object. This is required to support memory defragmentation.
- */
-struct zobj_header {
-#if 0
-	u32 table_idx;
-#endif
-};
-
 /*-- Configurable parameters */
 
 /* Default zram disk size: 25% of total RAM */
@@ -49,12 +38,6 @@ static const unsigned default_disksize_perc_ram = 25;
  */
 static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 
-/*
- * NOTE: max_zpage_size must be less than or equal to:
- *   XV_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
- * otherwise, xv_malloc() would always return failure.
- */
-
 /*-- End of configurable params */
 
 #define SECTOR_SHIFT		9
@@ -71,6 +54,18 @@ enum zram_pageflags {
 	/* Page consists entirely of zeros */
 	ZRAM_ZERO,
 
+	/* Page has not been accessed since the last 'idle' marking */
+	ZRAM_IDLE,
+
+	/* Page is stored on the backing device (table[].element) */
+	ZRAM_WB,
+
+	/* Page is being written to the backing device */
+	ZRAM_UNDER_WB,
+
+	/* Page was freed while a backing device read held it */
+	ZRAM_FREE_PENDING,
+
 	__NR_ZRAM_PAGEFLAGS,
 };
 
@@ -78,9 +73,12 @@ enum zram_pageflags {
 
 /* Allocated for each disk page */
 struct table {
-	struct page *page;
-	u16 offset;
-	u8 count;	/* object ref count (not yet used) */
+	union {
+		unsigned long handle;
+		unsigned long element;	/* backing device block if ZRAM_WB */
+	};
+	u16 size;	/* object size in mem_pool */
+	u8 count;	/* backing device reads in flight */
 	u8 flags;
 } __attribute__((aligned(4)));
 
@@ -96,14 +94,26 @@ struct zram_stats {
 	u32 pages_stored;	/* no. of pages currently stored */
 	u32 good_compress;	/* % of pages with compression ratio<=50% */
 	u32 pages_expand;	/* % of incompressible pages */
+	u64 pages_compacted;	/* pages freed by compaction */
+	u64 bd_count;		/* no. of pages in backing device */
+	u64 bd_reads;		/* no. of reads from backing device */
+	u64 bd_writes;		/* no. of writes to backing device */
+};
+
+/* Writeback modes for zram_writeback() */
+enum zram_wb_mode {
+	ZRAM_WB_IDLE,		/* pages not accessed since marked idle */
+	ZRAM_WB_HUGE,		/* incompressible pages */
 };
 
 struct zram {
-	struct xv_pool *mem_pool;
+	struct zs_pool *mem_pool;
 	void *compress_workmem;
 	void *compress_buffer;
 	struct table *table;
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
+	spinlock_t slot_lock;	/* protect table entries against writeback */
+	wait_queue_head_t slot_wait;	/* for table[].count to drop */
 	struct mutex lock;	/* protect compression buffers against
 				 * concurrent writes */
 	struct request_queue *queue;
@@ -118,6 +128,13 @@ struct zram {
 	u64 disksize;	/* bytes */
 
 	struct zram_stats stats;
+#ifdef CONFIG_ZRAM_WRITEBACK
+	struct file *backing_dev;
+	struct block_device *bdev;
+	unsigned long *bitmap;	/* used blocks on backing device */
+	unsigned long nr_pages;	/* backing device size in pages */
+	spinlock_t bitmap_lock;
+#endif
 };
 
 extern struct zram *devices;
@@ -128,5 +145,11 @@ extern struct attribute_group zram_disk_attr_group;
 
 extern int zram_init_device(struct zram *zram);
 extern void zram_reset_device(struct zram *zram);
+extern unsigned long zram_compact(struct zram *zram);
+#ifdef CONFIG_ZRAM_WRITEBACK
+extern int zram_set_backing_dev(struct zram *zram, const char *path);
+extern void zram_mark_idle(struct zram *zram);
+extern int zram_writeback(struct zram *zram, enum zram_wb_mode mode);
+#endif
 
 #endif
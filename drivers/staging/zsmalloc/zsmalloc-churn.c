@@ -0,0 +1,211 @@
+/*
+ * zsmalloc churn benchmark
+ *
+ * Keeps a working set of objects in a private pool and replaces random
+ * members of it for a while, the way a swap device sees long uptime.
+ * Object sizes follow a rough compressed page distribution. Reports
+ * allocation throughput and fragmentation periodically, and how much
+ * zs_compact() gives back at the end.
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the license that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#define pr_fmt(fmt) "zsmalloc-churn: " fmt
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/jiffies.h>
+#include <linux/math64.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+
+#include "zsmalloc.h"
+
+static unsigned int nr_objs = 16384;
+module_param(nr_objs, uint, 0);
+MODULE_PARM_DESC(nr_objs, "Number of live objects in the working set");
+
+static unsigned int duration = 60;
+module_param(duration, uint, 0);
+MODULE_PARM_DESC(duration, "Benchmark run time in seconds");
+
+static unsigned int report_interval = 10;
+module_param(report_interval, uint, 0);
+MODULE_PARM_DESC(report_interval, "Seconds between progress reports");
+
+struct churn_obj {
+	unsigned long handle;
+	u16 size;
+	u8 pattern;
+};
+
+/*
+ * Mostly 25-60% of a page, a tail of well compressible pages and some
+ * incompressible ones stored whole.
+ */
+static size_t churn_obj_size(void)
+{
+	u32 r = random32();
+
+	switch (r % 10) {
+	case 0:
+		return PAGE_SIZE;
+	case 1:
+	case 2:
+		return 32 + (r >> 8) % (PAGE_SIZE / 8);
+	default:
+		return PAGE_SIZE / 4 + (r >> 8) % (PAGE_SIZE * 7 / 20);
+	}
+}
+
+static int churn_store(struct zs_pool *pool, struct churn_obj *obj)
+{
+	void *mem;
+
+	obj->size = churn_obj_size();
+	obj->pattern = random32();
+	obj->handle = zs_malloc(pool, obj->size);
+	if (!obj->handle)
+		return -ENOMEM;
+
+	mem = zs_map_object(pool, obj->handle, ZS_MM_WO);
+	memset(mem, obj->pattern, obj->size);
+	zs_unmap_object(pool, obj->handle);
+
+	return 0;
+}
+
+static int churn_check(struct zs_pool *pool, struct churn_obj *obj)
+{
+	int i, ret = 0;
+	u8 *mem;
+
+	mem = zs_map_object(pool, obj->handle, ZS_MM_RO);
+	for (i = 0; i < obj->size; i++) {
+		if (mem[i] != obj->pattern) {
+			ret = -EIO;
+			break;
+		}
+	}
+	zs_unmap_object(pool, obj->handle);
+
+	return ret;
+}
+
+static void churn_report(struct zs_pool *pool, const char *when,
+			u64 ops, unsigned long start)
+{
+	struct zs_pool_stats stats;
+	unsigned int msecs = jiffies_to_msecs(jiffies - start) ?: 1;
+	u64 frag = 0;
+
+	zs_get_stats(pool, &stats);
+	if (stats.pages_allocated)
+		frag = 100 - div64_u64(stats.bytes_used * 100,
+				stats.pages_allocated << PAGE_SHIFT);
+
+	pr_info("%s: %llu ops/s, %llu pages, %llu/%llu objs used, "
+		"%llu%% fragmentation\n", when,
+		div_u64(ops * 1000, msecs), stats.pages_allocated,
+		stats.obj_used, stats.obj_allocated, frag);
+}
+
+static int __init zs_churn_init(void)
+{
+	int ret = 0;
+	unsigned int i;
+	unsigned long start, end, next_report;
+	unsigned long freed;
+	u64 ops = 0, failed = 0;
+	struct churn_obj *objs;
+	struct zs_pool *pool;
+
+	objs = vzalloc(nr_objs * sizeof(*objs));
+	if (!objs)
+		return -ENOMEM;
+
+	pool = zs_create_pool("churn", GFP_KERNEL | __GFP_HIGHMEM);
+	if (!pool) {
+		vfree(objs);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < nr_objs; i++) {
+		ret = churn_store(pool, &objs[i]);
+		if (ret)
+			goto out;
+	}
+	churn_report(pool, "filled", 0, jiffies);
+
+	start = jiffies;
+	end = start + duration * HZ;
+	next_report = start + report_interval * HZ;
+
+	while (time_before(jiffies, end)) {
+		struct churn_obj *obj = &objs[random32() % nr_objs];
+
+		if (obj->handle) {
+			if (churn_check(pool, obj)) {
+				pr_err("object %u corrupted\n",
+					(unsigned int)(obj - objs));
+				ret = -EIO;
+				goto out;
+			}
+			zs_free(pool, obj->handle);
+			obj->handle = 0;
+		}
+
+		if (churn_store(pool, obj))
+			failed++;
+		ops++;
+
+		if (time_after(jiffies, next_report)) {
+			churn_report(pool, "churn", ops, start);
+			next_report += report_interval * HZ;
+		}
+		cond_resched();
+	}
+	churn_report(pool, "done", ops, start);
+
+	start = jiffies;
+	freed = zs_compact(pool);
+	pr_info("compaction freed %lu pages in %u ms\n", freed,
+		jiffies_to_msecs(jiffies - start));
+	churn_report(pool, "compacted", 0, start);
+
+	for (i = 0; i < nr_objs; i++) {
+		if (objs[i].handle && churn_check(pool, &objs[i])) {
+			pr_err("object %u corrupted by compaction\n", i);
+			ret = -EIO;
+			goto out;
+		}
+	}
+
+	if (failed)
+		pr_info("%llu allocations failed\n", failed);
+
+out:
+	for (i = 0; i < nr_objs; i++)
+		zs_free(pool, objs[i].handle);
+	zs_destroy_pool(pool);
+	vfree(objs);
+
+	return ret;
+}
+
+static void __exit zs_churn_exit(void)
+{
+}
+
+module_init(zs_churn_init);
+module_exit(zs_churn_exit);
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_DESCRIPTION("zsmalloc churn benchmark");
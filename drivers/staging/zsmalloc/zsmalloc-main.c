@@ -0,0 +1,881 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the license that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+/*
+ * zsmalloc stores compressed pages, so allocations are between a few
+ * bytes and PAGE_SIZE and there is no use for a large contiguous area.
+ * Objects are grouped into size classes; each class carves its objects
+ * out of "zspages", chains of 0-order pages in which an object may cross
+ * a page boundary. The number of pages per zspage is picked per class
+ * to minimize the space left over at the end of the chain.
+ *
+ * Callers get an opaque handle rather than a pointer, and must map it
+ * with zs_map_object() to access the object. The indirection lets
+ * zs_compact() move objects out of sparsely used zspages and free them.
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/bit_spinlock.h>
+#include <linux/errno.h>
+#include <linux/highmem.h>
+#include <linux/list.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/debugfs.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "zsmalloc.h"
+#include "zsmalloc_int.h"
+
+static struct kmem_cache *handle_cachep;
+static DEFINE_PER_CPU(struct mapping_area, zs_map_area);
+
+#ifdef CONFIG_DEBUG_FS
+static struct dentry *zs_stat_root;
+#endif
+
+static int get_size_class_index(int size)
+{
+	int idx = 0;
+
+	if (likely(size > ZS_MIN_ALLOC_SIZE))
+		idx = DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE,
+				ZS_SIZE_CLASS_DELTA);
+
+	return idx;
+}
+
+/*
+ * Pick the zspage length, in pages, which leaves the least space unused
+ * at the end of the chain for objects of the given size.
+ */
+static int get_pages_per_zspage(int class_size)
+{
+	int i, max_usedpc = 0;
+	/* zspage order which gives maximum used size per KB */
+	int max_usedpc_order = 1;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		int zspage_size;
+		int waste, usedpc;
+
+		zspage_size = i * PAGE_SIZE;
+		waste = zspage_size % class_size;
+		usedpc = (zspage_size - waste) * 100 / zspage_size;
+
+		if (usedpc > max_usedpc) {
+			max_usedpc = usedpc;
+			max_usedpc_order = i;
+		}
+	}
+
+	return max_usedpc_order;
+}
+
+static enum fullness_group get_fullness_group(struct size_class *class,
+					struct zspage *zspage)
+{
+	unsigned int inuse = zspage->inuse;
+
+	if (inuse == 0)
+		return ZS_EMPTY;
+	if (inuse == class->objs_per_zspage)
+		return ZS_FULL;
+	if (inuse * ZS_ALMOST_FULL_DEN >=
+			class->objs_per_zspage * ZS_ALMOST_FULL_NUM)
+		return ZS_ALMOST_FULL;
+
+	return ZS_ALMOST_EMPTY;
+}
+
+/* Called with class->lock held */
+static void insert_zspage(struct size_class *class, struct zspage *zspage,
+			enum fullness_group fullness)
+{
+	zspage->fullness = fullness;
+	if (fullness == ZS_EMPTY)
+		return;
+
+	list_add(&zspage->list, &class->fullness_list[fullness]);
+	class->fullness_count[fullness]++;
+}
+
+/* Called with class->lock held */
+static void remove_zspage(struct size_class *class, struct zspage *zspage)
+{
+	enum fullness_group fullness = zspage->fullness;
+
+	if (fullness == ZS_EMPTY)
+		return;
+
+	BUG_ON(list_empty(&zspage->list));
+	list_del_init(&zspage->list);
+	class->fullness_count[fullness]--;
+}
+
+/*
+ * Move the zspage to the list matching its current usage. Returns the
+ * new fullness group; ZS_EMPTY zspages are left off all lists for the
+ * caller to free.
+ */
+static enum fullness_group fix_fullness_group(struct size_class *class,
+					struct zspage *zspage)
+{
+	enum fullness_group newfg;
+
+	newfg = get_fullness_group(class, zspage);
+	if (newfg == zspage->fullness)
+		return newfg;
+
+	remove_zspage(class, zspage);
+	insert_zspage(class, zspage, newfg);
+
+	return newfg;
+}
+
+static unsigned long location_to_obj(struct zspage *zspage, unsigned int idx)
+{
+	unsigned long obj;
+
+	obj = page_to_pfn(zspage->pages[0]) << ZS_OBJ_INDEX_BITS;
+	obj |= idx & OBJ_INDEX_MASK;
+
+	return obj << OBJ_TAG_BITS;
+}
+
+static void obj_to_location(unsigned long obj, struct zspage **zspage,
+			unsigned int *idx)
+{
+	struct page *first_page;
+
+	obj >>= OBJ_TAG_BITS;
+	first_page = pfn_to_page(obj >> ZS_OBJ_INDEX_BITS);
+	*zspage = (struct zspage *)page_private(first_page);
+	*idx = obj & OBJ_INDEX_MASK;
+}
+
+static unsigned long handle_to_obj(unsigned long handle)
+{
+	return *(unsigned long *)handle;
+}
+
+static void pin_tag(unsigned long handle)
+{
+	bit_spin_lock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static int trypin_tag(unsigned long handle)
+{
+	return bit_spin_trylock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static void unpin_tag(unsigned long handle)
+{
+	bit_spin_unlock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+/* Caller must hold the handle's pin bit */
+static void record_obj(unsigned long handle, unsigned long obj)
+{
+	*(unsigned long *)handle = obj | (1UL << HANDLE_PIN_BIT);
+}
+
+static void free_zspage(struct zspage *zspage)
+{
+	int i;
+
+	for (i = 0; i < zspage->class->pages_per_zspage; i++) {
+		set_page_private(zspage->pages[i], 0);
+		__free_page(zspage->pages[i]);
+	}
+	kfree(zspage);
+}
+
+static struct zspage *alloc_zspage(struct size_class *class, gfp_t flags)
+{
+	int i;
+	struct zspage *zspage;
+
+	zspage = kzalloc(sizeof(*zspage) +
+			class->objs_per_zspage * sizeof(unsigned long),
+			flags & ~__GFP_HIGHMEM);
+	if (!zspage)
+		return NULL;
+
+	INIT_LIST_HEAD(&zspage->list);
+	zspage->class = class;
+	zspage->fullness = ZS_EMPTY;
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		struct page *page;
+
+		page = alloc_page(flags);
+		if (!page) {
+			while (i--)
+				__free_page(zspage->pages[i]);
+			kfree(zspage);
+			return NULL;
+		}
+		set_page_private(page, (unsigned long)zspage);
+		zspage->pages[i] = page;
+	}
+
+	return zspage;
+}
+
+/*
+ * Copy @size bytes between @buf and the object at byte offset @off of
+ * the zspage, one page at a time.
+ */
+static void zs_copy_object(struct zspage *zspage, unsigned long off,
+			char *buf, int size, int to_buf)
+{
+	while (size) {
+		char *addr;
+		int len;
+
+		len = min_t(int, size, PAGE_SIZE - (off & ~PAGE_MASK));
+		addr = kmap_atomic(zspage->pages[off >> PAGE_SHIFT], KM_USER0);
+		if (to_buf)
+			memcpy(buf, addr + (off & ~PAGE_MASK), len);
+		else
+			memcpy(addr + (off & ~PAGE_MASK), buf, len);
+		kunmap_atomic(addr, KM_USER0);
+
+		buf += len;
+		off += len;
+		size -= len;
+	}
+}
+
+/* Copy object @s_idx of @src to slot @d_idx of @dst */
+static void zs_object_copy(struct size_class *class, struct zspage *dst,
+			unsigned int d_idx, struct zspage *src,
+			unsigned int s_idx)
+{
+	unsigned long s_off = s_idx * class->size;
+	unsigned long d_off = d_idx * class->size;
+	int size = class->size;
+
+	while (size) {
+		char *s_addr, *d_addr;
+		int len;
+
+		len = min_t(int, size, PAGE_SIZE - (s_off & ~PAGE_MASK));
+		len = min_t(int, len, PAGE_SIZE - (d_off & ~PAGE_MASK));
+
+		s_addr = kmap_atomic(src->pages[s_off >> PAGE_SHIFT], KM_USER0);
+		d_addr = kmap_atomic(dst->pages[d_off >> PAGE_SHIFT], KM_USER1);
+		memcpy(d_addr + (d_off & ~PAGE_MASK),
+			s_addr + (s_off & ~PAGE_MASK), len);
+		kunmap_atomic(d_addr, KM_USER1);
+		kunmap_atomic(s_addr, KM_USER0);
+
+		s_off += len;
+		d_off += len;
+		size -= len;
+	}
+}
+
+/* Called with class->lock held */
+static unsigned int obj_alloc(struct size_class *class, struct zspage *zspage,
+			unsigned long handle)
+{
+	unsigned int idx;
+
+	idx = find_first_zero_bit(zspage->used, class->objs_per_zspage);
+	BUG_ON(idx >= class->objs_per_zspage);
+
+	__set_bit(idx, zspage->used);
+	zspage->handles[idx] = handle;
+	zspage->inuse++;
+
+	return idx;
+}
+
+/* Called with class->lock held */
+static void obj_free(struct zspage *zspage, unsigned int idx)
+{
+	BUG_ON(!test_bit(idx, zspage->used));
+
+	__clear_bit(idx, zspage->used);
+	zspage->handles[idx] = 0;
+	zspage->inuse--;
+}
+
+static struct zspage *find_get_zspage(struct size_class *class)
+{
+	int i;
+
+	for (i = 0; i < ZS_FULL; i++) {
+		if (!list_empty(&class->fullness_list[i]))
+			return list_first_entry(&class->fullness_list[i],
+					struct zspage, list);
+	}
+
+	return NULL;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int zs_stats_show(struct seq_file *s, void *v)
+{
+	int i;
+	struct zs_pool *pool = s->private;
+	u64 total_zspages = 0, total_used = 0, total_objs = 0;
+	u64 total_bytes = 0, total_pages = 0;
+
+	seq_printf(s, " %5s %5s %11s %12s %10s %10s %8s %16s %10s %10s\n",
+			"class", "size", "almost_full", "almost_empty",
+			"obj_alloc", "obj_used", "pages", "pages_per_zspage",
+			"nr_alloc", "nr_free");
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+		u64 almost_full, almost_empty, zspages, obj_used;
+		u64 nr_alloc, nr_free, objs, pages;
+
+		spin_lock(&class->lock);
+		almost_full = class->fullness_count[ZS_ALMOST_FULL];
+		almost_empty = class->fullness_count[ZS_ALMOST_EMPTY];
+		zspages = class->zspages;
+		obj_used = class->obj_used;
+		nr_alloc = class->nr_alloc;
+		nr_free = class->nr_free;
+		spin_unlock(&class->lock);
+
+		if (!zspages && !nr_alloc)
+			continue;
+
+		objs = zspages * class->objs_per_zspage;
+		pages = zspages * class->pages_per_zspage;
+
+		seq_printf(s, " %5d %5d %11llu %12llu %10llu %10llu %8llu "
+				"%16d %10llu %10llu\n",
+			i, class->size, almost_full, almost_empty,
+			objs, obj_used, pages, class->pages_per_zspage,
+			nr_alloc, nr_free);
+
+		total_zspages += zspages;
+		total_objs += objs;
+		total_used += obj_used;
+		total_bytes += obj_used * class->size;
+		total_pages += pages;
+	}
+
+	seq_puts(s, "\n");
+	seq_printf(s, " %-18s %llu\n", "zspages", total_zspages);
+	seq_printf(s, " %-18s %llu\n", "obj_allocated", total_objs);
+	seq_printf(s, " %-18s %llu\n", "obj_used", total_used);
+	seq_printf(s, " %-18s %llu\n", "pages_used", total_pages);
+	seq_printf(s, " %-18s %llu%%\n", "fragmentation", total_pages ?
+		100 - div64_u64(total_bytes * 100, total_pages << PAGE_SHIFT) :
+		0);
+	seq_printf(s, " %-18s %ld\n", "pages_compacted",
+		atomic_long_read(&pool->pages_compacted));
+	seq_printf(s, " %-18s %ld\n", "objs_migrated",
+		atomic_long_read(&pool->objs_migrated));
+
+	return 0;
+}
+
+static int zs_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, zs_stats_show, inode->i_private);
+}
+
+static const struct file_operations zs_stat_fops = {
+	.open		= zs_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void zs_pool_stat_create(struct zs_pool *pool)
+{
+	if (!zs_stat_root)
+		return;
+
+	pool->debugfs_dentry = debugfs_create_dir(pool->name, zs_stat_root);
+	if (!pool->debugfs_dentry) {
+		pr_warning("zsmalloc: debugfs dir <%s> creation failed\n",
+			pool->name);
+		return;
+	}
+
+	debugfs_create_file("classes", S_IRUGO, pool->debugfs_dentry,
+			pool, &zs_stat_fops);
+}
+
+static void zs_pool_stat_destroy(struct zs_pool *pool)
+{
+	debugfs_remove_recursive(pool->debugfs_dentry);
+}
+#else
+static inline void zs_pool_stat_create(struct zs_pool *pool) {}
+static inline void zs_pool_stat_destroy(struct zs_pool *pool) {}
+#endif
+
+/**
+ * zs_create_pool - Creates an allocation pool to work from.
+ * @name: name of the pool, used for its debugfs directory
+ * @flags: allocation flags used to allocate pool pages
+ *
+ * This function must be called before anything when using
+ * the zsmalloc allocator.
+ *
+ * On success, a pointer to the newly created pool is returned,
+ * otherwise NULL.
+ */
+struct zs_pool *zs_create_pool(const char *name, gfp_t flags)
+{
+	int i;
+	struct zs_pool *pool;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	pool->name = kstrdup(name, GFP_KERNEL);
+	if (!pool->name) {
+		kfree(pool);
+		return NULL;
+	}
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		int fg;
+		struct size_class *class = &pool->size_class[i];
+
+		class->size = ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA;
+		class->index = i;
+		class->pages_per_zspage = get_pages_per_zspage(class->size);
+		class->objs_per_zspage = class->pages_per_zspage *
+						PAGE_SIZE / class->size;
+		spin_lock_init(&class->lock);
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++)
+			INIT_LIST_HEAD(&class->fullness_list[fg]);
+	}
+
+	pool->flags = flags;
+	atomic_long_set(&pool->pages_allocated, 0);
+	atomic_long_set(&pool->pages_compacted, 0);
+	atomic_long_set(&pool->objs_migrated, 0);
+
+	zs_pool_stat_create(pool);
+
+	return pool;
+}
+EXPORT_SYMBOL_GPL(zs_create_pool);
+
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	int i;
+
+	zs_pool_stat_destroy(pool);
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		int fg;
+		struct size_class *class = &pool->size_class[i];
+
+		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++) {
+			if (!list_empty(&class->fullness_list[fg])) {
+				pr_info("Freeing non-empty class with size "
+					"%db, fullness group %d\n",
+					class->size, fg);
+			}
+		}
+	}
+
+	kfree(pool->name);
+	kfree(pool);
+}
+EXPORT_SYMBOL_GPL(zs_destroy_pool);
+
+/**
+ * zs_malloc - Allocate block of given size from pool.
+ * @pool: pool to allocate from
+ * @size: size of block to allocate
+ *
+ * On success, handle to the allocated object is returned,
+ * otherwise 0.
+ * Allocation requests with size > ZS_MAX_ALLOC_SIZE will fail.
+ */
+unsigned long zs_malloc(struct zs_pool *pool, size_t size)
+{
+	unsigned long handle;
+	unsigned int idx;
+	struct size_class *class;
+	struct zspage *zspage;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE))
+		return 0;
+
+	handle = (unsigned long)kmem_cache_alloc(handle_cachep,
+					pool->flags & ~__GFP_HIGHMEM);
+	if (!handle)
+		return 0;
+
+	class = &pool->size_class[get_size_class_index(size)];
+
+	spin_lock(&class->lock);
+	zspage = find_get_zspage(class);
+
+	if (!zspage) {
+		spin_unlock(&class->lock);
+		zspage = alloc_zspage(class, pool->flags);
+		if (unlikely(!zspage)) {
+			kmem_cache_free(handle_cachep, (void *)handle);
+			return 0;
+		}
+
+		atomic_long_add(class->pages_per_zspage,
+				&pool->pages_allocated);
+		spin_lock(&class->lock);
+		class->zspages++;
+	}
+
+	idx = obj_alloc(class, zspage, handle);
+	*(unsigned long *)handle = location_to_obj(zspage, idx);
+	fix_fullness_group(class, zspage);
+	class->obj_used++;
+	class->nr_alloc++;
+	spin_unlock(&class->lock);
+
+	return handle;
+}
+EXPORT_SYMBOL_GPL(zs_malloc);
+
+void zs_free(struct zs_pool *pool, unsigned long handle)
+{
+	unsigned int idx;
+	struct zspage *zspage;
+	struct size_class *class;
+	enum fullness_group fullness;
+
+	if (unlikely(!handle))
+		return;
+
+	/* The object can not be migrated while we hold the pin */
+	pin_tag(handle);
+	obj_to_location(handle_to_obj(handle), &zspage, &idx);
+	class = zspage->class;
+
+	spin_lock(&class->lock);
+	obj_free(zspage, idx);
+	fullness = fix_fullness_group(class, zspage);
+	class->obj_used--;
+	class->nr_free++;
+	if (fullness == ZS_EMPTY)
+		class->zspages--;
+	spin_unlock(&class->lock);
+	unpin_tag(handle);
+
+	if (fullness == ZS_EMPTY) {
+		atomic_long_sub(class->pages_per_zspage,
+				&pool->pages_allocated);
+		free_zspage(zspage);
+	}
+
+	kmem_cache_free(handle_cachep, (void *)handle);
+}
+EXPORT_SYMBOL_GPL(zs_free);
+
+/**
+ * zs_map_object - get address of allocated object from handle.
+ * @pool: pool from which the object was allocated
+ * @handle: handle returned from zs_malloc
+ * @mm: how the caller will access the object
+ *
+ * Before using an object allocated from zs_malloc, it must be mapped
+ * using this function. When done with the object, it must be unmapped
+ * using zs_unmap_object.
+ *
+ * Only one object can be mapped per cpu at a time. There is no protection
+ * against nested mappings.
+ *
+ * This function returns with preemption and page faults disabled.
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long handle,
+			enum zs_mapmode mm)
+{
+	unsigned int idx;
+	unsigned long off;
+	struct zspage *zspage;
+	struct size_class *class;
+	struct mapping_area *area;
+
+	BUG_ON(!handle);
+
+	/* Disables preemption, so the per-cpu area below is ours */
+	pin_tag(handle);
+	obj_to_location(handle_to_obj(handle), &zspage, &idx);
+	class = zspage->class;
+	off = idx * class->size;
+
+	area = &__get_cpu_var(zs_map_area);
+	area->vm_mm = mm;
+
+	if ((off & ~PAGE_MASK) + class->size <= PAGE_SIZE) {
+		/* this object is contained entirely within a page */
+		area->vm_addr = kmap_atomic(zspage->pages[off >> PAGE_SHIFT],
+					KM_USER0);
+		return area->vm_addr + (off & ~PAGE_MASK);
+	}
+
+	/* this object spans two pages */
+	area->vm_addr = NULL;
+	pagefault_disable();
+	if (mm != ZS_MM_WO)
+		zs_copy_object(zspage, off, area->vm_buf, class->size, 1);
+
+	return area->vm_buf;
+}
+EXPORT_SYMBOL_GPL(zs_map_object);
+
+void zs_unmap_object(struct zs_pool *pool, unsigned long handle)
+{
+	unsigned int idx;
+	struct zspage *zspage;
+	struct size_class *class;
+	struct mapping_area *area;
+
+	BUG_ON(!handle);
+
+	area = &__get_cpu_var(zs_map_area);
+	if (area->vm_addr) {
+		kunmap_atomic(area->vm_addr, KM_USER0);
+		goto out;
+	}
+
+	obj_to_location(handle_to_obj(handle), &zspage, &idx);
+	class = zspage->class;
+	if (area->vm_mm != ZS_MM_RO)
+		zs_copy_object(zspage, idx * class->size, area->vm_buf,
+				class->size, 0);
+	pagefault_enable();
+
+out:
+	unpin_tag(handle);
+}
+EXPORT_SYMBOL_GPL(zs_unmap_object);
+
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	return (u64)atomic_long_read(&pool->pages_allocated) << PAGE_SHIFT;
+}
+EXPORT_SYMBOL_GPL(zs_get_total_size_bytes);
+
+void zs_get_stats(struct zs_pool *pool, struct zs_pool_stats *stats)
+{
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+
+		spin_lock(&class->lock);
+		stats->obj_allocated += class->zspages *
+					class->objs_per_zspage;
+		stats->obj_used += class->obj_used;
+		stats->bytes_used += class->obj_used * class->size;
+		spin_unlock(&class->lock);
+	}
+
+	stats->pages_allocated = atomic_long_read(&pool->pages_allocated);
+	stats->pages_compacted = atomic_long_read(&pool->pages_compacted);
+	stats->objs_migrated = atomic_long_read(&pool->objs_migrated);
+}
+EXPORT_SYMBOL_GPL(zs_get_stats);
+
+/*
+ * Take a zspage off its fullness list for compaction: sources are the
+ * least used zspages, targets the most used ones which still have room.
+ * Called with class->lock held.
+ */
+static struct zspage *isolate_zspage(struct size_class *class, int source)
+{
+	int i;
+	static const enum fullness_group source_fg[] = {
+		ZS_ALMOST_EMPTY, ZS_ALMOST_FULL
+	};
+	static const enum fullness_group target_fg[] = {
+		ZS_ALMOST_FULL, ZS_ALMOST_EMPTY
+	};
+
+	for (i = 0; i < ARRAY_SIZE(source_fg); i++) {
+		enum fullness_group fg = source ? source_fg[i] : target_fg[i];
+		struct zspage *zspage;
+
+		if (list_empty(&class->fullness_list[fg]))
+			continue;
+
+		zspage = list_first_entry(&class->fullness_list[fg],
+					struct zspage, list);
+		remove_zspage(class, zspage);
+		return zspage;
+	}
+
+	return NULL;
+}
+
+/*
+ * Move objects from @src to @dst until @src is empty or @dst is full.
+ * Objects which are mapped or being freed are skipped. Returns the
+ * number of objects moved. Called with class->lock held.
+ */
+static int migrate_zspage(struct size_class *class, struct zspage *dst,
+			struct zspage *src)
+{
+	unsigned int s_idx = 0, d_idx;
+	int nr_migrated = 0;
+
+	while (dst->inuse < class->objs_per_zspage) {
+		unsigned long handle;
+
+		s_idx = find_next_bit(src->used, class->objs_per_zspage, s_idx);
+		if (s_idx >= class->objs_per_zspage)
+			break;
+
+		handle = src->handles[s_idx];
+		if (!trypin_tag(handle)) {
+			s_idx++;
+			continue;
+		}
+
+		d_idx = obj_alloc(class, dst, handle);
+		zs_object_copy(class, dst, d_idx, src, s_idx);
+		record_obj(handle, location_to_obj(dst, d_idx));
+		obj_free(src, s_idx);
+		unpin_tag(handle);
+
+		nr_migrated++;
+		s_idx++;
+	}
+
+	return nr_migrated;
+}
+
+static unsigned long zs_compact_class(struct zs_pool *pool,
+				struct size_class *class)
+{
+	unsigned long pages_freed = 0;
+	struct zspage *src, *dst;
+
+	spin_lock(&class->lock);
+	while ((src = isolate_zspage(class, 1))) {
+		int migrated = 0;
+
+		while ((dst = isolate_zspage(class, 0))) {
+			migrated += migrate_zspage(class, dst, src);
+			insert_zspage(class, dst, get_fullness_group(class, dst));
+			if (!src->inuse || dst->inuse < class->objs_per_zspage)
+				break;
+		}
+
+		atomic_long_add(migrated, &pool->objs_migrated);
+
+		if (src->inuse) {
+			/* Out of targets, or the rest are pinned */
+			insert_zspage(class, src, get_fullness_group(class, src));
+			break;
+		}
+
+		class->zspages--;
+		spin_unlock(&class->lock);
+
+		atomic_long_sub(class->pages_per_zspage, &pool->pages_allocated);
+		free_zspage(src);
+		pages_freed += class->pages_per_zspage;
+
+		cond_resched();
+		spin_lock(&class->lock);
+	}
+	spin_unlock(&class->lock);
+
+	return pages_freed;
+}
+
+/**
+ * zs_compact - Free zspages by packing their objects into others.
+ * @pool: pool to compact
+ *
+ * Objects are moved from sparsely used zspages into ones of the same
+ * class which have room. Returns the number of pages freed.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	int i;
+	unsigned long pages_freed = 0;
+
+	for (i = ZS_SIZE_CLASSES - 1; i >= 0; i--)
+		pages_freed += zs_compact_class(pool, &pool->size_class[i]);
+
+	atomic_long_add(pages_freed, &pool->pages_compacted);
+
+	return pages_freed;
+}
+EXPORT_SYMBOL_GPL(zs_compact);
+
+static void zs_exit(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		kfree(per_cpu(zs_map_area, cpu).vm_buf);
+
+	if (handle_cachep)
+		kmem_cache_destroy(handle_cachep);
+
+#ifdef CONFIG_DEBUG_FS
+	debugfs_remove_recursive(zs_stat_root);
+#endif
+}
+
+static int zs_init(void)
+{
+	int cpu;
+
+	handle_cachep = kmem_cache_create("zs_handle", sizeof(unsigned long),
+					0, 0, NULL);
+	if (!handle_cachep)
+		goto fail;
+
+	for_each_possible_cpu(cpu) {
+		struct mapping_area *area = &per_cpu(zs_map_area, cpu);
+
+		area->vm_buf = kmalloc(ZS_MAX_ALLOC_SIZE, GFP_KERNEL);
+		if (!area->vm_buf)
+			goto fail;
+	}
+
+#ifdef CONFIG_DEBUG_FS
+	zs_stat_root = debugfs_create_dir("zsmalloc", NULL);
+	if (!zs_stat_root)
+		pr_warning("zsmalloc: debugfs not available, stats disabled\n");
+#endif
+
+	return 0;
+
+fail:
+	zs_exit();
+	return -ENOMEM;
+}
+
+module_init(zs_init);
+module_exit(zs_exit);
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_DESCRIPTION("Memory allocator for compressed pages");
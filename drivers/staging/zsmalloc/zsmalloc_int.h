@@ -0,0 +1,125 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the license that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_INT_H_
+#define _ZS_MALLOC_INT_H_
+
+#include <linux/kernel.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+#include "zsmalloc.h"
+
+/*
+ * A zspage is a chain of up to ZS_MAX_PAGES_PER_ZSPAGE 0-order pages
+ * holding objects of one size class back to back; an object may span
+ * two adjacent pages of the chain. Each page's ->private points back to
+ * the struct zspage describing the chain.
+ */
+#define ZS_MAX_ZSPAGE_ORDER	2
+#define ZS_MAX_PAGES_PER_ZSPAGE	(_AC(1, UL) << ZS_MAX_ZSPAGE_ORDER)
+
+#define ZS_MIN_ALLOC_SHIFT	5
+#define ZS_MIN_ALLOC_SIZE	(1 << ZS_MIN_ALLOC_SHIFT)
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+
+/*
+ * Size classes are ZS_SIZE_CLASS_DELTA bytes apart; with 4K pages this
+ * gives 255 classes, so at most 15 bytes are lost to rounding.
+ */
+#define ZS_SIZE_CLASS_DELTA	(PAGE_SIZE >> 8)
+#define ZS_SIZE_CLASSES		((ZS_MAX_ALLOC_SIZE - ZS_MIN_ALLOC_SIZE) / \
+					ZS_SIZE_CLASS_DELTA + 1)
+
+#define ZS_OBJ_INDEX_BITS	(PAGE_SHIFT + ZS_MAX_ZSPAGE_ORDER - \
+					ZS_MIN_ALLOC_SHIFT)
+#define ZS_MAX_OBJS_PER_ZSPAGE	(1 << ZS_OBJ_INDEX_BITS)
+
+/*
+ * A handle is the address of a word holding the object's location:
+ *
+ *   | pfn of first zspage page | object index | pin bit |
+ *
+ * The pin bit is a bit spinlock held while the object is mapped or
+ * being freed, which keeps compaction from moving it.
+ */
+#define HANDLE_PIN_BIT		0
+#define OBJ_TAG_BITS		1
+#define OBJ_INDEX_MASK		((_AC(1, UL) << ZS_OBJ_INDEX_BITS) - 1)
+
+/* A zspage with at least 3/4 of its objects used is "almost full" */
+#define ZS_ALMOST_FULL_NUM	3
+#define ZS_ALMOST_FULL_DEN	4
+
+enum fullness_group {
+	ZS_ALMOST_FULL,
+	ZS_ALMOST_EMPTY,
+	ZS_FULL,
+	_ZS_NR_FULLNESS_GROUPS,
+
+	ZS_EMPTY,
+};
+
+struct size_class;
+
+struct zspage {
+	struct list_head list;		/* on class->fullness_list[] */
+	struct size_class *class;
+	struct page *pages[ZS_MAX_PAGES_PER_ZSPAGE];
+	unsigned int inuse;		/* no. of allocated objects */
+	enum fullness_group fullness;
+	unsigned long used[BITS_TO_LONGS(ZS_MAX_OBJS_PER_ZSPAGE)];
+	unsigned long handles[0];	/* handle of each allocated object */
+};
+
+struct size_class {
+	/* Size of objects stored in this class */
+	int size;
+	unsigned int index;
+
+	/* Number of PAGE_SIZE sized pages to combine to form a 'zspage' */
+	int pages_per_zspage;
+	int objs_per_zspage;
+
+	spinlock_t lock;
+
+	struct list_head fullness_list[_ZS_NR_FULLNESS_GROUPS];
+	u64 fullness_count[_ZS_NR_FULLNESS_GROUPS];
+
+	/* stats */
+	u64 zspages;		/* zspages currently allocated */
+	u64 obj_used;		/* objects currently allocated */
+	u64 nr_alloc;		/* cumulative zs_malloc() calls */
+	u64 nr_free;		/* cumulative zs_free() calls */
+};
+
+struct zs_pool {
+	struct size_class size_class[ZS_SIZE_CLASSES];
+
+	gfp_t flags;	/* allocation flags used when growing pool */
+	atomic_long_t pages_allocated;
+	atomic_long_t pages_compacted;
+	atomic_long_t objs_migrated;
+
+	const char *name;
+	struct dentry *debugfs_dentry;
+};
+
+/*
+ * Per-cpu area used to map objects which span two pages. Such objects
+ * are copied here at map time and back at unmap time.
+ */
+struct mapping_area {
+	char *vm_buf;		/* bounce buffer, ZS_MAX_ALLOC_SIZE bytes */
+	char *vm_addr;		/* kmap_atomic()'ed page, if not bounced */
+	enum zs_mapmode vm_mm;	/* mapping mode */
+};
+
+#endif
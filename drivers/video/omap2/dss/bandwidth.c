@@ -0,0 +1,202 @@
+/*
+ * linux/drivers/video/omap2/dss/bandwidth.c
+ *
+ * DISPC memory bandwidth planner
+ *
+ * Predicts the memory (EMIF) load and latency for the overlays that are
+ * going to be enabled, and picks the FIFO thresholds that hide this latency.
+ * Compositions whose overlays cannot be fetched in time are reported, so
+ * that they can be downgraded or rejected before they are applied, instead
+ * of underflowing.
+ *
+ * The model is simple: each overlay loads memory with its average fetch
+ * rate, divided by the DMM efficiency of its buffer layout.  Latency grows
+ * with memory utilization like in a single server queue, and the FIFO of an
+ * overlay must hold enough data to cover its peak fetch rate for that
+ * latency.  The latency estimate is raised every time an underflow is
+ * still seen, and lowered again after a while without underflows.
+ * Underflows expected around enabling, disabling or retiming an output are
+ * ignored.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define DSS_SUBSYS_NAME "BW"
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/jiffies.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
+
+#include <video/omapdss.h>
+#include "dss.h"
+
+/* usable memory bandwidth, and the part of it used by SGX, IVA-HD, etc. */
+static unsigned int bw_emif_mbps = 4800;
+module_param(bw_emif_mbps, uint, 0644);
+static unsigned int bw_reserve_mbps = 2400;
+module_param(bw_reserve_mbps, uint, 0644);
+
+/* memory latency seen by DISPC on an idle system */
+static unsigned int bw_latency_ns = 1000;
+module_param(bw_latency_ns, uint, 0644);
+
+/* latency estimate scaling in percent, raised on every underflow */
+static unsigned int bw_margin = 100;
+#define BW_MARGIN_STEP	25
+#define BW_MARGIN_MAX	400
+#define BW_MARGIN_DECAY_MS	10000	/* ~600 frames without underflow */
+#define BW_SETTLE_MS	200		/* output changes may underflow */
+
+static unsigned long bw_clean_since;	/* last underflow or margin step */
+static unsigned long bw_settle_until;
+
+#define BW_UTIL_MAX	95		/* utilization used for latency, % */
+#define FIFO_WORD	16		/* bytes per FIFO location */
+#define BURST_WORDS	(16 * 32 / 8 / FIFO_WORD)
+
+/* DMM fetch efficiency of a buffer layout, in percent */
+static u32 bw_efficiency(struct dss_bw_ovl *o)
+{
+	if (o->rotation_type != OMAP_DSS_ROT_TILER)
+		return 100;
+
+	/* rotated views fetch each line across TILER pages */
+	return (o->rotation & 1) ? 50 : 85;
+}
+
+static void bw_calc_ovl(struct dss_bw_ovl *o)
+{
+	u32 bits, w, h, outw, outh, frame;
+	u64 line, avg, peak;
+
+	/* NV12 fetches half as many chroma bytes as luma bytes */
+	bits = o->color_mode == OMAP_DSS_COLOR_NV12 ? 12 :
+					color_mode_to_bpp(o->color_mode);
+	w = DIV_ROUND_UP(o->width, o->x_decim);
+	h = DIV_ROUND_UP(o->height, o->y_decim);
+	outw = o->out_width ? : o->width;
+	outh = o->out_height ? : o->height;
+	frame = o->htotal * o->vtotal;
+
+	/* bytes fetched per frame */
+	line = (u64) w * bits / 8;
+	avg = line * h * o->pclk_khz * 1000;
+	avg = frame ? div_u64(avg, frame) : 0;
+
+	/* fetched while the overlay's part of the line is scanned out */
+	peak = div_u64(line * h * o->pclk_khz * 1000, outh * outw);
+
+	o->load_mbps = div_u64(avg * 100, bw_efficiency(o) * 1000000);
+	o->peak_mbps = div_u64(peak * 100, bw_efficiency(o) * 1000000);
+}
+
+/*
+ * Computes the load, latency and FIFO thresholds for the enabled overlays
+ * in ovls, which is indexed by plane.  Returns 0 if all overlays are
+ * predicted to be fetched in time, -ENOSPC if not.
+ */
+int dss_bw_plan(struct dss_bw_plan *p, struct dss_bw_ovl *ovls, int num)
+{
+	struct dss_bw_ovl *o;
+	u32 util, need, size, lat;
+	int i;
+
+	/* step back towards 100% after a while without underflows */
+	if (bw_margin > 100 && time_after(jiffies, bw_clean_since +
+				msecs_to_jiffies(BW_MARGIN_DECAY_MS))) {
+		bw_margin = max_t(unsigned int, bw_margin - BW_MARGIN_STEP,
+				  100);
+		bw_clean_since = jiffies;
+	}
+
+	p->load_mbps = 0;
+	for (i = 0; i < num; i++) {
+		o = ovls + i;
+		if (!o->enabled)
+			continue;
+		bw_calc_ovl(o);
+		p->load_mbps += o->load_mbps;
+	}
+
+	util = bw_emif_mbps ?
+		(p->load_mbps + bw_reserve_mbps) * 100 / bw_emif_mbps : 100;
+	p->overload = util > 100;
+	lat = bw_latency_ns * 100 / (100 - min_t(u32, util, BW_UTIL_MAX));
+	p->latency_ns = lat * bw_margin / 100;
+
+	for (i = 0; i < num; i++) {
+		o = ovls + i;
+		if (!o->enabled)
+			continue;
+
+		/* MB/s is B/us, so latency is rounded up to us */
+		size = dispc_get_plane_fifo_size(i);
+		need = DIV_ROUND_UP(o->peak_mbps *
+				    DIV_ROUND_UP(p->latency_ns, 1000),
+				    FIFO_WORD) + BURST_WORDS;
+		o->fifo_high = size - 1;
+		o->underflow = need + BURST_WORDS > o->fifo_high;
+		o->fifo_low = min(need, o->fifo_high - BURST_WORDS);
+	}
+
+	for (i = 0; i < num; i++)
+		if (ovls[i].enabled && ovls[i].underflow)
+			return -ENOSPC;
+	return p->overload ? -ENOSPC : 0;
+}
+
+/* an output is enabled, disabled or retimed: expect underflows for a while */
+void dss_bw_settle(void)
+{
+	bw_settle_until = jiffies + msecs_to_jiffies(BW_SETTLE_MS);
+}
+
+/* an underflow was seen: estimate latency more conservatively */
+void dss_bw_underflow(void)
+{
+	if (time_before(jiffies, bw_settle_until))
+		return;
+
+	bw_clean_since = jiffies;
+	if (bw_margin >= BW_MARGIN_MAX)
+		return;
+
+	bw_margin = min_t(unsigned int, bw_margin + BW_MARGIN_STEP,
+			  BW_MARGIN_MAX);
+	DSSWARN("underflow, latency margin raised to %u%%\n", bw_margin);
+}
+
+void dss_bw_dump(struct seq_file *s, struct dss_bw_plan *p,
+		struct dss_bw_ovl *ovls, int num)
+{
+	struct dss_bw_ovl *o;
+	int i;
+
+	seq_printf(s, "bandwidth:\t%u MB/s + %u MB/s reserved of %u MB/s%s\n",
+		   p->load_mbps, bw_reserve_mbps, bw_emif_mbps,
+		   p->overload ? " (overload)" : "");
+	seq_printf(s, "latency:\t%u ns (margin %u%%)\n", p->latency_ns,
+		   bw_margin);
+
+	for (i = 0; i < num; i++) {
+		o = ovls + i;
+		if (!o->enabled)
+			continue;
+		seq_printf(s, "ovl%d:\t\tload %u MB/s, peak %u MB/s, "
+			   "decim %ux%u, fifo %u/%u%s\n", i, o->load_mbps, o->peak_mbps,
+			   o->x_decim, o->y_decim, o->fifo_low, o->fifo_high,
+			   o->underflow ? " (underflow)" : "");
+	}
+}
@@ -100,6 +100,7 @@ static struct {
 	struct clk *dss_clk;
 
 	u32	fifo_size[MAX_DSS_OVERLAYS];
+	u32	fifo_low_min[MAX_DSS_OVERLAYS];	/* from the bandwidth plan */
 
 	u32	channel_irq[3]; /* Max channels hardcoded to 3*/
 
@@ -112,6 +113,17 @@ static struct {
 	bool		ctx_valid;
 	u32		ctx[DISPC_SZ_REGS / sizeof(u32)];
 
+	/*
+	 * Last values written to the plane configuration registers, which
+	 * only change when written.  Writes of unchanged values are skipped,
+	 * so reprogramming a plane only writes the fields that changed.
+	 */
+	u32		regs[DISPC_SZ_REGS / sizeof(u32)];
+	DECLARE_BITMAP(regs_cacheable, DISPC_SZ_REGS / sizeof(u32));
+	DECLARE_BITMAP(regs_valid, DISPC_SZ_REGS / sizeof(u32));
+	u32		regs_written;
+	u32		regs_skipped;
+
 #ifdef CONFIG_OMAP2_DSS_COLLECT_IRQ_STATS
 	spinlock_t irq_stats_lock;
 	struct dispc_irq_stats irq_stats;
@@ -134,6 +146,10 @@ static void _omap_dispc_set_irqs(void);
 
 static inline void dispc_write_reg(const u16 idx, u32 val)
 {
+	if (test_bit(idx / sizeof(u32), dispc.regs_cacheable)) {
+		dispc.regs[idx / sizeof(u32)] = val;
+		__set_bit(idx / sizeof(u32), dispc.regs_valid);
+	}
 	__raw_writel(val, dispc.base + idx);
 }
 
@@ -142,6 +158,113 @@ static inline u32 dispc_read_reg(const u16 idx)
 	return __raw_readl(dispc.base + idx);
 }
 
+/* write a register unless it is known to already hold the value */
+static inline void dispc_write_reg_cached(const u16 idx, u32 val)
+{
+	if (test_bit(idx / sizeof(u32), dispc.regs_valid) &&
+	    dispc.regs[idx / sizeof(u32)] == val) {
+		dispc.regs_skipped++;
+		return;
+	}
+	dispc.regs_written++;
+	dispc_write_reg(idx, val);
+}
+
+static inline u32 dispc_read_reg_cached(const u16 idx)
+{
+	u32 val;
+
+	if (test_bit(idx / sizeof(u32), dispc.regs_valid))
+		return dispc.regs[idx / sizeof(u32)];
+
+	val = dispc_read_reg(idx);
+	if (test_bit(idx / sizeof(u32), dispc.regs_cacheable)) {
+		dispc.regs[idx / sizeof(u32)] = val;
+		__set_bit(idx / sizeof(u32), dispc.regs_valid);
+	}
+	return val;
+}
+
+#define REG_FLD_MOD_CACHED(idx, val, start, end)			\
+	dispc_write_reg_cached(idx,					\
+			FLD_MOD(dispc_read_reg_cached(idx), val, start, end))
+
+#define CR(reg) \
+	__set_bit(DISPC_##reg / sizeof(u32), dispc.regs_cacheable)
+
+/*
+ * Mark the GFX and VID plane configuration registers as cacheable.  The
+ * writeback registers are not, as the hardware clears the writeback enable
+ * bit on its own in memory to memory mode.
+ */
+static void dispc_init_reg_cache(void)
+{
+	int i, o;
+
+	if (dss_has_feature(FEAT_GLOBAL_ALPHA))
+		CR(GLOBAL_ALPHA);
+
+	for (o = OMAP_DSS_GFX; o <= OMAP_DSS_VIDEO3; o++) {
+		if (o == OMAP_DSS_VIDEO3 && !dss_has_feature(FEAT_OVL_VID3))
+			continue;
+
+		CR(OVL_BA0(o));
+		CR(OVL_BA1(o));
+		CR(OVL_POSITION(o));
+		CR(OVL_SIZE(o));
+		CR(OVL_ATTRIBUTES(o));
+		CR(OVL_FIFO_THRESHOLD(o));
+		CR(OVL_ROW_INC(o));
+		CR(OVL_PIXEL_INC(o));
+		if (dss_has_feature(FEAT_PRELOAD))
+			CR(OVL_PRELOAD(o));
+
+		if (o == OMAP_DSS_GFX)
+			continue;
+
+		CR(OVL_FIR(o));
+		CR(OVL_PICTURE_SIZE(o));
+		CR(OVL_ACCU0(o));
+		CR(OVL_ACCU1(o));
+
+		for (i = 0; i < 8; i++) {
+			CR(OVL_FIR_COEF_H(o, i));
+			CR(OVL_FIR_COEF_HV(o, i));
+		}
+
+		for (i = 0; i < 5; i++)
+			CR(OVL_CONV_COEF(o, i));
+
+		if (dss_has_feature(FEAT_FIR_COEF_V)) {
+			for (i = 0; i < 8; i++)
+				CR(OVL_FIR_COEF_V(o, i));
+		}
+
+		if (dss_has_feature(FEAT_HANDLE_UV_SEPARATE)) {
+			CR(OVL_BA0_UV(o));
+			CR(OVL_BA1_UV(o));
+			CR(OVL_FIR2(o));
+			CR(OVL_ACCU2_0(o));
+			CR(OVL_ACCU2_1(o));
+
+			for (i = 0; i < 8; i++) {
+				CR(OVL_FIR_COEF_H2(o, i));
+				CR(OVL_FIR_COEF_HV2(o, i));
+				CR(OVL_FIR_COEF_V2(o, i));
+			}
+		}
+		if (dss_has_feature(FEAT_ATTR2))
+			CR(OVL_ATTRIBUTES2(o));
+	}
+}
+#undef CR
+
+void dispc_get_reg_stats(u32 *written, u32 *skipped)
+{
+	*written = dispc.regs_written;
+	*skipped = dispc.regs_skipped;
+}
+
 static int dispc_get_ctx_loss_count(void)
 {
 	struct device *dev = &dispc.pdev->dev;
@@ -315,6 +438,9 @@ static void dispc_restore_context(void)
 	DSSDBG("ctx_loss_count: saved %d, current %d\n",
 			dispc.ctx_loss_cnt, ctx);
 
+	/* the registers are rewritten below, and reset until then */
+	bitmap_zero(dispc.regs_valid, DISPC_SZ_REGS / sizeof(u32));
+
 	/*RR(IRQENABLE);*/
 	/*RR(CONTROL);*/
 	RR(CONFIG);
@@ -471,7 +597,7 @@ static u32 dispc_calculate_threshold(enum omap_plane plane, u32 paddr,
 
 	/* Get the burst size */
 	shift = (plane == OMAP_DSS_GFX) ? 6 : 14;
-	val = dispc_read_reg(DISPC_OVL_ATTRIBUTES(plane));
+	val = dispc_read_reg_cached(DISPC_OVL_ATTRIBUTES(plane));
 	burstsize = FLD_GET(val, shift + 1, shift);
 	doublestride = FLD_GET(val, 22, 22);
 	rotation = FLD_GET(val, 13, 12);
@@ -682,38 +808,38 @@ void dispc_go(enum omap_channel channel)
 
 static void _dispc_write_firh_reg(enum omap_plane plane, int reg, u32 value)
 {
-	dispc_write_reg(DISPC_OVL_FIR_COEF_H(plane, reg), value);
+	dispc_write_reg_cached(DISPC_OVL_FIR_COEF_H(plane, reg), value);
 }
 
 static void _dispc_write_firhv_reg(enum omap_plane plane, int reg, u32 value)
 {
-	dispc_write_reg(DISPC_OVL_FIR_COEF_HV(plane, reg), value);
+	dispc_write_reg_cached(DISPC_OVL_FIR_COEF_HV(plane, reg), value);
 }
 
 static void _dispc_write_firv_reg(enum omap_plane plane, int reg, u32 value)
 {
-	dispc_write_reg(DISPC_OVL_FIR_COEF_V(plane, reg), value);
+	dispc_write_reg_cached(DISPC_OVL_FIR_COEF_V(plane, reg), value);
 }
 
 static void _dispc_write_firh2_reg(enum omap_plane plane, int reg, u32 value)
 {
 	BUG_ON(plane == OMAP_DSS_GFX);
 
-	dispc_write_reg(DISPC_OVL_FIR_COEF_H2(plane, reg), value);
+	dispc_write_reg_cached(DISPC_OVL_FIR_COEF_H2(plane, reg), value);
 }
 
 static void _dispc_write_firhv2_reg(enum omap_plane plane, int reg, u32 value)
 {
 	BUG_ON(plane == OMAP_DSS_GFX);
 
-	dispc_write_reg(DISPC_OVL_FIR_COEF_HV2(plane, reg), value);
+	dispc_write_reg_cached(DISPC_OVL_FIR_COEF_HV2(plane, reg), value);
 }
 
 static void _dispc_write_firv2_reg(enum omap_plane plane, int reg, u32 value)
 {
 	BUG_ON(plane == OMAP_DSS_GFX);
 
-	dispc_write_reg(DISPC_OVL_FIR_COEF_V2(plane, reg), value);
+	dispc_write_reg_cached(DISPC_OVL_FIR_COEF_V2(plane, reg), value);
 }
 
 static const struct dispc_hv_coef *
@@ -967,15 +1093,19 @@ void _dispc_setup_color_conv_coef(enum omap_plane plane,
 
 #define CVAL(x, y) (FLD_VAL(x, 26, 16) | FLD_VAL(y, 10, 0))
 
-	dispc_write_reg(DISPC_OVL_CONV_COEF(plane, 0), CVAL(ct->rcr, ct->ry));
-	dispc_write_reg(DISPC_OVL_CONV_COEF(plane, 1), CVAL(ct->gy,  ct->rcb));
-	dispc_write_reg(DISPC_OVL_CONV_COEF(plane, 2), CVAL(ct->gcb, ct->gcr));
-	dispc_write_reg(DISPC_OVL_CONV_COEF(plane, 3), CVAL(ct->bcr, ct->by));
-	dispc_write_reg(DISPC_OVL_CONV_COEF(plane, 4), CVAL(0, ct->bcb));
+	dispc_write_reg_cached(DISPC_OVL_CONV_COEF(plane, 0),
+			       CVAL(ct->rcr, ct->ry));
+	dispc_write_reg_cached(DISPC_OVL_CONV_COEF(plane, 1),
+			       CVAL(ct->gy,  ct->rcb));
+	dispc_write_reg_cached(DISPC_OVL_CONV_COEF(plane, 2),
+			       CVAL(ct->gcb, ct->gcr));
+	dispc_write_reg_cached(DISPC_OVL_CONV_COEF(plane, 3),
+			       CVAL(ct->bcr, ct->by));
+	dispc_write_reg_cached(DISPC_OVL_CONV_COEF(plane, 4), CVAL(0, ct->bcb));
 
 #undef CVAL
 
-	REG_FLD_MOD(DISPC_OVL_ATTRIBUTES(plane), ct->full_range, 11, 11);
+	REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES(plane), ct->full_range, 11, 11);
 }
 
 void _dispc_setup_wb_color_conv_coef(void)
@@ -992,46 +1122,46 @@ void _dispc_setup_wb_color_conv_coef(void)
 		0,
 	};
 #define CVAL(x, y) (FLD_VAL(x, 26, 16) | FLD_VAL(y, 10, 0))
-	dispc_write_reg(DISPC_OVL_CONV_COEF(OMAP_DSS_WB, 0),
+	dispc_write_reg_cached(DISPC_OVL_CONV_COEF(OMAP_DSS_WB, 0),
 			CVAL(ct.yg, ct.yr));
-	dispc_write_reg(DISPC_OVL_CONV_COEF(OMAP_DSS_WB, 1),
+	dispc_write_reg_cached(DISPC_OVL_CONV_COEF(OMAP_DSS_WB, 1),
 			CVAL(ct.crr,  ct.yb));
-	dispc_write_reg(DISPC_OVL_CONV_COEF(OMAP_DSS_WB, 2),
+	dispc_write_reg_cached(DISPC_OVL_CONV_COEF(OMAP_DSS_WB, 2),
 			CVAL(ct.crb, ct.crg));
-	dispc_write_reg(DISPC_OVL_CONV_COEF(OMAP_DSS_WB, 3),
+	dispc_write_reg_cached(DISPC_OVL_CONV_COEF(OMAP_DSS_WB, 3),
 			CVAL(ct.cbg, ct.cbr));
-	dispc_write_reg(DISPC_OVL_CONV_COEF(OMAP_DSS_WB, 4),
+	dispc_write_reg_cached(DISPC_OVL_CONV_COEF(OMAP_DSS_WB, 4),
 			CVAL(0, ct.cbb));
 #undef CVAL
-	REG_FLD_MOD(DISPC_OVL_ATTRIBUTES(OMAP_DSS_WB),
+	REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES(OMAP_DSS_WB),
 			ct.full_range, 11, 11);
 }
 
 static void _dispc_set_plane_ba0(enum omap_plane plane, u32 paddr)
 {
-	dispc_write_reg(DISPC_OVL_BA0(plane), paddr);
+	dispc_write_reg_cached(DISPC_OVL_BA0(plane), paddr);
 }
 
 static void _dispc_set_plane_ba1(enum omap_plane plane, u32 paddr)
 {
-	dispc_write_reg(DISPC_OVL_BA1(plane), paddr);
+	dispc_write_reg_cached(DISPC_OVL_BA1(plane), paddr);
 }
 
 static void _dispc_set_plane_ba0_uv(enum omap_plane plane, u32 paddr)
 {
-	dispc_write_reg(DISPC_OVL_BA0_UV(plane), paddr);
+	dispc_write_reg_cached(DISPC_OVL_BA0_UV(plane), paddr);
 }
 
 static void _dispc_set_plane_ba1_uv(enum omap_plane plane, u32 paddr)
 {
-	dispc_write_reg(DISPC_OVL_BA1_UV(plane), paddr);
+	dispc_write_reg_cached(DISPC_OVL_BA1_UV(plane), paddr);
 }
 
 static void _dispc_set_plane_pos(enum omap_plane plane, int x, int y)
 {
 	u32 val = FLD_VAL(y, 26, 16) | FLD_VAL(x, 10, 0);
 
-	dispc_write_reg(DISPC_OVL_POSITION(plane), val);
+	dispc_write_reg_cached(DISPC_OVL_POSITION(plane), val);
 }
 
 static void _dispc_set_pic_size(enum omap_plane plane, int width, int height)
@@ -1039,9 +1169,9 @@ static void _dispc_set_pic_size(enum omap_plane plane, int width, int height)
 	u32 val = FLD_VAL(height - 1, 26, 16) | FLD_VAL(width - 1, 10, 0);
 
 	if (plane == OMAP_DSS_GFX)
-		dispc_write_reg(DISPC_OVL_SIZE(plane), val);
+		dispc_write_reg_cached(DISPC_OVL_SIZE(plane), val);
 	else
-		dispc_write_reg(DISPC_OVL_PICTURE_SIZE(plane), val);
+		dispc_write_reg_cached(DISPC_OVL_PICTURE_SIZE(plane), val);
 }
 
 static void _dispc_set_vid_size(enum omap_plane plane, int width, int height)
@@ -1052,7 +1182,7 @@ static void _dispc_set_vid_size(enum omap_plane plane, int width, int height)
 
 	val = FLD_VAL(height - 1, 26, 16) | FLD_VAL(width - 1, 10, 0);
 
-	dispc_write_reg(DISPC_OVL_SIZE(plane), val);
+	dispc_write_reg_cached(DISPC_OVL_SIZE(plane), val);
 }
 
 static void _dispc_set_pre_mult_alpha(enum omap_plane plane, bool enable)
@@ -1064,7 +1194,7 @@ static void _dispc_set_pre_mult_alpha(enum omap_plane plane, bool enable)
 		plane == OMAP_DSS_VIDEO1)
 		return;
 
-	REG_FLD_MOD(DISPC_OVL_ATTRIBUTES(plane), enable ? 1 : 0, 28, 28);
+	REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES(plane), enable ? 1 : 0, 28, 28);
 }
 
 static void _dispc_setup_global_alpha(enum omap_plane plane, u8 global_alpha)
@@ -1077,23 +1207,23 @@ static void _dispc_setup_global_alpha(enum omap_plane plane, u8 global_alpha)
 		return;
 
 	if (plane == OMAP_DSS_GFX)
-		REG_FLD_MOD(DISPC_GLOBAL_ALPHA, global_alpha, 7, 0);
+		REG_FLD_MOD_CACHED(DISPC_GLOBAL_ALPHA, global_alpha, 7, 0);
 	else if (plane == OMAP_DSS_VIDEO1)
-		REG_FLD_MOD(DISPC_GLOBAL_ALPHA, global_alpha, 15, 8);
+		REG_FLD_MOD_CACHED(DISPC_GLOBAL_ALPHA, global_alpha, 15, 8);
 	else if (plane == OMAP_DSS_VIDEO2)
-		REG_FLD_MOD(DISPC_GLOBAL_ALPHA, global_alpha, 23, 16);
+		REG_FLD_MOD_CACHED(DISPC_GLOBAL_ALPHA, global_alpha, 23, 16);
 	else if (plane == OMAP_DSS_VIDEO3)
-		REG_FLD_MOD(DISPC_GLOBAL_ALPHA, global_alpha, 31, 24);
+		REG_FLD_MOD_CACHED(DISPC_GLOBAL_ALPHA, global_alpha, 31, 24);
 }
 
 static void _dispc_set_pix_inc(enum omap_plane plane, s32 inc)
 {
-	dispc_write_reg(DISPC_OVL_PIXEL_INC(plane), inc);
+	dispc_write_reg_cached(DISPC_OVL_PIXEL_INC(plane), inc);
 }
 
 static void _dispc_set_row_inc(enum omap_plane plane, s32 inc)
 {
-	dispc_write_reg(DISPC_OVL_ROW_INC(plane), inc);
+	dispc_write_reg_cached(DISPC_OVL_ROW_INC(plane), inc);
 }
 
 static void _dispc_set_color_mode(enum omap_plane plane,
@@ -1176,7 +1306,7 @@ static void _dispc_set_color_mode(enum omap_plane plane,
 		}
 	}
 
-	REG_FLD_MOD(DISPC_OVL_ATTRIBUTES(plane), m, 4, 1);
+	REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES(plane), m, 4, 1);
 }
 
 void dispc_set_channel_out(enum omap_plane plane,
@@ -1200,7 +1330,7 @@ void dispc_set_channel_out(enum omap_plane plane,
 		return;
 	}
 
-	val = dispc_read_reg(DISPC_OVL_ATTRIBUTES(plane));
+	val = dispc_read_reg_cached(DISPC_OVL_ATTRIBUTES(plane));
 	if (dss_has_feature(FEAT_MGR_LCD2)) {
 		switch (channel) {
 		case OMAP_DSS_CHANNEL_LCD:
@@ -1224,7 +1354,21 @@ void dispc_set_channel_out(enum omap_plane plane,
 	} else {
 		val = FLD_MOD(val, channel, shift, shift);
 	}
-	dispc_write_reg(DISPC_OVL_ATTRIBUTES(plane), val);
+	dispc_write_reg_cached(DISPC_OVL_ATTRIBUTES(plane), val);
+}
+
+/* route the output of a pipeline into the writeback pipeline */
+void dispc_set_channel_out_wb(enum omap_plane plane)
+{
+	int shift = plane == OMAP_DSS_GFX ? 8 : 16;
+	u32 val;
+
+	BUG_ON(!dss_has_feature(FEAT_OVL_WB) || plane == OMAP_DSS_WB);
+
+	val = dispc_read_reg_cached(DISPC_OVL_ATTRIBUTES(plane));
+	val = FLD_MOD(val, 0, shift, shift);
+	val = FLD_MOD(val, 3, 31, 30);
+	dispc_write_reg_cached(DISPC_OVL_ATTRIBUTES(plane), val);
 }
 
 void dispc_set_burst_size(enum omap_plane plane,
@@ -1247,9 +1391,9 @@ void dispc_set_burst_size(enum omap_plane plane,
 		return;
 	}
 
-	val = dispc_read_reg(DISPC_OVL_ATTRIBUTES(plane));
+	val = dispc_read_reg_cached(DISPC_OVL_ATTRIBUTES(plane));
 	val = FLD_MOD(val, burst_size, shift+1, shift);
-	dispc_write_reg(DISPC_OVL_ATTRIBUTES(plane), val);
+	dispc_write_reg_cached(DISPC_OVL_ATTRIBUTES(plane), val);
 }
 
 void dispc_enable_gamma_table(bool enable)
@@ -1273,9 +1417,9 @@ void dispc_set_zorder(enum omap_plane plane,
 
 	if (!dss_has_feature(FEAT_OVL_ZORDER))
 		return;
-	val = dispc_read_reg(DISPC_OVL_ATTRIBUTES(plane));
+	val = dispc_read_reg_cached(DISPC_OVL_ATTRIBUTES(plane));
 	val = FLD_MOD(val, zorder, 27, 26);
-	dispc_write_reg(DISPC_OVL_ATTRIBUTES(plane), val);
+	dispc_write_reg_cached(DISPC_OVL_ATTRIBUTES(plane), val);
 }
 
 void dispc_enable_zorder(enum omap_plane plane, bool enable)
@@ -1284,9 +1428,9 @@ void dispc_enable_zorder(enum omap_plane plane, bool enable)
 
 	if (!dss_has_feature(FEAT_OVL_ZORDER))
 		return;
-	val = dispc_read_reg(DISPC_OVL_ATTRIBUTES(plane));
+	val = dispc_read_reg_cached(DISPC_OVL_ATTRIBUTES(plane));
 	val = FLD_MOD(val, enable, 25, 25);
-	dispc_write_reg(DISPC_OVL_ATTRIBUTES(plane), val);
+	dispc_write_reg_cached(DISPC_OVL_ATTRIBUTES(plane), val);
 }
 
 void dispc_enable_cpr(enum omap_channel channel, bool enable)
@@ -1329,9 +1473,9 @@ static void _dispc_set_vid_color_conv(enum omap_plane plane, bool enable)
 
 	BUG_ON(plane == OMAP_DSS_GFX);
 
-	val = dispc_read_reg(DISPC_OVL_ATTRIBUTES(plane));
+	val = dispc_read_reg_cached(DISPC_OVL_ATTRIBUTES(plane));
 	val = FLD_MOD(val, enable, 9, 9);
-	dispc_write_reg(DISPC_OVL_ATTRIBUTES(plane), val);
+	dispc_write_reg_cached(DISPC_OVL_ATTRIBUTES(plane), val);
 }
 
 void dispc_enable_replication(enum omap_plane plane, bool enable)
@@ -1343,7 +1487,7 @@ void dispc_enable_replication(enum omap_plane plane, bool enable)
 	else
 		bit = 10;
 
-	REG_FLD_MOD(DISPC_OVL_ATTRIBUTES(plane), enable, bit, bit);
+	REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES(plane), enable, bit, bit);
 }
 
 void dispc_set_lcd_size(enum omap_channel channel, u16 width, u16 height)
@@ -1360,6 +1504,7 @@ void dispc_set_digit_size(u16 width, u16 height)
 	BUG_ON((width > (1 << 11)) || (height > (1 << 11)));
 	val = FLD_VAL(height - 1, 26, 16) | FLD_VAL(width - 1, 10, 0);
 	dispc_write_reg(DISPC_SIZE_MGR(OMAP_DSS_CHANNEL_DIGIT), val);
+	dss_bw_settle();
 }
 
 static void dispc_read_plane_fifo_sizes(void)
@@ -1382,6 +1527,12 @@ u32 dispc_get_plane_fifo_size(enum omap_plane plane)
 	return dispc.fifo_size[plane];
 }
 
+/* lower bound for the low threshold picked by dispc_setup_plane on OMAP4 */
+void dispc_set_plane_fifo_low_min(enum omap_plane plane, u32 low)
+{
+	dispc.fifo_low_min[plane] = low;
+}
+
 void dispc_setup_plane_fifo(enum omap_plane plane, u32 low, u32 high)
 {
 	u8 hi_start, hi_end, lo_start, lo_end;
@@ -1399,9 +1550,10 @@ void dispc_setup_plane_fifo(enum omap_plane plane, u32 low, u32 high)
 
 	/* preload to high threshold to avoid FIFO underflow, NA for WB */
 	if (plane != OMAP_DSS_WB)
-		dispc_write_reg(DISPC_OVL_PRELOAD(plane), min(high, 0xfffu));
+		dispc_write_reg_cached(DISPC_OVL_PRELOAD(plane),
+				       min(high, 0xfffu));
 
-	dispc_write_reg(DISPC_OVL_FIFO_THRESHOLD(plane),
+	dispc_write_reg_cached(DISPC_OVL_FIFO_THRESHOLD(plane),
 			FLD_VAL(high, hi_start, hi_end) |
 			FLD_VAL(low, lo_start, lo_end));
 }
@@ -1428,10 +1580,10 @@ static void _dispc_set_fir(enum omap_plane plane,
 		val = FLD_VAL(vinc, vinc_start, vinc_end) |
 				FLD_VAL(hinc, hinc_start, hinc_end);
 
-		dispc_write_reg(DISPC_OVL_FIR(plane), val);
+		dispc_write_reg_cached(DISPC_OVL_FIR(plane), val);
 	} else {
 		val = FLD_VAL(vinc, 28, 16) | FLD_VAL(hinc, 12, 0);
-		dispc_write_reg(DISPC_OVL_FIR2(plane), val);
+		dispc_write_reg_cached(DISPC_OVL_FIR2(plane), val);
 	}
 }
 
@@ -1446,7 +1598,7 @@ static void _dispc_set_vid_accu0(enum omap_plane plane, int haccu, int vaccu)
 	val = FLD_VAL(vaccu, vert_start, vert_end) |
 			FLD_VAL(haccu, hor_start, hor_end);
 
-	dispc_write_reg(DISPC_OVL_ACCU0(plane), val);
+	dispc_write_reg_cached(DISPC_OVL_ACCU0(plane), val);
 }
 
 static void _dispc_set_vid_accu1(enum omap_plane plane, int haccu, int vaccu)
@@ -1460,7 +1612,7 @@ static void _dispc_set_vid_accu1(enum omap_plane plane, int haccu, int vaccu)
 	val = FLD_VAL(vaccu, vert_start, vert_end) |
 			FLD_VAL(haccu, hor_start, hor_end);
 
-	dispc_write_reg(DISPC_OVL_ACCU1(plane), val);
+	dispc_write_reg_cached(DISPC_OVL_ACCU1(plane), val);
 }
 
 static void _dispc_set_vid_accu2_0(enum omap_plane plane, int haccu, int vaccu)
@@ -1468,7 +1620,7 @@ static void _dispc_set_vid_accu2_0(enum omap_plane plane, int haccu, int vaccu)
 	u32 val;
 
 	val = FLD_VAL(vaccu, 26, 16) | FLD_VAL(haccu, 10, 0);
-	dispc_write_reg(DISPC_OVL_ACCU2_0(plane), val);
+	dispc_write_reg_cached(DISPC_OVL_ACCU2_0(plane), val);
 }
 
 static void _dispc_set_vid_accu2_1(enum omap_plane plane, int haccu, int vaccu)
@@ -1476,7 +1628,7 @@ static void _dispc_set_vid_accu2_1(enum omap_plane plane, int haccu, int vaccu)
 	u32 val;
 
 	val = FLD_VAL(vaccu, 26, 16) | FLD_VAL(haccu, 10, 0);
-	dispc_write_reg(DISPC_OVL_ACCU2_1(plane), val);
+	dispc_write_reg_cached(DISPC_OVL_ACCU2_1(plane), val);
 }
 
 static void _dispc_set_scale_param(enum omap_plane plane,
@@ -1514,7 +1666,7 @@ static void _dispc_set_scaling_common(enum omap_plane plane,
 	_dispc_set_scale_param(plane, orig_width, orig_height - y_adjust,
 				out_width, out_height, five_taps,
 				rotation, DISPC_COLOR_COMPONENT_RGB_Y);
-	l = dispc_read_reg(DISPC_OVL_ATTRIBUTES(plane));
+	l = dispc_read_reg_cached(DISPC_OVL_ATTRIBUTES(plane));
 
 	/* RESIZEENABLE and VERTICALTAPS */
 	l &= ~((0x3 << 5) | (0x1 << 21));
@@ -1535,7 +1687,7 @@ static void _dispc_set_scaling_common(enum omap_plane plane,
 		l |= five_taps ? (1 << 22) : 0;
 	}
 
-	dispc_write_reg(DISPC_OVL_ATTRIBUTES(plane), l);
+	dispc_write_reg_cached(DISPC_OVL_ATTRIBUTES(plane), l);
 
 	/*
 	 * field 0 = even field = bottom field
@@ -1572,7 +1724,8 @@ static void _dispc_set_scaling_uv(enum omap_plane plane,
 			color_mode != OMAP_DSS_COLOR_NV12)) {
 		/* reset chroma resampling for RGB formats, NA for WB */
 		if (plane != OMAP_DSS_WB)
-			REG_FLD_MOD(DISPC_OVL_ATTRIBUTES2(plane), 0, 8, 8);
+			REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES2(plane),
+					   0, 8, 8);
 		return;
 	}
 	switch (color_mode) {
@@ -1621,12 +1774,12 @@ static void _dispc_set_scaling_uv(enum omap_plane plane,
 				rotation, DISPC_COLOR_COMPONENT_UV);
 
 	if (plane != OMAP_DSS_WB)
-		REG_FLD_MOD(DISPC_OVL_ATTRIBUTES2(plane),
+		REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES2(plane),
 			(scale_x || scale_y) ? 1 : 0, 8, 8);
 	/* set H scaling */
-	REG_FLD_MOD(DISPC_OVL_ATTRIBUTES(plane), scale_x ? 1 : 0, 5, 5);
+	REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES(plane), scale_x ? 1 : 0, 5, 5);
 	/* set V scaling */
-	REG_FLD_MOD(DISPC_OVL_ATTRIBUTES(plane), scale_y ? 1 : 0, 6, 6);
+	REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES(plane), scale_y ? 1 : 0, 6, 6);
 
 	_dispc_set_vid_accu2_0(plane, 0x80, 0);
 	_dispc_set_vid_accu2_1(plane, 0x80, 0);
@@ -1704,9 +1857,9 @@ static void _dispc_set_rotation_attrs(enum omap_plane plane, u8 rotation,
 			row_repeat = false;
 	}
 
-	REG_FLD_MOD(DISPC_OVL_ATTRIBUTES(plane), vidrot, 13, 12);
+	REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES(plane), vidrot, 13, 12);
 	if (dss_has_feature(FEAT_ROWREPEATENABLE))
-		REG_FLD_MOD(DISPC_OVL_ATTRIBUTES(plane),
+		REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES(plane),
 			row_repeat ? 1 : 0, 18, 18);
 
 	if (color_mode == OMAP_DSS_COLOR_NV12) {
@@ -1716,11 +1869,12 @@ static void _dispc_set_rotation_attrs(enum omap_plane plane, u8 rotation,
 				     rotation == OMAP_DSS_ROT_180) &&
 				     type == OMAP_DSS_ROT_TILER;
 		/* DOUBLESTRIDE */
-		REG_FLD_MOD(DISPC_OVL_ATTRIBUTES(plane), doublestride, 22, 22);
+		REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES(plane),
+				   doublestride, 22, 22);
 	}
 }
 
-static int color_mode_to_bpp(enum omap_color_mode color_mode)
+int color_mode_to_bpp(enum omap_color_mode color_mode)
 {
 	switch (color_mode) {
 	case OMAP_DSS_COLOR_CLUT1:
@@ -2392,7 +2546,8 @@ int dispc_setup_plane(enum omap_plane plane,
 	if (dss_has_feature(FEAT_HANDLE_UV_SEPARATE)) {
 		/* set BURSTTYPE */
 		bool use_tiler = rotation_type == OMAP_DSS_ROT_TILER;
-		REG_FLD_MOD(DISPC_OVL_ATTRIBUTES(plane), use_tiler, 29, 29);
+		REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES(plane),
+				   use_tiler, 29, 29);
 	}
 
 	if (rotation_type == OMAP_DSS_ROT_TILER) {
@@ -2496,6 +2651,7 @@ int dispc_setup_plane(enum omap_plane plane,
 		default_get_overlay_fifo_thresholds(plane, size,
 				&size, &fifo_low, &fifo_high);
 #endif
+		fifo_low = max(fifo_low, dispc.fifo_low_min[plane]);
 		dispc_setup_plane_fifo(plane, fifo_low, fifo_high);
 	}
 
@@ -2506,7 +2662,7 @@ int dispc_enable_plane(enum omap_plane plane, bool enable)
 {
 	DSSDBG("dispc_enable_plane %d, %d\n", plane, enable);
 
-	REG_FLD_MOD(DISPC_OVL_ATTRIBUTES(plane), enable ? 1 : 0, 0, 0);
+	REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES(plane), enable ? 1 : 0, 0, 0);
 
 	return 0;
 }
@@ -2567,17 +2723,17 @@ int dispc_setup_wb(struct writeback_cache_data *wb)
 
 	/* configure wb source */
 	if (source == OMAP_WB_TV)
-		REG_FLD_MOD(DISPC_OVL_ATTRIBUTES(plane), 2, 18, 16);
+		REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES(plane), 2, 18, 16);
 	else if (source == OMAP_WB_LCD2)
-		REG_FLD_MOD(DISPC_OVL_ATTRIBUTES(plane), 1, 18, 16);
+		REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES(plane), 1, 18, 16);
 	else
-		REG_FLD_MOD(DISPC_OVL_ATTRIBUTES(plane), source, 18, 16);
+		REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES(plane), source, 18, 16);
 
 	/*
 	 * configure wb mode:
 	 * 0-capture-mode; 1-memory-to-memory mode
 	 */
-	REG_FLD_MOD(DISPC_OVL_ATTRIBUTES(plane), wb->mode, 19, 19);
+	REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES(plane), wb->mode, 19, 19);
 
 	/* predecimate */
 	/* adjust for group-of-pixels*/
@@ -2641,7 +2797,7 @@ int dispc_setup_wb(struct writeback_cache_data *wb)
 		DSSDBG("rotated addresses: 0x%0x, 0x%0x\n",
 						paddr, puv_addr);
 		/* set BURSTTYPE if rotation is non-zero */
-		REG_FLD_MOD(DISPC_OVL_ATTRIBUTES(plane), 0x1, 8, 8);
+		REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES(plane), 0x1, 8, 8);
 	} else
 		row_inc = 1;
 	/* adjust back to pixels */
@@ -2663,7 +2819,7 @@ int dispc_setup_wb(struct writeback_cache_data *wb)
 		_dispc_set_plane_ba1_uv(plane, puv_addr + offset1);
 
 		/* DOUBLESTRIDE */
-		REG_FLD_MOD(DISPC_OVL_ATTRIBUTES(plane), 0x1, 22, 22);
+		REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES(plane), 0x1, 22, 22);
 	}
 
 	_dispc_set_row_inc(plane, row_inc);
@@ -2687,17 +2843,17 @@ int dispc_setup_wb(struct writeback_cache_data *wb)
 			fieldmode, wb->color_mode,
 			rotation);
 	/* configure wb burst size  */
-	REG_FLD_MOD(DISPC_OVL_ATTRIBUTES(plane), wb->burst_size, 15, 14);
+	REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES(plane), wb->burst_size, 15, 14);
 	/*
 	 * configure delay of 'n' lines after framedone for WB pipe flush
 	 * TODO: delay value of 3 is empirical (working for all scenarios)
 	 * need to work out value based on pix.clock, FIFO HT, etc
 	 */
 	if (wb->mode == OMAP_WB_CAPTURE_MODE)
-		REG_FLD_MOD(DISPC_OVL_ATTRIBUTES2(plane), 0x3, 7, 0);
+		REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES2(plane), 0x3, 7, 0);
 
 	/* TODO: need correct calculation for truncation bit */
-	REG_FLD_MOD(DISPC_OVL_ATTRIBUTES(plane), 0x0, 10, 10);
+	REG_FLD_MOD_CACHED(DISPC_OVL_ATTRIBUTES(plane), 0x0, 10, 10);
 
 	if (cconv)
 		_dispc_setup_wb_color_conv_coef();
@@ -2871,6 +3027,7 @@ bool dispc_is_channel_enabled(enum omap_channel channel)
 void dispc_enable_channel(enum omap_channel channel,
 		enum omap_display_type type, bool enable)
 {
+	dss_bw_settle();
 	if (channel == OMAP_DSS_CHANNEL_LCD ||
 			channel == OMAP_DSS_CHANNEL_LCD2)
 		dispc_enable_lcd_out(channel, enable);
@@ -2878,6 +3035,7 @@ void dispc_enable_channel(enum omap_channel channel,
 		dispc_enable_digit_out(type, enable);
 	else
 		BUG();
+	dss_bw_settle();
 }
 
 void dispc_lcd_enable_signal_polarity(bool act_high)
@@ -3188,6 +3346,7 @@ void dispc_set_lcd_timings(enum omap_channel channel,
 				timings->vfp, timings->vbp))
 		BUG();
 
+	dss_bw_settle();
 	_dispc_set_lcd_timings(channel, timings->hsw, timings->hfp,
 			timings->hbp, timings->vsw, timings->vfp,
 			timings->vbp);
@@ -3906,6 +4065,14 @@ static void dispc_error_worker(struct work_struct *work)
 	dispc.error_irqs = 0;
 	spin_unlock_irqrestore(&dispc.irq_lock, flags);
 
+	if (errors & (DISPC_IRQ_GFX_FIFO_UNDERFLOW |
+		      DISPC_IRQ_VID1_FIFO_UNDERFLOW |
+		      DISPC_IRQ_VID2_FIFO_UNDERFLOW |
+		      DISPC_IRQ_VID3_FIFO_UNDERFLOW |
+		      DISPC_IRQ_SYNC_LOST | DISPC_IRQ_SYNC_LOST2 |
+		      DISPC_IRQ_SYNC_LOST_DIGIT))
+		dss_bw_underflow();
+
 	dispc_runtime_get();
 
 	if (errors & DISPC_IRQ_GFX_FIFO_UNDERFLOW) {
@@ -4287,6 +4454,8 @@ static void _omap_dispc_initial_config(void)
 	dispc_set_loadmode(OMAP_DSS_LOAD_FRAME_ONLY);
 
 	dispc_read_plane_fifo_sizes();
+
+	dispc_init_reg_cache();
 }
 
 /* DISPC HW IP initialisation */
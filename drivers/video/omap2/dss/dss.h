@@ -241,6 +241,7 @@ void dss_setup_partial_planes(struct omap_dss_device *dssdev,
 				u16 *x, u16 *y, u16 *w, u16 *h,
 				bool enlarge_update_area);
 void dss_start_update(struct omap_dss_device *dssdev);
+void dss_mgr_dump_apply_stats(struct seq_file *s);
 
 /* overlay */
 void dss_init_overlays(struct platform_device *pdev);
@@ -426,6 +427,7 @@ void dispc_uninit_platform_driver(void);
 void dispc_dump_clocks(struct seq_file *s);
 void dispc_dump_irqs(struct seq_file *s);
 void dispc_dump_regs(struct seq_file *s);
+void dispc_get_reg_stats(u32 *written, u32 *skipped);
 void dispc_irq_handler(void);
 void dispc_fake_vsync_irq(void);
 
@@ -462,6 +464,7 @@ void dispc_set_plane_pos(enum omap_plane plane, u16 x, u16 y);
 void dispc_set_plane_size(enum omap_plane plane, u16 width, u16 height);
 void dispc_set_channel_out(enum omap_plane plane,
 		enum omap_channel channel_out);
+void dispc_set_channel_out_wb(enum omap_plane plane);
 
 void dispc_enable_gamma_table(bool enable);
 int dispc_setup_plane(enum omap_plane plane,
@@ -534,6 +537,41 @@ int dispc_get_clock_div(enum omap_channel channel,
 u32 sa_calc_wrap(struct dispc_config *dispc_reg_config, u32 channel_no);
 int dispc_setup_wb(struct writeback_cache_data *wb);
 void dispc_go_wb(void);
+int color_mode_to_bpp(enum omap_color_mode color_mode);
+void dispc_set_plane_fifo_low_min(enum omap_plane plane, u32 low);
+
+/* bandwidth planner */
+struct dss_bw_ovl {
+	bool enabled;
+	enum omap_channel channel;
+	enum omap_color_mode color_mode;
+	u16 width, height;
+	u16 out_width, out_height;
+	u16 x_decim, y_decim;
+	u16 max_y_decim;
+	u8 rotation;
+	enum omap_dss_rotation_type rotation_type;
+	u32 pclk_khz;		/* timings of the display */
+	u16 htotal, vtotal;
+
+	/* computed by dss_bw_plan */
+	u32 load_mbps;		/* average memory load */
+	u32 peak_mbps;		/* fetch rate while scanned out */
+	u32 fifo_low, fifo_high;
+	bool underflow;
+};
+
+struct dss_bw_plan {
+	u32 load_mbps;
+	u32 latency_ns;
+	bool overload;
+};
+
+int dss_bw_plan(struct dss_bw_plan *p, struct dss_bw_ovl *ovls, int num);
+void dss_bw_underflow(void);
+void dss_bw_settle(void);
+void dss_bw_dump(struct seq_file *s, struct dss_bw_plan *p,
+		struct dss_bw_ovl *ovls, int num);
 
 /* VENC */
 #ifdef CONFIG_OMAP2_DSS_VENC
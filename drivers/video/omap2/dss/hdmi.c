@@ -34,6 +34,7 @@
 #include <linux/regulator/consumer.h>
 #include <linux/pm_runtime.h>
 #include <linux/clk.h>
+#include <linux/jhash.h>
 #include <video/omapdss.h>
 #include <video/hdmi_ti_4xxx_ip.h>
 #include <linux/gpio.h>
@@ -56,6 +57,7 @@
 #define EDID_DESCRIPTOR_BLOCK1_ADDRESS		0x80
 #define EDID_SIZE_BLOCK0_TIMING_DESCRIPTOR	4
 #define EDID_SIZE_BLOCK1_TIMING_DESCRIPTOR	4
+#define EDID_BLK_SIZE				0x80
 
 #define OMAP_HDMI_TIMINGS_NB			34
 
@@ -68,6 +70,12 @@ static struct {
 	u8 edid[HDMI_EDID_MAX_LENGTH];
 	u8 edid_set;
 
+	/* parsed EDID, kept across hot-plugs of the same sink */
+	bool edid_cached;
+	u32 edid_hash;
+	struct fb_monspecs monspecs;
+	struct fb_videomode last_vmode;	/* last mode set on the sink */
+
 	bool custom_set;
 	enum hdmi_deep_color_mode deep_color;
 	struct hdmi_config cfg;
@@ -82,6 +90,7 @@ static struct {
 	int display_on;
 	bool set_mode;
 	bool wp_reset_done;
+	unsigned long phy;		/* TMDS clock of the PLL and PHY, or 0 */
 
 	struct fb_videomode initial_vmode;
 
@@ -265,7 +274,7 @@ done:
 	return i >= 0;
 }
 
-void hdmi_get_monspecs(struct fb_monspecs *specs)
+static void hdmi_parse_monspecs(struct fb_monspecs *specs)
 {
 	int i;
 	char *edid = (char *) hdmi.edid;
@@ -274,9 +283,6 @@ void hdmi_get_monspecs(struct fb_monspecs *specs)
 	struct fb_videomode default_vmode;
 
 	memset(specs, 0x0, sizeof(*specs));
-	if (!hdmi.edid_set)
-		return;
-
 	fb_edid_to_monspecs(edid, specs);
 	if (specs->modedb == NULL)
 		return;
@@ -424,7 +430,44 @@ void hdmi_get_monspecs(struct fb_monspecs *specs)
 		pr_info("%s: No usable video mode found!\n", __func__);
 }
 
-#define EDID_BLK_SIZE 0x80
+static int hdmi_edid_len(void)
+{
+	return min(hdmi.edid[0x7e] + 1, HDMI_EDID_MAX_LENGTH / EDID_BLK_SIZE) *
+								EDID_BLK_SIZE;
+}
+
+/*
+ * specs shares the modedb of the cached EDID, which is freed when another
+ * sink is read.  Called under the panel's hdmi_lock, which readers of the
+ * modedb also take.
+ */
+void hdmi_get_monspecs(struct fb_monspecs *specs)
+{
+	u32 hash;
+
+	if (!hdmi.edid_set) {
+		memset(specs, 0x0, sizeof(*specs));
+		return;
+	}
+
+	/*
+	 * A sink that is plugged back in, or that toggled its hot-plug
+	 * line, usually has the same EDID.  Keep what was parsed for it,
+	 * including the mode last set on it.
+	 */
+	hash = jhash(hdmi.edid, hdmi_edid_len(), 0);
+	if (hdmi.edid_cached && hash == hdmi.edid_hash) {
+		DSSINFO("same sink, reusing parsed EDID\n");
+	} else {
+		fb_destroy_modedb(hdmi.monspecs.modedb);
+		hdmi_parse_monspecs(&hdmi.monspecs);
+		memset(&hdmi.last_vmode, 0, sizeof(hdmi.last_vmode));
+		hdmi.edid_hash = hash;
+		hdmi.edid_cached = true;
+	}
+	*specs = hdmi.monspecs;
+}
+
 static void hdmi_parse_cea_audio_blocks(struct omap_hdmi_audio_modes *specs,
 					const u8* edid)
 {
@@ -694,28 +737,17 @@ static void hdmi_load_hdcp_keys(struct omap_dss_device *dssdev)
 
 }
 
-static int hdmi_display_on(struct omap_dss_device *dssdev)
+/*
+ * Programs the PLL, PHY, HDMI core and DISPC for the current timings.  The
+ * PLL and PHY keep running if the TMDS clock does not change.
+ */
+static int hdmi_display_program(struct omap_dss_device *dssdev)
 {
 	int r;
 	struct hdmi_pll_info pll_data;
 	struct omap_video_timings *p;
 	unsigned long phy;
 
-	DSSINFO("Entering %s\n", __func__);
-
-	if (!hdmi.custom_set) {
-		DSSERR("%s: custom_set is false, returning\n", __func__);
-		return -ENODEV;
-	}
-
-	if (hdmi.display_on) {
-		DSSWARN("%s: hdmi display already on\n", __func__);
-		return 0;
-	}
-
-	/* Load the HDCP keys if not already loaded */
-	hdmi_load_hdcp_keys(dssdev);
-
 	/* To be safe, make sure video is off before changing settings */
 	hdmi_ti_4xxx_wp_video_start(&hdmi.hdmi_data, 0);
 
@@ -746,19 +778,27 @@ static int hdmi_display_on(struct omap_dss_device *dssdev)
 		break;
 	}
 
-	hdmi_compute_pll(dssdev, phy, &pll_data);
+	if (phy != hdmi.phy) {
+		/* the PHY runs off the PLL, so stop it while relocking */
+		if (hdmi.phy)
+			hdmi_ti_4xxx_phy_off(&hdmi.hdmi_data, true);
+		hdmi.phy = 0;
 
-	/* config the PLL and PHY hdmi_set_pll_pwrfirst */
-	r = hdmi_ti_4xxx_pll_program(&hdmi.hdmi_data, &pll_data);
-	if (r) {
-		DSSERR("Failed to lock PLL\n");
-		return -EIO;
-	}
+		hdmi_compute_pll(dssdev, phy, &pll_data);
 
-	r = hdmi_ti_4xxx_phy_init(&hdmi.hdmi_data, phy);
-	if (r) {
-		DSSERR("Failed to start PHY\n");
-		return -EIO;
+		/* config the PLL and PHY hdmi_set_pll_pwrfirst */
+		r = hdmi_ti_4xxx_pll_program(&hdmi.hdmi_data, &pll_data);
+		if (r) {
+			DSSERR("Failed to lock PLL\n");
+			return -EIO;
+		}
+
+		r = hdmi_ti_4xxx_phy_init(&hdmi.hdmi_data, phy);
+		if (r) {
+			DSSERR("Failed to start PHY\n");
+			return -EIO;
+		}
+		hdmi.phy = phy;
 	}
 
 	hdmi_ti_4xxx_basic_configure(&hdmi.hdmi_data, &hdmi.cfg);
@@ -787,6 +827,32 @@ static int hdmi_display_on(struct omap_dss_device *dssdev)
 
 	hdmi_ti_4xxx_wp_video_start(&hdmi.hdmi_data, 1);
 
+	return 0;
+}
+
+static int hdmi_display_on(struct omap_dss_device *dssdev)
+{
+	int r;
+
+	DSSINFO("Entering %s\n", __func__);
+
+	if (!hdmi.custom_set) {
+		DSSERR("%s: custom_set is false, returning\n", __func__);
+		return -ENODEV;
+	}
+
+	if (hdmi.display_on) {
+		DSSWARN("%s: hdmi display already on\n", __func__);
+		return 0;
+	}
+
+	/* Load the HDCP keys if not already loaded */
+	hdmi_load_hdcp_keys(dssdev);
+
+	r = hdmi_display_program(dssdev);
+	if (r)
+		return r;
+
 	/* Start hdcp negotiation if needed */
 	if (hdmi.hdmi_start_frame_cb && hdmi.wp_reset_done)
 		(*hdmi.hdmi_start_frame_cb)();
@@ -806,6 +872,7 @@ static void hdmi_power_off(struct omap_dss_device *dssdev)
 	dispc_enable_channel(OMAP_DSS_CHANNEL_DIGIT, dssdev->type, 0);
 	hdmi_ti_4xxx_phy_off(&hdmi.hdmi_data, hdmi.set_mode);
 	hdmi_ti_4xxx_set_pll_pwr(&hdmi.hdmi_data, HDMI_PLLPWRCMD_ALLOFF);
+	hdmi.phy = 0;
 	hdmi_runtime_put();
 	hdmi.deep_color = HDMI_DEEP_COLOR_24BIT;
 }
@@ -888,11 +955,74 @@ int omapdss_hdmi_display_check_timing(struct omap_dss_device *dssdev,
 	return 0;
 }
 
+/* whether the enabled overlays of the display fit in a w x h frame */
+static bool hdmi_overlays_fit(struct omap_dss_device *dssdev, u32 w, u32 h)
+{
+	struct omap_overlay_info *info;
+	struct omap_overlay *ovl;
+	int i;
+
+	for (i = 0; i < omap_dss_get_num_overlays(); i++) {
+		ovl = omap_dss_get_overlay(i);
+		info = &ovl->info;
+		if (ovl->manager != dssdev->manager || !info->enabled)
+			continue;
+		if (info->pos_x + (info->out_width ? : info->width) > w ||
+		    info->pos_y + (info->out_height ? : info->height) > h)
+			return false;
+	}
+	return true;
+}
+
+/*
+ * Switches the mode of a display that is on, reprogramming only the
+ * timings (and the PLL and PHY if the pixel clock changes), without
+ * powering HDMI and the DISPC channel down.  The overlays stay as they
+ * are, so this is only done if they fit in the new mode; otherwise the
+ * display is disabled and enabled again, which lets the composition be
+ * redone for the new size.
+ */
+static int hdmi_display_switch_mode(struct omap_dss_device *dssdev,
+				    struct fb_videomode *vm)
+{
+	struct fb_videomode t = *vm;
+	ktime_t start = ktime_get();
+	int r;
+
+	mutex_lock(&hdmi.lock);
+
+	if (!hdmi.display_on || !hdmi_set_timings(&t, true) ||
+	    !hdmi_overlays_fit(dssdev, t.xres, t.yres)) {
+		mutex_unlock(&hdmi.lock);
+		return -EINVAL;
+	}
+
+	hdmi_set_timings(vm, false);
+	omapfb_fb2dss_timings(&hdmi.cfg.timings, &dssdev->panel.timings);
+
+	r = hdmi_display_program(dssdev);
+	if (!r && hdmi.hdmi_start_frame_cb && hdmi.wp_reset_done)
+		(*hdmi.hdmi_start_frame_cb)();
+
+	mutex_unlock(&hdmi.lock);
+
+	if (!r)
+		DSSINFO("switched mode in %lld us\n",
+			ktime_to_us(ktime_sub(ktime_get(), start)));
+	return r;
+}
+
 int omapdss_hdmi_display_set_mode(struct omap_dss_device *dssdev,
 				  struct fb_videomode *vm)
 {
 	int r1, r2;
 	DSSINFO("Enter omapdss_hdmi_display_set_mode\n");
+
+	if (!hdmi_display_switch_mode(dssdev, vm)) {
+		hdmi.last_vmode = *vm;
+		return 0;
+	}
+
 	/* turn the hdmi off and on to get new timings to use */
 	hdmi.set_mode = true;
 	dssdev->driver->disable(dssdev);
@@ -903,19 +1033,26 @@ int omapdss_hdmi_display_set_mode(struct omap_dss_device *dssdev,
 		omapfb_fb2dss_timings(&hdmi.cfg.timings, &dssdev->panel.timings);
 	hdmi.custom_set = 1;
 	r2 = dssdev->driver->enable(dssdev);
+	if (!r1 && !r2)
+		hdmi.last_vmode = *vm;
 	return r1 ? : r2;
 }
 
 int omapdss_hdmi_display_set_initial_mode(struct omap_dss_device *dssdev)
 {
 	int r1, r2;
+	struct fb_videomode *vm = &hdmi.initial_vmode;
 
 	DSSINFO("Enter omapdss_hdmi_display_set_initial_mode\n");
-	if (!hdmi.initial_vmode.pixclock) {
+
+	/* go back to the mode last used on the same sink */
+	if (hdmi.last_vmode.pixclock)
+		vm = &hdmi.last_vmode;
+	if (!vm->pixclock) {
 		DSSWARN("No valid initial_vmode set\n");
 		return -EINVAL;
 	}
-	r1 = hdmi_set_timings(&hdmi.initial_vmode, false) ? 0 : -EINVAL;
+	r1 = hdmi_set_timings(vm, false) ? 0 : -EINVAL;
 	/* convert hdmi.cfg.timings to dssdev->panel.timings */
 	if (!r1)
 		omapfb_fb2dss_timings(&hdmi.cfg.timings, &dssdev->panel.timings);
@@ -464,9 +464,13 @@ static int hdmi_get_modedb(struct omap_dss_device *dssdev,
 			   struct fb_videomode *modedb, int modedb_len)
 {
 	struct fb_monspecs *specs = &dssdev->panel.monspecs;
+
+	/* the modedb is replaced under hdmi_lock when a new sink is read */
+	mutex_lock(&hdmi.hdmi_lock);
 	if (specs->modedb_len < modedb_len)
 		modedb_len = specs->modedb_len;
 	memcpy(modedb, specs->modedb, sizeof(*modedb) * modedb_len);
+	mutex_unlock(&hdmi.hdmi_lock);
 	return modedb_len;
 }
 static void hdmi_get_resolution(struct omap_dss_device *dssdev,
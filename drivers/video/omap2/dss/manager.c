@@ -551,6 +551,7 @@ struct overlay_cache_data {
 	enum omap_burst_size burst_size;
 	u32 fifo_low;
 	u32 fifo_high;
+	u32 fifo_low_min;	/* from the bandwidth plan, 0 if none */
 
 	bool manual_update;
 	enum omap_overlay_zorder zorder;
@@ -593,14 +594,66 @@ struct manager_cache_data {
 	bool m2m_only;
 };
 
+/*
+ * Plane setup last programmed into DISPC.  Kept zero-filled, so that it
+ * can be compared with memcmp.
+ */
+struct overlay_setup {
+	bool valid;
+	u32 paddr;
+	u32 p_uv_addr;
+	u16 screen_width;
+	u16 x, y, w, h;
+	u16 outw, outh;
+	enum omap_color_mode color_mode;
+	bool ilace;
+	u16 x_decim, y_decim;
+	bool five_taps;
+	enum omap_dss_rotation_type rotation_type;
+	u8 rotation;
+	bool mirror;
+	u8 global_alpha;
+	u8 pre_mult_alpha;
+	enum omap_channel channel;
+	bool replication;
+	enum omap_burst_size burst_size;
+	enum omap_overlay_zorder zorder;
+	u32 fifo_low, fifo_high;
+	struct omap_dss_cconv_coefs cconv;
+};
+
 static struct {
 	spinlock_t lock;
 	struct overlay_cache_data overlay_cache[MAX_DSS_OVERLAYS];
 	struct manager_cache_data manager_cache[MAX_DSS_MANAGERS];
 	struct writeback_cache_data writeback_cache;
+	struct overlay_setup overlay_setup[MAX_DSS_OVERLAYS];
 
 	bool irq_enabled;
 	u32 comp_irq_enabled;
+
+	/* overlay used by a memory to memory writeback, or -1 */
+	int m2m_plane;
+	omap_dispc_isr_t m2m_isr;
+	void *m2m_isr_arg;
+
+	/* bandwidth plan of the enabled overlays, on OMAP4 */
+	struct dss_bw_plan bw;
+	struct dss_bw_ovl bw_ovls[MAX_DSS_OVERLAYS];
+	u16 bw_min_y_decim[MAX_DSS_OVERLAYS];	/* imposed by the plan */
+
+	struct {
+		u32 frames;
+		u32 full;		/* overlays fully programmed */
+		u32 addr_only;		/* overlays only flipped */
+		u32 unchanged;		/* overlays left as they were */
+		u32 regs_last;		/* plane registers written per frame */
+		u32 regs_max;
+		u32 regs_written;
+		u32 regs_skipped;	/* register writes found redundant */
+		u32 bw_downgraded;	/* applies decimated to fit */
+		u32 bw_rejected;	/* applies that could not fit */
+	} stats;
 } dss_cache;
 
 /* propagating callback info between states */
@@ -984,6 +1037,8 @@ static int configure_overlay(enum omap_plane plane)
 	bool five_taps;
 	u16 orig_w, orig_h, orig_outw, orig_outh;
 	bool source_of_wb = false;
+	struct overlay_setup setup, *last;
+	bool same;
 
 	DSSDBGF("%d", plane);
 
@@ -1000,6 +1055,7 @@ static int configure_overlay(enum omap_plane plane)
 	}
 
 	if (!c->enabled) {
+		dss_cache.overlay_setup[plane].valid = false;
 		dispc_enable_plane(plane, 0);
 		return 0;
 	}
@@ -1027,6 +1083,7 @@ static int configure_overlay(enum omap_plane plane)
 		/* If the overlay is outside the update region, disable it */
 		if (!rectangle_intersects(mc->x, mc->y, mc->w, mc->h,
 					x, y, outw, outh)) {
+			dss_cache.overlay_setup[plane].valid = false;
 			dispc_enable_plane(plane, 0);
 			return 0;
 		}
@@ -1117,7 +1174,58 @@ static int configure_overlay(enum omap_plane plane)
 			       c->min_x_decim, c->max_x_decim,
 			       c->min_y_decim, c->max_y_decim,
 			       &x_decim, &y_decim, &five_taps);
-	r = r ? : dispc_setup_plane(plane,
+	if (r)
+		goto err;
+
+	memset(&setup, 0, sizeof(setup));
+	setup.valid = true;
+	setup.screen_width = c->screen_width;
+	setup.x = x;
+	setup.y = y;
+	setup.w = w;
+	setup.h = h;
+	setup.outw = outw;
+	setup.outh = outh;
+	setup.color_mode = c->color_mode;
+	setup.ilace = c->ilace;
+	setup.x_decim = x_decim;
+	setup.y_decim = y_decim;
+	setup.five_taps = five_taps;
+	setup.rotation_type = c->rotation_type;
+	setup.rotation = c->rotation;
+	setup.mirror = c->mirror;
+	setup.global_alpha = c->global_alpha;
+	setup.pre_mult_alpha = c->pre_mult_alpha;
+	setup.channel = c->channel;
+	setup.replication = c->replication;
+	setup.burst_size = c->burst_size;
+	setup.zorder = c->zorder;
+	setup.fifo_low = c->fifo_low;
+	setup.fifo_high = c->fifo_high;
+	if (plane != OMAP_DSS_GFX)
+		setup.cconv = c->cconv;
+	if (cpu_is_omap44xx())
+		dispc_set_plane_fifo_low_min(plane, c->fifo_low_min);
+
+	/*
+	 * Most frames only flip buffers.  Skip the plane altogether if
+	 * nothing changed, and program only the buffer addresses if only
+	 * they changed.
+	 */
+	last = &dss_cache.overlay_setup[plane];
+	setup.paddr = last->paddr;
+	setup.p_uv_addr = last->p_uv_addr;
+	same = !memcmp(&setup, last, sizeof(setup));
+	setup.paddr = paddr;
+	setup.p_uv_addr = c->p_uv_addr;
+
+	if (same && setup.paddr == last->paddr &&
+	    setup.p_uv_addr == last->p_uv_addr) {
+		dss_cache.stats.unchanged++;
+		goto enable;
+	}
+
+	r = dispc_setup_plane(plane,
 			paddr,
 			c->screen_width,
 			x, y,
@@ -1132,13 +1240,16 @@ static int configure_overlay(enum omap_plane plane)
 			c->pre_mult_alpha,
 			c->channel,
 			c->p_uv_addr);
+	if (r)
+		goto err;
 
-	if (r) {
-		/* this shouldn't happen */
-		DSSERR("dispc_setup_plane failed for ovl %d\n", plane);
-		dispc_enable_plane(plane, 0);
-		return r;
+	memcpy(last, &setup, sizeof(setup));
+	if (same) {
+		/* only the base address registers were written */
+		dss_cache.stats.addr_only++;
+		goto enable;
 	}
+	dss_cache.stats.full++;
 
 	dispc_enable_replication(plane, c->replication);
 
@@ -1150,11 +1261,19 @@ static int configure_overlay(enum omap_plane plane)
 	if (plane != OMAP_DSS_GFX)
 		_dispc_setup_color_conv_coef(plane, &c->cconv);
 
+enable:
 	/* for WB source, enable plane along with WB */
 	if (!source_of_wb)
 		dispc_enable_plane(plane, 1);
 
 	return 0;
+
+err:
+	/* this shouldn't happen */
+	DSSERR("dispc_setup_plane failed for ovl %d\n", plane);
+	dss_cache.overlay_setup[plane].valid = false;
+	dispc_enable_plane(plane, 0);
+	return r;
 }
 
 static void configure_manager(enum omap_channel channel)
@@ -1200,10 +1319,13 @@ static int configure_dispc(void)
 	bool mgr_busy[MAX_DSS_MANAGERS];
 	bool mgr_go[MAX_DSS_MANAGERS];
 	bool busy;
+	u32 written, skipped, regs_written, regs_skipped;
 
 	r = 0;
 	busy = false;
 
+	dispc_get_reg_stats(&written, &skipped);
+
 	for (i = 0; i < num_mgrs; i++) {
 		mgr_busy[i] = dispc_go_busy(i);
 		mgr_go[i] = false;
@@ -1224,6 +1346,10 @@ static int configure_dispc(void)
 		if (oc->manual_update && !mc->do_manual_update)
 			continue;
 
+		/* overlay is configured once the writeback completes */
+		if (i == dss_cache.m2m_plane)
+			continue;
+
 		if (mgr_busy[oc->channel]) {
 			busy = true;
 			continue;
@@ -1336,6 +1462,19 @@ static int configure_dispc(void)
 		}
 	}
 
+	/* account the plane registers written by this frame */
+	dispc_get_reg_stats(&regs_written, &regs_skipped);
+	regs_written -= written;
+	regs_skipped -= skipped;
+	if (regs_written || regs_skipped) {
+		dss_cache.stats.frames++;
+		dss_cache.stats.regs_last = regs_written;
+		dss_cache.stats.regs_max = max(dss_cache.stats.regs_max,
+					       regs_written);
+		dss_cache.stats.regs_written += regs_written;
+		dss_cache.stats.regs_skipped += regs_skipped;
+	}
+
 	if (busy)
 		r = 1;
 	else
@@ -1883,6 +2022,136 @@ int omap_dss_manager_unregister_callback(struct omap_overlay_manager *mgr,
 	return r;
 }
 
+/* fill out the bandwidth planner input for an overlay */
+static void dss_bw_setup_ovl(struct dss_bw_ovl *b, struct omap_overlay *ovl,
+			     struct omap_overlay_info *info, u16 min_y_decim)
+{
+	struct omap_video_timings *t = &ovl->manager->device->panel.timings;
+	bool five_taps;
+
+	b->enabled = true;
+	b->channel = ovl->manager->id;
+	b->color_mode = info->color_mode;
+	b->width = info->width;
+	b->height = info->height;
+	b->out_width = info->out_width ? : info->width;
+	b->out_height = info->out_height ? : info->height;
+	b->rotation = info->rotation;
+	b->rotation_type = info->rotation_type;
+	b->max_y_decim = info->max_y_decim;
+	b->pclk_khz = t->pixel_clock;
+	b->htotal = t->x_res + t->hfp + t->hsw + t->hbp;
+	b->vtotal = t->y_res + t->vfp + t->vsw + t->vbp;
+
+	/* manual update panels may have no timings: assume 60 fps */
+	if (!b->pclk_khz)
+		b->pclk_khz = b->htotal * b->vtotal * 60 / 1000;
+
+	if (dispc_scaling_decision(info->width, info->height,
+				   b->out_width, b->out_height,
+				   ovl->id, info->color_mode, ovl->manager->id,
+				   info->rotation, info->rotation_type,
+				   info->min_x_decim, info->max_x_decim,
+				   max(info->min_y_decim, min_y_decim),
+				   info->max_y_decim,
+				   &b->x_decim, &b->y_decim, &five_taps)) {
+		/* overlay will be rejected on its own */
+		b->x_decim = b->y_decim = 1;
+	}
+}
+
+/*
+ * Plans the memory bandwidth of the overlays as they will be after mgr is
+ * applied.  If the overlays would underflow, the vertical decimation of
+ * video overlays on mgr is raised until they fit, and if they cannot fit,
+ * the apply is rejected.  Called with dss_cache.lock held.
+ */
+static int dss_mgr_plan_bw(struct omap_overlay_manager *mgr)
+{
+	struct dss_bw_ovl bw[MAX_DSS_OVERLAYS], *b;
+	u16 min_y_decim[MAX_DSS_OVERLAYS] = { 0 }, raised_from = 0;
+	struct dss_bw_plan plan;
+	struct omap_overlay *ovl;
+	int i, n, worst, r, raised = -1;
+	u32 fixed = 0;			/* overlays that cannot be decimated more */
+	bool downgraded = false, enabled;
+
+	n = min(omap_dss_get_num_overlays(), MAX_DSS_OVERLAYS);
+	for (;;) {
+		memset(bw, 0, sizeof(bw));
+		for (i = 0; i < n; i++) {
+			ovl = omap_dss_get_overlay(i);
+			if (!(ovl->caps & OMAP_DSS_OVL_CAP_DISPC) ||
+			    !overlay_enabled(ovl))
+				continue;
+
+			/* overlays of other managers stay as they are */
+			if (ovl->manager != mgr) {
+				if (dss_cache.overlay_cache[i].enabled)
+					dss_bw_setup_ovl(bw + i, ovl, &ovl->info,
+						dss_cache.bw_min_y_decim[i]);
+				continue;
+			}
+
+			if (ovl->info_dirty)
+				enabled = !dss_check_overlay(ovl, mgr->device);
+			else
+				enabled = dss_cache.overlay_cache[i].enabled;
+			if (enabled)
+				dss_bw_setup_ovl(bw + i, ovl, &ovl->info,
+						 min_y_decim[i]);
+		}
+
+		/*
+		 * If the scaler rejected the raised decimation, the overlay fell
+		 * back to no decimation: restore it and stop decimating it.
+		 */
+		if (raised >= 0 && bw[raised].y_decim < min_y_decim[raised]) {
+			min_y_decim[raised] = raised_from;
+			fixed |= 1 << raised;
+			raised = -1;
+			continue;
+		}
+		raised = -1;
+
+		r = dss_bw_plan(&plan, bw, n);
+		if (!r)
+			break;
+
+		/* decimate the most demanding video overlay on mgr */
+		worst = -1;
+		for (i = 0; i < n; i++) {
+			b = bw + i;
+			if (i != OMAP_DSS_GFX && b->enabled &&
+			    b->channel == mgr->id && !(fixed & (1 << i)) &&
+			    b->y_decim < b->max_y_decim &&
+			    (worst < 0 || b->peak_mbps > bw[worst].peak_mbps))
+				worst = i;
+		}
+		if (worst < 0) {
+			dss_cache.stats.bw_rejected++;
+			DSSERR("%s: composition exceeds memory bandwidth\n",
+			       mgr->name);
+			return r;
+		}
+		raised = worst;
+		raised_from = min_y_decim[worst];
+		min_y_decim[worst] = bw[worst].y_decim + 1;
+		downgraded = true;
+	}
+
+	if (downgraded)
+		dss_cache.stats.bw_downgraded++;
+	for (i = 0; i < n; i++) {
+		ovl = omap_dss_get_overlay(i);
+		if (ovl->manager == mgr)
+			dss_cache.bw_min_y_decim[i] = min_y_decim[i];
+	}
+	dss_cache.bw = plan;
+	memcpy(dss_cache.bw_ovls, bw, sizeof(bw));
+	return 0;
+}
+
 static int omap_dss_mgr_apply(struct omap_overlay_manager *mgr)
 {
 	struct overlay_cache_data *oc;
@@ -1910,6 +2179,12 @@ static int omap_dss_mgr_apply(struct omap_overlay_manager *mgr)
 		goto done;
 	}
 
+	if (cpu_is_omap44xx()) {
+		r = dss_mgr_plan_bw(mgr);
+		if (r)
+			goto done;
+	}
+
 	/* Configure overlays */
 	for (i = 0; i < omap_dss_get_num_overlays(); ++i) {
 		struct omap_dss_device *dssdev;
@@ -2108,6 +2383,30 @@ skip_mgr:
 		default:
 			BUG();
 		}
+
+		/*
+		 * On OMAP4, thresholds and decimation follow the plan.  The
+		 * plan is made for unmerged FIFOs, so merged FIFOs keep their
+		 * default thresholds.
+		 */
+		oc->fifo_low_min = 0;
+		if (cpu_is_omap44xx()) {
+			struct dss_bw_ovl *b = &dss_cache.bw_ovls[ovl->id];
+			u16 min_y_decim = dss_cache.bw_min_y_decim[ovl->id];
+
+			min_y_decim = max(min_y_decim, ovl->info.min_y_decim);
+			if (ovl->manager == mgr) {
+				if (oc->min_y_decim != min_y_decim ||
+				    (!use_fifomerge && oc->fifo_low != b->fifo_low))
+					oc->dirty = true;
+				oc->min_y_decim = min_y_decim;
+			}
+			if (!use_fifomerge) {
+				oc->fifo_low = b->fifo_low;
+				oc->fifo_high = b->fifo_high;
+				oc->fifo_low_min = b->fifo_low;
+			}
+		}
 	}
 
 	r = 0;
@@ -2212,6 +2511,176 @@ int omap_dss_wb_apply(struct omap_overlay_manager *mgr,
 }
 EXPORT_SYMBOL(omap_dss_wb_apply);
 
+/* route an overlay back to its manager after a writeback */
+static void omap_dss_wb_m2m_restore(struct omap_overlay *ovl)
+{
+	if (ovl->manager)
+		dispc_set_channel_out(ovl->id, ovl->manager->id);
+	dss_cache.overlay_setup[ovl->id].valid = false;
+}
+
+/*
+ * Start a memory to memory writeback of an overlay, which must be disabled.
+ * The overlay is programmed from info, and is kept from being used for
+ * display until omap_dss_wb_m2m_stop() is called.  isr is called with arg
+ * on DISPC_IRQ_WB_M2M interrupts until then.
+ * Scaling is done in the overlay from info->width/height to
+ * info->out_width/out_height, and in the writeback pipeline from
+ * wb->width/height (which must match the overlay output) to
+ * wb->out_width/out_height.
+ */
+int omap_dss_wb_m2m_start(struct omap_overlay *ovl,
+		struct omap_overlay_info *info, struct omap_writeback_info *wb,
+		omap_dispc_isr_t isr, void *arg)
+{
+	struct overlay_cache_data *oc;
+	struct writeback_cache_data wbc;
+	enum omap_plane plane = ovl->id;
+	unsigned long flags;
+	u16 x_decim, y_decim;
+	bool five_taps;
+	int r;
+
+	if (!dss_has_feature(FEAT_OVL_WB) || plane == OMAP_DSS_WB ||
+	    wb->width != info->out_width || wb->height != info->out_height)
+		return -EINVAL;
+
+	r = dispc_runtime_get();
+	if (r)
+		return r;
+
+	spin_lock_irqsave(&dss_cache.lock, flags);
+
+	oc = &dss_cache.overlay_cache[plane];
+	if (dss_cache.m2m_plane >= 0 || dss_cache.writeback_cache.enabled ||
+	    oc->enabled || oc->dirty || oc->shadow_dirty) {
+		r = -EBUSY;
+		goto done;
+	}
+
+	/*
+	 * The scaling limits are checked against the primary LCD pixel
+	 * clock, as writeback is not paced by a display.
+	 */
+	r = dispc_scaling_decision(info->width, info->height,
+			info->out_width, info->out_height,
+			plane, info->color_mode, OMAP_DSS_CHANNEL_LCD,
+			info->rotation, info->rotation_type,
+			info->min_x_decim, info->max_x_decim,
+			info->min_y_decim, info->max_y_decim,
+			&x_decim, &y_decim, &five_taps);
+	dispc_set_plane_fifo_low_min(plane, 0);
+	r = r ? : dispc_setup_plane(plane, info->paddr, info->screen_width,
+			0, 0, info->width, info->height,
+			info->out_width, info->out_height,
+			info->color_mode, false, x_decim, y_decim, five_taps,
+			info->rotation_type, info->rotation, info->mirror,
+			255, info->pre_mult_alpha, OMAP_DSS_CHANNEL_LCD,
+			info->p_uv_addr);
+	if (r)
+		goto done;
+
+	dispc_enable_replication(plane, false);
+	dispc_set_burst_size(plane, OMAP_DSS_BURST_16x32);
+	if (plane != OMAP_DSS_GFX)
+		_dispc_setup_color_conv_coef(plane, &info->cconv);
+	dispc_set_channel_out_wb(plane);
+	dss_cache.overlay_setup[plane].valid = false;
+
+	memset(&wbc, 0, sizeof(wbc));
+	wbc.enabled = true;
+	wbc.mode = OMAP_WB_MEM2MEM_MODE;
+	wbc.source = OMAP_WB_GFX + plane;
+	wbc.color_mode = wb->dss_mode;
+	wbc.width = wb->width;
+	wbc.height = wb->height;
+	wbc.out_width = wb->out_width;
+	wbc.out_height = wb->out_height;
+	wbc.paddr = wb->paddr;
+	wbc.p_uv_addr = wb->p_uv_addr;
+	wbc.rotation = wb->rotation;
+	wbc.rotation_type = wb->rotation_type;
+	wbc.burst_size = OMAP_DSS_BURST_16x32;
+	wbc.fifo_high = 0x10;
+	wbc.fifo_low = 0x8;
+
+	r = dispc_setup_wb(&wbc) ? :
+	    omap_dispc_register_isr(isr, arg, DISPC_IRQ_WB_M2M);
+	if (r) {
+		omap_dss_wb_m2m_restore(ovl);
+		goto done;
+	}
+
+	/* enabling writeback starts the transfer */
+	dss_cache.m2m_plane = plane;
+	dss_cache.m2m_isr = isr;
+	dss_cache.m2m_isr_arg = arg;
+	dispc_enable_plane(plane, 1);
+	dispc_enable_plane(OMAP_DSS_WB, 1);
+done:
+	spin_unlock_irqrestore(&dss_cache.lock, flags);
+
+	if (r)
+		dispc_runtime_put();
+	return r;
+}
+EXPORT_SYMBOL(omap_dss_wb_m2m_start);
+
+/* Release an overlay after a memory to memory writeback, or abort it. */
+void omap_dss_wb_m2m_stop(struct omap_overlay *ovl)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&dss_cache.lock, flags);
+
+	if (WARN_ON(dss_cache.m2m_plane != ovl->id)) {
+		spin_unlock_irqrestore(&dss_cache.lock, flags);
+		return;
+	}
+
+	dispc_enable_plane(OMAP_DSS_WB, 0);
+	dispc_enable_plane(ovl->id, 0);
+	omap_dispc_unregister_isr(dss_cache.m2m_isr, dss_cache.m2m_isr_arg,
+				  DISPC_IRQ_WB_M2M);
+	omap_dss_wb_m2m_restore(ovl);
+	dss_cache.m2m_plane = -1;
+
+	/* apply any display setup that was held back */
+	if (dss_cache.overlay_cache[ovl->id].dirty)
+		configure_dispc();
+
+	spin_unlock_irqrestore(&dss_cache.lock, flags);
+
+	dispc_runtime_put();
+}
+EXPORT_SYMBOL(omap_dss_wb_m2m_stop);
+
+void dss_mgr_dump_apply_stats(struct seq_file *s)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&dss_cache.lock, flags);
+
+	seq_printf(s, "frames:\t\t%u\n", dss_cache.stats.frames);
+	seq_printf(s, "overlays:\tfull %u, address only %u, unchanged %u\n",
+		   dss_cache.stats.full, dss_cache.stats.addr_only,
+		   dss_cache.stats.unchanged);
+	seq_printf(s, "regs/frame:\tlast %u, max %u, avg %u\n",
+		   dss_cache.stats.regs_last, dss_cache.stats.regs_max,
+		   dss_cache.stats.frames ? dss_cache.stats.regs_written /
+		   dss_cache.stats.frames : 0);
+	seq_printf(s, "regs skipped:\t%u\n", dss_cache.stats.regs_skipped);
+	if (cpu_is_omap44xx()) {
+		seq_printf(s, "downgraded:\t%u\nrejected:\t%u\n",
+			   dss_cache.stats.bw_downgraded,
+			   dss_cache.stats.bw_rejected);
+		dss_bw_dump(s, &dss_cache.bw, dss_cache.bw_ovls,
+			    ARRAY_SIZE(dss_cache.bw_ovls));
+	}
+
+	spin_unlock_irqrestore(&dss_cache.lock, flags);
+}
+
 #ifdef CONFIG_DEBUG_FS
 static void seq_print_cb(struct seq_file *s, struct omapdss_ovl_cb *cb)
 {
@@ -2371,6 +2840,7 @@ int dss_init_overlay_managers(struct platform_device *pdev)
 	int i, r;
 
 	spin_lock_init(&dss_cache.lock);
+	dss_cache.m2m_plane = -1;
 
 	INIT_LIST_HEAD(&manager_list);
 
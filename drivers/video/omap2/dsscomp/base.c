@@ -175,60 +175,25 @@ int crop_to_rect(union rect *crop, union rect *win, union rect *vis,
 	return 0;
 }
 
-int set_dss_ovl_info(struct dss2_ovl_info *oi)
+/*
+ * Set the buffer addresses, cropping and rotation type in an overlay info
+ * from a buffer and a crop region within it.
+ */
+int set_dss_ovl_buffer(struct omap_overlay_info *info, struct dss2_ovl_info *oi,
+		       struct dss2_rect_t *crop_r)
 {
-	struct omap_overlay_info info;
-	struct omap_overlay *ovl;
-	struct dss2_ovl_cfg *cfg;
-	union rect crop, win, vis;
+	struct dss2_ovl_cfg *cfg = &oi->cfg;
+	union rect *crop = (union rect *) crop_r;
 	int c;
 
-	/* check overlay number */
-	if (!oi || oi->cfg.ix >= omap_dss_get_num_overlays())
-		return -EINVAL;
-	cfg = &oi->cfg;
-	ovl = omap_dss_get_overlay(cfg->ix);
-
-	/* just in case there are new fields, we get the current info */
-	ovl->get_overlay_info(ovl, &info);
-
-	info.enabled = cfg->enabled;
-	if (!cfg->enabled)
-		goto done;
-
-	/* copied params */
-	info.zorder = cfg->zorder;
-
-	if (cfg->zonly)
-		goto done;
-
-	info.global_alpha = cfg->global_alpha;
-	info.pre_mult_alpha = cfg->pre_mult_alpha;
-	info.rotation = cfg->rotation;
-	info.mirror = cfg->mirror;
-	info.color_mode = cfg->color_mode;
-
-	/* crop to screen */
-	crop.r = cfg->crop;
-	win.r = cfg->win;
-	vis.x = vis.y = 0;
-	vis.w = ovl->manager->device->panel.timings.x_res;
-	vis.h = ovl->manager->device->panel.timings.y_res;
-
-	if (crop_to_rect(&crop, &win, &vis, cfg->rotation, cfg->mirror) ||
-								vis.w < 2) {
-		info.enabled = false;
-		goto done;
-	}
-
 	/* adjust crop to UV pixel boundaries */
 	for (c = 0; c < (cfg->color_mode == OMAP_DSS_COLOR_NV12 ? 2 :
 		(cfg->color_mode &
 		 (OMAP_DSS_COLOR_YUV2 | OMAP_DSS_COLOR_UYVY)) ? 1 : 0); c++) {
 		/* keep the output window to avoid trembling edges */
-		crop.wh[c] += crop.xy[c] & 1;	/* round down start */
-		crop.xy[c] &= ~1;
-		crop.wh[c] += crop.wh[c] & 1;	/* round up end */
+		crop->wh[c] += crop->xy[c] & 1;	/* round down start */
+		crop->xy[c] &= ~1;
+		crop->wh[c] += crop->wh[c] & 1;	/* round up end */
 
 		/*
 		 * Buffer is aligned on UV pixel boundaries, so no
@@ -236,24 +201,20 @@ int set_dss_ovl_info(struct dss2_ovl_info *oi)
 		 */
 	}
 
-	info.width  = crop.w;
-	info.height = crop.h;
+	info->width  = crop->w;
+	info->height = crop->h;
 	if (cfg->rotation & 1)
 		/* DISPC uses swapped height/width for 90/270 degrees */
-		swap(info.width, info.height);
-	info.pos_x = win.x;
-	info.pos_y = win.y;
-	info.out_width = win.w;
-	info.out_height = win.h;
+		swap(info->width, info->height);
 
 	/* calculate addresses and cropping */
-	info.paddr = oi->ba;
-	info.p_uv_addr = (info.color_mode == OMAP_DSS_COLOR_NV12) ? oi->uv : 0;
-	info.vaddr = NULL;
+	info->paddr = oi->ba;
+	info->p_uv_addr = (cfg->color_mode == OMAP_DSS_COLOR_NV12) ? oi->uv : 0;
+	info->vaddr = NULL;
 
 	/* check for TILER 2D buffer */
-	if (info.paddr >= 0x60000000 && info.paddr < 0x78000000) {
-		int bpp = 1 << ((info.paddr >> 27) & 3);
+	if (info->paddr >= 0x60000000 && info->paddr < 0x78000000) {
+		int bpp = 1 << ((info->paddr >> 27) & 3);
 		struct tiler_view_t t;
 
 		/* crop to top-left */
@@ -270,42 +231,100 @@ int set_dss_ovl_info(struct dss2_ovl_info *oi)
 		else if (cfg->color_mode == OMAP_DSS_COLOR_RGB24P)
 			bpp = 3;
 
-		tilview_create(&t, info.paddr, cfg->width, cfg->height);
-		info.paddr -= t.tsptr;
-		tilview_crop(&t, 0, crop.y, cfg->width, crop.h);
-		info.paddr += t.tsptr + bpp * crop.x;
+		tilview_create(&t, info->paddr, cfg->width, cfg->height);
+		info->paddr -= t.tsptr;
+		tilview_crop(&t, 0, crop->y, cfg->width, crop->h);
+		info->paddr += t.tsptr + bpp * crop->x;
 
-		info.rotation_type = OMAP_DSS_ROT_TILER;
-		info.screen_width = 0;
+		info->rotation_type = OMAP_DSS_ROT_TILER;
+		info->screen_width = 0;
 
 		/* for NV12 format also crop NV12 */
-		if (info.color_mode == OMAP_DSS_COLOR_NV12) {
-			tilview_create(&t, info.p_uv_addr,
+		if (cfg->color_mode == OMAP_DSS_COLOR_NV12) {
+			tilview_create(&t, info->p_uv_addr,
 					cfg->width >> 1, cfg->height >> 1);
-			info.p_uv_addr -= t.tsptr;
-			tilview_crop(&t, 0, crop.y >> 1, cfg->width >> 1,
-								crop.h >> 1);
-			info.p_uv_addr += t.tsptr + bpp * crop.x;
+			info->p_uv_addr -= t.tsptr;
+			tilview_crop(&t, 0, crop->y >> 1, cfg->width >> 1,
+								crop->h >> 1);
+			info->p_uv_addr += t.tsptr + bpp * crop->x;
 		}
 	} else {
 		/* program tiler 1D as SDMA */
 
 		int bpp = color_mode_to_bpp(cfg->color_mode);
-		info.screen_width = cfg->stride * 8 / (bpp == 12 ? 8 : bpp);
-		info.paddr += crop.x * (bpp / 8) + crop.y * cfg->stride;
+		info->screen_width = cfg->stride * 8 / (bpp == 12 ? 8 : bpp);
+		info->paddr += crop->x * (bpp / 8) + crop->y * cfg->stride;
 
 		/* for NV12 format also crop NV12 */
-		if (info.color_mode == OMAP_DSS_COLOR_NV12)
-			info.p_uv_addr += crop.x * (bpp / 8) +
-				(crop.y >> 1) * cfg->stride;
+		if (cfg->color_mode == OMAP_DSS_COLOR_NV12)
+			info->p_uv_addr += crop->x * (bpp / 8) +
+				(crop->y >> 1) * cfg->stride;
 
 		/* no rotation on DMA buffer */
 		if (cfg->rotation & 3 || cfg->mirror)
 			return -EINVAL;
 
-		info.rotation_type = OMAP_DSS_ROT_DMA;
+		info->rotation_type = OMAP_DSS_ROT_DMA;
 	}
 
+	return 0;
+}
+
+int set_dss_ovl_info(struct dss2_ovl_info *oi)
+{
+	struct omap_overlay_info info;
+	struct omap_overlay *ovl;
+	struct dss2_ovl_cfg *cfg;
+	union rect crop, win, vis;
+	int r;
+
+	/* check overlay number */
+	if (!oi || oi->cfg.ix >= omap_dss_get_num_overlays())
+		return -EINVAL;
+	cfg = &oi->cfg;
+	ovl = omap_dss_get_overlay(cfg->ix);
+
+	/* just in case there are new fields, we get the current info */
+	ovl->get_overlay_info(ovl, &info);
+
+	info.enabled = cfg->enabled;
+	if (!cfg->enabled)
+		goto done;
+
+	/* copied params */
+	info.zorder = cfg->zorder;
+
+	if (cfg->zonly)
+		goto done;
+
+	info.global_alpha = cfg->global_alpha;
+	info.pre_mult_alpha = cfg->pre_mult_alpha;
+	info.rotation = cfg->rotation;
+	info.mirror = cfg->mirror;
+	info.color_mode = cfg->color_mode;
+
+	/* crop to screen */
+	crop.r = cfg->crop;
+	win.r = cfg->win;
+	vis.x = vis.y = 0;
+	vis.w = ovl->manager->device->panel.timings.x_res;
+	vis.h = ovl->manager->device->panel.timings.y_res;
+
+	if (crop_to_rect(&crop, &win, &vis, cfg->rotation, cfg->mirror) ||
+								vis.w < 2) {
+		info.enabled = false;
+		goto done;
+	}
+
+	r = set_dss_ovl_buffer(&info, oi, &crop.r);
+	if (r)
+		return r;
+
+	info.pos_x = win.x;
+	info.pos_y = win.y;
+	info.out_width = win.w;
+	info.out_height = win.h;
+
 	info.max_x_decim = cfg->decim.max_x ? : 255;
 	info.max_y_decim = cfg->decim.max_y ? : 255;
 	info.min_x_decim = cfg->decim.min_x ? : 1;
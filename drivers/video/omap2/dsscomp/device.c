@@ -369,6 +369,137 @@ static long setup_display(struct dsscomp_dev *cdev,
 		return 0;
 }
 
+/* refresh rate matching limits */
+#define MAX_MATCH_MODES		64
+#define MAX_REFRESH_MULTIPLE	4	/* show a frame for up to 4 vsyncs */
+#define MAX_REFRESH_ERROR	5000	/* ppm, a dropped frame every 200 */
+
+/* refresh rate of a timing in mHz, or 0 if unknown */
+static u32 mode_refresh(struct fb_videomode *m)
+{
+	u64 frame = (u64) m->pixclock *
+		(m->xres + m->left_margin + m->right_margin + m->hsync_len) *
+		(m->yres + m->upper_margin + m->lower_margin + m->vsync_len);
+
+	return frame ? div64_u64(1000000000000000ULL, frame) : 0;
+}
+
+/*
+ * judder of showing frames at rate on a display refreshing at refresh, in
+ * ppm of the refresh rate: 0 if refresh is a multiple of rate
+ */
+static u32 refresh_error(u32 refresh, u32 rate)
+{
+	u32 n = DIV_ROUND_CLOSEST(refresh, rate);
+	u32 diff;
+
+	if (!n || n > MAX_REFRESH_MULTIPLE)
+		return -1;
+	diff = refresh > n * rate ? refresh - n * rate : n * rate - refresh;
+	return div_u64((u64) diff * 1000000, refresh);
+}
+
+static long match_refresh(struct dsscomp_dev *cdev,
+				struct dsscomp_match_refresh_data *d)
+{
+	struct omap_dss_device *dev;
+	struct omap_video_timings *t;
+	struct fb_videomode *modedb, *best = NULL;
+	u32 err, best_err, refresh, htot, vtot;
+	int i, n;
+	long r = 0;
+
+	/* get display */
+	if (d->ix >= cdev->num_displays || !d->frame_rate)
+		return -EINVAL;
+	dev = cdev->displays[d->ix];
+	if (!dev || !dev->driver->get_modedb || !dev->driver->set_mode)
+		return -EINVAL;
+
+	modedb = kmalloc(sizeof(*modedb) * MAX_MATCH_MODES, GFP_KERNEL);
+	if (!modedb)
+		return -ENOMEM;
+	n = dev->driver->get_modedb(dev, modedb, MAX_MATCH_MODES);
+
+	/* the current timing wins ties, as it needs no switch */
+	t = &dev->panel.timings;
+	htot = t->x_res + t->hfp + t->hsw + t->hbp;
+	vtot = t->y_res + t->vfp + t->vsw + t->vbp;
+	refresh = htot && vtot ?
+		div_u64((u64) t->pixel_clock * 1000000, htot * vtot) : 0;
+	best_err = refresh ? refresh_error(refresh, d->frame_rate) : -1;
+
+	for (i = 0; i < n; i++) {
+		struct fb_videomode *m = modedb + i;
+
+		if (m->xres != t->x_res || m->yres != t->y_res ||
+		    (m->vmode & FB_VMODE_INTERLACED))
+			continue;
+
+		err = refresh_error(mode_refresh(m), d->frame_rate);
+		if (err < best_err && err <= MAX_REFRESH_ERROR) {
+			best = m;
+			best_err = err;
+		}
+	}
+
+	memset(&d->mode, 0, sizeof(d->mode));
+	d->switched = false;
+	if (best) {
+		dev_info(DEV(cdev), "display%u: %u.%03u fps -> %ux%u@%u\n",
+			 d->ix, d->frame_rate / 1000, d->frame_rate % 1000,
+			 best->xres, best->yres, best->refresh);
+		r = dev->driver->set_mode(dev, best);
+		d->switched = !r;
+		if (!r)
+			memcpy(&d->mode, best, sizeof(d->mode));
+	}
+	if (!d->switched) {
+		d->mode.refresh = DIV_ROUND_CLOSEST(refresh, 1000);
+		d->mode.xres = t->x_res;
+		d->mode.yres = t->y_res;
+		d->mode.pixclock = t->pixel_clock ?
+					KHZ2PICOS(t->pixel_clock) : 0;
+		d->mode.right_margin = t->hfp;
+		d->mode.left_margin = t->hbp;
+		d->mode.hsync_len = t->hsw;
+		d->mode.lower_margin = t->vfp;
+		d->mode.upper_margin = t->vbp;
+		d->mode.vsync_len = t->vsw;
+	}
+	d->mode.name = NULL;
+	d->refresh = d->switched ? mode_refresh(best) : refresh;
+
+	kfree(modedb);
+	return r;
+}
+
+static long wb_copy(struct dsscomp_dev *cdev, struct dsscomp_wb_copy_data *d)
+{
+	u32 addr;
+
+	if (d->wb.cfg.ix != OMAP_DSS_WB)
+		return -EINVAL;
+
+	/* convert addresses to user space */
+	addr = (u32) d->ovl.address;
+	if (d->ovl.cfg.color_mode == OMAP_DSS_COLOR_NV12)
+		d->ovl.uv = hwc_virt_to_phys(addr +
+				d->ovl.cfg.height * d->ovl.cfg.stride);
+	d->ovl.ba = hwc_virt_to_phys(addr);
+
+	/* only TILER is known to be contiguous in the physical address space */
+	addr = (u32) d->wb.address;
+	if (d->wb.cfg.color_mode == OMAP_DSS_COLOR_NV12)
+		d->wb.uv = hwc_virt_to_phys(addr +
+				d->wb.cfg.height * d->wb.cfg.stride);
+	d->wb.ba = hwc_virt_to_phys(addr);
+	if (d->wb.ba < 0x60000000 || d->wb.ba >= 0x78000000)
+		return -EINVAL;
+
+	return dsscomp_wb_copy(d);
+}
+
 static void fill_cache(struct dsscomp_dev *cdev)
 {
 	unsigned long i;
@@ -419,6 +550,8 @@ static long comp_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		struct dsscomp_display_info dis;
 		struct dsscomp_check_ovl_data chk;
 		struct dsscomp_setup_display_data sdis;
+		struct dsscomp_wb_copy_data wb;
+		struct dsscomp_match_refresh_data mr;
 	} u;
 
 	dsscomp_gralloc_init(cdev);
@@ -479,6 +612,19 @@ static long comp_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		    setup_display(cdev, &u.sdis);
 		break;
 	}
+	case DSSCIOC_WB_COPY:
+	{
+		r = copy_from_user(&u.wb, ptr, sizeof(u.wb)) ? :
+		    wb_copy(cdev, &u.wb);
+		break;
+	}
+	case DSSCIOC_MATCH_REFRESH:
+	{
+		r = copy_from_user(&u.mr, ptr, sizeof(u.mr)) ? :
+		    match_refresh(cdev, &u.mr) ? :
+		    copy_to_user(ptr, &u.mr, sizeof(u.mr));
+		break;
+	}
 	default:
 		r = -EINVAL;
 	}
@@ -542,6 +688,10 @@ static int dsscomp_probe(struct platform_device *pdev)
 			cdev->dbgfs, dsscomp_dbg_comps, &dsscomp_debug_fops);
 		debugfs_create_file("gralloc", S_IRUGO,
 			cdev->dbgfs, dsscomp_dbg_gralloc, &dsscomp_debug_fops);
+		debugfs_create_file("frames", S_IRUGO,
+			cdev->dbgfs, dsscomp_dbg_frames, &dsscomp_debug_fops);
+		debugfs_create_file("wb", S_IRUGO,
+			cdev->dbgfs, dsscomp_dbg_wb, &dsscomp_debug_fops);
 #ifdef CONFIG_DSSCOMP_DEBUG_LOG
 		debugfs_create_file("log", S_IRUGO,
 			cdev->dbgfs, dsscomp_dbg_events, &dsscomp_debug_fops);
@@ -557,6 +707,7 @@ static int dsscomp_probe(struct platform_device *pdev)
 	/* initialize queues */
 	dsscomp_queue_init(cdev);
 	dsscomp_gralloc_init(cdev);
+	dsscomp_wb_init(cdev);
 
 	return 0;
 }
@@ -568,6 +719,7 @@ static int dsscomp_remove(struct platform_device *pdev)
 	debugfs_remove_recursive(cdev->dbgfs);
 	dsscomp_queue_exit();
 	dsscomp_gralloc_exit();
+	dsscomp_wb_exit();
 	kfree(cdev);
 
 	return 0;
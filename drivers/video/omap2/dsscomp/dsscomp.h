@@ -25,6 +25,8 @@
 #include <linux/miscdevice.h>
 #include <linux/debugfs.h>
 #include <linux/seq_file.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
 #ifdef CONFIG_DSSCOMP_DEBUG_LOG
 #include <linux/hrtimer.h>
 #endif
@@ -111,6 +113,12 @@ struct dsscomp_data {
 	void *extra_cb_data;
 	bool must_apply;	/* whether composition must be applied */
 
+	struct work_struct apply_work;
+	struct work_struct cb_work;
+	atomic_t cb_status;	/* completions not yet handled by cb_work */
+	ktime_t t_queued;	/* when composition was queued for apply */
+	ktime_t t_displayed;	/* when composition was first displayed */
+
 #ifdef CONFIG_DEBUG_FS
 	struct list_head dbg_q;
 	u32 dbg_used;
@@ -133,6 +141,9 @@ int dsscomp_queue_init(struct dsscomp_dev *cdev);
 void dsscomp_queue_exit(void);
 void dsscomp_gralloc_init(struct dsscomp_dev *cdev);
 void dsscomp_gralloc_exit(void);
+void dsscomp_wb_init(struct dsscomp_dev *cdev);
+void dsscomp_wb_exit(void);
+int dsscomp_wb_copy(struct dsscomp_wb_copy_data *d);
 int dsscomp_gralloc_queue_ioctl(struct dsscomp_setup_dispc_data *d);
 int dsscomp_wait(struct dsscomp_sync_obj *sync, enum dsscomp_wait_phase phase,
 								int timeout);
@@ -141,6 +152,8 @@ int dsscomp_state_notifier(struct notifier_block *nb,
 
 /* basic operation - if not using queues */
 int set_dss_ovl_info(struct dss2_ovl_info *oi);
+int set_dss_ovl_buffer(struct omap_overlay_info *info, struct dss2_ovl_info *oi,
+						struct dss2_rect_t *crop);
 int set_dss_mgr_info(struct dss2_mgr_info *mi, struct omapdss_ovl_cb *cb);
 struct omap_overlay_manager *find_dss_mgr(int display_ix);
 void swap_rb_in_ovl_info(struct dss2_ovl_info *oi);
@@ -159,6 +172,8 @@ const char *dsscomp_get_color_name(enum omap_color_mode m);
 
 void dsscomp_dbg_comps(struct seq_file *s);
 void dsscomp_dbg_gralloc(struct seq_file *s);
+void dsscomp_dbg_frames(struct seq_file *s);
+void dsscomp_dbg_wb(struct seq_file *s);
 
 #define log_state_str(s) (\
 	(s) == DSSCOMP_STATE_ACTIVE		? "ACTIVE"	: \
@@ -12,23 +12,55 @@
 static bool blanked;
 
 #define NUM_TILER1D_SLOTS 2
+#define NUM_SLOT_BUFS (2 * MAX_OVERLAYS)
 #ifdef CONFIG_OMAP2_LARGE_FB
 static u32 TILER1D_SLOT_SIZE = (32 << 20);
 #else
 static u32 TILER1D_SLOT_SIZE = (16 << 20);
 #endif
+
+/*
+ * Buffers stay mapped in a slot after their frame is released, so a buffer
+ * that is posted again (e.g. on the next round of a buffer queue) does not
+ * need its PAT entries refilled.  Buffers are recognized by their physical
+ * pages.
+ */
+struct tiler1d_buf {
+	u32 start;		/* first page in slot */
+	u32 size;		/* pages */
+	u32 frame;		/* slot frame the buffer was last used in */
+};
+
 static struct tiler1d_slot {
 	struct list_head q;
 	tiler_blk_handle slot;
 	u32 phys;
 	u32 size;
-	u32 *page_map;
+	u32 *page_map;		/* pages mapped into the slot, 0 if none */
+	u32 end;		/* end of the last buffer mapped */
+	u32 frame;		/* frames the slot was used for */
+	u32 dirty_start;	/* pages to pin for the current frame */
+	u32 dirty_end;
+	u32 num_bufs;
+	struct tiler1d_buf bufs[NUM_SLOT_BUFS];
 } slots[NUM_TILER1D_SLOTS];
 static struct list_head free_slots;
 static struct dsscomp_dev *cdev;
 static DEFINE_MUTEX(mtx);
 static struct semaphore free_slots_sem =
 				__SEMAPHORE_INITIALIZER(free_slots_sem, 0);
+static struct workqueue_struct *pin_wkq;	/* pin & apply work queue */
+
+/* slot statistics (protected by mtx) */
+static struct {
+	u32 frames;		/* frames using a slot */
+	u32 bufs;		/* buffers mapped into a slot */
+	u32 hits;		/* buffers that were still mapped, once pinned */
+	u32 pins;		/* PAT refills */
+	u32 pages;		/* pages refilled */
+	u64 pin_ns;		/* time spent refilling */
+	u64 pin_max_ns;
+} slot_stats;
 
 /* gralloc composition sync object */
 struct dsscomp_gralloc_t {
@@ -39,6 +71,13 @@ struct dsscomp_gralloc_t {
 	atomic_t refs;
 	bool early_callback;
 	bool programmed;
+
+	/* pinning and applying the compositions */
+	struct work_struct work;
+	struct tiler1d_slot *pin_slot;	/* slot to pin before applying */
+	u32 slot_hits;			/* buffers still mapped in the slot */
+	u32 num_comps;
+	dsscomp_t comps[MAX_MANAGERS];
 };
 
 /* queued gralloc compositions */
@@ -46,20 +85,194 @@ static LIST_HEAD(flip_queue);
 
 static u32 ovl_use_mask[MAX_MANAGERS];
 
-static void unpin_tiler_blocks(struct list_head *slots)
+/* (must have mtx) release tiler slots, keeping their buffers mapped */
+static void release_tiler_slots(struct list_head *slots)
 {
 	struct tiler1d_slot *slot;
 
-	/* unpin any tiler memory */
-	list_for_each_entry(slot, slots, q) {
-		tiler_unpin_block(slot->slot);
+	list_for_each_entry(slot, slots, q)
 		up(&free_slots_sem);
-	}
 
 	/* free tiler slots */
 	list_splice_init(slots, &free_slots);
 }
 
+/* find a buffer still mapped in a slot */
+static struct tiler1d_buf *slot_find(struct tiler1d_slot *slot, u32 *pages,
+				     u32 size)
+{
+	struct tiler1d_buf *b;
+
+	for (b = slot->bufs; b < slot->bufs + slot->num_bufs; b++)
+		if (b->size == size &&
+		    !memcmp(slot->page_map + b->start, pages,
+			    sizeof(*pages) * size))
+			return b;
+	return NULL;
+}
+
+/* (must have mtx) get a free slot, preferring one that has the buffer */
+static struct tiler1d_slot *get_free_slot(u32 *pages, u32 size)
+{
+	struct tiler1d_slot *slot;
+
+	list_for_each_entry(slot, &free_slots, q)
+		if (slot_find(slot, pages, size))
+			return slot;
+
+	/* otherwise use the slot released the longest time ago */
+	return list_entry(free_slots.prev, typeof(*slot), q);
+}
+
+/*
+ * Map a buffer into a slot for the current frame of the slot.  Returns the
+ * first page of the buffer in the slot, or -ENOMEM if it does not fit next
+ * to the other buffers of the frame.  *hit is set if the buffer was already
+ * mapped.
+ */
+static int slot_map(struct tiler1d_slot *slot, u32 *pages, u32 size,
+		    bool *hit)
+{
+	struct tiler1d_buf *b, *lru;
+	bool wrapped = false;
+	u32 start;
+
+	b = slot_find(slot, pages, size);
+	*hit = b;
+	if (b) {
+		b->frame = slot->frame;
+		return b->start;
+	}
+
+	/* map after the last buffer mapped, wrapping around once */
+	start = slot->end;
+retry:
+	if (start + size > slot->size) {
+		if (wrapped || size > slot->size)
+			return -ENOMEM;
+		start = 0;
+		wrapped = true;
+	}
+	for (b = slot->bufs; b < slot->bufs + slot->num_bufs; b++) {
+		if (b->frame == slot->frame && b->start < start + size &&
+		    start < b->start + b->size) {
+			start = b->start + b->size;
+			goto retry;
+		}
+	}
+
+	/* drop the buffers that get overwritten */
+	for (b = slot->bufs; b < slot->bufs + slot->num_bufs; ) {
+		if (b->start < start + size && start < b->start + b->size)
+			*b = slot->bufs[--slot->num_bufs];
+		else
+			b++;
+	}
+
+	/* a frame uses at most MAX_OVERLAYS buffers, so LRU is not current */
+	if (slot->num_bufs == NUM_SLOT_BUFS) {
+		lru = slot->bufs;
+		for (b = slot->bufs + 1; b < slot->bufs + NUM_SLOT_BUFS; b++)
+			if ((s32) (b->frame - lru->frame) < 0)
+				lru = b;
+		b = lru;
+	} else {
+		b = slot->bufs + slot->num_bufs++;
+	}
+	b->start = start;
+	b->size = size;
+	b->frame = slot->frame;
+
+	memcpy(slot->page_map + start, pages, sizeof(*pages) * size);
+	slot->dirty_start = min(slot->dirty_start, start);
+	slot->dirty_end = max(slot->dirty_end, start + size);
+	slot->end = start + size;
+	return start;
+}
+
+/*
+ * Forget the buffers mapped into a slot for the current frame, as their
+ * PAT entries were not refilled.  The slot must not be free.
+ */
+static void slot_drop_dirty(struct tiler1d_slot *slot)
+{
+	struct tiler1d_buf *b;
+
+	if (slot->dirty_end <= slot->dirty_start)
+		return;
+
+	for (b = slot->bufs; b < slot->bufs + slot->num_bufs; ) {
+		if (b->start < slot->dirty_end &&
+		    slot->dirty_start < b->start + b->size)
+			*b = slot->bufs[--slot->num_bufs];
+		else
+			b++;
+	}
+	memset(slot->page_map + slot->dirty_start, 0,
+	       sizeof(*slot->page_map) * (slot->dirty_end - slot->dirty_start));
+	slot->dirty_start = slot->size;
+	slot->dirty_end = 0;
+}
+
+/* refill the PAT entries of the buffers newly mapped into a slot */
+static int pin_slot(struct tiler1d_slot *slot)
+{
+	u32 n = slot->dirty_end - slot->dirty_start;
+	ktime_t t = ktime_get();
+	u64 ns;
+	int r;
+
+	r = tiler_pin_block_range(slot->slot, slot->dirty_start,
+				  slot->page_map + slot->dirty_start, n);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), t));
+	if (r) {
+		dev_err(DEV(cdev), "failed to pin %d pages into"
+			" %d-pg slots (%d)\n", n,
+			TILER1D_SLOT_SIZE >> PAGE_SHIFT, r);
+		/* so that later frames refill them again */
+		slot_drop_dirty(slot);
+		return r;
+	}
+
+	mutex_lock(&mtx);
+	slot_stats.pins++;
+	slot_stats.pages += n;
+	slot_stats.pin_ns += ns;
+	slot_stats.pin_max_ns = max(slot_stats.pin_max_ns, ns);
+	mutex_unlock(&mtx);
+	return 0;
+}
+
+/*
+ * Pins the buffers of a gralloc composition, and then applies its
+ * compositions.  This runs off the posting path, while the prior frame is
+ * still being displayed.
+ */
+static void dsscomp_gralloc_do_apply(struct work_struct *work)
+{
+	struct dsscomp_gralloc_t *gsync = container_of(work, typeof(*gsync),
+						       work);
+	dsscomp_t comps[MAX_MANAGERS];
+	u32 i, n = gsync->num_comps;
+	int r;
+
+	/* gsync may complete once its last composition is applied */
+	memcpy(comps, gsync->comps, sizeof(*comps) * n);
+
+	r = gsync->pin_slot ? pin_slot(gsync->pin_slot) : 0;
+	if (!r && gsync->slot_hits) {
+		mutex_lock(&mtx);
+		slot_stats.hits += gsync->slot_hits;
+		mutex_unlock(&mtx);
+	}
+
+	for (i = 0; i < n; i++) {
+		r = dsscomp_delayed_apply(comps[i]);
+		if (r)
+			dev_err(DEV(cdev), "failed to apply comp (%d)\n", r);
+	}
+}
+
 static void dsscomp_gralloc_cb(void *data, int status)
 {
 	struct dsscomp_gralloc_t *gsync = data, *gsync_;
@@ -72,7 +285,7 @@ static void dsscomp_gralloc_cb(void *data, int status)
 
 	if (status & DSS_COMPLETION_RELEASED) {
 		if (atomic_dec_and_test(&gsync->refs))
-			unpin_tiler_blocks(&gsync->slots);
+			release_tiler_slots(&gsync->slots);
 
 		log_event(0, 0, gsync, "--refs=%d on %s",
 				atomic_read(&gsync->refs),
@@ -175,7 +388,7 @@ int dsscomp_gralloc_queue(struct dsscomp_setup_dispc_data *d,
 	u32 mgr_set_mask = 0;
 	u32 ovl_set_mask = 0;
 	struct tiler1d_slot *slot = NULL;
-	u32 slot_used = 0;
+	u32 slot_bufs = 0, slot_hits = 0;
 #ifdef CONFIG_DEBUG_FS
 	u32 ms = ktime_to_ms(ktime_get());
 #endif
@@ -202,6 +415,7 @@ int dsscomp_gralloc_queue(struct dsscomp_setup_dispc_data *d,
 	gsync->refs.counter = 1;
 	gsync->early_callback = early_callback;
 	INIT_LIST_HEAD(&gsync->slots);
+	INIT_WORK(&gsync->work, dsscomp_gralloc_do_apply);
 	list_add_tail(&gsync->q, &flip_queue);
 	if (debug & DEBUG_GRALLOC_PHASES)
 		dev_info(DEV(cdev), "[%p] queuing flip\n", gsync);
@@ -303,6 +517,8 @@ int dsscomp_gralloc_queue(struct dsscomp_setup_dispc_data *d,
 		struct dss2_ovl_info *oi = d->ovls + i;
 		u32 mgr_ix = oi->cfg.mgr_ix;
 		u32 size;
+		int start;
+		bool hit;
 
 		/* verify manager index */
 		if (mgr_ix >= d->num_mgrs) {
@@ -366,6 +582,11 @@ int dsscomp_gralloc_queue(struct dsscomp_setup_dispc_data *d,
 		if (!pas[i] || !oi->cfg.enabled)
 			goto skip_map1d;
 
+		size = oi->cfg.stride * oi->cfg.height;
+		if (oi->cfg.color_mode == OMAP_DSS_COLOR_NV12)
+			size += size >> 2;
+		size = DIV_ROUND_UP(size, PAGE_SIZE);
+
 		if (!slot) {
 			if (down_timeout(&free_slots_sem,
 						msecs_to_jiffies(100))) {
@@ -373,28 +594,27 @@ int dsscomp_gralloc_queue(struct dsscomp_setup_dispc_data *d,
 				goto skip_buffer;
 			}
 			mutex_lock(&mtx);
-			slot = list_first_entry(&free_slots, typeof(*slot), q);
+			slot = get_free_slot(pas[i]->mem, size);
 			list_move(&slot->q, &gsync->slots);
 			mutex_unlock(&mtx);
-		}
 
-		size = oi->cfg.stride * oi->cfg.height;
-		if (oi->cfg.color_mode == OMAP_DSS_COLOR_NV12)
-			size += size >> 2;
-		size = DIV_ROUND_UP(size, PAGE_SIZE);
+			slot->frame++;
+			slot->dirty_start = slot->size;
+			slot->dirty_end = 0;
+		}
 
-		if (slot_used + size > slot->size) {
-			dev_err(DEV(cdev), "tiler slot not big enough for frame %d + %d > %d",
-				slot_used, size, slot->size);
+		/* "map" into TILER 1D - pinning will happen before apply */
+		start = slot_map(slot, pas[i]->mem, size, &hit);
+		if (start < 0) {
+			dev_err(DEV(cdev), "tiler slot not big enough for frame (%d pages)\n",
+				size);
 			goto skip_buffer;
 		}
+		slot_bufs++;
+		slot_hits += hit;
 
-		/* "map" into TILER 1D - will happen after loop */
-		oi->ba = slot->phys + (slot_used << PAGE_SHIFT) +
+		oi->ba = slot->phys + (start << PAGE_SHIFT) +
 			(oi->ba & ~PAGE_MASK);
-		memcpy(slot->page_map + slot_used, pas[i]->mem,
-		       sizeof(*slot->page_map) * size);
-		slot_used += size;
 		goto skip_map1d;
 
 skip_buffer:
@@ -412,13 +632,15 @@ skip_map1d:
 			ovl_set_mask |= 1 << oi->cfg.ix;
 	}
 
-	if (slot && slot_used) {
-		r = tiler_pin_block(slot->slot, slot->page_map,
-						slot_used);
-		if (r)
-			dev_err(DEV(cdev), "failed to pin %d pages into"
-				" %d-pg slots (%d)\n", slot_used,
-				TILER1D_SLOT_SIZE >> PAGE_SHIFT, r);
+	if (slot) {
+		if (slot->dirty_end > slot->dirty_start)
+			gsync->pin_slot = slot;
+		gsync->slot_hits = slot_hits;
+
+		mutex_lock(&mtx);
+		slot_stats.frames++;
+		slot_stats.bufs += slot_bufs;
+		mutex_unlock(&mtx);
 	}
 
 	for (ch = 0; ch < MAX_MANAGERS; ch++) {
@@ -445,11 +667,19 @@ skip_map1d:
 		log_event(0, ms, gsync, "++refs=%d for [%p]",
 				atomic_read(&gsync->refs), (u32) comp[ch]);
 
-		r = dsscomp_delayed_apply(comp[ch]);
-		if (r)
-			dev_err(DEV(cdev), "failed to apply comp (%d)\n", r);
+		/* applied after pinning, which cannot fail the composition */
+		gsync->comps[gsync->num_comps++] = comp[ch];
+		ovl_use_mask[ch] = ovl_new_use_mask[ch];
+	}
+
+	if (gsync->num_comps) {
+		if (pin_wkq)
+			queue_work(pin_wkq, &gsync->work);
 		else
-			ovl_use_mask[ch] = ovl_new_use_mask[ch];
+			dsscomp_gralloc_do_apply(&gsync->work);
+	} else if (slot) {
+		/* nothing shows the frame, so its buffers are not pinned */
+		slot_drop_dirty(slot);
 	}
 skip_comp:
 	/* release sync object ref - this completes unapplied compositions */
@@ -566,6 +796,20 @@ void dsscomp_dbg_gralloc(struct seq_file *s)
 	}
 	seq_printf(s, "\n");
 	mutex_unlock(&dbg_mtx);
+
+	mutex_lock(&mtx);
+	seq_printf(s, "TILER 1D SLOTS\n\n");
+	seq_printf(s, "  frames=%u buffers=%u cached=%u\n", slot_stats.frames,
+		   slot_stats.bufs, slot_stats.hits);
+	seq_printf(s, "  refills=%u pages=%u", slot_stats.pins,
+		   slot_stats.pages);
+	if (slot_stats.pins)
+		seq_printf(s, " avg=%lluus max=%lluus",
+			   div_u64(div_u64(slot_stats.pin_ns, slot_stats.pins),
+				   NSEC_PER_USEC),
+			   div_u64(slot_stats.pin_max_ns, NSEC_PER_USEC));
+	seq_printf(s, "\n\n");
+	mutex_unlock(&mtx);
 #endif
 }
 
@@ -580,6 +824,9 @@ void dsscomp_gralloc_init(struct dsscomp_dev *cdev_)
 #ifdef CONFIG_HAS_EARLYSUSPEND
 		register_early_suspend(&early_suspend_info);
 #endif
+		pin_wkq = create_singlethread_workqueue("dsscomp_pin");
+		if (!pin_wkq)
+			pr_err("could not create pin work queue");
 	}
 
 	if (!free_slots.next) {
@@ -596,7 +843,7 @@ void dsscomp_gralloc_init(struct dsscomp_dev *cdev_)
 			slots[i].slot = slot;
 			slots[i].phys = phys;
 			slots[i].size = TILER1D_SLOT_SIZE >> PAGE_SHIFT;
-			slots[i].page_map = kmalloc(sizeof(*slots[i].page_map) *
+			slots[i].page_map = kzalloc(sizeof(*slots[i].page_map) *
 						slots[i].size, GFP_KERNEL);
 			if (!slots[i].page_map) {
 				pr_err("could not allocate page_map");
@@ -620,7 +867,13 @@ void dsscomp_gralloc_exit(void)
 	unregister_early_suspend(&early_suspend_info);
 #endif
 
-	list_for_each_entry(slot, &free_slots, q)
+	if (pin_wkq)
+		destroy_workqueue(pin_wkq);
+	pin_wkq = NULL;
+
+	list_for_each_entry(slot, &free_slots, q) {
 		tiler_free_block_area(slot->slot);
+		kfree(slot->page_map);
+	}
 	INIT_LIST_HEAD(&free_slots);
 }
@@ -34,22 +34,41 @@
 #include "dsscomp.h"
 /* queue state */
 
-static DEFINE_MUTEX(mtx);
-
 /* free overlay structs */
 struct maskref {
 	u32 mask;
 	u32 refs[MAX_OVERLAYS];
 };
 
+/*
+ * Each manager has its own queue state.  The overlay masks are protected by
+ * the manager's spinlock, which is never held across DSS calls.  mtx
+ * serializes applying to the manager with blanking it.
+ */
 static struct {
 	struct workqueue_struct *apply_workq;
+	spinlock_t lock;
+	struct mutex mtx;
 
 	u32 ovl_mask;		/* overlays used on this display */
 	struct maskref ovl_qmask;		/* overlays queued to this display */
 	bool blanking;
 } mgrq[MAX_MANAGERS];
 
+/* frame pacing statistics */
+#define LAT_BUCKETS	10	/* < 1ms, < 2ms, ... < 256ms, longer */
+#define MISS_BUCKETS	8	/* 0 .. 6 missed vsyncs, more */
+
+static struct frame_stats {
+	spinlock_t lock;
+	u32 frames;		/* compositions displayed */
+	u32 dropped;		/* compositions released without display */
+	u64 latency_sum;	/* queue to display, ns */
+	u64 latency_max;
+	u32 latency[LAT_BUCKETS];
+	u32 missed[MISS_BUCKETS];
+} frame_stats[MAX_DISPLAYS];
+
 static struct workqueue_struct *cb_wkq;		/* callback work queue */
 static struct dsscomp_dev *cdev;
 
@@ -77,6 +96,9 @@ static inline void __log_state(dsscomp_t c, void *fn, u32 ev)
 }
 #define log_state(c, fn, ev) DO_IF_DEBUG_FS(__log_state(c, fn, ev))
 
+static void dsscomp_do_apply(struct work_struct *work);
+static void dsscomp_mgr_delayed_cb(struct work_struct *work);
+
 static inline void maskref_incbit(struct maskref *om, u32 ix)
 {
 	om->refs[ix]++;
@@ -109,8 +131,14 @@ int dsscomp_queue_init(struct dsscomp_dev *cdev_)
 		return -EINVAL;
 
 	ZERO(mgrq);
+	ZERO(frame_stats);
+	for (i = 0; i < ARRAY_SIZE(frame_stats); i++)
+		spin_lock_init(&frame_stats[i].lock);
+
 	for (i = 0; i < cdev->num_mgrs; i++) {
 		struct omap_overlay_manager *mgr;
+		spin_lock_init(&mgrq[i].lock);
+		mutex_init(&mgrq[i].mtx);
 		mgrq[i].apply_workq = create_singlethread_workqueue("dsscomp_apply");
 		if (!mgrq[i].apply_workq)
 			goto error;
@@ -181,6 +209,8 @@ dsscomp_t dsscomp_new(struct omap_overlay_manager *mgr)
 	comp->frm.sync_id = 0;
 	comp->frm.mgr.ix = display_ix;
 	comp->state = DSSCOMP_STATE_ACTIVE;
+	INIT_WORK(&comp->apply_work, dsscomp_do_apply);
+	INIT_WORK(&comp->cb_work, dsscomp_mgr_delayed_cb);
 
 	DO_IF_DEBUG_FS({
 		__log_state(comp, dsscomp_new, 0);
@@ -194,14 +224,9 @@ EXPORT_SYMBOL(dsscomp_new);
 /* returns overlays used in a composition */
 u32 dsscomp_get_ovls(dsscomp_t comp)
 {
-	u32 mask;
-
-	mutex_lock(&mtx);
 	BUG_ON(comp->state != DSSCOMP_STATE_ACTIVE);
-	mask = comp->ovl_mask;
-	mutex_unlock(&mtx);
 
-	return mask;
+	return comp->ovl_mask;
 }
 EXPORT_SYMBOL(dsscomp_get_ovls);
 
@@ -212,17 +237,15 @@ int dsscomp_set_ovl(dsscomp_t comp, struct dss2_ovl_info *ovl)
 	u32 i, mask, oix, ix;
 	struct omap_overlay *o;
 
-	mutex_lock(&mtx);
-
 	BUG_ON(!ovl);
 	BUG_ON(comp->state != DSSCOMP_STATE_ACTIVE);
 
 	ix = comp->ix;
 
-	if (ovl->cfg.ix >= cdev->num_ovls) {
-		r = -EINVAL;
-		goto done;
-	}
+	if (ovl->cfg.ix >= cdev->num_ovls)
+		return -EINVAL;
+
+	spin_lock(&mgrq[ix].lock);
 
 	/* if overlay is already part of the composition */
 	mask = 1 << ovl->cfg.ix;
@@ -238,12 +261,16 @@ int dsscomp_set_ovl(dsscomp_t comp, struct dss2_ovl_info *ovl)
 		if (comp->frm.num_ovls >= ARRAY_SIZE(comp->ovls))
 			goto done;
 
-		/* not in any other displays queue */
+		/*
+		 * not in any other displays queue.  Other queues are only
+		 * peeked at: an overlay moving between displays is caught
+		 * again by the manager check when it is applied.
+		 */
 		if (mask & ~mgrq[ix].ovl_qmask.mask) {
 			for (i = 0; i < cdev->num_mgrs; i++) {
 				if (i == ix)
 					continue;
-				if (mgrq[i].ovl_qmask.mask & mask)
+				if (ACCESS_ONCE(mgrq[i].ovl_qmask.mask) & mask)
 					goto done;
 			}
 		}
@@ -262,7 +289,7 @@ int dsscomp_set_ovl(dsscomp_t comp, struct dss2_ovl_info *ovl)
 	comp->ovls[oix] = *ovl;
 	r = 0;
 done:
-	mutex_unlock(&mtx);
+	spin_unlock(&mgrq[ix].lock);
 
 	return r;
 }
@@ -274,8 +301,6 @@ int dsscomp_get_ovl(dsscomp_t comp, u32 ix, struct dss2_ovl_info *ovl)
 	int r;
 	u32 oix;
 
-	mutex_lock(&mtx);
-
 	BUG_ON(!ovl);
 	BUG_ON(comp->state != DSSCOMP_STATE_ACTIVE);
 
@@ -293,8 +318,6 @@ int dsscomp_get_ovl(dsscomp_t comp, u32 ix, struct dss2_ovl_info *ovl)
 		r = -ENOENT;
 	}
 
-	mutex_unlock(&mtx);
-
 	return r;
 }
 EXPORT_SYMBOL(dsscomp_get_ovl);
@@ -302,15 +325,11 @@ EXPORT_SYMBOL(dsscomp_get_ovl);
 /* set manager info */
 int dsscomp_set_mgr(dsscomp_t comp, struct dss2_mgr_info *mgr)
 {
-	mutex_lock(&mtx);
-
 	BUG_ON(comp->state != DSSCOMP_STATE_ACTIVE);
 	BUG_ON(mgr->ix != comp->frm.mgr.ix);
 
 	comp->frm.mgr = *mgr;
 
-	mutex_unlock(&mtx);
-
 	return 0;
 }
 EXPORT_SYMBOL(dsscomp_set_mgr);
@@ -318,15 +337,11 @@ EXPORT_SYMBOL(dsscomp_set_mgr);
 /* get manager info */
 int dsscomp_get_mgr(dsscomp_t comp, struct dss2_mgr_info *mgr)
 {
-	mutex_lock(&mtx);
-
 	BUG_ON(!mgr);
 	BUG_ON(comp->state != DSSCOMP_STATE_ACTIVE);
 
 	*mgr = comp->frm.mgr;
 
-	mutex_unlock(&mtx);
-
 	return 0;
 }
 EXPORT_SYMBOL(dsscomp_get_mgr);
@@ -335,15 +350,11 @@ EXPORT_SYMBOL(dsscomp_get_mgr);
 int dsscomp_setup(dsscomp_t comp, enum dsscomp_setup_mode mode,
 			struct dss2_rect_t win)
 {
-	mutex_lock(&mtx);
-
 	BUG_ON(comp->state != DSSCOMP_STATE_ACTIVE);
 
 	comp->frm.mode = mode;
 	comp->frm.win = win;
 
-	mutex_unlock(&mtx);
-
 	return 0;
 }
 EXPORT_SYMBOL(dsscomp_setup);
@@ -356,8 +367,11 @@ EXPORT_SYMBOL(dsscomp_setup);
 void dsscomp_drop(dsscomp_t comp)
 {
 	/* decrement unprogrammed references */
-	if (comp->state < DSSCOMP_STATE_PROGRAMMED)
+	if (comp->state < DSSCOMP_STATE_PROGRAMMED) {
+		spin_lock(&mgrq[comp->ix].lock);
 		maskref_decmask(&mgrq[comp->ix].ovl_qmask, comp->ovl_mask);
+		spin_unlock(&mgrq[comp->ix].lock);
+	}
 	comp->state = 0;
 
 	if (debug & DEBUG_COMPOSITIONS)
@@ -369,71 +383,151 @@ void dsscomp_drop(dsscomp_t comp)
 }
 EXPORT_SYMBOL(dsscomp_drop);
 
-struct dsscomp_cb_work {
-	struct work_struct work;
-	struct dsscomp_data *comp;
-	int status;
-};
+/* frame period of a display in ns, or 0 if it is not refreshed on its own */
+static u32 frame_period_ns(u32 display_ix)
+{
+	struct omap_dss_device *dssdev = cdev->displays[display_ix];
+	struct omap_video_timings *t;
 
-static void dsscomp_mgr_delayed_cb(struct work_struct *work)
+	if (!dssdev || (dssdev->caps & OMAP_DSS_DISPLAY_CAP_MANUAL_UPDATE))
+		return 0;
+
+	t = &dssdev->panel.timings;
+	if (!t->pixel_clock)
+		return 0;
+
+	/* pixel clock is in kHz */
+	return div_u64((u64) (t->x_res + t->hfp + t->hsw + t->hbp) *
+		       (t->y_res + t->vfp + t->vsw + t->vbp) * 1000000,
+		       t->pixel_clock);
+}
+
+static void frame_stats_displayed(dsscomp_t comp)
 {
-	struct dsscomp_cb_work *wk = container_of(work, typeof(*wk), work);
-	struct dsscomp_data *comp = wk->comp;
-	int status = wk->status;
-	u32 ix;
+	struct frame_stats *st = frame_stats + comp->frm.mgr.ix;
+	u64 latency = ktime_to_ns(ktime_sub(comp->t_displayed,
+					    comp->t_queued));
+	u32 ms = min_t(u64, div_u64(latency, NSEC_PER_MSEC), 1 << 30);
+	u32 period = frame_period_ns(comp->frm.mgr.ix);
+	u32 missed = 0;
+
+	/* a composition should be on screen within a frame of posting it */
+	if (period && latency)
+		missed = min_t(u64, div_u64(latency - 1, period),
+			       MISS_BUCKETS - 1);
+
+	spin_lock(&st->lock);
+	st->frames++;
+	st->latency_sum += latency;
+	st->latency_max = max(st->latency_max, latency);
+	st->latency[min(ms ? fls(ms) : 0, LAT_BUCKETS - 1)]++;
+	if (period)
+		st->missed[missed]++;
+	spin_unlock(&st->lock);
+}
+
+static void frame_stats_dropped(dsscomp_t comp)
+{
+	struct frame_stats *st = frame_stats + comp->frm.mgr.ix;
 
-	kfree(work);
+	spin_lock(&st->lock);
+	st->dropped++;
+	spin_unlock(&st->lock);
+}
 
-	mutex_lock(&mtx);
+/*
+ * Completion callbacks arrive in interrupt context, and are handed off to
+ * the callback work queue through comp->cb_status.  They arrive in
+ * PROGRAMMED, DISPLAYED, RELEASED order, and nothing arrives after
+ * RELEASED, so the statuses pending for a composition can be processed in
+ * that same order.
+ */
+static void dsscomp_mgr_delayed_cb(struct work_struct *work)
+{
+	struct dsscomp_data *comp = container_of(work, typeof(*comp), cb_work);
+	int status = atomic_xchg(&comp->cb_status, 0);
+	u32 ix;
 
 	BUG_ON(comp->state == DSSCOMP_STATE_ACTIVE);
 	ix = comp->ix;
 
-	/* call extra callbacks if requested */
-	if (comp->extra_cb)
-		comp->extra_cb(comp->extra_cb_data, status);
+	/* handle programming */
+	if (status & DSS_COMPLETION_PROGRAMMED) {
+		/* call extra callbacks if requested */
+		if (comp->extra_cb)
+			comp->extra_cb(comp->extra_cb_data,
+				       DSS_COMPLETION_PROGRAMMED);
 
-	/* handle programming & release */
-	if (status == DSS_COMPLETION_PROGRAMMED) {
 		comp->state = DSSCOMP_STATE_PROGRAMMED;
-		log_state(comp, dsscomp_mgr_delayed_cb, status);
+		log_state(comp, dsscomp_mgr_delayed_cb,
+			  DSS_COMPLETION_PROGRAMMED);
 
 		/* update used overlay mask */
+		spin_lock(&mgrq[ix].lock);
 		mgrq[ix].ovl_mask = comp->ovl_mask & ~comp->ovl_dmask;
 		maskref_decmask(&mgrq[ix].ovl_qmask, comp->ovl_mask);
+		spin_unlock(&mgrq[ix].lock);
 
 		if (debug & DEBUG_PHASES)
 			dev_info(DEV(cdev), "[%p] programmed\n", comp);
-	} else if ((status == DSS_COMPLETION_DISPLAYED) &&
-		   comp->state == DSSCOMP_STATE_PROGRAMMED) {
+	}
+
+	if (status & DSS_COMPLETION_DISPLAYED) {
+		if (comp->extra_cb)
+			comp->extra_cb(comp->extra_cb_data,
+				       DSS_COMPLETION_DISPLAYED);
+	}
+
+	if ((status & DSS_COMPLETION_DISPLAYED) &&
+	    comp->state == DSSCOMP_STATE_PROGRAMMED) {
 		/* composition is 1st displayed */
 		comp->state = DSSCOMP_STATE_DISPLAYED;
-		log_state(comp, dsscomp_mgr_delayed_cb, status);
+		log_state(comp, dsscomp_mgr_delayed_cb,
+			  DSS_COMPLETION_DISPLAYED);
+		frame_stats_displayed(comp);
 		if (debug & DEBUG_PHASES)
 			dev_info(DEV(cdev), "[%p] displayed\n", comp);
-	} else if (status & DSS_COMPLETION_RELEASED) {
+	}
+
+	if (status & DSS_COMPLETION_RELEASED) {
+		status &= DSS_COMPLETION_RELEASED;
+		if (comp->extra_cb)
+			comp->extra_cb(comp->extra_cb_data, status);
+
 		/* composition is no longer displayed */
 		log_event(20 * comp->ix + 20, 0, comp, "%pf on %s",
 				(u32) dsscomp_mgr_delayed_cb,
 				(u32) log_status_str(status));
+		if (comp->state != DSSCOMP_STATE_DISPLAYED)
+			frame_stats_dropped(comp);
 		dsscomp_drop(comp);
 	}
-	mutex_unlock(&mtx);
 }
 
 static u32 dsscomp_mgr_callback(void *data, int id, int status)
 {
 	struct dsscomp_data *comp = data;
+	int old, new;
 
 	if (status == DSS_COMPLETION_PROGRAMMED ||
 	    (status == DSS_COMPLETION_DISPLAYED &&
 	     comp->state != DSSCOMP_STATE_DISPLAYED) ||
 	    (status & DSS_COMPLETION_RELEASED)) {
-		struct dsscomp_cb_work *wk = kzalloc(sizeof(*wk), GFP_ATOMIC);
-		wk->comp = comp;
-		wk->status = status;
-		INIT_WORK(&wk->work, dsscomp_mgr_delayed_cb);
-		queue_work(cb_wkq, &wk->work);
+		if (status == DSS_COMPLETION_DISPLAYED)
+			comp->t_displayed = ktime_get();
+
+		/*
+		 * Only the callback that finds no status pending queues the
+		 * work.  Any other callback's status is picked up by work
+		 * that has not run yet, which then owns the composition.
+		 */
+		do {
+			old = atomic_read(&comp->cb_status);
+			new = old | status;
+		} while (atomic_cmpxchg(&comp->cb_status, old, new) != old);
+
+		if (!old)
+			queue_work(cb_wkq, &comp->cb_work);
 	}
 
 	/* get each callback only once */
@@ -567,10 +661,10 @@ skip_ovl_set:
 			if ((~comp->ovl_mask & mask) &&
 			    cdev->ovls[i]->info.enabled &&
 			    cdev->ovls[i]->manager == mgr) {
-				mutex_lock(&mtx);
+				spin_lock(&mgrq[comp->ix].lock);
 				comp->ovl_mask |= mask;
 				maskref_incbit(&mgrq[comp->ix].ovl_qmask, i);
-				mutex_unlock(&mtx);
+				spin_unlock(&mgrq[comp->ix].lock);
 			}
 		}
 	}
@@ -585,7 +679,7 @@ skip_ovl_set:
 	if (!d->win.h && !d->win.y)
 		d->win.h = dssdev->panel.timings.y_res - d->win.y;
 
-	mutex_lock(&mtx);
+	mutex_lock(&mgrq[comp->ix].mtx);
 	if (mgrq[comp->ix].blanking) {
 		pr_info_ratelimited("ignoring apply mgr(%s) while blanking\n",
 				    mgr->name);
@@ -598,7 +692,7 @@ skip_ovl_set:
 		if (!r && !cb_programmed)
 			r = -EINVAL;
 	}
-	mutex_unlock(&mtx);
+	mutex_unlock(&mgrq[comp->ix].mtx);
 
 	/*
 	 * TRICKY: try to unregister callback to see if callbacks have
@@ -631,11 +725,6 @@ done:
 	return r;
 }
 
-struct dsscomp_apply_work {
-	struct work_struct work;
-	dsscomp_t comp;
-};
-
 int dsscomp_state_notifier(struct notifier_block *nb,
 						unsigned long arg, void *ptr)
 {
@@ -643,14 +732,14 @@ int dsscomp_state_notifier(struct notifier_block *nb,
 	enum omap_dss_display_state state = arg;
 	struct omap_overlay_manager *mgr = dssdev->manager;
 	if (mgr) {
-		mutex_lock(&mtx);
+		mutex_lock(&mgrq[mgr->id].mtx);
 		if (state == OMAP_DSS_DISPLAY_DISABLED) {
 			mgr->blank(mgr, true);
 			mgrq[mgr->id].blanking = true;
 		} else if (state == OMAP_DSS_DISPLAY_ACTIVE) {
 			mgrq[mgr->id].blanking = false;
 		}
-		mutex_unlock(&mtx);
+		mutex_unlock(&mgrq[mgr->id].mtx);
 	}
 	return 0;
 }
@@ -658,33 +747,25 @@ int dsscomp_state_notifier(struct notifier_block *nb,
 
 static void dsscomp_do_apply(struct work_struct *work)
 {
-	struct dsscomp_apply_work *wk = container_of(work, typeof(*wk), work);
+	dsscomp_t comp = container_of(work, typeof(*comp), apply_work);
 	/* complete compositions that failed to apply */
-	if (dsscomp_apply(wk->comp))
-		dsscomp_mgr_callback(wk->comp, -1, DSS_COMPLETION_ECLIPSED_SET);
-	kfree(wk);
+	if (dsscomp_apply(comp))
+		dsscomp_mgr_callback(comp, -1, DSS_COMPLETION_ECLIPSED_SET);
 }
 
 int dsscomp_delayed_apply(dsscomp_t comp)
 {
 	/* don't block in case we are called from interrupt context */
-	struct dsscomp_apply_work *wk = kzalloc(sizeof(*wk), GFP_NOWAIT);
-	if (!wk)
-		return -ENOMEM;
-
-	mutex_lock(&mtx);
-
 	BUG_ON(comp->state != DSSCOMP_STATE_ACTIVE);
 	comp->state = DSSCOMP_STATE_APPLYING;
+	comp->t_queued = ktime_get();
 	log_state(comp, dsscomp_delayed_apply, 0);
 
 	if (debug & DEBUG_PHASES)
 		dev_info(DEV(cdev), "[%p] applying\n", comp);
-	mutex_unlock(&mtx);
 
-	wk->comp = comp;
-	INIT_WORK(&wk->work, dsscomp_do_apply);
-	return queue_work(mgrq[comp->ix].apply_workq, &wk->work) ? 0 : -EBUSY;
+	return queue_work(mgrq[comp->ix].apply_workq, &comp->apply_work) ?
+								0 : -EBUSY;
 }
 EXPORT_SYMBOL(dsscomp_delayed_apply);
 
@@ -767,6 +848,35 @@ void dsscomp_dbg_comps(struct seq_file *s)
 #endif
 }
 
+void dsscomp_dbg_frames(struct seq_file *s)
+{
+#ifdef CONFIG_DEBUG_FS
+	struct frame_stats st;
+	u32 i, b;
+
+	for (i = 0; i < cdev->num_displays; i++) {
+		spin_lock(&frame_stats[i].lock);
+		st = frame_stats[i];
+		spin_unlock(&frame_stats[i].lock);
+
+		seq_printf(s, "%s: frames=%u dropped=%u",
+			   cdev->displays[i]->name, st.frames, st.dropped);
+		if (st.frames)
+			seq_printf(s, " latency avg=%lluus max=%lluus",
+				   div_u64(div_u64(st.latency_sum, st.frames),
+					   NSEC_PER_USEC),
+				   div_u64(st.latency_max, NSEC_PER_USEC));
+		seq_printf(s, "\n  latency:");
+		for (b = 0; b < LAT_BUCKETS - 1; b++)
+			seq_printf(s, " <%ums:%u", 1 << b, st.latency[b]);
+		seq_printf(s, " more:%u\n  missed vsyncs:", st.latency[b]);
+		for (b = 0; b < MISS_BUCKETS - 1; b++)
+			seq_printf(s, " %u:%u", b, st.missed[b]);
+		seq_printf(s, " more:%u\n\n", st.missed[b]);
+	}
+#endif
+}
+
 void dsscomp_dbg_events(struct seq_file *s)
 {
 #ifdef CONFIG_DSSCOMP_DEBUG_LOG
@@ -798,7 +908,7 @@ void dsscomp_queue_exit(void)
 {
 	if (cdev) {
 		int i;
-		for (i = 0; i < cdev->num_displays; i++)
+		for (i = 0; i < cdev->num_mgrs; i++)
 			destroy_workqueue(mgrq[i].apply_workq);
 		destroy_workqueue(cb_wkq);
 		cdev = NULL;
@@ -0,0 +1,414 @@
+/*
+ * linux/drivers/video/omap2/dsscomp/wb.c
+ *
+ * DSS Composition memory to memory writeback support
+ *
+ * Scales and color converts buffers using an overlay pipeline that is not
+ * used for display, and the writeback pipeline.  Jobs are run in order on a
+ * single thread.  A job waits (a bounded time) for an overlay to become
+ * free, so writeback runs alongside display whenever a pipeline is unused.
+ *
+ * Upscaling is done by the overlay, downscaling by the writeback pipeline
+ * (past its limit, also by the overlay), so downscaling and plain color
+ * conversion can also use the GFX pipeline.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/delay.h>
+#include <linux/sched.h>
+#include <linux/completion.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
+
+#include <video/omapdss.h>
+#include <video/dsscomp.h>
+#include <plat/dsscomp.h>
+#include "dsscomp.h"
+
+#define WB_WAIT_MS	100	/* for a free overlay */
+#define WB_TIMEOUT_MS	100	/* for the writeback to complete */
+#define WB_MAX_SIZE	2048	/* DISPC size fields are 11 bits */
+
+struct dsscomp_wb_job {
+	struct list_head q;
+	struct omap_overlay_info src;
+	struct omap_writeback_info dst;
+	bool need_vid;		/* needs a scaling/YUV capable overlay */
+	void (*cb_fn)(void *, int);
+	void *cb_arg;
+	ktime_t t_queued;
+};
+
+static struct dsscomp_dev *cdev;
+static struct workqueue_struct *wb_wkq;
+static struct work_struct wb_work;
+static DEFINE_SPINLOCK(wb_lock);	/* protects wb_jobs */
+static LIST_HEAD(wb_jobs);
+static DEFINE_MUTEX(mtx);		/* protects wb_stats */
+
+static struct completion wb_done;
+static u32 wb_irq_status;
+
+static struct {
+	u32 queued, frames, failed, busy;
+	u32 pending, pending_max;
+	u64 hw_ns, hw_max_ns;		/* writeback time */
+	u64 latency_ns;			/* queue to completion */
+	ktime_t t_first, t_last;	/* first and last completion */
+} wb_stats;
+
+/* bits per pixel (of the Y plane for NV12), or 0 if not supported */
+static u32 wb_bpp(enum omap_color_mode mode)
+{
+	switch (mode) {
+	case OMAP_DSS_COLOR_NV12:
+		return 8;
+	case OMAP_DSS_COLOR_RGB12U:
+	case OMAP_DSS_COLOR_ARGB16:
+	case OMAP_DSS_COLOR_RGB16:
+	case OMAP_DSS_COLOR_RGBA16:
+	case OMAP_DSS_COLOR_RGBX16:
+	case OMAP_DSS_COLOR_ARGB16_1555:
+	case OMAP_DSS_COLOR_XRGB16_1555:
+	case OMAP_DSS_COLOR_YUV2:
+	case OMAP_DSS_COLOR_UYVY:
+		return 16;
+	case OMAP_DSS_COLOR_RGB24P:
+		return 24;
+	case OMAP_DSS_COLOR_RGB24U:
+	case OMAP_DSS_COLOR_ARGB32:
+	case OMAP_DSS_COLOR_RGBA32:
+		return 32;
+	default:
+		return 0;
+	}
+}
+
+static bool is_tiler_addr(u32 addr)
+{
+	return addr >= 0x60000000 && addr < 0x78000000;
+}
+
+static void dsscomp_wb_isr(void *arg, u32 mask)
+{
+	wb_irq_status = mask;
+	complete(&wb_done);
+}
+
+/* translate a copy request into overlay and writeback settings */
+static int wb_setup_job(struct dsscomp_wb_job *job, struct dss2_ovl_info *src,
+			struct dss2_ovl_info *dst)
+{
+	struct omap_overlay_info *oi = &job->src;
+	struct omap_writeback_info *wi = &job->dst;
+	struct dss2_rect_t crop = src->cfg.crop;
+	u32 bpp = wb_bpp(dst->cfg.color_mode);
+	u32 in_w, in_h, max_down, out_w, out_h;
+	int r;
+
+	/* writeback cannot write packed 24-bit RGB */
+	if (!wb_bpp(src->cfg.color_mode) || !bpp || bpp == 24 ||
+	    !crop.w || !crop.h || !dst->cfg.width || !dst->cfg.height ||
+	    crop.x + crop.w > src->cfg.width ||
+	    crop.y + crop.h > src->cfg.height)
+		return -EINVAL;
+
+	/* 1D destinations must be packed, and cannot be rotated */
+	if (!is_tiler_addr(dst->ba) &&
+	    (dst->cfg.stride != dst->cfg.width * bpp / 8 ||
+	     dst->cfg.rotation & 3 || dst->cfg.mirror))
+		return -EINVAL;
+
+	oi->enabled = true;
+	oi->color_mode = src->cfg.color_mode;
+	oi->rotation = src->cfg.rotation;
+	oi->mirror = src->cfg.mirror;
+	oi->global_alpha = 255;
+	oi->pre_mult_alpha = src->cfg.pre_mult_alpha;
+	oi->cconv = src->cfg.cconv;
+	oi->max_x_decim = src->cfg.decim.max_x ? : 255;
+	oi->max_y_decim = src->cfg.decim.max_y ? : 255;
+	oi->min_x_decim = src->cfg.decim.min_x ? : 1;
+	oi->min_y_decim = src->cfg.decim.min_y ? : 1;
+	r = set_dss_ovl_buffer(oi, src, &crop);
+	if (r)
+		return r;
+
+	/* size of the frame fed into writeback, after overlay rotation */
+	in_w = oi->width;
+	in_h = oi->height;
+	if (oi->rotation & 1)
+		swap(in_w, in_h);
+
+	/* output size before writeback rotation */
+	wi->out_width = dst->cfg.width;
+	wi->out_height = dst->cfg.height;
+	if (dst->cfg.rotation & 1)
+		swap(wi->out_width, wi->out_height);
+
+	/* upscale in the overlay, downscale in writeback */
+	max_down = dst->cfg.color_mode == OMAP_DSS_COLOR_NV12 ? 2 : 4;
+	out_w = clamp_t(u32, in_w, wi->out_width, wi->out_width * max_down);
+	out_h = clamp_t(u32, in_h, wi->out_height, wi->out_height * max_down);
+	if (out_w > WB_MAX_SIZE || out_h > WB_MAX_SIZE)
+		return -EINVAL;
+	oi->out_width = out_w;
+	oi->out_height = out_h;
+	job->need_vid = oi->out_width != in_w || oi->out_height != in_h ||
+			(oi->color_mode & (OMAP_DSS_COLOR_NV12 |
+			 OMAP_DSS_COLOR_YUV2 | OMAP_DSS_COLOR_UYVY));
+
+	wi->enabled = true;
+	wi->mode = OMAP_WB_MEM2MEM_MODE;
+	wi->width = oi->out_width;
+	wi->height = oi->out_height;
+	wi->dss_mode = dst->cfg.color_mode;
+	wi->paddr = dst->ba;
+	wi->p_uv_addr = dst->cfg.color_mode == OMAP_DSS_COLOR_NV12 ?
+								dst->uv : 0;
+	wi->rotation = dst->cfg.rotation;
+	wi->rotation_type = is_tiler_addr(dst->ba) ?
+				OMAP_DSS_ROT_TILER : OMAP_DSS_ROT_DMA;
+	return 0;
+}
+
+/* start a job on the first free overlay, preferring the video overlays */
+static struct omap_overlay *wb_start(struct dsscomp_wb_job *job)
+{
+	unsigned long timeout = jiffies + msecs_to_jiffies(WB_WAIT_MS);
+	struct omap_overlay *ovl;
+	int i, r;
+
+	for (;;) {
+		r = -EINVAL;
+		for (i = cdev->num_ovls - 1; i >= 0; i--) {
+			ovl = cdev->ovls[i];
+			if ((job->need_vid && ovl->id == OMAP_DSS_GFX) ||
+			    !(ovl->supported_modes & job->src.color_mode))
+				continue;
+
+			INIT_COMPLETION(wb_done);
+			r = omap_dss_wb_m2m_start(ovl, &job->src, &job->dst,
+						  dsscomp_wb_isr, NULL);
+			if (!r)
+				return ovl;
+			if (r != -EBUSY)
+				break;
+		}
+
+		if (r != -EBUSY || time_after(jiffies, timeout))
+			return ERR_PTR(r);
+
+		mutex_lock(&mtx);
+		wb_stats.busy++;
+		mutex_unlock(&mtx);
+		usleep_range(1000, 2000);
+	}
+}
+
+static int wb_run(struct dsscomp_wb_job *job)
+{
+	struct omap_overlay *ovl;
+	ktime_t t;
+	u64 ns;
+	int r = 0;
+
+	ovl = wb_start(job);
+	if (IS_ERR(ovl))
+		return PTR_ERR(ovl);
+
+	t = ktime_get();
+	if (!wait_for_completion_timeout(&wb_done,
+					 msecs_to_jiffies(WB_TIMEOUT_MS)))
+		r = -ETIMEDOUT;
+	else if (wb_irq_status & DISPC_IRQ_WBINCOMPLETE)
+		r = -EIO;
+	ns = ktime_to_ns(ktime_sub(ktime_get(), t));
+
+	omap_dss_wb_m2m_stop(ovl);
+
+	if (r) {
+		dev_err(DEV(cdev), "writeback on ovl%d failed (%d)\n",
+			ovl->id, r);
+		return r;
+	}
+
+	mutex_lock(&mtx);
+	wb_stats.frames++;
+	wb_stats.hw_ns += ns;
+	wb_stats.hw_max_ns = max(wb_stats.hw_max_ns, ns);
+	t = ktime_get();
+	wb_stats.latency_ns += ktime_to_ns(ktime_sub(t, job->t_queued));
+	if (wb_stats.frames == 1)
+		wb_stats.t_first = t;
+	wb_stats.t_last = t;
+	mutex_unlock(&mtx);
+	return 0;
+}
+
+static void dsscomp_wb_do_work(struct work_struct *work)
+{
+	struct dsscomp_wb_job *job;
+	int r;
+
+	for (;;) {
+		spin_lock(&wb_lock);
+		if (list_empty(&wb_jobs)) {
+			spin_unlock(&wb_lock);
+			break;
+		}
+		job = list_first_entry(&wb_jobs, struct dsscomp_wb_job, q);
+		list_del(&job->q);
+		spin_unlock(&wb_lock);
+
+		r = wb_run(job);
+
+		mutex_lock(&mtx);
+		wb_stats.pending--;
+		if (r)
+			wb_stats.failed++;
+		mutex_unlock(&mtx);
+
+		if (job->cb_fn)
+			job->cb_fn(job->cb_arg, r);
+		kfree(job);
+	}
+}
+
+/*
+ * Queue a copy of a crop region of src into the whole of dst, converting
+ * color format and scaling as needed.  src and dst must have kernel (ba/uv)
+ * addressing.  cb_fn is called with 0 or a negative error once the copy is
+ * done or has failed.  Returns 0 if the copy was queued.
+ */
+int dsscomp_wb_queue(struct dss2_ovl_info *src, struct dss2_ovl_info *dst,
+		     void (*cb_fn)(void *, int), void *cb_arg)
+{
+	struct dsscomp_wb_job *job;
+	int r;
+
+	if (!cdev || !wb_wkq)
+		return -ENODEV;
+
+	job = kzalloc(sizeof(*job), GFP_KERNEL);
+	if (!job)
+		return -ENOMEM;
+
+	r = wb_setup_job(job, src, dst);
+	if (r) {
+		kfree(job);
+		return r;
+	}
+	job->cb_fn = cb_fn;
+	job->cb_arg = cb_arg;
+	job->t_queued = ktime_get();
+
+	mutex_lock(&mtx);
+	wb_stats.queued++;
+	wb_stats.pending++;
+	wb_stats.pending_max = max(wb_stats.pending_max, wb_stats.pending);
+	mutex_unlock(&mtx);
+
+	spin_lock(&wb_lock);
+	list_add_tail(&job->q, &wb_jobs);
+	spin_unlock(&wb_lock);
+
+	queue_work(wb_wkq, &wb_work);
+	return 0;
+}
+EXPORT_SYMBOL(dsscomp_wb_queue);
+
+struct wb_copy_sync {
+	struct completion done;
+	int status;
+};
+
+static void wb_copy_cb(void *data, int status)
+{
+	struct wb_copy_sync *sync = data;
+
+	sync->status = status;
+	complete(&sync->done);
+}
+
+/* blocking copy, for DSSCIOC_WB_COPY */
+int dsscomp_wb_copy(struct dsscomp_wb_copy_data *d)
+{
+	struct wb_copy_sync sync;
+	int r;
+
+	init_completion(&sync.done);
+	r = dsscomp_wb_queue(&d->ovl, &d->wb, wb_copy_cb, &sync);
+	if (r)
+		return r;
+
+	wait_for_completion(&sync.done);
+	return sync.status;
+}
+
+void dsscomp_dbg_wb(struct seq_file *s)
+{
+#ifdef CONFIG_DEBUG_FS
+	u64 ns;
+
+	mutex_lock(&mtx);
+	seq_printf(s, "queued=%u done=%u failed=%u pending=%u (max %u) "
+		   "busy=%u\n", wb_stats.queued, wb_stats.frames,
+		   wb_stats.failed, wb_stats.pending, wb_stats.pending_max,
+		   wb_stats.busy);
+	if (wb_stats.frames) {
+		seq_printf(s, "writeback: avg=%lluus max=%lluus "
+			   "latency avg=%lluus\n",
+			   div_u64(div_u64(wb_stats.hw_ns, wb_stats.frames),
+				   NSEC_PER_USEC),
+			   div_u64(wb_stats.hw_max_ns, NSEC_PER_USEC),
+			   div_u64(div_u64(wb_stats.latency_ns,
+					   wb_stats.frames), NSEC_PER_USEC));
+
+		/* hardware throughput, and achieved since the first copy */
+		seq_printf(s, "throughput: %llu fps",
+			   div64_u64((u64) wb_stats.frames * NSEC_PER_SEC,
+				     wb_stats.hw_ns ? : 1));
+		ns = ktime_to_ns(ktime_sub(wb_stats.t_last,
+					   wb_stats.t_first));
+		if (ns)
+			seq_printf(s, " (achieved %llu fps)",
+				   div64_u64((u64) (wb_stats.frames - 1) *
+					     NSEC_PER_SEC, ns));
+		seq_printf(s, "\n");
+	}
+	mutex_unlock(&mtx);
+#endif
+}
+
+void dsscomp_wb_init(struct dsscomp_dev *cdev_)
+{
+	cdev = cdev_;
+	init_completion(&wb_done);
+	INIT_WORK(&wb_work, dsscomp_wb_do_work);
+
+	wb_wkq = create_singlethread_workqueue("dsscomp_wb");
+	if (!wb_wkq)
+		pr_err("could not create writeback work queue\n");
+}
+
+void dsscomp_wb_exit(void)
+{
+	if (wb_wkq)
+		destroy_workqueue(wb_wkq);
+	wb_wkq = NULL;
+}
@@ -37,6 +37,7 @@ static inline void set_freeze_flag(struct task_struct *p)
 static inline void clear_freeze_flag(struct task_struct *p)
 {
 	clear_tsk_thread_flag(p, TIF_FREEZE);
+	p->freeze_start = 0;
 }
 
 static inline bool should_send_signal(struct task_struct *p)
@@ -48,6 +49,7 @@ static inline bool should_send_signal(struct task_struct *p)
 extern int thaw_process(struct task_struct *p);
 
 extern void refrigerator(void);
+extern void freezer_task_frozen(struct task_struct *p);
 extern int freeze_processes(void);
 extern void thaw_processes(void);
 
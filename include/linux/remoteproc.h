@@ -38,6 +38,8 @@
 #include <linux/workqueue.h>
 #include <linux/notifier.h>
 #include <linux/pm_qos_params.h>
+#include <linux/ktime.h>
+#include <linux/wait.h>
 
 /* Must match the BIOS version embeded in the BIOS firmware image */
 #define RPROC_BIOS_VERSION	2
@@ -104,8 +106,60 @@ enum fw_resource_type {
 	RSC_BOOTADDR	= 5,
 	RSC_CRASHDUMP	= 6,
 	RSC_END		= 7,
+	RSC_EVENTLOG	= 8,
 };
 
+/**
+ * The event log is a ring of timestamped events, written by the remote
+ * processor into a carveout announced with a RSC_EVENTLOG resource, and
+ * read by the host without any interaction with the remote processor.
+ *
+ * The host initializes the header before starting the remote processor.
+ * The remote processor writes each event to entries[head % num], then
+ * increments head, never waiting for the host: the host notices it fell
+ * behind by more than num events when head moves past its read position
+ * by more than num, and accounts the overwritten events as lost.
+ *
+ * Timestamps are taken from a free running counter of clock_rate Hz, which
+ * the host can read too (see rproc_ops->read_clock), so that events are
+ * correlated with the host clock.
+ */
+#define RPROC_EVLOG_MAGIC	0x45564c47	/* "EVLG" */
+
+enum rproc_evlog_type {
+	RPROC_EVLOG_LOAD	= 0,	/* arg: cpu load, in percent */
+	RPROC_EVLOG_IDLE_ENTER	= 1,
+	RPROC_EVLOG_IDLE_EXIT	= 2,
+	RPROC_EVLOG_FRAME_BEGIN	= 3,	/* id: codec instance, arg: frame */
+	RPROC_EVLOG_FRAME_END	= 4,	/* id: codec instance, arg: frame */
+	RPROC_EVLOG_MARK	= 5,	/* id and arg are user defined */
+};
+
+struct rproc_evlog_entry {
+	u32 ts;
+	u16 type;
+	u16 id;
+	u32 arg;
+	u32 reserved;
+} __packed;
+
+/**
+ * struct rproc_evlog_hdr - header of the event log
+ *
+ * @magic: RPROC_EVLOG_MAGIC, written by the host
+ * @num: number of entries, a power of two, written by the host
+ * @clock_rate: rate of the timestamps in Hz, written by the remote
+ * @head: number of events written so far, written by the remote
+ */
+struct rproc_evlog_hdr {
+	u32 magic;
+	u32 num;
+	u32 clock_rate;
+	u32 head;
+	u32 reserved[4];
+	struct rproc_evlog_entry entries[0];
+} __packed;
+
 /**
  * struct rproc_mem_pool - descriptor for the rproc's contiguous memory pool data
  *
@@ -146,6 +200,7 @@ enum rproc_constraint {
 };
 
 struct rproc;
+struct firmware;
 
 struct rproc_ops {
 	int (*start)(struct rproc *rproc, u64 bootaddr);
@@ -160,6 +215,7 @@ struct rproc_ops {
 	int (*watchdog_init)(struct rproc *, int (*)(struct rproc *));
 	int (*watchdog_exit)(struct rproc *);
 	void (*dump_registers)(struct rproc *);
+	int (*read_clock)(struct rproc *, u32 *);
 };
 
 /*
@@ -212,6 +268,29 @@ enum rproc_event {
 
 #define RPROC_MAX_NAME	100
 
+/**
+ * struct rproc_boot_stats - timing of the boot phases of a remote processor
+ *
+ * @fetch: time spent getting the firmware image, zero for a warm boot
+ * @load: time spent handling the resources and copying the image sections
+ * @iommu: time spent configuring the iommu
+ * @start: time spent powering on the remote processor
+ * @total: time from the boot request until the remote processor is up
+ * @warm: whether the last boot was from the retained image
+ * @cold_boots: number of boots which fetched the firmware image
+ * @warm_boots: number of boots from the retained image
+ */
+struct rproc_boot_stats {
+	ktime_t fetch;
+	ktime_t load;
+	ktime_t iommu;
+	ktime_t start;
+	ktime_t total;
+	bool warm;
+	unsigned cold_boots;
+	unsigned warm_boots;
+};
+
 /*
  * struct rproc - a physical remote processor device
  *
@@ -247,6 +326,25 @@ enum rproc_event {
  * @secure_mode: flag to dictate whether to enable secure loading
  * @secure_ok: restart status flag to be looked up upon the event's completion
  * @secure_reset: flag to uninstall the firewalls
+ * @retain: whether to keep the firmware image across stop/start
+ * @fw: retained firmware image, reused by the next boot
+ * @rsc_copy: pristine copy of the resource table of the retained image
+ * @rsc_len: length of @rsc_copy
+ * @mapped_maps: memory maps the iommu page table was last filled with
+ * @iommu_mapped: set while starting if the iommu page table still holds
+ *                the memory maps, so they need not be mapped again
+ * @boot_work: work in charge of booting from the retained image
+ * @preload_work: work in charge of fetching the image ahead of first use
+ * @boot_begin: time the current boot was requested
+ * @boot_stats: timing of the last boot
+ * @evlog: event log of the remote processor, see struct rproc_evlog_hdr
+ * @evlog_len: length of the event log
+ * @evlog_num: number of entries of the event log, as set up by the host
+ * @evlog_gen: incremented every time the event log is initialized
+ * @evlog_head: head of the event log when it was last polled
+ * @evlog_readers: number of readers of the event log
+ * @evlog_wq: wait queue of the event log readers
+ * @evlog_work: work polling the event log while it has readers
  */
 struct rproc {
 	struct list_head next;
@@ -288,6 +386,24 @@ struct rproc {
 	bool halt_on_crash;
 	char *header;
 	int header_len;
+	bool retain;
+	const struct firmware *fw;
+	void *rsc_copy;
+	int rsc_len;
+	struct rproc_mem_entry mapped_maps[RPROC_MAX_MEM_ENTRIES];
+	bool iommu_mapped;
+	struct work_struct boot_work;
+	struct delayed_work preload_work;
+	ktime_t boot_begin;
+	struct rproc_boot_stats boot_stats;
+	struct rproc_evlog_hdr *evlog;
+	int evlog_len;
+	u32 evlog_num;
+	unsigned evlog_gen;
+	u32 evlog_head;
+	int evlog_readers;
+	wait_queue_head_t evlog_wq;
+	struct delayed_work evlog_work;
 };
 
 int rproc_set_secure(const char *, bool);
@@ -39,21 +39,40 @@
 
 /* The feature bitmap for virtio rpmsg */
 #define VIRTIO_RPMSG_F_NS	0 /* RP supports name service notifications */
+#define VIRTIO_RPMSG_F_FRAG	1 /* RP supports fragmented messages */
 
 /**
  * struct rpmsg_hdr -
+ * @len:	length of the payload in this buffer
+ * @flags:	see enum rpmsg_msg_flags
+ * @src:	source address
+ * @dst:	destination address
+ * @offset:	offset of this fragment in its message, zero otherwise
+ * @data:	the payload
  *
- * ... keep documenting ...
+ * Messages larger than a buffer are sent as consecutive fragments, if both
+ * sides support VIRTIO_RPMSG_F_FRAG.  All fragments but the last one have
+ * RPMSG_F_FRAG set.  A sender does not interleave fragments of messages
+ * to the same destination.
  */
 struct rpmsg_hdr {
 	u16 len;
 	u16 flags;
 	u32 src;
 	u32 dst;
-	u32 unused;
+	u32 offset;
 	u8 data[0];
 } __packed;
 
+/**
+ * enum rpmsg_msg_flags - flags of an rpmsg message
+ *
+ * @RPMSG_F_FRAG: more fragments of this message follow
+ */
+enum rpmsg_msg_flags {
+	RPMSG_F_FRAG		= 1 << 0,
+};
+
 enum rpmsg_ns_flags {
 	RPMSG_NS_CREATE		= 0,
 	RPMSG_NS_DESTROY	= 1,
@@ -114,12 +133,18 @@ struct rpmsg_channel_info {
  * @cb:
  * @src: local rpmsg address
  * @priv:
+ * @frag: buffer of the fragmented message being received, or NULL
+ * @frag_len: length received so far, negative if none is in progress
+ * @frag_src: source address of that message
  */
 struct rpmsg_endpoint {
 	struct rpmsg_channel *rpdev;
 	void (*cb)(struct rpmsg_channel *, void *, int, void *, u32);
 	u32 addr;
 	void *priv;
+	void *frag;
+	int frag_len;
+	u32 frag_src;
 };
 
 /**
@@ -33,6 +33,7 @@
 #ifndef RPMSG_OMX_H
 #define RPMSG_OMX_H
 
+#include <linux/types.h>
 #include <linux/ioctl.h>
 
 #define OMX_IOC_MAGIC	'X'
@@ -40,8 +41,46 @@
 #define OMX_IOCCONNECT		_IOW(OMX_IOC_MAGIC, 1, char *)
 #define OMX_IOCIONREGISTER	_IOWR(OMX_IOC_MAGIC, 2, struct ion_fd_data)
 #define OMX_IOCIONUNREGISTER	_IOWR(OMX_IOC_MAGIC, 3, struct ion_fd_data)
+#define OMX_IOCRINGKICK		_IO(OMX_IOC_MAGIC, 4)
 
-#define OMX_IOC_MAXNR	(3)
+#define OMX_IOC_MAXNR	(4)
+
+/*
+ * Message ring shared with user space, mapped with mmap() at offset 0 and
+ * OMX_RING_SIZE bytes long: a control page, followed by OMX_RING_SLOTS
+ * receive slots and OMX_RING_SLOTS transmit slots.  Slot indices run freely
+ * and wrap modulo OMX_RING_SLOTS.
+ *
+ * The driver fills receive slots and advances rx_head, user space consumes
+ * them and advances rx_tail.  User space fills transmit slots, advances
+ * tx_head and issues OMX_IOCRINGKICK, which sends them and advances tx_tail.
+ * Messages that arrive while the receive ring is full are queued, and moved
+ * into it by the next OMX_IOCRINGKICK.  poll() reports POLLIN while there
+ * are messages to consume.  Both sides must order their slot accesses and
+ * index updates with memory barriers.
+ */
+#define OMX_RING_SLOTS		32
+#define OMX_RING_SLOT_SIZE	512
+#define OMX_RING_CTRL_SIZE	4096
+#define OMX_RING_RX_OFFSET	OMX_RING_CTRL_SIZE
+#define OMX_RING_TX_OFFSET	(OMX_RING_RX_OFFSET + \
+				 OMX_RING_SLOTS * OMX_RING_SLOT_SIZE)
+#define OMX_RING_SIZE		(OMX_RING_TX_OFFSET + \
+				 OMX_RING_SLOTS * OMX_RING_SLOT_SIZE)
+
+struct omx_ring_ctrl {
+	__u32 rx_head;		/* written by the driver */
+	__u32 rx_tail;		/* written by user space */
+	__u32 tx_head;		/* written by user space */
+	__u32 tx_tail;		/* written by the driver */
+	__u32 rx_queued;	/* messages waiting for a receive slot */
+	__u32 tx_errors;	/* invalid transmit slots that were dropped */
+};
+
+struct omx_ring_slot {
+	__u32 len;
+	char data[OMX_RING_SLOT_SIZE - sizeof(__u32)];
+};
 
 #ifdef __KERNEL__
 
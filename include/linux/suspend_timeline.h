@@ -0,0 +1,59 @@
+/*
+ * Timeline of the steps of system suspend and resume.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _LINUX_SUSPEND_TIMELINE_H
+#define _LINUX_SUSPEND_TIMELINE_H
+
+#include <linux/types.h>
+
+#ifdef CONFIG_SUSPEND_TIMELINE
+extern bool suspend_timeline_in_enter;
+
+/*
+ * A step is recorded when it ends: take a timestamp with
+ * suspend_timeline_start() when it begins, and pass it to
+ * suspend_timeline_record() along with the phase it belongs to, its
+ * result and a description (a device or callback name).
+ */
+extern u64 suspend_timeline_start(void);
+extern void suspend_timeline_record(u64 start, const char *phase, int error,
+				    const char *fmt, ...)
+	__attribute__((format(printf, 4, 5)));
+
+/* Set while the platform is entering the sleep state, for low-level code */
+static inline void suspend_timeline_set_entering(bool entering)
+{
+	suspend_timeline_in_enter = entering;
+}
+
+static inline bool suspend_timeline_entering(void)
+{
+	return suspend_timeline_in_enter;
+}
+#else
+static inline u64 suspend_timeline_start(void)
+{
+	return 0;
+}
+
+static inline void suspend_timeline_record(u64 start, const char *phase,
+					   int error, const char *fmt, ...)
+{
+}
+
+static inline void suspend_timeline_set_entering(bool entering)
+{
+}
+
+static inline bool suspend_timeline_entering(void)
+{
+	return false;
+}
+#endif
+
+#endif /* _LINUX_SUSPEND_TIMELINE_H */
@@ -552,9 +552,16 @@ struct dsscomp_setup_dispc_data {
 
 /*
  * ioctl: DSSCIOC_WB_COPY, struct dsscomp_wb_copy_data
- *,
+ *
+ * Copies the ovl.cfg.crop region of the ovl buffer into the whole wb
+ * buffer, scaling and converting color format as needed.  The overlay
+ * pipeline is picked by dsscomp among the ones not used for display, so
+ * ovl.cfg.ix is ignored.  Upscaling is done by the overlay, downscaling by
+ * the writeback pipeline.
+ *
  * Requirements:
  *	wb.ix must be OMAP_DSS_WB.
+ *	wb must be a TILER buffer.
  *
  * Returns 0 on success (copy is completed), non-0 on failure.
  */
@@ -601,6 +608,30 @@ struct dsscomp_setup_display_data {
 	struct dsscomp_videomode mode;	/* video timings */
 };
 
+/*
+ * ioctl: DSSCIOC_MATCH_REFRESH, struct dsscomp_match_refresh_data
+ *
+ * Switches the display to the supported timing at the current resolution
+ * whose refresh rate is the closest multiple of the content frame rate,
+ * e.g. to 24 Hz for 23.976 fps or to 50 Hz for 25 fps video.  Fill in ix
+ * and frame_rate before calling ioctl, and rest of the fields are filled
+ * in by ioctl.  The display is not switched if no timing matches better
+ * than the current one.
+ *
+ * If switched is set, the display refresh rate changed to refresh, and
+ * vsync timestamps from before the call should no longer be used for
+ * A/V sync.
+ *
+ * Returns: 0 on success, non-0 error value on failure.
+ */
+struct dsscomp_match_refresh_data {
+	__u32 ix;			/* display index (sysfs/display#) */
+	__u32 frame_rate;		/* content frame rate in mHz */
+	__u32 refresh;			/* display refresh rate in mHz */
+	__u8 switched;			/* bool: display timing changed */
+	struct dsscomp_videomode mode;	/* video timings in use */
+};
+
 /*
  * ioctl: DSSCIOC_WAIT, struct dsscomp_wait_data
  *
@@ -641,4 +672,5 @@ struct dsscomp_wait_data {
 
 #define DSSCIOC_SETUP_DISPC	_IOW('O', 133, struct dsscomp_setup_dispc_data)
 #define DSSCIOC_SETUP_DISPLAY	_IOW('O', 134, struct dsscomp_setup_display_data)
+#define DSSCIOC_MATCH_REFRESH	_IOWR('O', 135, struct dsscomp_match_refresh_data)
 #endif
@@ -825,6 +825,12 @@ typedef void (*omap_dispc_isr_t) (void *arg, u32 mask);
 int omap_dispc_register_isr(omap_dispc_isr_t isr, void *arg, u32 mask);
 int omap_dispc_unregister_isr(omap_dispc_isr_t isr, void *arg, u32 mask);
 
+#define DISPC_IRQ_WB_M2M	(DISPC_IRQ_FRAMEDONE_WB | DISPC_IRQ_WBINCOMPLETE)
+int omap_dss_wb_m2m_start(struct omap_overlay *ovl,
+		struct omap_overlay_info *info, struct omap_writeback_info *wb,
+		omap_dispc_isr_t isr, void *arg);
+void omap_dss_wb_m2m_stop(struct omap_overlay *ovl);
+
 int omap_dispc_wait_for_irq_timeout(u32 irqmask, unsigned long timeout);
 int omap_dispc_wait_for_irq_interruptible_timeout(u32 irqmask,
 		unsigned long timeout);
@@ -18,6 +18,8 @@ static inline void frozen_process(void)
 	if (!unlikely(current->flags & PF_NOFREEZE)) {
 		current->flags |= PF_FROZEN;
 		smp_wmb();
+		if (current->freeze_start)
+			freezer_task_frozen(current);
 	}
 	clear_freeze_flag(current);
 }
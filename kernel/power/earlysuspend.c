@@ -13,10 +13,12 @@
  *
  */
 
+#include <linux/async.h>
 #include <linux/earlysuspend.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/rtc.h>
+#include <linux/suspend_timeline.h>
 #include <linux/syscalls.h> /* sys_sync */
 #include <linux/wakelock.h>
 #include <linux/workqueue.h>
@@ -44,6 +46,35 @@ enum {
 	SUSPEND_REQUESTED_AND_SUSPENDED = SUSPEND_REQUESTED | SUSPENDED,
 };
 static int state;
+static LIST_HEAD(early_suspend_domain);
+
+static void early_suspend_call(struct early_suspend *handler)
+{
+	u64 start = suspend_timeline_start();
+
+	handler->suspend(handler);
+	suspend_timeline_record(start, "early_suspend", 0, "%pf",
+				handler->suspend);
+}
+
+static void late_resume_call(struct early_suspend *handler)
+{
+	u64 start = suspend_timeline_start();
+
+	handler->resume(handler);
+	suspend_timeline_record(start, "late_resume", 0, "%pf",
+				handler->resume);
+}
+
+static void early_suspend_async(void *data, async_cookie_t cookie)
+{
+	early_suspend_call(data);
+}
+
+static void late_resume_async(void *data, async_cookie_t cookie)
+{
+	late_resume_call(data);
+}
 
 void register_early_suspend(struct early_suspend *handler)
 {
@@ -76,6 +107,7 @@ static void early_suspend(struct work_struct *work)
 	struct early_suspend *pos;
 	unsigned long irqflags;
 	int abort = 0;
+	u64 start = suspend_timeline_start();
 
 	mutex_lock(&early_suspend_lock);
 	spin_lock_irqsave(&state_lock, irqflags);
@@ -97,10 +129,17 @@ static void early_suspend(struct work_struct *work)
 	list_for_each_entry(pos, &early_suspend_handlers, link) {
 		if (pos->suspend != NULL) {
 			if (debug_mask & DEBUG_VERBOSE)
-				pr_info("early_suspend: calling %pf\n", pos->suspend);
-			pos->suspend(pos);
+				pr_info("early_suspend: calling %pf%s\n",
+					pos->suspend, pos->async ? " async" : "");
+			if (pos->async)
+				async_schedule_domain(early_suspend_async, pos,
+						      &early_suspend_domain);
+			else
+				early_suspend_call(pos);
 		}
 	}
+	async_synchronize_full_domain(&early_suspend_domain);
+	suspend_timeline_record(start, "early_suspend", 0, "-");
 	mutex_unlock(&early_suspend_lock);
 
 	if (debug_mask & DEBUG_SUSPEND)
@@ -119,6 +158,7 @@ static void late_resume(struct work_struct *work)
 	struct early_suspend *pos;
 	unsigned long irqflags;
 	int abort = 0;
+	u64 start = suspend_timeline_start();
 
 	mutex_lock(&early_suspend_lock);
 	spin_lock_irqsave(&state_lock, irqflags);
@@ -138,11 +178,18 @@ static void late_resume(struct work_struct *work)
 	list_for_each_entry_reverse(pos, &early_suspend_handlers, link) {
 		if (pos->resume != NULL) {
 			if (debug_mask & DEBUG_VERBOSE)
-				pr_info("late_resume: calling %pf\n", pos->resume);
-
-			pos->resume(pos);
+				pr_info("late_resume: calling %pf%s\n",
+					pos->resume, pos->async ? " async" : "");
+
+			if (pos->async)
+				async_schedule_domain(late_resume_async, pos,
+						      &early_suspend_domain);
+			else
+				late_resume_call(pos);
 		}
 	}
+	async_synchronize_full_domain(&early_suspend_domain);
+	suspend_timeline_record(start, "late_resume", 0, "-");
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("late_resume: done\n");
 abort:
@@ -8,21 +8,57 @@
 
 #undef DEBUG
 
+#include <linux/debugfs.h>
 #include <linux/interrupt.h>
 #include <linux/oom.h>
 #include <linux/suspend.h>
+#include <linux/suspend_timeline.h>
 #include <linux/module.h>
 #include <linux/syscalls.h>
 #include <linux/freezer.h>
 #include <linux/delay.h>
 #include <linux/workqueue.h>
 #include <linux/wakelock.h>
+#include <linux/seq_file.h>
+#include <linux/sort.h>
+#include <linux/spinlock.h>
 
 /* 
  * Timeout for stopping processes
  */
 #define TIMEOUT	(20 * HZ)
 
+/*
+ * Backstop for a freezing pass: tasks that exit or stop instead of
+ * entering the refrigerator, and busy workqueues, do not wake us up.
+ */
+#define FREEZE_RETRY_MSECS	10
+
+/*
+ * Tasks counted by the current pass that have not entered the
+ * refrigerator yet. The last one to freeze wakes freeze_waitq.
+ */
+static atomic_t freeze_outstanding = ATOMIC_INIT(0);
+static DECLARE_WAIT_QUEUE_HEAD(freeze_waitq);
+
+#define FREEZE_SLOW_TASKS	8
+
+struct freeze_task_stat {
+	pid_t pid;
+	char comm[TASK_COMM_LEN];
+	u64 latency_ns;
+};
+
+/* Statistics of the last freeze_processes(), under freeze_stats_lock */
+static struct {
+	unsigned int passes;
+	unsigned int woken;
+	unsigned int tasks;
+	u64 max_latency_ns;
+	struct freeze_task_stat slowest[FREEZE_SLOW_TASKS];
+} freeze_stats;
+static DEFINE_SPINLOCK(freeze_stats_lock);
+
 static inline int freezable(struct task_struct * p)
 {
 	if ((p == current) ||
@@ -32,6 +68,68 @@ static inline int freezable(struct task_struct * p)
 	return 1;
 }
 
+static u64 freeze_clock(void)
+{
+	return ktime_to_ns(ktime_get());
+}
+
+/*
+ * Count @p as outstanding for this pass. Returns false if it has frozen
+ * already, in which case it will not report back.
+ */
+static bool freeze_count_task(struct task_struct *p)
+{
+	bool counted = false;
+
+	task_lock(p);
+	if (!frozen(p)) {
+		if (!p->freeze_start)
+			p->freeze_start = freeze_clock();
+		atomic_inc(&freeze_outstanding);
+		counted = true;
+	}
+	task_unlock(p);
+
+	return counted;
+}
+
+/*
+ * Called by @p from the refrigerator, under task_lock(p), if the freezer
+ * was waiting on it.
+ */
+void freezer_task_frozen(struct task_struct *p)
+{
+	struct freeze_task_stat *slot;
+	u64 latency = freeze_clock() - p->freeze_start;
+	int i;
+
+	if (atomic_dec_return(&freeze_outstanding) <= 0)
+		wake_up(&freeze_waitq);
+
+	spin_lock(&freeze_stats_lock);
+	freeze_stats.tasks++;
+	if (latency > freeze_stats.max_latency_ns)
+		freeze_stats.max_latency_ns = latency;
+
+	slot = &freeze_stats.slowest[0];
+	for (i = 1; i < FREEZE_SLOW_TASKS; i++)
+		if (freeze_stats.slowest[i].latency_ns < slot->latency_ns)
+			slot = &freeze_stats.slowest[i];
+	if (latency > slot->latency_ns) {
+		slot->pid = p->pid;
+		memcpy(slot->comm, p->comm, TASK_COMM_LEN);
+		slot->latency_ns = latency;
+	}
+	spin_unlock(&freeze_stats_lock);
+}
+
+static void freeze_stats_reset(void)
+{
+	spin_lock(&freeze_stats_lock);
+	memset(&freeze_stats, 0, sizeof(freeze_stats));
+	spin_unlock(&freeze_stats_lock);
+}
+
 static int try_to_freeze_tasks(bool sig_only)
 {
 	struct task_struct *g, *p;
@@ -52,6 +150,7 @@ static int try_to_freeze_tasks(bool sig_only)
 
 	while (true) {
 		todo = 0;
+		atomic_set(&freeze_outstanding, 0);
 		read_lock(&tasklist_lock);
 		do_each_thread(g, p) {
 			if (frozen(p) || !freezable(p))
@@ -73,7 +172,7 @@ static int try_to_freeze_tasks(bool sig_only)
 			 * stop sees TIF_FREEZE.
 			 */
 			if (!task_is_stopped_or_traced(p) &&
-			    !freezer_should_skip(p))
+			    !freezer_should_skip(p) && freeze_count_task(p))
 				todo++;
 		} while_each_thread(g, p);
 		read_unlock(&tasklist_lock);
@@ -96,10 +195,24 @@ static int try_to_freeze_tasks(bool sig_only)
 		}
 
 		/*
-		 * We need to retry, but first give the freezing tasks some
-		 * time to enter the regrigerator.
+		 * We need to retry. Sleep until the last task counted above
+		 * has entered the refrigerator, or the backstop expires.
+		 * Only busy workqueues left means nobody will wake us.
 		 */
-		msleep(10);
+		spin_lock(&freeze_stats_lock);
+		freeze_stats.passes++;
+		spin_unlock(&freeze_stats_lock);
+		if (todo > wq_busy) {
+			if (wait_event_timeout(freeze_waitq,
+				atomic_read(&freeze_outstanding) <= 0,
+				msecs_to_jiffies(FREEZE_RETRY_MSECS))) {
+				spin_lock(&freeze_stats_lock);
+				freeze_stats.woken++;
+				spin_unlock(&freeze_stats_lock);
+			}
+		} else {
+			msleep(FREEZE_RETRY_MSECS);
+		}
 	}
 
 	do_gettimeofday(&end);
@@ -151,15 +264,22 @@ static int try_to_freeze_tasks(bool sig_only)
 int freeze_processes(void)
 {
 	int error;
+	u64 start;
+
+	freeze_stats_reset();
 
 	printk("Freezing user space processes ... ");
+	start = suspend_timeline_start();
 	error = try_to_freeze_tasks(true);
+	suspend_timeline_record(start, "freeze", error, "user_tasks");
 	if (error)
 		goto Exit;
 	printk("done.\n");
 
 	printk("Freezing remaining freezable tasks ... ");
+	start = suspend_timeline_start();
 	error = try_to_freeze_tasks(false);
+	suspend_timeline_record(start, "freeze", error, "kernel_tasks");
 	if (error)
 		goto Exit;
 	printk("done.");
@@ -194,6 +314,8 @@ static void thaw_tasks(bool nosig_only)
 
 void thaw_processes(void)
 {
+	u64 start = suspend_timeline_start();
+
 	oom_killer_enable();
 
 	printk("Restarting tasks ... ");
@@ -202,5 +324,76 @@ void thaw_processes(void)
 	thaw_tasks(false);
 	schedule();
 	printk("done.\n");
+	suspend_timeline_record(start, "thaw", 0, "-");
+}
+
+
+#ifdef CONFIG_DEBUG_FS
+static int freeze_task_stat_cmp(const void *a, const void *b)
+{
+	const struct freeze_task_stat *ta = a, *tb = b;
+
+	if (ta->latency_ns == tb->latency_ns)
+		return 0;
+	return ta->latency_ns < tb->latency_ns ? 1 : -1;
+}
+
+static int freezer_stats_show(struct seq_file *s, void *data)
+{
+	struct freeze_task_stat slowest[FREEZE_SLOW_TASKS];
+	unsigned int tasks, passes, woken;
+	u64 max_latency;
+	int i;
+
+	spin_lock(&freeze_stats_lock);
+	tasks = freeze_stats.tasks;
+	passes = freeze_stats.passes;
+	woken = freeze_stats.woken;
+	max_latency = freeze_stats.max_latency_ns;
+	memcpy(slowest, freeze_stats.slowest, sizeof(slowest));
+	spin_unlock(&freeze_stats_lock);
+
+	sort(slowest, FREEZE_SLOW_TASKS, sizeof(slowest[0]),
+	     freeze_task_stat_cmp, NULL);
+
+	seq_printf(s, "tasks: %u\n", tasks);
+	seq_printf(s, "retries: %u (%u woken by last task)\n", passes, woken);
+	seq_printf(s, "max_latency_us: %llu\n",
+		   div_u64(max_latency, NSEC_PER_USEC));
+	seq_printf(s, "%8s  %-16s  %s\n", "pid", "comm", "latency_us");
+	for (i = 0; i < FREEZE_SLOW_TASKS && slowest[i].latency_ns; i++)
+		seq_printf(s, "%8d  %-16s  %llu\n", slowest[i].pid,
+			   slowest[i].comm,
+			   div_u64(slowest[i].latency_ns, NSEC_PER_USEC));
+
+	return 0;
+}
+
+static int freezer_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, freezer_stats_show, NULL);
+}
+
+static const struct file_operations freezer_stats_fops = {
+	.open		= freezer_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init freezer_stats_init(void)
+{
+	struct dentry *d;
+
+	d = debugfs_create_file("freezer_stats", 0444, NULL, NULL,
+				&freezer_stats_fops);
+	if (!d) {
+		pr_err("Failed to create freezer_stats debug file\n");
+		return -ENOMEM;
+	}
+
+	return 0;
 }
 
+late_initcall(freezer_stats_init);
+#endif
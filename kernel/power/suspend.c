@@ -22,6 +22,7 @@
 #include <linux/mm.h>
 #include <linux/slab.h>
 #include <linux/suspend.h>
+#include <linux/suspend_timeline.h>
 #include <linux/syscore_ops.h>
 #include <trace/events/power.h>
 
@@ -137,9 +138,12 @@ void __attribute__ ((weak)) arch_suspend_enable_irqs(void)
 static int suspend_enter(suspend_state_t state)
 {
 	int error;
+	u64 start;
 
 	if (suspend_ops->prepare) {
+		start = suspend_timeline_start();
 		error = suspend_ops->prepare();
+		suspend_timeline_record(start, "platform", error, "prepare");
 		if (error)
 			goto Platform_finish;
 	}
@@ -159,27 +163,40 @@ static int suspend_enter(suspend_state_t state)
 	if (suspend_test(TEST_PLATFORM))
 		goto Platform_wake;
 
+	start = suspend_timeline_start();
 	error = disable_nonboot_cpus();
+	suspend_timeline_record(start, "cpus", error, "disable_nonboot");
 	if (error || suspend_test(TEST_CPUS))
 		goto Enable_cpus;
 
 	arch_suspend_disable_irqs();
 	BUG_ON(!irqs_disabled());
 
+	start = suspend_timeline_start();
 	error = syscore_suspend();
+	suspend_timeline_record(start, "syscore", error, "suspend");
 	if (!error) {
 		if (!(suspend_test(TEST_CORE) || pm_wakeup_pending())) {
+			start = suspend_timeline_start();
+			suspend_timeline_set_entering(true);
 			error = suspend_ops->enter(state);
+			suspend_timeline_set_entering(false);
+			suspend_timeline_record(start, "platform", error,
+						"enter");
 			events_check_enabled = false;
 		}
+		start = suspend_timeline_start();
 		syscore_resume();
+		suspend_timeline_record(start, "syscore", 0, "resume");
 	}
 
 	arch_suspend_enable_irqs();
 	BUG_ON(irqs_disabled());
 
  Enable_cpus:
+	start = suspend_timeline_start();
 	enable_nonboot_cpus();
+	suspend_timeline_record(start, "cpus", 0, "enable_nonboot");
 
  Platform_wake:
 	if (suspend_ops->wake)
@@ -188,8 +205,11 @@ static int suspend_enter(suspend_state_t state)
 	dpm_resume_noirq(PMSG_RESUME);
 
  Platform_finish:
-	if (suspend_ops->finish)
+	if (suspend_ops->finish) {
+		start = suspend_timeline_start();
 		suspend_ops->finish();
+		suspend_timeline_record(start, "platform", 0, "finish");
+	}
 
 	return error;
 }
@@ -269,6 +289,7 @@ static void suspend_finish(void)
 int enter_state(suspend_state_t state)
 {
 	int error;
+	u64 start;
 
 	if (!valid_state(state))
 		return -ENODEV;
@@ -277,7 +298,9 @@ int enter_state(suspend_state_t state)
 		return -EBUSY;
 
 	printk(KERN_INFO "PM: Syncing filesystems ... ");
+	start = suspend_timeline_start();
 	sys_sync();
+	suspend_timeline_record(start, "sync", 0, "-");
 	printk("done.\n");
 
 	pr_debug("PM: Preparing system for %s sleep\n", pm_states[state]);
@@ -0,0 +1,152 @@
+/*
+ * debugfs timeline of system suspend and resume
+ *
+ * Records when each step of suspend and resume started and ended:
+ * early suspend handlers, the freezer, every device callback, the
+ * platform steps and, where the platform supports it, the low-level
+ * entry into the sleep state. /sys/kernel/debug/suspend_timeline lists
+ * the steps, oldest first, one per line:
+ *
+ *	start_ns end_ns cpu phase detail error
+ *
+ * where detail names the device or callback, or is "-" for a whole phase.
+ * Timestamps come from sched_clock(). Writing to the file clears it.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/smp.h>
+#include <linux/spinlock.h>
+#include <linux/suspend_timeline.h>
+
+#define TIMELINE_ENTRIES	1024
+#define TIMELINE_DETAIL_LEN	40
+
+struct timeline_entry {
+	u64 start;
+	u64 end;
+	const char *phase;
+	int error;
+	int cpu;
+	char detail[TIMELINE_DETAIL_LEN];
+};
+
+static struct timeline_entry timeline[TIMELINE_ENTRIES];
+static unsigned int timeline_next;	/* slot the next step goes to */
+static unsigned int timeline_count;	/* valid entries, up to ENTRIES */
+static unsigned long timeline_lost;	/* overwritten entries */
+static DEFINE_SPINLOCK(timeline_lock);
+
+bool suspend_timeline_in_enter;
+
+u64 suspend_timeline_start(void)
+{
+	return sched_clock();
+}
+
+void suspend_timeline_record(u64 start, const char *phase, int error,
+			     const char *fmt, ...)
+{
+	struct timeline_entry *e;
+	unsigned long flags;
+	u64 end = sched_clock();
+	va_list args;
+
+	spin_lock_irqsave(&timeline_lock, flags);
+	e = &timeline[timeline_next];
+	timeline_next = (timeline_next + 1) % TIMELINE_ENTRIES;
+	if (timeline_count < TIMELINE_ENTRIES)
+		timeline_count++;
+	else
+		timeline_lost++;
+
+	e->start = start;
+	e->end = end;
+	e->phase = phase;
+	e->error = error;
+	e->cpu = raw_smp_processor_id();
+	va_start(args, fmt);
+	vsnprintf(e->detail, sizeof(e->detail), fmt, args);
+	va_end(args);
+	if (!e->detail[0])
+		strcpy(e->detail, "-");
+	spin_unlock_irqrestore(&timeline_lock, flags);
+}
+
+static int timeline_show(struct seq_file *m, void *unused)
+{
+	struct timeline_entry e;
+	unsigned long flags;
+	unsigned int i, first;
+
+	spin_lock_irqsave(&timeline_lock, flags);
+	seq_printf(m, "# %lu lost\n", timeline_lost);
+	spin_unlock_irqrestore(&timeline_lock, flags);
+	seq_puts(m, "# start_ns end_ns cpu phase detail error\n");
+
+	for (i = 0; ; i++) {
+		spin_lock_irqsave(&timeline_lock, flags);
+		if (i >= timeline_count) {
+			spin_unlock_irqrestore(&timeline_lock, flags);
+			break;
+		}
+		first = (timeline_next + TIMELINE_ENTRIES - timeline_count) %
+			TIMELINE_ENTRIES;
+		e = timeline[(first + i) % TIMELINE_ENTRIES];
+		spin_unlock_irqrestore(&timeline_lock, flags);
+
+		seq_printf(m, "%llu %llu %d %s %s %d\n", e.start, e.end, e.cpu,
+			   e.phase, e.detail, e.error);
+	}
+	return 0;
+}
+
+static int timeline_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, timeline_show, NULL);
+}
+
+static ssize_t timeline_write(struct file *file, const char __user *buf,
+			      size_t count, loff_t *ppos)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&timeline_lock, flags);
+	timeline_next = 0;
+	timeline_count = 0;
+	timeline_lost = 0;
+	spin_unlock_irqrestore(&timeline_lock, flags);
+
+	return count;
+}
+
+static const struct file_operations timeline_fops = {
+	.open		= timeline_open,
+	.read		= seq_read,
+	.write		= timeline_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init suspend_timeline_init(void)
+{
+	struct dentry *d;
+
+	d = debugfs_create_file("suspend_timeline", 0644, NULL, NULL,
+		&timeline_fops);
+	if (!d) {
+		pr_err("Failed to create suspend_timeline debug file\n");
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+late_initcall(suspend_timeline_init);
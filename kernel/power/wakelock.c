@@ -38,11 +38,17 @@ module_param_named(debug_mask, debug_mask, int, S_IRUGO | S_IWUSR | S_IWGRP);
 #define WAKE_LOCK_INITIALIZED            (1U << 8)
 #define WAKE_LOCK_ACTIVE                 (1U << 9)
 #define WAKE_LOCK_AUTO_EXPIRE            (1U << 10)
-#define WAKE_LOCK_PREVENTING_SUSPEND     (1U << 11)
 
+/*
+ * All initialized locks are on wake_locks, for stats and debug output only.
+ * Active locks without a timeout are just counted, and active locks with
+ * one are kept in expiry order, so has_wake_lock() does not need to look
+ * at every lock.
+ */
 static DEFINE_SPINLOCK(list_lock);
-static LIST_HEAD(inactive_locks);
-static struct list_head active_wake_locks[WAKE_LOCK_TYPE_COUNT];
+static LIST_HEAD(wake_locks);
+static int untimed_active_count[WAKE_LOCK_TYPE_COUNT];
+static struct rb_root timed_wake_locks[WAKE_LOCK_TYPE_COUNT];
 static int current_event_num;
 struct workqueue_struct *suspend_work_queue;
 struct wake_lock main_wake_lock;
@@ -57,9 +63,26 @@ static unsigned suspend_short_count;
 
 #ifdef CONFIG_WAKELOCK_STAT
 static struct wake_lock deleted_wake_locks;
-static ktime_t last_sleep_time_update;
 static int wait_for_wakeup;
 
+/*
+ * Suspend locks are charged prevent_suspend_time while main_wake_lock is
+ * not held. Rather than updating every active lock when main_wake_lock
+ * changes, keep a clock that only runs while it is not held; each lock
+ * is charged the clock's advance between its activation and release.
+ */
+static ktime_t sleep_wait_time;
+static ktime_t last_sleep_time_update;
+
+enum {
+	WAKE_LOCK_EVENT_ACQUIRE,
+	WAKE_LOCK_EVENT_RELEASE,
+	WAKE_LOCK_EVENT_EXPIRE,
+	WAKE_LOCK_EVENT_COUNT
+};
+static DEFINE_PER_CPU(unsigned long [WAKE_LOCK_TYPE_COUNT]
+				    [WAKE_LOCK_EVENT_COUNT], wake_lock_events);
+
 int get_expired_time(struct wake_lock *lock, ktime_t *expire_time)
 {
 	struct timespec ts;
@@ -82,6 +105,34 @@ int get_expired_time(struct wake_lock *lock, ktime_t *expire_time)
 	return 1;
 }
 
+static ktime_t sleep_wait_clock(ktime_t now)
+{
+	if (wake_lock_active(&main_wake_lock) ||
+	    now.tv64 <= last_sleep_time_update.tv64)
+		return sleep_wait_time;
+	return ktime_add(sleep_wait_time,
+			 ktime_sub(now, last_sleep_time_update));
+}
+
+/* Time @lock has prevented suspend since it was last charged */
+static ktime_t sleep_wait_since(struct wake_lock *lock, ktime_t now)
+{
+	if ((lock->flags & WAKE_LOCK_TYPE_MASK) != WAKE_LOCK_SUSPEND)
+		return ktime_set(0, 0);
+	return ktime_sub(sleep_wait_clock(now), lock->stat.sleep_wait_start);
+}
+
+static void wake_lock_stat_start_locked(struct wake_lock *lock)
+{
+	lock->stat.last_time = ktime_get();
+	lock->stat.sleep_wait_start = sleep_wait_clock(lock->stat.last_time);
+}
+
+static void wake_lock_event(int type, int event)
+{
+	__get_cpu_var(wake_lock_events)[type][event]++;
+}
+
 
 static int print_lock_stat(struct seq_file *m, struct wake_lock *lock)
 {
@@ -104,9 +155,8 @@ static int print_lock_stat(struct seq_file *m, struct wake_lock *lock)
 		else
 			expire_count++;
 		total_time = ktime_add(total_time, add_time);
-		if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND)
-			prevent_suspend_time = ktime_add(prevent_suspend_time,
-					ktime_sub(now, last_sleep_time_update));
+		prevent_suspend_time = ktime_add(prevent_suspend_time,
+					sleep_wait_since(lock, now));
 		if (add_time.tv64 > max_time.tv64)
 			max_time = add_time;
 	}
@@ -125,19 +175,35 @@ static int wakelock_stats_show(struct seq_file *m, void *unused)
 	unsigned long irqflags;
 	struct wake_lock *lock;
 	int ret;
-	int type;
 
 	spin_lock_irqsave(&list_lock, irqflags);
 
 	ret = seq_puts(m, "name\tcount\texpire_count\twake_count\tactive_since"
 			"\ttotal_time\tsleep_time\tmax_time\tlast_change\n");
-	list_for_each_entry(lock, &inactive_locks, link)
+	list_for_each_entry(lock, &wake_locks, link)
 		ret = print_lock_stat(m, lock);
+	spin_unlock_irqrestore(&list_lock, irqflags);
+	return 0;
+}
+
+static int wakelock_events_show(struct seq_file *m, void *unused)
+{
+	int cpu, type, event;
+	unsigned long count[WAKE_LOCK_EVENT_COUNT];
+
+	seq_puts(m, "type\tacquired\treleased\texpired\n");
 	for (type = 0; type < WAKE_LOCK_TYPE_COUNT; type++) {
-		list_for_each_entry(lock, &active_wake_locks[type], link)
-			ret = print_lock_stat(m, lock);
+		memset(count, 0, sizeof(count));
+		for_each_possible_cpu(cpu)
+			for (event = 0; event < WAKE_LOCK_EVENT_COUNT; event++)
+				count[event] +=
+				    per_cpu(wake_lock_events, cpu)[type][event];
+		seq_printf(m, "%s\t%lu\t%lu\t%lu\n",
+			   type == WAKE_LOCK_SUSPEND ? "suspend" : "idle",
+			   count[WAKE_LOCK_EVENT_ACQUIRE],
+			   count[WAKE_LOCK_EVENT_RELEASE],
+			   count[WAKE_LOCK_EVENT_EXPIRE]);
 	}
-	spin_unlock_irqrestore(&list_lock, irqflags);
 	return 0;
 }
 
@@ -159,54 +225,87 @@ static void wake_unlock_stat_locked(struct wake_lock *lock, int expired)
 	if (ktime_to_ns(duration) > ktime_to_ns(lock->stat.max_time))
 		lock->stat.max_time = duration;
 	lock->stat.last_time = ktime_get();
-	if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND) {
-		duration = ktime_sub(now, last_sleep_time_update);
-		lock->stat.prevent_suspend_time = ktime_add(
-			lock->stat.prevent_suspend_time, duration);
-		lock->flags &= ~WAKE_LOCK_PREVENTING_SUSPEND;
-	}
+	lock->stat.prevent_suspend_time = ktime_add(
+		lock->stat.prevent_suspend_time, sleep_wait_since(lock, now));
 }
 
-static void update_sleep_wait_stats_locked(int done)
+static void expire_timed_wake_locks_locked(int type);
+
+/*
+ * Called just before main_wake_lock changes state. Expire timed out locks
+ * first, so that every lock expiring later does so after this update and
+ * is charged exactly by sleep_wait_clock().
+ */
+static void update_sleep_wait_stats_locked(void)
 {
-	struct wake_lock *lock;
-	ktime_t now, etime, elapsed, add;
-	int expired;
+	ktime_t now;
 
+	expire_timed_wake_locks_locked(WAKE_LOCK_SUSPEND);
 	now = ktime_get();
-	elapsed = ktime_sub(now, last_sleep_time_update);
-	list_for_each_entry(lock, &active_wake_locks[WAKE_LOCK_SUSPEND], link) {
-		expired = get_expired_time(lock, &etime);
-		if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND) {
-			if (expired)
-				add = ktime_sub(etime, last_sleep_time_update);
-			else
-				add = elapsed;
-			lock->stat.prevent_suspend_time = ktime_add(
-				lock->stat.prevent_suspend_time, add);
-		}
-		if (done || expired)
-			lock->flags &= ~WAKE_LOCK_PREVENTING_SUSPEND;
-		else
-			lock->flags |= WAKE_LOCK_PREVENTING_SUSPEND;
-	}
+	sleep_wait_time = sleep_wait_clock(now);
 	last_sleep_time_update = now;
 }
 #endif
 
+static void enqueue_wake_lock(struct wake_lock *lock, int type)
+{
+	struct rb_node **p = &timed_wake_locks[type].rb_node;
+	struct rb_node *parent = NULL;
+	struct wake_lock *entry;
+
+	if (!(lock->flags & WAKE_LOCK_AUTO_EXPIRE)) {
+		untimed_active_count[type]++;
+		return;
+	}
+
+	while (*p) {
+		parent = *p;
+		entry = rb_entry(parent, struct wake_lock, node);
+		if (time_before(lock->expires, entry->expires))
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&lock->node, parent, p);
+	rb_insert_color(&lock->node, &timed_wake_locks[type]);
+}
+
+static void dequeue_wake_lock(struct wake_lock *lock, int type)
+{
+	if (lock->flags & WAKE_LOCK_AUTO_EXPIRE)
+		rb_erase(&lock->node, &timed_wake_locks[type]);
+	else
+		untimed_active_count[type]--;
+}
 
 static void expire_wake_lock(struct wake_lock *lock)
 {
+	int type = lock->flags & WAKE_LOCK_TYPE_MASK;
+
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_unlock_stat_locked(lock, 1);
+	wake_lock_event(type, WAKE_LOCK_EVENT_EXPIRE);
 #endif
+	dequeue_wake_lock(lock, type);
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
-	list_del(&lock->link);
-	list_add(&lock->link, &inactive_locks);
 	if (debug_mask & (DEBUG_WAKE_LOCK | DEBUG_EXPIRE))
 		pr_info("expired wake lock %s\n", lock->name);
 }
 
+/* Expire timed locks of @type, earliest first, until one is still live */
+static void expire_timed_wake_locks_locked(int type)
+{
+	struct rb_node *node;
+	struct wake_lock *lock;
+
+	while ((node = rb_first(&timed_wake_locks[type]))) {
+		lock = rb_entry(node, struct wake_lock, node);
+		if ((long)(lock->expires - jiffies) > 0)
+			break;
+		expire_wake_lock(lock);
+	}
+}
+
 /* Caller must acquire the list_lock spinlock */
 static void print_active_locks(int type)
 {
@@ -214,7 +313,10 @@ static void print_active_locks(int type)
 	bool print_expired = true;
 
 	BUG_ON(type >= WAKE_LOCK_TYPE_COUNT);
-	list_for_each_entry(lock, &active_wake_locks[type], link) {
+	list_for_each_entry(lock, &wake_locks, link) {
+		if (!(lock->flags & WAKE_LOCK_ACTIVE) ||
+		    (lock->flags & WAKE_LOCK_TYPE_MASK) != type)
+			continue;
 		if (lock->flags & WAKE_LOCK_AUTO_EXPIRE) {
 			long timeout = lock->expires - jiffies;
 			if (timeout > 0)
@@ -232,21 +334,17 @@ static void print_active_locks(int type)
 
 static long has_wake_lock_locked(int type)
 {
-	struct wake_lock *lock, *n;
-	long max_timeout = 0;
+	struct rb_node *last;
 
 	BUG_ON(type >= WAKE_LOCK_TYPE_COUNT);
-	list_for_each_entry_safe(lock, n, &active_wake_locks[type], link) {
-		if (lock->flags & WAKE_LOCK_AUTO_EXPIRE) {
-			long timeout = lock->expires - jiffies;
-			if (timeout <= 0)
-				expire_wake_lock(lock);
-			else if (timeout > max_timeout)
-				max_timeout = timeout;
-		} else
-			return -1;
-	}
-	return max_timeout;
+	expire_timed_wake_locks_locked(type);
+	if (untimed_active_count[type])
+		return -1;
+
+	last = rb_last(&timed_wake_locks[type]);
+	if (!last)
+		return 0;
+	return rb_entry(last, struct wake_lock, node)->expires - jiffies;
 }
 
 long has_wake_lock(int type)
@@ -260,6 +358,7 @@ long has_wake_lock(int type)
 	spin_unlock_irqrestore(&list_lock, irqflags);
 	return ret;
 }
+EXPORT_SYMBOL(has_wake_lock);
 
 static void suspend_backoff(void)
 {
@@ -379,8 +478,9 @@ void wake_lock_init(struct wake_lock *lock, int type, const char *name)
 	lock->flags = (type & WAKE_LOCK_TYPE_MASK) | WAKE_LOCK_INITIALIZED;
 
 	INIT_LIST_HEAD(&lock->link);
+	RB_CLEAR_NODE(&lock->node);
 	spin_lock_irqsave(&list_lock, irqflags);
-	list_add(&lock->link, &inactive_locks);
+	list_add(&lock->link, &wake_locks);
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
 EXPORT_SYMBOL(wake_lock_init);
@@ -391,6 +491,8 @@ void wake_lock_destroy(struct wake_lock *lock)
 	if (debug_mask & DEBUG_WAKE_LOCK)
 		pr_info("wake_lock_destroy name=%s\n", lock->name);
 	spin_lock_irqsave(&list_lock, irqflags);
+	if (lock->flags & WAKE_LOCK_ACTIVE)
+		dequeue_wake_lock(lock, lock->flags & WAKE_LOCK_TYPE_MASK);
 	lock->flags &= ~WAKE_LOCK_INITIALIZED;
 #ifdef CONFIG_WAKELOCK_STAT
 	if (lock->stat.count) {
@@ -424,25 +526,27 @@ static void wake_lock_internal(
 	BUG_ON(type >= WAKE_LOCK_TYPE_COUNT);
 	BUG_ON(!(lock->flags & WAKE_LOCK_INITIALIZED));
 #ifdef CONFIG_WAKELOCK_STAT
+	if (lock == &main_wake_lock && !wake_lock_active(lock))
+		update_sleep_wait_stats_locked();
 	if (type == WAKE_LOCK_SUSPEND && wait_for_wakeup) {
 		if (debug_mask & DEBUG_WAKEUP)
 			pr_info("wakeup wake lock: %s\n", lock->name);
 		wait_for_wakeup = 0;
 		lock->stat.wakeup_count++;
 	}
-	if ((lock->flags & WAKE_LOCK_AUTO_EXPIRE) &&
-	    (long)(lock->expires - jiffies) <= 0) {
-		wake_unlock_stat_locked(lock, 0);
-		lock->stat.last_time = ktime_get();
-	}
+	wake_lock_event(type, WAKE_LOCK_EVENT_ACQUIRE);
 #endif
-	if (!(lock->flags & WAKE_LOCK_ACTIVE)) {
+	if ((lock->flags & WAKE_LOCK_AUTO_EXPIRE) &&
+	    (long)(lock->expires - jiffies) <= 0)
+		expire_wake_lock(lock);
+	if (lock->flags & WAKE_LOCK_ACTIVE) {
+		dequeue_wake_lock(lock, type);
+	} else {
 		lock->flags |= WAKE_LOCK_ACTIVE;
 #ifdef CONFIG_WAKELOCK_STAT
-		lock->stat.last_time = ktime_get();
+		wake_lock_stat_start_locked(lock);
 #endif
 	}
-	list_del(&lock->link);
 	if (has_timeout) {
 		if (debug_mask & DEBUG_WAKE_LOCK)
 			pr_info("wake_lock: %s, type %d, timeout %ld.%03lu\n",
@@ -450,22 +554,15 @@ static void wake_lock_internal(
 				(timeout % HZ) * MSEC_PER_SEC / HZ);
 		lock->expires = jiffies + timeout;
 		lock->flags |= WAKE_LOCK_AUTO_EXPIRE;
-		list_add_tail(&lock->link, &active_wake_locks[type]);
 	} else {
 		if (debug_mask & DEBUG_WAKE_LOCK)
 			pr_info("wake_lock: %s, type %d\n", lock->name, type);
 		lock->expires = LONG_MAX;
 		lock->flags &= ~WAKE_LOCK_AUTO_EXPIRE;
-		list_add(&lock->link, &active_wake_locks[type]);
 	}
+	enqueue_wake_lock(lock, type);
 	if (type == WAKE_LOCK_SUSPEND) {
 		current_event_num++;
-#ifdef CONFIG_WAKELOCK_STAT
-		if (lock == &main_wake_lock)
-			update_sleep_wait_stats_locked(1);
-		else if (!wake_lock_active(&main_wake_lock))
-			update_sleep_wait_stats_locked(0);
-#endif
 		if (has_timeout)
 			expire_in = has_wake_lock_locked(type);
 		else
@@ -506,13 +603,16 @@ void wake_unlock(struct wake_lock *lock)
 	spin_lock_irqsave(&list_lock, irqflags);
 	type = lock->flags & WAKE_LOCK_TYPE_MASK;
 #ifdef CONFIG_WAKELOCK_STAT
+	if (lock == &main_wake_lock && wake_lock_active(lock))
+		update_sleep_wait_stats_locked();
 	wake_unlock_stat_locked(lock, 0);
+	wake_lock_event(type, WAKE_LOCK_EVENT_RELEASE);
 #endif
 	if (debug_mask & DEBUG_WAKE_LOCK)
 		pr_info("wake_unlock: %s\n", lock->name);
+	if (lock->flags & WAKE_LOCK_ACTIVE)
+		dequeue_wake_lock(lock, type);
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
-	list_del(&lock->link);
-	list_add(&lock->link, &inactive_locks);
 	if (type == WAKE_LOCK_SUSPEND) {
 		long has_lock = has_wake_lock_locked(type);
 		if (has_lock > 0) {
@@ -528,13 +628,8 @@ void wake_unlock(struct wake_lock *lock)
 			if (has_lock == 0)
 				queue_work(suspend_work_queue, &suspend_work);
 		}
-		if (lock == &main_wake_lock) {
-			if (debug_mask & DEBUG_SUSPEND)
-				print_active_locks(WAKE_LOCK_SUSPEND);
-#ifdef CONFIG_WAKELOCK_STAT
-			update_sleep_wait_stats_locked(0);
-#endif
-		}
+		if (lock == &main_wake_lock && (debug_mask & DEBUG_SUSPEND))
+			print_active_locks(WAKE_LOCK_SUSPEND);
 	}
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
@@ -559,13 +654,26 @@ static const struct file_operations wakelock_stats_fops = {
 	.release = single_release,
 };
 
+static int wakelock_events_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, wakelock_events_show, NULL);
+}
+
+static const struct file_operations wakelock_events_fops = {
+	.owner = THIS_MODULE,
+	.open = wakelock_events_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static int __init wakelocks_init(void)
 {
 	int ret;
 	int i;
 
-	for (i = 0; i < ARRAY_SIZE(active_wake_locks); i++)
-		INIT_LIST_HEAD(&active_wake_locks[i]);
+	for (i = 0; i < ARRAY_SIZE(timed_wake_locks); i++)
+		timed_wake_locks[i] = RB_ROOT;
 
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_lock_init(&deleted_wake_locks, WAKE_LOCK_SUSPEND,
@@ -596,6 +704,7 @@ static int __init wakelocks_init(void)
 
 #ifdef CONFIG_WAKELOCK_STAT
 	proc_create("wakelocks", S_IRUGO, NULL, &wakelock_stats_fops);
+	proc_create("wakelock_events", S_IRUGO, NULL, &wakelock_events_fops);
 #endif
 
 	return 0;
@@ -617,6 +726,7 @@ err_platform_device_register:
 static void  __exit wakelocks_exit(void)
 {
 #ifdef CONFIG_WAKELOCK_STAT
+	remove_proc_entry("wakelock_events", NULL);
 	remove_proc_entry("wakelocks", NULL);
 #endif
 	destroy_workqueue(suspend_work_queue);
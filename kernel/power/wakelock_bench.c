@@ -0,0 +1,130 @@
+/* kernel/power/wakelock_bench.c
+ *
+ * Times the wake lock fast paths with nr_locks other locks of each type
+ * held, half of them with a timeout, and prints the average cost of
+ * each operation to the kernel log.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#define pr_fmt(fmt) "wakelock_bench: " fmt
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/wakelock.h>
+
+static unsigned int nr_locks = 256;
+module_param(nr_locks, uint, 0);
+MODULE_PARM_DESC(nr_locks, "Number of other wake locks held per type");
+
+static unsigned int iterations = 100000;
+module_param(iterations, uint, 0);
+MODULE_PARM_DESC(iterations, "Operations timed per test");
+
+#define BENCH_TIMEOUT	(60 * HZ)
+
+enum {
+	BENCH_LOCK,
+	BENCH_LOCK_TIMEOUT,
+	BENCH_HAS_LOCK,
+};
+
+static void bench_one(struct wake_lock *lock, int op)
+{
+	switch (op) {
+	case BENCH_LOCK:
+		wake_lock(lock);
+		wake_unlock(lock);
+		break;
+	case BENCH_LOCK_TIMEOUT:
+		wake_lock_timeout(lock, BENCH_TIMEOUT);
+		wake_unlock(lock);
+		break;
+	case BENCH_HAS_LOCK:
+		has_wake_lock(WAKE_LOCK_IDLE);
+		break;
+	}
+}
+
+static void bench_run(struct wake_lock *lock, int op, const char *name)
+{
+	unsigned int i;
+	ktime_t start;
+	s64 ns;
+
+	start = ktime_get();
+	for (i = 0; i < iterations; i++) {
+		bench_one(lock, op);
+		if (!(i & 1023))
+			cond_resched();
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	pr_info("%s: %lld ns/op\n", name, div_s64(ns, iterations ?: 1));
+}
+
+static int __init wakelock_bench_init(void)
+{
+	struct wake_lock *held, guard, idle, suspend;
+	unsigned int i, n = 2 * nr_locks;
+
+	held = kcalloc(n, sizeof(*held), GFP_KERNEL);
+	if (!held)
+		return -ENOMEM;
+
+	/* keep the bench itself from letting the system suspend */
+	wake_lock_init(&guard, WAKE_LOCK_SUSPEND, "bench_guard");
+	wake_lock(&guard);
+
+	for (i = 0; i < n; i++) {
+		wake_lock_init(&held[i], i & 1 ? WAKE_LOCK_IDLE :
+			       WAKE_LOCK_SUSPEND, "bench_held");
+		if (i & 2)
+			wake_lock_timeout(&held[i], BENCH_TIMEOUT + i);
+		else
+			wake_lock(&held[i]);
+	}
+	wake_lock_init(&idle, WAKE_LOCK_IDLE, "bench_idle");
+	wake_lock_init(&suspend, WAKE_LOCK_SUSPEND, "bench_suspend");
+
+	pr_info("%u iterations, %u locks of each type held\n",
+		iterations, nr_locks);
+	bench_run(&suspend, BENCH_LOCK, "suspend lock/unlock");
+	bench_run(&suspend, BENCH_LOCK_TIMEOUT, "suspend timeout/unlock");
+	bench_run(&idle, BENCH_LOCK, "idle lock/unlock");
+	bench_run(&idle, BENCH_LOCK_TIMEOUT, "idle timeout/unlock");
+	bench_run(&idle, BENCH_HAS_LOCK, "has_wake_lock");
+
+	wake_lock_destroy(&suspend);
+	wake_lock_destroy(&idle);
+	for (i = 0; i < n; i++) {
+		wake_unlock(&held[i]);
+		wake_lock_destroy(&held[i]);
+	}
+	wake_unlock(&guard);
+	wake_lock_destroy(&guard);
+	kfree(held);
+
+	return 0;
+}
+
+static void __exit wakelock_bench_exit(void)
+{
+}
+
+module_init(wakelock_bench_init);
+module_exit(wakelock_bench_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Wake lock benchmark");
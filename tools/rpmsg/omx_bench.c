@@ -0,0 +1,201 @@
+/*
+ * omx_bench.c
+ *
+ * Measures the message rate of an rpmsg-omx connection, with read() and
+ * write() calls, and with the mmap'd message ring of the driver.  Meant to
+ * run against the loopback rpmsg transport (CONFIG_RPMSG_LOOPBACK), whose
+ * OMX instances echo every message, but works with any remote service that
+ * answers each message with one reply.
+ *
+ * Messages are sent in batches, and each batch is waited for before the
+ * next one is sent.  With -b 1 this measures round trip latency.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "../../include/linux/rpmsg_omx.h"
+
+#define mb()	__sync_synchronize()
+
+static int fd;
+static unsigned int size = 64, batch = 8;
+static unsigned long num = 100000, syscalls;
+static char msg[OMX_RING_SLOT_SIZE];
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void die(const char *what)
+{
+	perror(what);
+	exit(1);
+}
+
+static void run_syscall(void)
+{
+	char reply[OMX_RING_SLOT_SIZE];
+	unsigned long sent = 0;
+	unsigned int i, n;
+
+	while (sent < num) {
+		n = num - sent < batch ? num - sent : batch;
+		for (i = 0; i < n; i++, syscalls++)
+			if (write(fd, msg, size) < 0)
+				die("write");
+		for (i = 0; i < n; i++, syscalls++)
+			if (read(fd, reply, sizeof(reply)) < 0)
+				die("read");
+		sent += n;
+	}
+}
+
+static void run_ring(void)
+{
+	volatile struct omx_ring_ctrl *ctrl;
+	struct omx_ring_slot *rx, *tx;
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	unsigned long sent = 0;
+	unsigned int i, n, got;
+	char *ring;
+
+	ring = mmap(NULL, OMX_RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    fd, 0);
+	if (ring == MAP_FAILED)
+		die("mmap");
+	ctrl = (void *) ring;
+	rx = (void *) (ring + OMX_RING_RX_OFFSET);
+	tx = (void *) (ring + OMX_RING_TX_OFFSET);
+
+	if (batch > OMX_RING_SLOTS)
+		batch = OMX_RING_SLOTS;
+
+	while (sent < num) {
+		n = num - sent < batch ? num - sent : batch;
+		for (i = 0; i < n; i++) {
+			struct omx_ring_slot *s =
+				tx + (ctrl->tx_head + i) % OMX_RING_SLOTS;
+
+			s->len = size;
+			memcpy(s->data, msg, size);
+		}
+		mb();
+		ctrl->tx_head += n;
+		syscalls++;
+		if (ioctl(fd, OMX_IOCRINGKICK))
+			die("OMX_IOCRINGKICK");
+
+		for (got = 0; got < n; ) {
+			while (ctrl->rx_tail == ctrl->rx_head) {
+				syscalls++;
+				if (poll(&pfd, 1, 5000) <= 0)
+					die("poll");
+				/* replies that missed the ring are queued */
+				if (ctrl->rx_tail == ctrl->rx_head &&
+						ctrl->rx_queued) {
+					syscalls++;
+					if (ioctl(fd, OMX_IOCRINGKICK))
+						die("OMX_IOCRINGKICK");
+				}
+			}
+			mb();
+			while (got < n && ctrl->rx_tail != ctrl->rx_head) {
+				struct omx_ring_slot *s =
+					rx + ctrl->rx_tail % OMX_RING_SLOTS;
+
+				if (s->len != size)
+					fprintf(stderr, "bad reply length %u\n",
+						s->len);
+				mb();
+				ctrl->rx_tail++;
+				got++;
+			}
+		}
+		sent += n;
+	}
+
+	if (ctrl->tx_errors)
+		fprintf(stderr, "transmit errors: %u\n", ctrl->tx_errors);
+	munmap(ring, OMX_RING_SIZE);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: omx_bench [-r] [-d device] [-n messages] "
+		"[-b batch] [-s size]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *dev = "/dev/rpmsg-omx0";
+	char name[48] = "OMX.loopback";
+	int c, ring = 0;
+	double t;
+
+	while ((c = getopt(argc, argv, "rd:n:b:s:")) != -1) {
+		switch (c) {
+		case 'r':
+			ring = 1;
+			break;
+		case 'd':
+			dev = optarg;
+			break;
+		case 'n':
+			num = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			batch = atoi(optarg);
+			break;
+		case 's':
+			size = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	/* the message must hold at least an unmapped omx_packet */
+	if (optind < argc || !batch || size > 496 - 12 ||
+			size < sizeof(struct omx_packet) + sizeof(uint32_t))
+		usage();
+
+	fd = open(dev, O_RDWR);
+	if (fd < 0)
+		die(dev);
+	if (ioctl(fd, OMX_IOCCONNECT, name))
+		die("OMX_IOCCONNECT");
+
+	t = now();
+	if (ring)
+		run_ring();
+	else
+		run_syscall();
+	t = now() - t;
+
+	printf("%s: %lu messages of %u bytes in batches of %u\n",
+	       ring ? "ring" : "read/write", num, size, batch);
+	printf("%.0f messages/s, %.1f us per batch, %.2f syscalls "
+	       "per message\n", num / t, t * 1e6 / num * batch,
+	       (double) syscalls / num);
+
+	close(fd);
+	return 0;
+}
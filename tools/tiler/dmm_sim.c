@@ -0,0 +1,460 @@
+/*
+ * dmm_sim.c
+ *
+ * Software model of the DMM physical address translator (PAT), to test the
+ * PAT refill code in drivers/media/video/tiler/dmm.c off-device.
+ *
+ * The model implements the PAT registers used by the driver: manual
+ * refills through the AREA, DATA and CTRL registers, and descriptor chains
+ * started by writing DESCR, which complete later with an interrupt like on
+ * the hardware.  Page lists and descriptors are kept in a simulated
+ * physical memory.
+ *
+ * The test queues random refill batches mixed with manual refills, and
+ * checks the completion order and status of each batch, and the resulting
+ * translation table against a reference.  It also injects invalid
+ * descriptors, which must fail their batch but not the following ones,
+ * and cancels queued batches as on a refill timeout, which must not
+ * complete or refill anything and must not hold up the following ones.
+ * Manual refills raise the interrupt like the hardware does, and an
+ * interrupt the driver does not claim and ack counts as an error.
+ * With -m, the DMM has no interrupt, so batches are refilled one area at
+ * a time.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <getopt.h>
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/io.h>
+#include <linux/interrupt.h>
+#include <linux/platform_device.h>
+#include <mach/dmm.h>
+
+#define WIDTH		256
+#define HEIGHT		128
+#define PHYS_BASE	0x80000000u
+#define PHYS_SIZE	(4 << 20)
+#define DMM_IRQ		42
+
+#define MAX_BATCHES	4
+#define MAX_AREAS	8
+
+/* PAT engine 0 interrupt bits */
+#define IRQ_DST		(1 << 0)
+#define IRQ_LST		(1 << 1)
+#define IRQ_INV_DSC	(1 << 2)
+
+/* model state */
+static u32 regs[DMM_SIZE / 4];
+static u32 irq_raw, irq_enable;
+static u32 chain;			/* phys.addr of started chain, or 0 */
+static irq_handler_t handler;
+static struct platform_driver *driver;
+static u32 lut[HEIGHT][WIDTH];		/* translation table */
+static u8 *phys;			/* simulated physical memory */
+static u32 phys_used;
+
+/* test state */
+static u32 ref[HEIGHT][WIDTH];		/* expected translation table */
+static unsigned long *mmio;		/* access counter in use */
+
+struct sim_batch {
+	struct dmm_batch b;
+	int expect;			/* expected status */
+	int status;
+	int done;			/* times done was called */
+	bool cancelled;
+};
+
+static struct sim_batch batches[MAX_BATCHES];
+static int num_done;
+
+static struct {
+	unsigned long batches, areas, manual, injected, cancelled, irqs;
+	unsigned long unhandled;
+	unsigned long mmio_batch, mmio_manual;
+} st;
+
+static void *va(u32 pa)
+{
+	assert(pa >= PHYS_BASE && pa - PHYS_BASE < phys_used);
+	return phys + (pa - PHYS_BASE);
+}
+
+/* allocate 16-byte aligned simulated physical memory */
+static u32 phys_alloc(u32 size)
+{
+	u32 pa = PHYS_BASE + phys_used;
+
+	phys_used += ALIGN(size, 16);
+	assert(phys_used <= PHYS_SIZE);
+	return pa;
+}
+
+/* refill an area of the translation table, as the PAT engine would */
+static int refill(u32 area, u32 data, u32 table[HEIGHT][WIDTH])
+{
+	u32 x0 = area & 0xff, y0 = (area >> 8) & 0x7f;
+	u32 x1 = (area >> 16) & 0xff, y1 = (area >> 24) & 0x7f;
+	u32 *pages, x, y;
+
+	if (x1 < x0 || y1 < y0 || (data & 15))
+		return -1;
+
+	pages = va(data);
+	for (y = y0; y <= y1; y++)
+		for (x = x0; x <= x1; x++)
+			table[y][x] = *pages++;
+	return 0;
+}
+
+/*
+ * Deliver a pending interrupt.  It is level triggered, so a handler that
+ * does not claim and ack it would get it again and again, until the kernel
+ * disables the line.
+ */
+static void sim_irq(void)
+{
+	if (!handler || !(irq_raw & irq_enable))
+		return;
+	st.irqs++;
+	if (handler(DMM_IRQ, NULL) == IRQ_NONE || (irq_raw & irq_enable))
+		st.unhandled++;
+}
+
+u32 sim_readl(const void *addr)
+{
+	u32 reg = (const u32 *) addr - regs;
+
+	(*mmio)++;
+	switch (reg * 4) {
+	case DMM_PAT_IRQSTATUS_RAW:
+		return irq_raw;
+	case DMM_PAT_IRQSTATUS:
+		return irq_raw & irq_enable;
+	case DMM_PAT_STATUS__0:
+		return 0;
+	default:
+		return regs[reg];
+	}
+}
+
+void sim_writel(u32 v, void *addr)
+{
+	u32 reg = (u32 *) addr - regs;
+
+	(*mmio)++;
+	regs[reg] = v;
+	switch (reg * 4) {
+	case DMM_PAT_IRQSTATUS:
+		irq_raw &= ~v;
+		break;
+	case DMM_PAT_IRQENABLE_SET:
+		irq_enable |= v;
+		break;
+	case DMM_PAT_IRQENABLE_CLR:
+		irq_enable &= ~v;
+		break;
+	case DMM_PAT_DESCR__0:
+		/* a chain is fetched once the CPU lets the model run */
+		chain = v & ~15;
+		break;
+	case DMM_PAT_CTRL__0:
+		if (!(v & 1))
+			break;
+		if (refill(regs[DMM_PAT_AREA__0 / 4], regs[DMM_PAT_DATA__0 / 4],
+			   lut))
+			irq_raw |= IRQ_INV_DSC;
+		else
+			irq_raw |= IRQ_DST | IRQ_LST;
+		sim_irq();
+		break;
+	}
+}
+
+void *sim_ioremap(u32 pa, u32 size)
+{
+	assert(pa == DMM_BASE && size <= sizeof(regs));
+	return regs;
+}
+
+int request_irq(unsigned int irq, irq_handler_t fn, unsigned long flags,
+		const char *name, void *data)
+{
+	handler = fn;
+	return 0;
+}
+
+void free_irq(unsigned int irq, void *data)
+{
+	handler = NULL;
+}
+
+int platform_driver_register(struct platform_driver *drv)
+{
+	driver = drv;
+	return 0;
+}
+
+void platform_driver_unregister(struct platform_driver *drv)
+{
+	driver = NULL;
+}
+
+/* run the PAT engine on a started chain and deliver its interrupt */
+void sim_wait(void)
+{
+	struct pat_desc *d;
+	u32 pa;
+
+	for (pa = chain; pa; pa = d->next) {
+		d = va(pa);
+		if (refill(d->area, d->data, lut)) {
+			irq_raw |= IRQ_INV_DSC;
+			break;
+		}
+		irq_raw |= IRQ_DST;
+	}
+	if (chain && !(irq_raw & IRQ_INV_DSC))
+		irq_raw |= IRQ_LST;
+	chain = 0;
+
+	sim_irq();
+}
+
+/* cancelled batches do not complete, count them as done in order */
+static void skip_cancelled(void)
+{
+	while (num_done < MAX_BATCHES && batches[num_done].cancelled)
+		num_done++;
+}
+
+static void batch_done(struct dmm_batch *b, s32 status)
+{
+	struct sim_batch *sb = b->data;
+
+	/* batches must complete once, in order */
+	assert(sb == batches + num_done);
+	sb->status = status;
+	sb->done++;
+	num_done++;
+	skip_cancelled();
+}
+
+static struct pat_area random_area(void)
+{
+	struct pat_area a;
+	u32 w = 1 + rand() % 64, h = 1 + rand() % 16, x, y;
+
+	/* many refills are full rows of 1D areas */
+	if (rand() % 2) {
+		w = WIDTH;
+		h = 1 + rand() % 3;
+	}
+	x = rand() % (WIDTH - w + 1);
+	y = rand() % (HEIGHT - h + 1);
+	a.x0 = x;
+	a.y0 = y;
+	a.x1 = x + w - 1;
+	a.y1 = y + h - 1;
+	return a;
+}
+
+/* a page list for an area, also applied to the reference if valid */
+static u32 random_pages(struct pat_area a, bool apply)
+{
+	u32 w = (u8) a.x1 - (u8) a.x0 + 1, h = (u8) a.y1 - (u8) a.y0 + 1;
+	u32 n = (s32) w > 0 && (s32) h > 0 ? w * h : 1;
+	u32 pa = phys_alloc(n * 4), *pages = va(pa), i;
+	u32 area = ((u8) a.x0) | ((u8) a.y0 << 8) | ((u8) a.x1 << 16) |
+		   ((u8) a.y1 << 24);
+
+	for (i = 0; i < n; i++)
+		pages[i] = (rand() << 12) | 0x80000000;
+	if (apply)
+		refill(area, pa, ref);
+	return pa;
+}
+
+static void manual_refill(struct dmm *dmm)
+{
+	struct pat pd = {0};
+	unsigned long *prev = mmio;
+
+	pd.area = random_area();
+	pd.ctrl.start = 1;
+	pd.data = random_pages(pd.area, true);
+
+	mmio = &st.mmio_manual;
+	if (dmm_pat_refill(dmm, &pd, MANUAL))
+		fprintf(stderr, "manual refill failed\n");
+	mmio = prev;
+	st.manual++;
+}
+
+static int run(struct dmm *dmm, int iterations, bool has_irq)
+{
+	struct pat_area a;
+	int it, i, j, nb, na, bad, r, errors = 0;
+	bool failed, cancel;
+
+	for (it = 0; it < iterations; it++) {
+		phys_used = 0;
+		num_done = 0;
+		memset(batches, 0, sizeof(batches));
+		nb = 1 + rand() % MAX_BATCHES;
+
+		for (i = 0; i < nb; i++) {
+			struct sim_batch *sb = batches + i;
+
+			/* refills wait for the queued batches */
+			if (rand() % 4 == 0)
+				manual_refill(dmm);
+
+			/* maybe cancel the batch, as if it timed out */
+			cancel = has_irq && rand() % 16 == 0;
+			dmm_batch_init(&sb->b, NULL, 0, MAX_AREAS);
+			sb->b.desc_pa = phys_alloc(MAX_AREAS *
+						   sizeof(struct pat_desc));
+			sb->b.desc = va(sb->b.desc_pa);
+			sb->b.done = batch_done;
+			sb->b.data = sb;
+
+			/* maybe make one descriptor invalid */
+			na = 1 + rand() % MAX_AREAS;
+			bad = cancel || rand() % 16 ? -1 : rand() % na;
+			failed = cancel;
+			for (j = 0; j < na; j++) {
+				a = random_area();
+				if (j == bad) {
+					a.x0 = 2;
+					a.x1 = 1;
+					sb->expect = has_irq ? -EIO : -EFAULT;
+					st.injected++;
+				}
+				r = dmm_batch_add(&sb->b, a,
+						  random_pages(a, !failed));
+				assert(!r);
+				failed |= j == bad;
+			}
+
+			mmio = &st.mmio_batch;
+			r = dmm_pat_refill_batch(dmm, &sb->b);
+			if (r) {
+				/* done is not called for failed submits */
+				assert(!has_irq);
+				sb->status = r;
+				sb->done++;
+				num_done++;
+			} else if (cancel) {
+				r = dmm_pat_cancel_batch(dmm, &sb->b);
+				if (r) {
+					fprintf(stderr, "iteration %d batch %d: "
+						"cancel failed (%d)\n", it, i, r);
+					errors++;
+				}
+				sb->cancelled = true;
+				skip_cancelled();
+				st.cancelled++;
+			}
+			st.batches++;
+			st.areas += na;
+		}
+
+		mmio = &st.mmio_batch;
+		for (i = 0; num_done < nb && i < 100; i++)
+			sim_wait();
+
+		for (i = 0; i < nb; i++) {
+			struct sim_batch *sb = batches + i;
+
+			/* completed batches are no longer queued */
+			if (!sb->cancelled && has_irq &&
+			    dmm_pat_cancel_batch(dmm, &sb->b) != -ENOENT) {
+				fprintf(stderr, "iteration %d batch %d: "
+					"cancelled after completion\n", it, i);
+				errors++;
+			}
+			if (sb->cancelled ? sb->done :
+			    sb->done != 1 || sb->status != sb->expect) {
+				fprintf(stderr, "iteration %d batch %d: done "
+					"%d times, status %d (expected %d)\n",
+					it, i, sb->done, sb->status,
+					sb->expect);
+				errors++;
+			}
+		}
+		if (memcmp(lut, ref, sizeof(lut))) {
+			fprintf(stderr, "iteration %d: PAT mismatch\n", it);
+			memcpy(lut, ref, sizeof(lut));
+			errors++;
+		}
+	}
+	return errors;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: dmm_sim [-m] [-n iterations] [-s seed]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	struct omap_dmm_platform_data pdata = { "dmm", regs, DMM_IRQ };
+	struct platform_device pdev = { { &pdata } };
+	static unsigned long unused;
+	int iterations = 10000, seed = 1, c, errors;
+	struct dmm *dmm;
+
+	while ((c = getopt(argc, argv, "mn:s:")) != -1) {
+		switch (c) {
+		case 'm':
+			pdata.irq = 0;
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 's':
+			seed = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind < argc)
+		usage();
+
+	phys = malloc(PHYS_SIZE);
+	mmio = &unused;
+	if (!phys || sim_module_init() || driver->probe(&pdev))
+		return 1;
+	dmm = dmm_pat_init(0);
+	if (!dmm)
+		return 1;
+
+	srand(seed);
+	errors = run(dmm, iterations, pdata.irq);
+
+	printf("mode: %s\n", pdata.irq ? "batched" : "manual");
+	printf("batches: %lu, areas: %lu, manual refills: %lu\n",
+	       st.batches, st.areas, st.manual);
+	printf("invalid descriptors injected: %lu, batches cancelled: %lu\n",
+	       st.injected, st.cancelled);
+	printf("interrupts: %lu (unhandled %lu)\n", st.irqs, st.unhandled);
+	printf("register accesses per area: batched %.1f, manual %.1f\n",
+	       (double) st.mmio_batch / st.areas,
+	       (double) st.mmio_manual / (st.manual ? : 1));
+	errors += st.unhandled;
+	printf("errors: %d\n", errors);
+
+	dmm_pat_release(dmm);
+	sim_module_exit();
+	free(phys);
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,4 @@
+#ifndef LINUX_BITMAP_H
+#define LINUX_BITMAP_H
+#include "kernel.h"
+#endif
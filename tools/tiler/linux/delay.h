@@ -0,0 +1,6 @@
+#ifndef LINUX_DELAY_H
+#define LINUX_DELAY_H
+#include "kernel.h"
+
+#define udelay(us)	do { } while (0)
+#endif
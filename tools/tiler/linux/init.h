@@ -0,0 +1,7 @@
+#ifndef LINUX_INIT_H
+#define LINUX_INIT_H
+#include "kernel.h"
+
+#define __init
+#define __exit
+#endif
@@ -0,0 +1,14 @@
+#ifndef LINUX_INTERRUPT_H
+#define LINUX_INTERRUPT_H
+#include "kernel.h"
+
+typedef int irqreturn_t;
+typedef irqreturn_t (*irq_handler_t)(int irq, void *data);
+
+#define IRQ_NONE	0
+#define IRQ_HANDLED	1
+
+int request_irq(unsigned int irq, irq_handler_t handler, unsigned long flags,
+		const char *name, void *data);
+void free_irq(unsigned int irq, void *data);
+#endif
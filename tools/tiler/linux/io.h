@@ -0,0 +1,19 @@
+#ifndef LINUX_IO_H
+#define LINUX_IO_H
+#include "kernel.h"
+
+/* register accesses go to the software model */
+#define __iomem
+
+u32 sim_readl(const void *addr);
+void sim_writel(u32 v, void *addr);
+void *sim_ioremap(u32 pa, u32 size);
+
+#define __raw_readl(a)		sim_readl(a)
+#define __raw_writel(v, a)	sim_writel(v, a)
+#define readl(a)		sim_readl(a)
+#define writel(v, a)		sim_writel(v, a)
+#define ioremap(pa, size)	sim_ioremap(pa, size)
+#define iounmap(va)		do { } while (0)
+#define wmb()			do { } while (0)
+#endif
@@ -0,0 +1,121 @@
+#ifndef LINUX_KERNEL_H
+#define LINUX_KERNEL_H
+
+/* Just enough of the kernel to build the TILER container managers and DMM */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <stddef.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int16_t s16;
+typedef int32_t s32;
+
+#define KERN_ERR	""
+#define KERN_WARNING	""
+#define KERN_NOTICE	""
+#define KERN_INFO	""
+#define KERN_DEBUG	""
+#define printk		printf
+
+#define BUG_ON(cond)	assert(!(cond))
+#define WARN_ON(cond) ({						\
+	int __ret_warn_on = !!(cond);					\
+	if (__ret_warn_on)						\
+		fprintf(stderr, "WARN_ON(%s) at %s:%d\n", #cond,	\
+			__FILE__, __LINE__);				\
+	__ret_warn_on;							\
+})
+
+#define WARN(cond, fmt...) ({					\
+	int __ret_warn_on = !!(cond);					\
+	if (__ret_warn_on)						\
+		fprintf(stderr, fmt);					\
+	__ret_warn_on;							\
+})
+
+#define container_of(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+#define ALIGN(x, a)	(((x) + ((typeof(x))(a) - 1)) & ~((typeof(x))(a) - 1))
+
+#define GFP_KERNEL	0
+#define kmalloc(size, flags)	malloc(size)
+#define kzalloc(size, flags)	calloc(1, size)
+#define kfree(p)		free(p)
+
+/* the simulation is single threaded */
+struct mutex {
+	int locked;
+};
+
+#define mutex_init(m)		((m)->locked = 0)
+#define mutex_destroy(m)	assert(!(m)->locked)
+#define mutex_lock(m)		do { assert(!(m)->locked); (m)->locked = 1; } while (0)
+#define mutex_unlock(m)		do { assert((m)->locked); (m)->locked = 0; } while (0)
+
+#define BITS_PER_LONG		(8 * (int)sizeof(long))
+#define BITS_TO_LONGS(nr)	(((nr) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+#define BIT_WORD(nr)		((nr) / BITS_PER_LONG)
+#define BIT_MASK(nr)		(1UL << ((nr) % BITS_PER_LONG))
+
+static inline int test_bit(int nr, const unsigned long *addr)
+{
+	return !!(addr[BIT_WORD(nr)] & BIT_MASK(nr));
+}
+
+static inline void bitmap_set(unsigned long *map, int start, int nr)
+{
+	for (; nr; nr--, start++)
+		map[BIT_WORD(start)] |= BIT_MASK(start);
+}
+
+static inline void bitmap_clear(unsigned long *map, int start, int nr)
+{
+	for (; nr; nr--, start++)
+		map[BIT_WORD(start)] &= ~BIT_MASK(start);
+}
+
+static inline unsigned long __find_next(const unsigned long *addr,
+					unsigned long size,
+					unsigned long offset,
+					unsigned long invert)
+{
+	unsigned long word;
+
+	while (offset < size) {
+		word = (addr[BIT_WORD(offset)] ^ invert) &
+			(~0UL << (offset % BITS_PER_LONG));
+		if (word) {
+			offset = offset - offset % BITS_PER_LONG +
+				__builtin_ctzl(word);
+			return offset < size ? offset : size;
+		}
+		offset += BITS_PER_LONG - offset % BITS_PER_LONG;
+	}
+	return size;
+}
+
+static inline unsigned long find_next_bit(const unsigned long *addr,
+					  unsigned long size,
+					  unsigned long offset)
+{
+	return __find_next(addr, size, offset, 0);
+}
+
+static inline unsigned long find_next_zero_bit(const unsigned long *addr,
+					       unsigned long size,
+					       unsigned long offset)
+{
+	return __find_next(addr, size, offset, ~0UL);
+}
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef LINUX_MODULE_H
+#define LINUX_MODULE_H
+#include "kernel.h"
+
+/* the simulation calls the module init and exit functions directly */
+#define THIS_MODULE		NULL
+#define EXPORT_SYMBOL(sym)
+#define MODULE_LICENSE(s)
+#define MODULE_AUTHOR(s)
+#define module_init(fn) \
+	int sim_module_init(void) { return fn(); }
+#define module_exit(fn) \
+	void sim_module_exit(void) { fn(); }
+
+int sim_module_init(void);
+void sim_module_exit(void);
+#endif
@@ -0,0 +1,23 @@
+#ifndef LINUX_PLATFORM_DEVICE_H
+#define LINUX_PLATFORM_DEVICE_H
+#include "kernel.h"
+
+struct device {
+	void *platform_data;
+};
+
+struct platform_device {
+	struct device dev;
+};
+
+struct platform_driver {
+	int (*probe)(struct platform_device *pdev);
+	struct {
+		void *owner;
+		const char *name;
+	} driver;
+};
+
+int platform_driver_register(struct platform_driver *drv);
+void platform_driver_unregister(struct platform_driver *drv);
+#endif
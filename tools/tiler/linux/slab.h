@@ -0,0 +1,4 @@
+#ifndef LINUX_SLAB_H
+#define LINUX_SLAB_H
+#include "kernel.h"
+#endif
@@ -0,0 +1,20 @@
+#ifndef LINUX_SPINLOCK_H
+#define LINUX_SPINLOCK_H
+#include "kernel.h"
+
+/* interrupts are delivered between calls, so locks are never contended */
+typedef struct {
+	int locked;
+} spinlock_t;
+
+#define DEFINE_SPINLOCK(l)	spinlock_t l = { 0 }
+
+#define spin_lock(l) \
+	do { assert(!(l)->locked); (l)->locked = 1; } while (0)
+#define spin_unlock(l) \
+	do { assert((l)->locked); (l)->locked = 0; } while (0)
+#define spin_lock_irqsave(l, f) \
+	do { (f) = 0; spin_lock(l); } while (0)
+#define spin_unlock_irqrestore(l, f) \
+	do { (void) (f); spin_unlock(l); } while (0)
+#endif
@@ -0,0 +1,16 @@
+#ifndef LINUX_WAIT_H
+#define LINUX_WAIT_H
+#include "kernel.h"
+
+/* waiting lets the model run and deliver its interrupt */
+typedef struct {
+	int unused;
+} wait_queue_head_t;
+
+void sim_wait(void);
+
+#define DECLARE_WAIT_QUEUE_HEAD(wq)	wait_queue_head_t wq
+#define wake_up_all(wq)			((void) (wq))
+#define wait_event(wq, cond) \
+	do { while (!(cond)) sim_wait(); } while (0)
+#endif
@@ -0,0 +1,409 @@
+/*
+ * tcm_sim.c
+ *
+ * Replays TILER container allocation traces against the container
+ * managers in drivers/media/video/tiler/tcm, and reports allocation
+ * failures, allocation latency and fragmentation.
+ *
+ * Trace format, one operation per line, sizes in slots:
+ *
+ *   2 <id> <width> <height> <align>	reserve a 2D area
+ *   r <id> <width> <height> <align>	reserve a 2D area that may be moved
+ *					(a reservation not handed out yet)
+ *   1 <id> <slots>			reserve a 1D area
+ *   f <id>				free an area
+ *   # ...				comment
+ *
+ * Without a trace file a video-session-like trace is generated.  As in the
+ * driver, when a 2D reservation fails the movable areas are compacted and
+ * the reservation is retried, if the container manager can move areas.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <getopt.h>
+#include <time.h>
+
+#include <linux/kernel.h>
+
+#include "tcm.h"
+#include "tcm/tcm-sita.h"
+#include "tcm/tcm-pack.h"
+
+#define MAX_IDS		65536
+#define SAMPLE_EVERY	64
+
+struct sim_area {
+	struct tcm_area a;
+	u16 align;
+	bool live;
+	bool movable;
+};
+
+static struct sim_area areas[MAX_IDS];
+static struct tcm *tcm;
+static u16 width = 256, height = 128;
+static int *owner;			/* area id + 1 of each slot, or 0 */
+
+static struct {
+	unsigned long ops, reserve_2d, reserve_1d, frees;
+	unsigned long failed_2d, failed_1d;
+	unsigned long compactions, moved;
+	double lat_sum, lat_max;	/* reservation latency, ns */
+	double frag_sum, frag_max, frag;
+	unsigned long frag_samples;
+} st;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* mark the slots of an area in the shadow map, checking for overlaps */
+static void own(struct tcm_area *a, int id)
+{
+	struct tcm_area slice, a_;
+	int x, y;
+
+	tcm_for_each_slice(slice, *a, a_) {
+		for (y = slice.p0.y; y <= slice.p1.y; y++) {
+			for (x = slice.p0.x; x <= slice.p1.x; x++) {
+				int *o = owner + y * width + x;
+
+				if (id && *o) {
+					fprintf(stderr, "area %d overlaps area "
+						"%d at %d,%d\n", id - 1,
+						*o - 1, x, y);
+					exit(1);
+				}
+				*o = id;
+			}
+		}
+	}
+}
+
+/* 1 - largest free rectangle / free slots */
+static double fragmentation(void)
+{
+	static int *run;
+	int x, y, i, top, free_slots = 0, largest = 0;
+	int *stack_h, *stack_x;
+
+	if (!run)
+		run = calloc(width, sizeof(*run));
+	stack_h = calloc(width + 1, sizeof(int));
+	stack_x = calloc(width + 1, sizeof(int));
+	memset(run, 0, width * sizeof(*run));
+
+	/* largest rectangle in a histogram of free column heights */
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			run[x] = owner[y * width + x] ? 0 : run[x] + 1;
+			free_slots += !owner[y * width + x];
+		}
+
+		top = 0;
+		for (x = 0; x <= width; x++) {
+			int h = x < width ? run[x] : 0, start = x;
+
+			while (top && stack_h[top - 1] >= h) {
+				top--;
+				i = stack_h[top] * (x - stack_x[top]);
+				if (i > largest)
+					largest = i;
+				start = stack_x[top];
+			}
+			stack_h[top] = h;
+			stack_x[top++] = start;
+		}
+	}
+	free(stack_h);
+	free(stack_x);
+
+	return free_slots ? 1.0 - (double)largest / free_slots : 0.0;
+}
+
+static void sample(void)
+{
+	st.frag = fragmentation();
+	st.frag_sum += st.frag;
+	if (st.frag > st.frag_max)
+		st.frag_max = st.frag;
+	st.frag_samples++;
+}
+
+static void compact(void)
+{
+	struct tcm_pt p0;
+	int id;
+
+	st.compactions++;
+	for (id = 0; id < MAX_IDS; id++) {
+		struct sim_area *sa = areas + id;
+
+		if (!sa->live || !sa->movable)
+			continue;
+
+		p0 = sa->a.p0;
+		own(&sa->a, 0);
+		if (tcm_relocate_2d(&sa->a, sa->align) > 0 &&
+		    (p0.x != sa->a.p0.x || p0.y != sa->a.p0.y))
+			st.moved++;
+		own(&sa->a, id + 1);
+	}
+}
+
+static int reserve(int id, bool is2d, u16 w, u16 h, u16 align, bool movable)
+{
+	struct sim_area *sa;
+	double t;
+	int r;
+
+	if (id < 0 || id >= MAX_IDS || areas[id].live) {
+		fprintf(stderr, "bad or live area id %d\n", id);
+		return -EINVAL;
+	}
+	sa = areas + id;
+
+	t = now_ns();
+	if (is2d)
+		r = tcm_reserve_2d(tcm, w, h, align, &sa->a);
+	else
+		r = tcm_reserve_1d(tcm, w, &sa->a);
+	t = now_ns() - t;
+
+	if (r && is2d && tcm->relocate_2d) {
+		compact();
+		t -= now_ns();
+		r = tcm_reserve_2d(tcm, w, h, align, &sa->a);
+		t += now_ns();
+	}
+
+	st.lat_sum += t;
+	if (t > st.lat_max)
+		st.lat_max = t;
+
+	if (is2d)
+		st.reserve_2d++;
+	else
+		st.reserve_1d++;
+
+	if (r) {
+		if (is2d)
+			st.failed_2d++;
+		else
+			st.failed_1d++;
+		return r;
+	}
+
+	sa->live = true;
+	sa->movable = movable;
+	sa->align = align;
+	own(&sa->a, id + 1);
+	return 0;
+}
+
+static void release(int id)
+{
+	if (id < 0 || id >= MAX_IDS || !areas[id].live)
+		return;
+
+	own(&areas[id].a, 0);
+	tcm_free(&areas[id].a);
+	areas[id].live = false;
+	st.frees++;
+}
+
+static void op_done(void)
+{
+	if (!(++st.ops % SAMPLE_EVERY))
+		sample();
+}
+
+static int replay(FILE *f)
+{
+	char line[256];
+	int id, w, h, a, n = 0;
+
+	while (fgets(line, sizeof(line), f)) {
+		n++;
+		switch (line[0]) {
+		case '2':
+		case 'r':
+			if (sscanf(line + 1, "%d %d %d %d",
+				   &id, &w, &h, &a) != 4)
+				goto bad;
+			reserve(id, true, w, h, a, line[0] == 'r');
+			break;
+		case '1':
+			if (sscanf(line + 1, "%d %d", &id, &w) != 2)
+				goto bad;
+			reserve(id, false, w, 1, 1, false);
+			break;
+		case 'f':
+			if (sscanf(line + 1, "%d", &id) != 1)
+				goto bad;
+			release(id);
+			break;
+		case '#':
+		case '\n':
+			continue;
+		default:
+			goto bad;
+		}
+		op_done();
+	}
+	return 0;
+
+bad:
+	fprintf(stderr, "bad trace line %d: %s", n, line);
+	return -EINVAL;
+}
+
+/* buffer shapes of a video session, in slots */
+static const struct {
+	u16 w, h, align;
+	int weight;
+} shapes[] = {
+	{ 30, 17, 32, 6 },	/* 1080p luma */
+	{ 30,  9, 32, 6 },	/* 1080p chroma */
+	{ 20, 12, 32, 4 },	/* 720p luma */
+	{ 20,  6, 32, 4 },	/* 720p chroma */
+	{ 40, 23,  1, 2 },	/* 32bpp UI layer */
+	{  4,  4,  1, 3 },	/* thumbnail */
+	{  0,  0,  0, 3 },	/* 1D buffer */
+};
+
+static int generate(unsigned long n, unsigned int live_max)
+{
+	int *live = calloc(MAX_IDS, sizeof(*live));
+	unsigned int nlive = 0, i, total = 0, next_id = 0;
+
+	for (i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++)
+		total += shapes[i].weight;
+
+	while (st.ops < n) {
+		/* keep the working set around live_max areas */
+		if (nlive && (nlive >= live_max ||
+			      (unsigned int)rand() % live_max < nlive / 2)) {
+			i = rand() % nlive;
+			release(live[i]);
+			live[i] = live[--nlive];
+		} else {
+			int pick = rand() % total, id = next_id;
+
+			next_id = (next_id + 1) % MAX_IDS;
+			for (i = 0; pick >= shapes[i].weight; i++)
+				pick -= shapes[i].weight;
+
+			if (!shapes[i].w) {
+				if (!reserve(id, false, 1 + rand() % 512, 1, 1,
+					     false))
+					live[nlive++] = id;
+			} else if (!reserve(id, true, shapes[i].w, shapes[i].h,
+					    shapes[i].align,
+					    rand() % 4 == 0)) {
+				live[nlive++] = id;
+			}
+		}
+		op_done();
+	}
+
+	free(live);
+	return 0;
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: tcm_sim [-a sita|pack] [-w width] [-h height]\n"
+		"               [-n ops] [-l live] [-s seed] [trace]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *alg = "pack";
+	unsigned long n = 100000;
+	unsigned int live = 64, seed = 1;
+	struct tcm_pt div_pt;
+	int c, r;
+
+	while ((c = getopt(argc, argv, "a:w:h:n:l:s:")) != -1) {
+		switch (c) {
+		case 'a':
+			alg = optarg;
+			break;
+		case 'w':
+			width = atoi(optarg);
+			break;
+		case 'h':
+			height = atoi(optarg);
+			break;
+		case 'n':
+			n = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			live = atoi(optarg);
+			break;
+		case 's':
+			seed = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind < argc - 1 || !live)
+		usage();
+
+	/* same split as the driver */
+	div_pt.x = width;
+	div_pt.y = (3 * height) / 4;
+	if (!strcmp(alg, "sita"))
+		tcm = sita_init(width, height, &div_pt);
+	else if (!strcmp(alg, "pack"))
+		tcm = pack_init(width, height, &div_pt);
+	else
+		usage();
+	if (!tcm) {
+		fprintf(stderr, "could not create %s container %ux%u\n",
+			alg, width, height);
+		return 1;
+	}
+	owner = calloc(width * height, sizeof(*owner));
+
+	srand(seed);
+	if (optind < argc) {
+		FILE *f = fopen(argv[optind], "r");
+
+		if (!f) {
+			perror(argv[optind]);
+			return 1;
+		}
+		r = replay(f);
+		fclose(f);
+	} else {
+		r = generate(n, live);
+	}
+	sample();
+
+	printf("allocator: %s (%ux%u)\n", alg, width, height);
+	printf("ops: %lu (2d %lu, 1d %lu, free %lu)\n", st.ops,
+	       st.reserve_2d, st.reserve_1d, st.frees);
+	printf("failed: 2d %lu, 1d %lu\n", st.failed_2d, st.failed_1d);
+	printf("reserve latency: avg %.2f us, max %.2f us\n",
+	       st.lat_sum / (st.reserve_2d + st.reserve_1d ? : 1) / 1000,
+	       st.lat_max / 1000);
+	printf("fragmentation: avg %.1f%%, max %.1f%%, final %.1f%%\n",
+	       100 * st.frag_sum / st.frag_samples, 100 * st.frag_max,
+	       100 * st.frag);
+	printf("compactions: %lu, areas moved: %lu\n", st.compactions,
+	       st.moved);
+
+	return r ? 1 : 0;
+}